@@ -17,7 +17,7 @@ import Foundation
 import Logging
 import NIO
 import ProfileRecorder
-import _ProfileRecorderSampleConversion
+@_spi(DwarfTest) import _ProfileRecorderSampleConversion
 import SampleWorkload
 
 let benchmarks = {
@@ -78,6 +78,26 @@ let benchmarks = {
         }
     }
 
+    // Symbolisation is trivial with the fake symboliser, so this mostly measures rendering.
+    Benchmark("ArrayAppend FakeSymbolizer (FlamegraphCollapsed)") { benchmark in
+        let converter = ProfileRecorderSampleConverter(
+            config: SymbolizerConfiguration.default,
+            threadPool: .singleton,
+            group: .singletonMultiThreadedEventLoopGroup,
+            renderer: FlamegraphCollapsedOutputRenderer(),
+            symbolizer: _ProfileRecorderFakeSymbolizer()
+        )
+
+        for _ in benchmark.scaledIterations {
+            try await converter.convert(
+                inputRawProfileRecorderFormatPath: arrayAppendProfilePath,
+                outputPath: outputDir.appending("/array-append.fake.collapsed"),
+                format: .flamegraphCollapsedSymbolized,
+                logger: logger
+            )
+        }
+    }
+
     Benchmark("ArrayAppend convert to PerfScript") { benchmark in
         let symbolizer = ProfileRecorderSampler._makeDefaultSymbolizer()
 
@@ -106,6 +126,34 @@ let benchmarks = {
         }
     }
 
+    Benchmark("ArrayAppend convert to FlamegraphCollapsed") { benchmark in
+        let symbolizer = ProfileRecorderSampler._makeDefaultSymbolizer()
+
+        try await NIOThreadPool.singleton.runIfActive {
+            try symbolizer.start()
+        }
+
+        let converter = ProfileRecorderSampleConverter(
+            config: SymbolizerConfiguration.default,
+            threadPool: .singleton,
+            group: .singletonMultiThreadedEventLoopGroup,
+            renderer: FlamegraphCollapsedOutputRenderer(),
+            symbolizer: symbolizer
+        )
+
+        for _ in benchmark.scaledIterations {
+            try await converter.convert(
+                inputRawProfileRecorderFormatPath: arrayAppendProfilePath,
+                outputPath: outputDir.appending("/array-append.collapsed"),
+                format: .flamegraphCollapsedSymbolized,
+                logger: logger
+            )
+        }
+        try? await NIOThreadPool.singleton.runIfActive {
+            try symbolizer.shutdown()
+        }
+    }
+
     Benchmark("ArrayAppend convert to pprof") { benchmark in
         let symbolizer = ProfileRecorderSampler._makeDefaultSymbolizer()
 
@@ -133,4 +181,33 @@ let benchmarks = {
             try symbolizer.shutdown()
         }
     }
+
+    // The binary to look up file:line information in, defaults to this benchmark executable. Set
+    // `SWIPR_BENCHMARK_ELF_PATH` to measure a bigger one.
+    let sourceLocationImagePath = ProcessInfo.processInfo.environment["SWIPR_BENCHMARK_ELF_PATH"] ?? "/proc/self/exe"
+
+    Benchmark(
+        "DWARF file:line lookups",
+        configuration: .init(metrics: [.wallClock, .throughput], scalingFactor: .kilo)
+    ) { benchmark in
+        // Not an ELF binary (for example on macOS), nothing to measure.
+        guard let lookup = DwarfSourceLocationLookup(path: sourceLocationImagePath),
+            !lookup.functionAddresses.isEmpty
+        else {
+            return
+        }
+        let addresses = lookup.functionAddresses
+        var found = 0
+
+        benchmark.startMeasurement()
+        for iteration in benchmark.scaledIterations {
+            // Jump around the binary rather than walking it in address order.
+            let address = addresses[(iteration &* 7919) % addresses.count]
+            if lookup.sourceLocation(for: address + 1) != nil {
+                found += 1
+            }
+        }
+        benchmark.stopMeasurement()
+        blackHole(found)
+    }
 }
@@ -58,6 +58,7 @@ let package = Package(
                 "ProfileRecorder",
                 "CProfileRecorderSwiftELF",
                 "CProfileRecorderDarwin",
+                "CProfileRecorderZlib",
                 "ProfileRecorderPprofFormat",
                 "ProfileRecorderHelpers",
                 .product(name: "NIO", package: "swift-nio"),
@@ -140,6 +141,13 @@ let package = Package(
             name: "CProfileRecorderSampler",
             dependencies: []
         ),
+        .target(
+            name: "CProfileRecorderZlib",
+            dependencies: [],
+            linkerSettings: [
+                .linkedLibrary("z")
+            ]
+        ),
 
         // MARK: - Tests
         .testTarget(
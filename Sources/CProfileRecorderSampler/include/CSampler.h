@@ -17,10 +17,21 @@
 
 #include <unistd.h>
 #include <stdio.h>
+#include <stdint.h>
 
 int swipr_request_sample(FILE *output,
                          size_t sample_count,
                          useconds_t usecs_between_samples);
 int swipr_initialize(void);
 
+typedef void (*swipr_dynamic_lib_visitor)(const char *path,
+                                          const char *architecture,
+                                          uintptr_t seg_slide,
+                                          uintptr_t seg_start_addr,
+                                          uintptr_t seg_end_addr,
+                                          void *context);
+
+/// Calls `visitor` once for every segment that would be reported as a `VMAP` by `swipr_request_sample`.
+int swipr_enumerate_dynamic_libs(swipr_dynamic_lib_visitor visitor, void *context);
+
 #endif /* CSampler_h */
@@ -51,6 +51,9 @@ struct swipr_dynamic_lib {
 
     /// The in-the-process segment end address (slide + in-the-file virtual segment end address)
     uintptr_t dl_seg_end_addr; // dl_seg_start_addr + vmsize
+
+    /// The hex encoded GNU build ID of the image or the empty string if unknown
+    char dl_build_id[65];
 };
 
 int swipr_os_dep_list_all_dynamic_libs(struct swipr_dynamic_lib *all_libs,
@@ -157,9 +157,48 @@ struct dl_iterate_phdr_data {
     bool dli_first;
 };
 
+// Finds the `NT_GNU_BUILD_ID` note in the loaded image's `PT_NOTE` segments and writes it hex encoded into
+// `build_id`, which is left empty if there is none.
+static void
+swipr_find_gnu_build_id(struct dl_phdr_info *info, char *build_id, size_t build_id_size) {
+    static const char hex_digits[] = "0123456789abcdef";
+    build_id[0] = 0;
+
+    for (int i=0; i<info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type != PT_NOTE) {
+            continue;
+        }
+
+        size_t align_mask = phdr->p_align == 8 ? 7 : 3;
+        const uint8_t *note = (const uint8_t *)(info->dlpi_addr + phdr->p_vaddr);
+        const uint8_t *notes_end = note + phdr->p_memsz;
+        while (note + sizeof(ElfW(Nhdr)) <= notes_end) {
+            const ElfW(Nhdr) *nhdr = (const ElfW(Nhdr) *)note;
+            const uint8_t *name = note + sizeof(*nhdr);
+            const uint8_t *desc = name + ((nhdr->n_namesz + align_mask) & ~align_mask);
+            if (desc + nhdr->n_descsz > notes_end) {
+                break;
+            }
+            if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 && memcmp(name, "GNU", 4) == 0) {
+                size_t byte_count = SWIPR_MIN(nhdr->n_descsz, (build_id_size - 1) / 2);
+                for (size_t byte_index=0; byte_index<byte_count; byte_index++) {
+                    build_id[2 * byte_index] = hex_digits[desc[byte_index] >> 4];
+                    build_id[2 * byte_index + 1] = hex_digits[desc[byte_index] & 0xf];
+                }
+                build_id[2 * byte_count] = 0;
+                return;
+            }
+            note = desc + ((nhdr->n_descsz + align_mask) & ~align_mask);
+        }
+    }
+}
+
 static int
 dl_iterate_phdr_cb(struct dl_phdr_info *info, size_t size, void *v_data) {
     struct dl_iterate_phdr_data *data = (typeof(data))v_data;
+    char build_id[sizeof(data->dli_all_libs[0].dl_build_id)];
+    swipr_find_gnu_build_id(info, build_id, sizeof(build_id));
 
     for (int i=0; i<info->dlpi_phnum; i++) {
         const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
@@ -174,6 +213,7 @@ dl_iterate_phdr_cb(struct dl_phdr_info *info, size_t size, void *v_data) {
             strncpy(my_lib->dl_name, info->dlpi_name, sizeof(my_lib->dl_name));
         }
         my_lib->dl_name[sizeof(my_lib->dl_name) - 1] = 0;
+        memcpy(my_lib->dl_build_id, build_id, sizeof(my_lib->dl_build_id));
 
         my_lib->dl_seg_slide = info->dlpi_addr;
         my_lib->dl_seg_start_addr = info->dlpi_addr + phdr->p_vaddr;
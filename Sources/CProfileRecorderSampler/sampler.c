@@ -21,6 +21,7 @@
 #include <string.h>
 #include <sys/errno.h>
 
+#include "include/CSampler.h"
 #include "os_dep.h"
 #include "interface.h"
 #include "asserts.h"
@@ -101,16 +102,34 @@ swipr_dump_shared_objs(FILE *output) {
                 "\"architecture\": \"%s\", "
                 "\"segmentSlide\": \"0x%lx\", "
                 "\"segmentStartAddress\": \"0x%lx\", "
-                "\"segmentEndAddress\": \"0x%lx\""
+                "\"segmentEndAddress\": \"0x%lx\", "
+                "\"buildID\": \"%s\""
                 "}\n",
                 all_libs[i].dl_name, all_libs[i].dl_arch, all_libs[i].dl_seg_slide,
-                all_libs[i].dl_seg_start_addr, all_libs[i].dl_seg_end_addr);
+                all_libs[i].dl_seg_start_addr, all_libs[i].dl_seg_end_addr, all_libs[i].dl_build_id);
     }
     UNSAFE_DEBUG("Number of libraries mapped: %zu \n", all_libs_count);
     free(all_libs);
     return 0;
 }
 
+int
+swipr_enumerate_dynamic_libs(swipr_dynamic_lib_visitor visitor, void *context) {
+    size_t all_libs_count = 0;
+    struct swipr_dynamic_lib *all_libs = calloc(SWIPR_MAX_LIBS, sizeof(*all_libs));
+    if (!all_libs) {
+        return 1;
+    }
+    swipr_os_dep_list_all_dynamic_libs(all_libs, SWIPR_MAX_LIBS, &all_libs_count);
+
+    for (size_t i=0; i < all_libs_count; i++) {
+        visitor(all_libs[i].dl_name, all_libs[i].dl_arch, all_libs[i].dl_seg_slide,
+                all_libs[i].dl_seg_start_addr, all_libs[i].dl_seg_end_addr, context);
+    }
+    free(all_libs);
+    return 0;
+}
+
 static int
 swipr_initialise_c2ms(FILE *output) {
     for (int i=0; i<SWIPR_MAX_MUTATOR_THREADS; i++) {
@@ -544,6 +544,7 @@ enum {
   internal_SWIPR_DT_PREINIT_ARRAYSZ = 33, // Size in bytes of pre-initialization fn array
 
   internal_SWIPR_DT_LOOS            = 0x6000000D, // Operating system specific
+  internal_SWIPR_DT_GNU_HASH        = 0x6ffffef5, // Address of GNU-style hash table
   internal_SWIPR_DT_HIOS            = 0x6ffff000,
 
   internal_SWIPR_DT_LOPROC          = 0x70000000, // Processor specific
@@ -0,0 +1,35 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CProfileRecorderZLIB_h
+#define CProfileRecorderZLIB_h
+
+#include <zlib.h>
+
+// `deflateInit2` is a macro, so it isn't visible from Swift.
+static inline int CProfileRecorderZlib_deflateInit2(z_streamp strm,
+                                                    int level,
+                                                    int method,
+                                                    int windowBits,
+                                                    int memLevel,
+                                                    int strategy) {
+    return deflateInit2(strm, level, method, windowBits, memLevel, strategy);
+}
+
+// `inflateInit2` is a macro, so it isn't visible from Swift.
+static inline int CProfileRecorderZlib_inflateInit2(z_streamp strm, int windowBits) {
+    return inflateInit2(strm, windowBits);
+}
+
+#endif
@@ -187,6 +187,49 @@ public final class ProfileRecorderSampler: Sendable {
     }
 }
 
+extension ProfileRecorderSampler {
+    /// A segment of an executable or dynamic library that is currently loaded into this process.
+    ///
+    /// These are the same segments that the raw sample output reports as `VMAP` records.
+    public struct _LoadedImageSegment: Sendable & Hashable {
+        public var path: String
+        public var architecture: String
+        public var segmentSlide: UInt
+        public var segmentStartAddress: UInt
+        public var segmentEndAddress: UInt
+    }
+
+    /// Lists all segments of all executables and dynamic libraries loaded into this process.
+    public static func _listLoadedImageSegments() -> [_LoadedImageSegment] {
+        #if canImport(CProfileRecorderSampler) // only on macOS & Linux
+        final class Collector {
+            var segments: [_LoadedImageSegment] = []
+        }
+        let collector = Collector()
+        withExtendedLifetime(collector) {
+            _ = swipr_enumerate_dynamic_libs(
+                { path, architecture, slide, startAddress, endAddress, context in
+                    let collector = Unmanaged<Collector>.fromOpaque(context!).takeUnretainedValue()
+                    collector.segments.append(
+                        _LoadedImageSegment(
+                            path: path.map { String(cString: $0) } ?? "",
+                            architecture: architecture.map { String(cString: $0) } ?? "",
+                            segmentSlide: UInt(slide),
+                            segmentStartAddress: UInt(startAddress),
+                            segmentEndAddress: UInt(endAddress)
+                        )
+                    )
+                },
+                Unmanaged.passUnretained(collector).toOpaque()
+            )
+        }
+        return collector.segments
+        #else
+        return []
+        #endif
+    }
+}
+
 struct CFilePointer: @unchecked Sendable {
     let handle: UnsafeMutablePointer<FILE>
 
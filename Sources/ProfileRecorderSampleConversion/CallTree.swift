@@ -0,0 +1,187 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+/// Aggregates stacks into a call tree (a prefix trie rooted at the outermost frame), one tree per thread.
+///
+/// Stacks share long common prefixes, so storing each unique stack separately is wasteful. Here, every stack is just
+/// the node of its innermost frame and memory use scales with the number of unique tree nodes. The nodes live in flat
+/// arrays indexed by ``NodeID`` (struct of arrays) rather than in individually allocated objects.
+///
+/// The tree doesn't know what a location is, it just stores the `UInt32` location IDs it is given.
+struct CallTree: Sendable {
+    typealias NodeID = UInt32
+
+    static let noParent = NodeID.max
+
+    private struct ChildKey: Sendable, Hashable {
+        var parent: NodeID
+        var location: UInt32
+    }
+
+    /// The parent of each node, ``noParent`` for the roots.
+    private(set) var parents: [NodeID] = []
+    /// The location ID of each node. For roots, this is the index into ``threads`` instead.
+    private(set) var locations: [UInt32] = []
+    /// The number of samples whose innermost frame is each node.
+    private(set) var counts: [Int] = []
+    private(set) var threads: [SampleAggregator.ThreadInfo] = []
+    private var roots: [SampleAggregator.ThreadInfo: NodeID] = [:]
+    private var children: [ChildKey: NodeID] = [:]
+
+    var nodeCount: Int {
+        return self.parents.count
+    }
+
+    /// The root node of the tree of `thread`.
+    mutating func root(of thread: SampleAggregator.ThreadInfo) -> NodeID {
+        if let root = self.roots[thread] {
+            return root
+        }
+        let root = self.appendNode(parent: Self.noParent, location: UInt32(self.threads.count))
+        self.threads.append(thread)
+        self.roots[thread] = root
+        return root
+    }
+
+    /// The child of `parent` for `location`, created if it doesn't exist yet.
+    mutating func child(of parent: NodeID, location: UInt32) -> NodeID {
+        let key = ChildKey(parent: parent, location: location)
+        if let child = self.children[key] {
+            return child
+        }
+        let child = self.appendNode(parent: parent, location: location)
+        self.children[key] = child
+        return child
+    }
+
+    /// Records one sample whose innermost frame is `node`.
+    mutating func addSample(at node: NodeID) {
+        self.counts[Int(node)] += 1
+    }
+
+    /// Records `count` samples whose innermost frame is `node`.
+    mutating func addSamples(_ count: Int, at node: NodeID) {
+        self.counts[Int(node)] += count
+    }
+
+    /// Adds all samples of `other` to this tree, translating `other`'s location IDs with `mapLocation`.
+    ///
+    /// The work done is linear in the size of `other`, not in the number of samples.
+    mutating func merge(_ other: CallTree, mapLocation: (UInt32) -> UInt32) {
+        var mergedNodes: [NodeID] = []
+        mergedNodes.reserveCapacity(other.nodeCount)
+        // Parents are always created before their children, so their merged nodes are known by the time we need them.
+        for node in other.parents.indices {
+            let mergedNode: NodeID
+            if other.parents[node] == Self.noParent {
+                mergedNode = self.root(of: other.threads[Int(other.locations[node])])
+            } else {
+                mergedNode = self.child(
+                    of: mergedNodes[Int(other.parents[node])],
+                    location: mapLocation(other.locations[node])
+                )
+            }
+            self.addSamples(other.counts[node], at: mergedNode)
+            mergedNodes.append(mergedNode)
+        }
+    }
+
+    /// Calls `body` once per unique stack that had samples, in the order the stacks' innermost nodes were created.
+    ///
+    /// The location IDs are passed innermost frame first, like pprof wants them.
+    func forEachStack(
+        _ body: (_ locationIDs: [UInt32], _ thread: SampleAggregator.ThreadInfo, _ count: Int) throws -> Void
+    ) rethrows {
+        var locationIDs: [UInt32] = []
+        for node in self.counts.indices where self.counts[node] > 0 {
+            let root = self.locationIDs(of: NodeID(node), into: &locationIDs)
+            try body(locationIDs, self.threads[Int(self.locations[Int(root)])], self.counts[node])
+        }
+    }
+
+    /// The nodes of all unique stacks that had samples, grouped by thread (indexed like ``threads``).
+    func stacksByThread() -> [[NodeID]] {
+        var stacks = Array(repeating: [NodeID](), count: self.threads.count)
+        for node in self.counts.indices where self.counts[node] > 0 {
+            var current = node
+            while self.parents[current] != Self.noParent {
+                current = Int(self.parents[current])
+            }
+            stacks[Int(self.locations[current])].append(NodeID(node))
+        }
+        return stacks
+    }
+
+    /// Replaces the contents of `locationIDs` with the stack ending in `node`, innermost frame first.
+    ///
+    /// - returns: The root of `node`'s tree.
+    @discardableResult
+    func locationIDs(of node: NodeID, into locationIDs: inout [UInt32]) -> NodeID {
+        locationIDs.removeAll(keepingCapacity: true)
+        var current = Int(node)
+        while self.parents[current] != Self.noParent {
+            locationIDs.append(self.locations[current])
+            current = Int(self.parents[current])
+        }
+        return NodeID(current)
+    }
+
+    func count(of node: NodeID) -> Int {
+        return self.counts[Int(node)]
+    }
+
+    /// The number of samples in the subtree of each node (the node's own samples plus all its descendants'), indexed
+    /// by ``NodeID``.
+    func inclusiveCounts() -> [Int] {
+        return self.inclusiveSums(of: self.counts)
+    }
+
+    /// Like ``inclusiveCounts()`` but for any per-node `values` (indexed by ``NodeID``) rather than ``counts``.
+    func inclusiveSums(of values: [Int]) -> [Int] {
+        precondition(values.count == self.nodeCount, "need one value per node")
+        var inclusiveSums = values
+        // Children are always created after their parents, so going backwards visits all children before the parent.
+        for node in self.parents.indices.reversed() where self.parents[node] != Self.noParent {
+            inclusiveSums[Int(self.parents[node])] += inclusiveSums[node]
+        }
+        return inclusiveSums
+    }
+
+    /// The children of all nodes in one array, those of node `n` are `children[starts[n]..<starts[n + 1]]`.
+    func childrenByParent() -> (starts: [Int], children: [NodeID]) {
+        var starts = Array(repeating: 0, count: self.nodeCount + 1)
+        for parent in self.parents where parent != Self.noParent {
+            starts[Int(parent) + 1] += 1
+        }
+        for index in starts.indices.dropFirst() {
+            starts[index] += starts[index - 1]
+        }
+        var nextSlot = starts
+        var children = Array(repeating: NodeID(0), count: starts[self.nodeCount])
+        for (node, parent) in self.parents.enumerated() where parent != Self.noParent {
+            children[nextSlot[Int(parent)]] = NodeID(node)
+            nextSlot[Int(parent)] += 1
+        }
+        return (starts, children)
+    }
+
+    private mutating func appendNode(parent: NodeID, location: UInt32) -> NodeID {
+        precondition(self.parents.count < Int(Self.noParent), "call tree too large")
+        let node = NodeID(self.parents.count)
+        self.parents.append(parent)
+        self.locations.append(location)
+        self.counts.append(0)
+        return node
+    }
+}
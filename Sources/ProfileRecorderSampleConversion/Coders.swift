@@ -52,25 +52,30 @@ public struct DynamicLibMapping: Decodable & Sendable & CustomStringConvertible
         case segmentSlide
         case segmentStartAddress
         case segmentEndAddress
+        case buildID
     }
     public var path: String
     public var architecture: String
     public var segmentSlide: UInt
     public var segmentStartAddress: UInt
     public var segmentEndAddress: UInt
+    /// The hex encoded GNU build ID of the image, if known. Older `VMAP` records don't have it.
+    public var buildID: String?
 
     public init(
         path: String,
         architecture: String,
         segmentSlide: UInt,
         segmentStartAddress: UInt,
-        segmentEndAddress: UInt
+        segmentEndAddress: UInt,
+        buildID: String? = nil
     ) {
         self.path = path
         self.architecture = architecture
         self.segmentSlide = segmentSlide
         self.segmentStartAddress = segmentStartAddress
         self.segmentEndAddress = segmentEndAddress
+        self.buildID = buildID
     }
 
     public init(from decoder: Decoder) throws {
@@ -98,6 +103,11 @@ public struct DynamicLibMapping: Decodable & Sendable & CustomStringConvertible
         } else {
             throw FailedToDecodeAddressError()
         }
+        if let buildID = try container.decodeIfPresent(String.self, forKey: .buildID), !buildID.isEmpty {
+            self.buildID = buildID
+        } else {
+            self.buildID = nil
+        }
     }
 
     public static func < (lhs: DynamicLibMapping, rhs: DynamicLibMapping) -> Bool {
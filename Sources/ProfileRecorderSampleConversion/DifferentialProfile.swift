@@ -0,0 +1,173 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import NIOCore
+import ProfileRecorderPprofFormat
+
+/// The samples of two captures, a base and a new one, merged into one call tree so they can be compared stack by
+/// stack.
+///
+/// Thread IDs and addresses don't mean anything across captures (let alone builds), so all threads are merged into
+/// one root and frames are identified by their function name only. The locations in ``callTree`` are the interned
+/// function names, its own counts are unused.
+struct DifferentialProfile: Sendable {
+    enum Side: Sendable {
+        case base
+        case new
+    }
+
+    struct Error: Swift.Error {
+        var message: String
+    }
+
+    private(set) var callTree: CallTree
+    /// The number of samples whose innermost frame is each node, in the base capture (indexed by node).
+    private(set) var baseCounts: [Int] = [0]
+    /// The number of samples whose innermost frame is each node, in the new capture (indexed by node).
+    private(set) var newCounts: [Int] = [0]
+    private(set) var baseTotal = 0
+    private(set) var newTotal = 0
+    let root: CallTree.NodeID
+
+    init(interner: SymbolInterner) {
+        var callTree = CallTree()
+        self.root = callTree.root(of: SampleAggregator.ThreadInfo(tid: 0, name: interner.intern("all")))
+        self.callTree = callTree
+    }
+
+    /// Adds `count` samples of the stack `functionNames` (outermost frame first) to `side`.
+    mutating func add(_ functionNames: some Sequence<SymbolInterner.ID>, count: Int, to side: Side) {
+        var node = self.root
+        for functionName in functionNames {
+            node = self.callTree.child(of: node, location: functionName.rawValue)
+        }
+        if self.baseCounts.count < self.callTree.nodeCount {
+            let missing = self.callTree.nodeCount - self.baseCounts.count
+            self.baseCounts.append(contentsOf: repeatElement(0, count: missing))
+            self.newCounts.append(contentsOf: repeatElement(0, count: missing))
+        }
+        switch side {
+        case .base:
+            self.baseCounts[Int(node)] += count
+            self.baseTotal += count
+        case .new:
+            self.newCounts[Int(node)] += count
+            self.newTotal += count
+        }
+    }
+
+    /// The base counts, scaled so the base capture has as many samples as the new one if `normalized`.
+    ///
+    /// Without normalising, a longer (or higher rate) capture would look like a regression everywhere.
+    func baseCounts(normalized: Bool) -> [Int] {
+        guard normalized, self.baseTotal > 0, self.baseTotal != self.newTotal else {
+            return self.baseCounts
+        }
+        let scale = Double(self.newTotal) / Double(self.baseTotal)
+        return self.baseCounts.map { Int((Double($0) * scale).rounded()) }
+    }
+
+    /// Adds the samples of a decoded pprof profile to `side`.
+    ///
+    /// Only one value per sample is used: the `samples` one if there is one, otherwise the last one (which is what
+    /// pprof shows by default). With `demangleSymbols`, the function names are demangled like those of raw captures
+    /// (see ``SymbolizerConfiguration/demangleSymbols``), so they match up with them.
+    mutating func add(
+        _ profile: Perftools_Profiles_Profile,
+        to side: Side,
+        interner: SymbolInterner,
+        demangleSymbols: Bool = false
+    ) throws {
+        func string(_ index: Int64) throws -> String {
+            guard index >= 0 && index < profile.stringTable.count else {
+                throw Error(message: "pprof string table index \(index) out of bounds")
+            }
+            return profile.stringTable[Int(index)]
+        }
+
+        guard !profile.sampleType.isEmpty else {
+            throw Error(message: "pprof profile without sample types")
+        }
+        let valueIndex = try profile.sampleType.firstIndex { try string($0.type) == "samples" }
+            ?? profile.sampleType.count - 1
+
+        var functionNames: [UInt64: SymbolInterner.ID] = [:]
+        for function in profile.function {
+            let name = interner.intern(try string(function.name))
+            functionNames[function.id] = demangleSymbols ? interner.demangled(name) : name
+        }
+        // Innermost (inlined) frame first, like pprof has the lines.
+        var locations: [UInt64: [SymbolInterner.ID]] = [:]
+        for location in profile.location {
+            if location.line.isEmpty {
+                locations[location.id] = [interner.intern("unknown @ 0x\(String(location.address, radix: 16))")]
+            } else {
+                locations[location.id] = try location.line.map { line in
+                    guard let functionName = functionNames[line.functionID] else {
+                        throw Error(message: "pprof location \(location.id) refers to unknown function")
+                    }
+                    return functionName
+                }
+            }
+        }
+
+        var stack: [SymbolInterner.ID] = []
+        for sample in profile.sample where valueIndex < sample.value.count && sample.value[valueIndex] > 0 {
+            stack.removeAll(keepingCapacity: true)
+            for locationID in sample.locationID.reversed() {
+                guard let frames = locations[locationID] else {
+                    throw Error(message: "pprof sample refers to unknown location \(locationID)")
+                }
+                stack.append(contentsOf: frames.reversed())
+            }
+            self.add(stack, count: Int(sample.value[valueIndex]), to: side)
+        }
+    }
+}
+
+/// Collects the samples of a raw capture into a ``DifferentialProfile`` instead of rendering them.
+struct DifferentialProfileCollector: ProfileRecorderSampleConversionOutputRenderer {
+    var profile: DifferentialProfile
+    let side: DifferentialProfile.Side
+    private var stack: [SymbolInterner.ID] = []
+
+    init(profile: DifferentialProfile, side: DifferentialProfile.Side) {
+        self.profile = profile
+        self.side = side
+    }
+
+    mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        self.stack.removeAll(keepingCapacity: true)
+        // Outermost frame first, that includes the inlined frames.
+        for stackFrame in sample.stack.reversed() {
+            for frame in try symbolizer.symboliseInterned(stackFrame).allFrames.reversed() {
+                self.stack.append(frame.functionName)
+            }
+        }
+        self.profile.add(self.stack, count: 1, to: self.side)
+        return ByteBuffer()
+    }
+
+    mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        return ByteBuffer()
+    }
+}
@@ -0,0 +1,165 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import CProfileRecorderZlib
+import NIO
+
+/// Streaming gzip compression (zlib's deflate with a gzip header and trailer).
+///
+/// Feed the input chunk by chunk using ``compress(_:into:)`` and call ``finish(into:)`` once at the end. The output
+/// isn't necessarily produced right away, zlib buffers input until it has enough to compress.
+internal final class GzipCompressor {
+    struct Error: Swift.Error {
+        var message: String
+    }
+
+    /// The writable space we ask for in the output buffer before each call into zlib.
+    private static let minimumOutputSpace = 16 * 1024
+
+    private let stream: UnsafeMutablePointer<z_stream>
+    private var finished = false
+
+    init(level: CInt = Z_DEFAULT_COMPRESSION) throws {
+        self.stream = UnsafeMutablePointer<z_stream>.allocate(capacity: 1)
+        self.stream.initialize(to: z_stream())
+        let result = CProfileRecorderZlib_deflateInit2(
+            self.stream,
+            level,
+            Z_DEFLATED,
+            15 + 16,  // maximum window size (15) and a gzip instead of a zlib wrapper (+16)
+            8,  // zlib's default memory level
+            Z_DEFAULT_STRATEGY
+        )
+        guard result == Z_OK else {
+            self.stream.deinitialize(count: 1)
+            self.stream.deallocate()
+            throw Error(message: "deflateInit2 failed: \(result)")
+        }
+    }
+
+    deinit {
+        deflateEnd(self.stream)
+        self.stream.deinitialize(count: 1)
+        self.stream.deallocate()
+    }
+
+    func compress(_ input: ByteBuffer, into output: inout ByteBuffer) throws {
+        precondition(!self.finished, "compress(_:into:) called after finish(into:)")
+        try self.compress(input, flush: Z_NO_FLUSH, into: &output)
+    }
+
+    /// Writes out everything still buffered as well as the gzip trailer.
+    func finish(into output: inout ByteBuffer) throws {
+        precondition(!self.finished, "finish(into:) called twice")
+        self.finished = true
+        try self.compress(ByteBuffer(), flush: Z_FINISH, into: &output)
+    }
+
+    private func compress(_ input: ByteBuffer, flush: CInt, into output: inout ByteBuffer) throws {
+        try input.withUnsafeReadableBytes { inputPtr in
+            let inputBytes = inputPtr.bindMemory(to: Bytef.self)
+            self.stream.pointee.next_in = UnsafeMutablePointer(mutating: inputBytes.baseAddress)
+            self.stream.pointee.avail_in = uInt(inputBytes.count)
+            defer {
+                self.stream.pointee.next_in = nil
+                self.stream.pointee.avail_in = 0
+            }
+
+            var result: CInt = Z_OK
+            repeat {
+                output.writeWithUnsafeMutableBytes(minimumWritableBytes: Self.minimumOutputSpace) { outputPtr in
+                    let outputBytes = outputPtr.bindMemory(to: Bytef.self)
+                    self.stream.pointee.next_out = outputBytes.baseAddress
+                    self.stream.pointee.avail_out = uInt(outputBytes.count)
+                    result = deflate(self.stream, flush)
+                    return outputBytes.count - Int(self.stream.pointee.avail_out)
+                }
+                self.stream.pointee.next_out = nil
+                switch result {
+                case Z_OK, Z_STREAM_END:
+                    ()
+                case Z_BUF_ERROR:
+                    // No progress possible, everything's consumed and the pending output written.
+                    return
+                default:
+                    throw Error(message: "deflate failed: \(result)")
+                }
+                // If zlib filled up all of the output space, there may be more output pending. When finishing, zlib
+                // tells us explicitly when it's done.
+            } while self.stream.pointee.avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END)
+        }
+    }
+}
+
+/// One-shot gzip decompression (zlib's inflate expecting a gzip header and trailer).
+internal enum GzipDecompressor {
+    /// The writable space we ask for in the output buffer before each call into zlib.
+    private static let minimumOutputSpace = 64 * 1024
+
+    /// Whether `buffer` starts with the gzip magic bytes.
+    static func isGzipCompressed(_ buffer: ByteBuffer) -> Bool {
+        return buffer.getBytes(at: buffer.readerIndex, length: 2) == [0x1f, 0x8b]
+    }
+
+    static func decompress(_ input: ByteBuffer) throws -> ByteBuffer {
+        // zlib keeps a pointer back to the stream, so it must not move.
+        let stream = UnsafeMutablePointer<z_stream>.allocate(capacity: 1)
+        stream.initialize(to: z_stream())
+        defer {
+            stream.deinitialize(count: 1)
+            stream.deallocate()
+        }
+        // maximum window size (15) and a gzip instead of a zlib wrapper (+16)
+        let initResult = CProfileRecorderZlib_inflateInit2(stream, 15 + 16)
+        guard initResult == Z_OK else {
+            throw GzipCompressor.Error(message: "inflateInit2 failed: \(initResult)")
+        }
+        defer {
+            inflateEnd(stream)
+        }
+
+        var output = ByteBuffer()
+        try input.withUnsafeReadableBytes { inputPtr in
+            let inputBytes = inputPtr.bindMemory(to: Bytef.self)
+            stream.pointee.next_in = UnsafeMutablePointer(mutating: inputBytes.baseAddress)
+            stream.pointee.avail_in = uInt(inputBytes.count)
+            defer {
+                stream.pointee.next_in = nil
+                stream.pointee.avail_in = 0
+            }
+
+            var result: CInt = Z_OK
+            while result != Z_STREAM_END {
+                output.writeWithUnsafeMutableBytes(minimumWritableBytes: Self.minimumOutputSpace) { outputPtr in
+                    let outputBytes = outputPtr.bindMemory(to: Bytef.self)
+                    stream.pointee.next_out = outputBytes.baseAddress
+                    stream.pointee.avail_out = uInt(outputBytes.count)
+                    result = inflate(stream, Z_NO_FLUSH)
+                    return outputBytes.count - Int(stream.pointee.avail_out)
+                }
+                stream.pointee.next_out = nil
+                switch result {
+                case Z_OK, Z_STREAM_END:
+                    ()
+                case Z_BUF_ERROR:
+                    // There's always output space, so zlib ran out of input before the end of the stream.
+                    throw GzipCompressor.Error(message: "gzip input truncated")
+                default:
+                    throw GzipCompressor.Error(message: "inflate failed: \(result)")
+                }
+            }
+        }
+        return output
+    }
+}
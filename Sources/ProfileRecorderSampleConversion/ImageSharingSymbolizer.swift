@@ -0,0 +1,138 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import Logging
+import NIOConcurrencyHelpers
+import NIOCore
+
+/// Caches the symbolisation results of another ``Symbolizer`` by image and file address.
+///
+/// ``CachedSymbolizer`` caches by instruction pointer, which is only meaningful within one process. Captures of many
+/// replicas of the same build load the same images at different addresses though, so this cache is keyed by the
+/// image's GNU build ID (or its path, if there's no build ID) and the file address instead. Then every unique address
+/// is symbolised once across all captures. Safe to use from several threads at once.
+internal final class ImageSharingSymbolizer: Symbolizer & Sendable {
+    private struct ImageAddress: Hashable {
+        var image: String
+        var fileVirtualAddress: UInt
+    }
+
+    private let underlying: any Symbolizer
+    private let cache: NIOLockedValueBox<[ImageAddress: SymbolisedStackFrame]> = NIOLockedValueBox([:])
+
+    init(underlying: any Symbolizer) {
+        self.underlying = underlying
+    }
+
+    func start() throws {
+        try self.underlying.start()
+    }
+
+    func symbolise(
+        fileVirtualAddressIP: UInt,
+        library: DynamicLibMapping,
+        logger: Logger
+    ) throws -> SymbolisedStackFrame {
+        let key = ImageAddress(
+            image: library.buildID.map { "build-id:\($0)" } ?? "path:\(library.path)",
+            fileVirtualAddress: fileVirtualAddressIP
+        )
+        if var symbolised = self.cache.withLockedValue({ $0[key] }) {
+            // Same image and address but possibly mapped elsewhere.
+            for index in symbolised.allFrames.indices {
+                symbolised.allFrames[index].vmap = library
+            }
+            return symbolised
+        }
+        // Not under the lock, so the threads can symbolise in parallel (if the underlying symboliser can). Two threads
+        // may occasionally symbolise the same address, that's harmless.
+        let symbolised = try self.underlying.symbolise(
+            fileVirtualAddressIP: fileVirtualAddressIP,
+            library: library,
+            logger: logger
+        )
+        self.cache.withLockedValue { $0[key] = symbolised }
+        return symbolised
+    }
+
+    func symbolise(_ queries: [SymbolisationQuery], logger: Logger) throws -> [SymbolisedStackFrame] {
+        let keys = queries.map { query in
+            ImageAddress(
+                image: query.library.buildID.map { "build-id:\($0)" } ?? "path:\(query.library.path)",
+                fileVirtualAddress: query.fileVirtualAddressIP
+            )
+        }
+        var results: [SymbolisedStackFrame?] = self.cache.withLockedValue { cache in
+            keys.map { cache[$0] }
+        }
+        // Only the addresses that aren't cached go to the underlying symboliser, each once, in one batch.
+        var missingIndices: [Int] = []
+        var missingKeys: [ImageAddress: Int] = [:]
+        for index in results.indices where results[index] == nil {
+            if missingKeys[keys[index]] == nil {
+                missingKeys[keys[index]] = missingIndices.count
+                missingIndices.append(index)
+            }
+        }
+        if !missingIndices.isEmpty {
+            let symbolised = try self.underlying.symbolise(missingIndices.map { queries[$0] }, logger: logger)
+            precondition(
+                symbolised.count == missingIndices.count,
+                "\(self.underlying) returned \(symbolised.count) results for \(missingIndices.count) queries"
+            )
+            self.cache.withLockedValue { cache in
+                for (index, frame) in zip(missingIndices, symbolised) {
+                    cache[keys[index]] = frame
+                }
+            }
+            for index in results.indices where results[index] == nil {
+                results[index] = symbolised[missingKeys[keys[index]]!]
+            }
+        }
+        return zip(queries, results).map { query, result in
+            // Same image and address but possibly mapped elsewhere.
+            var symbolised = result!
+            for index in symbolised.allFrames.indices {
+                symbolised.allFrames[index].vmap = query.library
+            }
+            return symbolised
+        }
+    }
+
+    func shutdown() throws {
+        try self.underlying.shutdown()
+    }
+
+    func prewarm(
+        libraries: [DynamicLibMapping],
+        cpuBudget: TimeAmount,
+        logger: Logger,
+        isCancelled: () -> Bool
+    ) throws {
+        try self.underlying.prewarm(
+            libraries: libraries,
+            cpuBudget: cpuBudget,
+            logger: logger,
+            isCancelled: isCancelled
+        )
+    }
+
+    var cachedAddressCount: Int {
+        return self.cache.withLockedValue { $0.count }
+    }
+
+    var description: String {
+        return "ImageSharingSymbolizer(cachedAddresses: \(self.cachedAddressCount), underlying: \(self.underlying))"
+    }
+}
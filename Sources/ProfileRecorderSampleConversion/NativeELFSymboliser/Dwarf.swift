@@ -313,6 +313,7 @@ private enum DwarfError: Error {
   case missingAddrBase
   case missingStrOffsetsBase
   case missingLocListsBase
+  case badRangeListEntry(SWIPR_Dwarf_Byte)
   case unspecifiedAddressSize
 }
 
@@ -550,6 +551,8 @@ class DwarfReader<S: DwarfSource & AnyObject> {
   var lineStrSection: ImageSource?
   var strOffsetsSection: ImageSource?
   var rangesSection: ImageSource?
+  var rngListsSection: ImageSource?
+  var arangesSection: ImageSource?
   var shouldSwap: Bool
 
   typealias DwarfAbbrev = UInt64
@@ -569,6 +572,7 @@ class DwarfReader<S: DwarfSource & AnyObject> {
     var addrBase: UInt64?
     var strOffsetsBase: UInt64?
     var loclistsBase: UInt64?
+    var rnglistsBase: UInt64?
 
     var abbrevs: [DwarfAbbrev: AbbrevInfo]
 
@@ -611,6 +615,8 @@ class DwarfReader<S: DwarfSource & AnyObject> {
     lineStrSection = source.getDwarfSection(.debugLineStr)
     strOffsetsSection = source.getDwarfSection(.debugStrOffsets)
     rangesSection = source.getDwarfSection(.debugRanges)
+    rngListsSection = source.getDwarfSection(.debugRngLists)
+    arangesSection = source.getDwarfSection(.debugARanges)
 
     self.source = source
     self.shouldSwap = shouldSwap
@@ -785,6 +791,10 @@ class DwarfReader<S: DwarfSource & AnyObject> {
          case let .sectionOffset(offset) = value {
         unit.loclistsBase = offset
       }
+      if let value = firstPass[.internal_SWIPR_DW_AT_rnglists_base],
+         case let .sectionOffset(offset) = value {
+        unit.rnglistsBase = offset
+      }
       if let value = firstPass[.internal_SWIPR_DW_AT_stmt_list],
          case let .sectionOffset(offset) = value {
         unit.lineBase = offset
@@ -1531,7 +1541,7 @@ class DwarfReader<S: DwarfSource & AnyObject> {
     return attributes
   }
 
-  struct CallSiteInfo {
+  struct CallSiteInfo: InlineCallSiteRange {
     var depth: Int
     var rawName: String?
     var name: String?
@@ -1778,53 +1788,429 @@ class DwarfReader<S: DwarfSource & AnyObject> {
     }
   }
 
-  private lazy var _lazyInfo: (callSites: [CallSiteInfo],
-                               functions: [FunctionInfo]) = _scanUnits()
+  // .. Address to unit mapping ................................................
+
+  /// An address range covered by a compile unit.
+  struct UnitRange {
+    var lowPC: Address
+    var highPC: Address
+    var unitIndex: Int
+    /// The highest `highPC` of this range and all the ranges sorted before it.
+    var maxHighPC: Address = 0
+  }
+
+  /// The address ranges of all units, sorted by `lowPC` (and then by
+  /// descending `highPC`), and the units we couldn't find any address ranges
+  /// for.
+  private lazy var unitRanges: (ranges: [UnitRange], unrangedUnits: [Int])
+    = _buildUnitRanges()
+
+  /// Build the address to unit mapping now rather than on the first lookup.
+  func prewarm() {
+    _ = unitRanges
+  }
+
+  private func _buildUnitRanges()
+    -> (ranges: [UnitRange], unrangedUnits: [Int]) {
+    var ranges: [UnitRange] = []
+    var coveredUnits = Set<Int>()
+
+    // .debug_aranges has exactly what we want, without touching .debug_info
+    if let arangesSection = arangesSection {
+      var unitIndices: [Address: Int] = [:]
+      for (ndx, unit) in units.enumerated() {
+        unitIndices[unit.baseOffset] = ndx
+      }
+
+      do {
+        try readARanges(arangesSection) { infoOffset, lowPC, highPC in
+          guard let unitIndex = unitIndices[infoOffset] else {
+            return
+          }
+          ranges.append(UnitRange(lowPC: lowPC,
+                                  highPC: highPC,
+                                  unitIndex: unitIndex))
+          coveredUnits.insert(unitIndex)
+        }
+      } catch {
+        swift_reportWarning(0,
+                            """
+                              swift-runtime: warning: unable to read \
+                              .debug_aranges: \(error)
+                              """)
+      }
+    }
+
+    // Not every producer emits .debug_aranges (or emits them for every unit),
+    // for the rest we look at the unit's own ranges.
+    var unrangedUnits: [Int] = []
+    for (ndx, unit) in units.enumerated() where !coveredUnits.contains(ndx) {
+      if unit.unitType == .internal_SWIPR_DW_UT_type
+           || unit.unitType == .internal_SWIPR_DW_UT_split_type {
+        continue
+      }
+
+      var found = false
+      do {
+        try forEachAddressRange(of: unit) { lowPC, highPC in
+          ranges.append(UnitRange(lowPC: lowPC,
+                                  highPC: highPC,
+                                  unitIndex: ndx))
+          found = true
+        }
+      } catch {
+        found = false
+      }
+      if !found {
+        unrangedUnits.append(ndx)
+      }
+    }
+
+    ranges.sort(by: {
+      $0.lowPC != $1.lowPC ? $0.lowPC < $1.lowPC : $0.highPC > $1.highPC
+    })
+
+    var maxHighPC: Address = 0
+    for ndx in ranges.indices {
+      maxHighPC = Swift.max(maxHighPC, ranges[ndx].highPC)
+      ranges[ndx].maxHighPC = maxHighPC
+    }
+
+    return (ranges: ranges, unrangedUnits: unrangedUnits)
+  }
+
+  /// Calls `fn` with the debug info offset of the unit and the address range
+  /// of every entry in `.debug_aranges`.
+  private func readARanges(
+    _ arangesSection: ImageSource,
+    _ fn: (Address, Address, Address) -> ()
+  ) throws {
+    let end = arangesSection.bytes.count
+    var cursor = ImageSourceCursor(source: arangesSection)
+
+    while cursor.pos < end {
+      // See 6.1.2 Lookup by Address
+      let base = cursor.pos
+      let (length, dwarf64) = try cursor.readDwarfLength()
+      let next = cursor.pos + length
+
+      let version = Int(maybeSwap(try cursor.read(as: SWIPR_Dwarf_Half.self)))
+      let infoOffset: Address
+      if dwarf64 {
+        infoOffset = maybeSwap(try cursor.read(as: UInt64.self))
+      } else {
+        infoOffset = Address(maybeSwap(try cursor.read(as: UInt32.self)))
+      }
+      let addressSize = Int(try cursor.read(as: SWIPR_Dwarf_Byte.self))
+      let segmentSelectorSize = Int(try cursor.read(as: SWIPR_Dwarf_Byte.self))
+
+      guard version == 2, segmentSelectorSize == 0,
+            addressSize == 4 || addressSize == 8 else {
+        cursor.pos = next
+        continue
+      }
+
+      // The tuples are aligned to twice the address size, relative to the
+      // start of the set
+      let tupleSize = Address(2 * addressSize)
+      let headerSize = cursor.pos - base
+      cursor.pos = base + (headerSize + tupleSize - 1) / tupleSize * tupleSize
+
+      while cursor.pos + tupleSize <= next {
+        let address: Address
+        let length: Size
+        if addressSize == 4 {
+          address = Address(maybeSwap(try cursor.read(as: UInt32.self)))
+          length = Size(maybeSwap(try cursor.read(as: UInt32.self)))
+        } else {
+          address = maybeSwap(try cursor.read(as: UInt64.self))
+          length = maybeSwap(try cursor.read(as: UInt64.self))
+        }
+
+        if address == 0 && length == 0 {
+          break
+        }
+        if length > 0 {
+          fn(infoOffset, address, address + length)
+        }
+      }
+
+      cursor.pos = next
+    }
+  }
+
+  /// Calls `fn` with every address range covered by `unit`, according to its
+  /// `DW_AT_low_pc`/`DW_AT_high_pc` or `DW_AT_ranges` attributes.
+  private func forEachAddressRange(
+    of unit: Unit,
+    _ fn: (Address, Address) -> ()
+  ) throws {
+    let attributes = unit.attributes
+
+    if let lowPCVal = attributes[.internal_SWIPR_DW_AT_low_pc],
+       let highPCVal = attributes[.internal_SWIPR_DW_AT_high_pc],
+       case let .address(lowPC) = lowPCVal {
+      if case let .address(highPC) = highPCVal {
+        fn(lowPC, highPC)
+      } else if let highPCOffset = highPCVal.uint64Value() {
+        fn(lowPC, lowPC + highPCOffset)
+      }
+      return
+    }
+
+    guard let rangeVal = attributes[.internal_SWIPR_DW_AT_ranges] else {
+      return
+    }
+
+    if unit.version < 5 {
+      guard let rangesSection = rangesSection,
+            case let .sectionOffset(offset) = rangeVal else {
+        return
+      }
+
+      var rangeCursor = ImageSourceCursor(source: rangesSection,
+                                          offset: offset)
+      var rangeBase: Address = unit.lowPC ?? 0
+
+      while true {
+        let beginning = try readAddress(at: &rangeCursor, size: unit.addressSize)
+        let ending = try readAddress(at: &rangeCursor, size: unit.addressSize)
+
+        if beginning == 0 && ending == 0 {
+          break
+        }
+        if (unit.addressSize == 4 && beginning == 0xffffffff)
+             || beginning == 0xffffffffffffffff {
+          rangeBase = ending
+          continue
+        }
+
+        fn(beginning + rangeBase, ending + rangeBase)
+      }
+      return
+    }
+
+    guard let rngListsSection = rngListsSection else {
+      return
+    }
+
+    // See 7.28 Range List Table
+    let offset: Address
+    switch rangeVal {
+      case let .sectionOffset(sectionOffset):
+        offset = sectionOffset
+      case let .rangeList(index):
+        guard let rnglistsBase = unit.rnglistsBase else {
+          return
+        }
+        let entryOffset: Address
+        if unit.isDwarf64 {
+          entryOffset = maybeSwap(
+            try rngListsSection.fetch(from: rnglistsBase + 8 * index,
+                                      as: UInt64.self))
+        } else {
+          entryOffset = Address(maybeSwap(
+            try rngListsSection.fetch(from: rnglistsBase + 4 * index,
+                                      as: UInt32.self)))
+        }
+        offset = rnglistsBase + entryOffset
+      default:
+        return
+    }
+
+    var cursor = ImageSourceCursor(source: rngListsSection, offset: offset)
+    var rangeBase: Address = unit.lowPC ?? 0
+
+    func indirectAddress(_ ndx: UInt64) throws -> Address {
+      guard let addrSection = addrSection else {
+        throw DwarfError.missingAddrSection
+      }
+      guard let addrBase = unit.addrBase else {
+        throw DwarfError.missingAddrBase
+      }
+      var addrCursor = ImageSourceCursor(
+        source: addrSection,
+        offset: addrBase + ndx * UInt64(unit.addressSize)
+      )
+      return try readAddress(at: &addrCursor, size: unit.addressSize)
+    }
+
+    while true {
+      let rawKind = try cursor.read(as: SWIPR_Dwarf_Byte.self)
+      guard let kind = SWIPR_Dwarf_RLE_Entry(rawValue: rawKind) else {
+        throw DwarfError.badRangeListEntry(rawKind)
+      }
+
+      switch kind {
+        case .internal_SWIPR_DW_RLE_end_of_list:
+          return
+        case .internal_SWIPR_DW_RLE_base_addressx:
+          rangeBase = try indirectAddress(try cursor.readULEB128())
+        case .internal_SWIPR_DW_RLE_startx_endx:
+          let start = try indirectAddress(try cursor.readULEB128())
+          let end = try indirectAddress(try cursor.readULEB128())
+          fn(start, end)
+        case .internal_SWIPR_DW_RLE_startx_length:
+          let start = try indirectAddress(try cursor.readULEB128())
+          let length = try cursor.readULEB128()
+          fn(start, start + length)
+        case .internal_SWIPR_DW_RLE_offset_pair:
+          let start = try cursor.readULEB128()
+          let end = try cursor.readULEB128()
+          fn(rangeBase + start, rangeBase + end)
+        case .internal_SWIPR_DW_RLE_base_address:
+          rangeBase = try readAddress(at: &cursor, size: unit.addressSize)
+        case .internal_SWIPR_DW_RLE_start_end:
+          let start = try readAddress(at: &cursor, size: unit.addressSize)
+          let end = try readAddress(at: &cursor, size: unit.addressSize)
+          fn(start, end)
+        case .internal_SWIPR_DW_RLE_start_length:
+          let start = try readAddress(at: &cursor, size: unit.addressSize)
+          let length = try cursor.readULEB128()
+          fn(start, start + length)
+        default:
+          throw DwarfError.badRangeListEntry(rawKind)
+      }
+    }
+  }
+
+  private func readAddress(at cursor: inout ImageSourceCursor,
+                           size: Int) throws -> Address {
+    switch size {
+      case 4:
+        return Address(maybeSwap(try cursor.read(as: UInt32.self)))
+      case 8:
+        return maybeSwap(try cursor.read(as: UInt64.self))
+      default:
+        throw DwarfError.badAddressSize(size)
+    }
+  }
+
+  // .. Inline call sites and functions ........................................
 
+  private typealias UnitInfo = (callSites: InlineCallSiteIndex<CallSiteInfo>,
+                                functions: [FunctionInfo])
+
+  /// The call sites and functions of every unit that has been scanned so
+  /// far, by unit index.
+  private var _unitInfo: [Int: UnitInfo] = [:]
+
+  /// The call sites and functions of all the units we don't know the
+  /// address ranges of; we have to scan all of them on the first lookup that
+  /// doesn't hit another unit.
+  private lazy var _unrangedInfo: UnitInfo = _scanUnits(unitRanges.unrangedUnits)
+
+  private lazy var _lazyInfo: UnitInfo = _scanUnits(Array(units.indices))
+
+  /// All inline call sites, sorted by `lowPC`.
+  ///
+  /// - note: This scans all units, use `lookupInlineCallSites(at:)` to only
+  ///         scan the units that are actually needed.
   var inlineCallSites: [CallSiteInfo] {
-    _lazyInfo.callSites
+    _lazyInfo.callSites.callSites
   }
 
+  /// All functions, sorted by `lowPC`.
+  ///
+  /// - note: This scans all units, use `lookupFunction(at:)` to only scan
+  ///         the units that are actually needed.
   var functions: [FunctionInfo] {
     _lazyInfo.functions
   }
 
-  func lookupInlineCallSites(
-    at address: Address
-  ) -> ArraySlice<CallSiteInfo> {
-    var min = 0
-    var max = inlineCallSites.count
+  /// The number of units whose call sites and functions have been indexed.
+  var scannedUnitCount: Int {
+    _unitInfo.count
+  }
 
+  private func unitInfo(_ unitIndex: Int) -> UnitInfo {
+    if let info = _unitInfo[unitIndex] {
+      return info
+    }
+    let info = _scanUnits([unitIndex])
+    _unitInfo[unitIndex] = info
+    return info
+  }
+
+  /// The indices of the units covering `address`.
+  ///
+  /// Units' address ranges don't overlap in practice (apart from the ranges
+  /// of functions the linker dropped, which are all at zero), so this only
+  /// looks at the ranges directly preceding `address`, until none of the
+  /// ranges before can reach `address` any more.
+  func unitIndices(covering address: Address) -> [Int] {
+    let ranges = unitRanges.ranges
+
+    // Find the first range starting after `address`
+    var min = 0, max = ranges.count
     while min < max {
       let mid = min + (max - min) / 2
-      let callSite = inlineCallSites[mid]
-
-      if callSite.lowPC <= address && callSite.highPC > address {
-        var first = mid, last = mid
-        while first > 0
-                && inlineCallSites[first - 1].lowPC <= address
-                && inlineCallSites[first - 1].highPC > address {
-          first -= 1
-        }
-        while last < inlineCallSites.count - 1
-                && inlineCallSites[last + 1].lowPC <= address
-                && inlineCallSites[last + 1].highPC > address {
-          last += 1
-        }
-
-        return inlineCallSites[first...last]
-      } else if callSite.highPC <= address {
+      if ranges[mid].lowPC <= address {
         min = mid + 1
-      } else if callSite.lowPC > address {
+      } else {
         max = mid
       }
     }
 
-    return []
+    var found: [Int] = []
+    var ndx = min - 1
+    while ndx >= 0 && ranges[ndx].maxHighPC > address {
+      let unitIndex = ranges[ndx].unitIndex
+      if ranges[ndx].highPC > address && !found.contains(unitIndex) {
+        found.append(unitIndex)
+      }
+      ndx -= 1
+    }
+
+    return found
+  }
+
+  /// The call sites and functions of the units covering `address`, scanning
+  /// them first if necessary.
+  private func unitInfos(covering address: Address) -> [UnitInfo] {
+    var result = unitIndices(covering: address).map { unitInfo($0) }
+
+    if result.isEmpty && !unitRanges.unrangedUnits.isEmpty {
+      result.append(_unrangedInfo)
+    }
+
+    return result
+  }
+
+  /// The inline call sites containing `address`, outermost first.
+  func lookupInlineCallSites(
+    at address: Address
+  ) -> ArraySlice<CallSiteInfo> {
+    let infos = unitInfos(covering: address)
+    if infos.count == 1 {
+      return infos[0].callSites.callSites(containing: address)[...]
+    }
+
+    var callSites: [CallSiteInfo] = []
+    for info in infos {
+      callSites += info.callSites.callSites(containing: address)
+    }
+    callSites.sort(
+      by: { (a, b) in
+        a.lowPC < b.lowPC || (a.lowPC == b.lowPC) && a.depth < b.depth
+      })
+    return callSites[...]
   }
 
   func lookupFunction(
     at address: Address
+  ) -> FunctionInfo? {
+    for info in unitInfos(covering: address) {
+      if let function = Self.lookupFunction(at: address, in: info.functions) {
+        return function
+      }
+    }
+    return nil
+  }
+
+  private static func lookupFunction(
+    at address: Address,
+    in functions: [FunctionInfo]
   ) -> FunctionInfo? {
     var min = 0, max = functions.count
     while min < max {
@@ -1843,45 +2229,94 @@ class DwarfReader<S: DwarfSource & AnyObject> {
   }
 
 
+  // .. Line tables ............................................................
+
+  /// The line tables decoded so far, by index into `lineNumberInfo`.
+  private var _lineTables: [Int: DwarfLineTable] = [:]
+
+  /// The indices into `lineNumberInfo`, by offset into `.debug_line`.
+  private lazy var lineNumberInfoIndices: [Address: Int] = {
+    var indices: [Address: Int] = [:]
+    for (ndx, info) in lineNumberInfo.enumerated() {
+      indices[info.baseOffset] = ndx
+    }
+    return indices
+  }()
+
+  /// The number of line number programs that have been decoded.
+  var decodedLineTableCount: Int {
+    _lineTables.count
+  }
+
+  /// A rough estimate of the memory used by the call sites, functions and
+  /// line tables decoded so far.
+  var estimatedByteCount: Int {
+    var total = 0
+    for info in _unitInfo.values {
+      total += info.callSites.rangeCount
+        * (MemoryLayout<CallSiteInfo>.stride + MemoryLayout<UInt32>.stride
+             + MemoryLayout<UInt64>.stride)
+      total += info.functions.count * MemoryLayout<FunctionInfo>.stride
+    }
+    for table in _lineTables.values {
+      total += table.rows.count * MemoryLayout<DwarfLineTable.Row>.stride
+    }
+    return total
+  }
+
+  private func lineTable(_ ndx: Int) throws -> DwarfLineTable {
+    if let table = _lineTables[ndx] {
+      return table
+    }
+    do {
+      let table = try DwarfLineTable(info: lineNumberInfo[ndx])
+      _lineTables[ndx] = table
+      return table
+    } catch {
+      // Don't run a broken program again for every lookup
+      _lineTables[ndx] = DwarfLineTable(info: lineNumberInfo[ndx], rows: [])
+      throw error
+    }
+  }
 
   func sourceLocation(
     for address: Address
   ) throws -> SourceLocation? {
-    var result: SourceLocation? = nil
-    var prevState: DwarfLineNumberState? = nil
-
-    for ndx in 0..<lineNumberInfo.count {
-      var info = lineNumberInfo[ndx]
-      try info.executeProgram { (state, done) in
-        if let oldState = prevState,
-           address >= oldState.address && address < state.address {
-          result = SourceLocation(
-            path: oldState.path,
-            line: oldState.line,
-            column: oldState.column
-          )
-          done = true
-        }
+    // Usually, the unit covering the address tells us which line number
+    // program to look at
+    var foundLineTable = false
+    for unitIndex in unitIndices(covering: address) {
+      guard let lineBase = units[unitIndex].lineBase,
+            let ndx = lineNumberInfoIndices[lineBase] else {
+        continue
+      }
+      foundLineTable = true
+      if let location = try lineTable(ndx).sourceLocation(for: address) {
+        return location
+      }
+    }
+    if foundLineTable {
+      return nil
+    }
 
-        if state.endSequence {
-          prevState = nil
-        } else {
-          prevState = state
-        }
+    // If not, we have to look at all of them
+    for ndx in lineNumberInfo.indices {
+      if let location = try lineTable(ndx).sourceLocation(for: address) {
+        return location
       }
     }
 
-    return result
+    return nil
   }
 
-  private func _scanUnits()
-    -> (callSites: [CallSiteInfo],
-        functions: [FunctionInfo]) {
-
+  /// Scans all DIEs of the units at `unitIndices` for inline call sites and
+  /// functions.
+  private func _scanUnits(_ unitIndices: [Int]) -> UnitInfo {
     var callSites: [CallSiteInfo] = []
     var functions: [FunctionInfo] = []
 
-    for unit in units {
+    for unitIndex in unitIndices {
+      let unit = units[unitIndex]
       do {
         var cursor = ImageSourceCursor(source: infoSection,
                                        offset: unit.dieBounds.base)
@@ -1946,17 +2381,12 @@ class DwarfReader<S: DwarfSource & AnyObject> {
       }
     }
 
-    callSites.sort(
-      by: { (a, b) in
-        a.lowPC < b.lowPC || (a.lowPC == b.lowPC) && a.depth > b.depth
-      })
-
     functions.sort(
       by: { (a, b) in
         a.lowPC < b.lowPC || (a.lowPC == b.lowPC) && a.depth > b.depth
       })
 
-    return (callSites: callSites, functions: functions)
+    return (callSites: InlineCallSiteIndex(callSites), functions: functions)
   }
 
 }
@@ -2221,6 +2651,112 @@ struct DwarfLineNumberInfo {
   }
 }
 
+/// The rows of a line number program, decoded once and sorted by address, so
+/// that looking up an address is a binary search rather than a run of the
+/// whole program.
+struct DwarfLineTable {
+  typealias Address = UInt64
+
+  struct Row {
+    var address: Address
+    var file: UInt32
+    var line: UInt32
+    var column: UInt32
+    /// Marks the first address after a sequence, which isn't covered by it.
+    var isEndSequence: Bool
+  }
+
+  /// The line number program, as it was after running it (it can define
+  /// extra files).
+  private(set) var info: DwarfLineNumberInfo
+
+  /// The rows of all sequences, sorted by address; each sequence ends with an
+  /// end of sequence row.
+  private(set) var rows: [Row]
+
+  init(info: DwarfLineNumberInfo, rows: [Row]) {
+    self.info = info
+    self.rows = rows
+  }
+
+  init(info: DwarfLineNumberInfo) throws {
+    var info = info
+    var unsortedRows: [Row] = []
+    var sequences: [Range<Int>] = []
+    var sequenceStart = 0
+
+    try info.executeProgram { (state, _) in
+      unsortedRows.append(Row(address: state.address,
+                              file: UInt32(clamping: state.file),
+                              line: UInt32(clamping: state.line),
+                              column: UInt32(clamping: state.column),
+                              isEndSequence: state.endSequence))
+      if state.endSequence {
+        // Sequences with just an end row don't cover anything, and those
+        // starting at zero are code the linker dropped (its tombstone). The
+        // latter can be long enough to hide real sequences behind them.
+        if unsortedRows.count - sequenceStart > 1
+             && unsortedRows[sequenceStart].address != 0 {
+          sequences.append(sequenceStart..<unsortedRows.count)
+        }
+        sequenceStart = unsortedRows.count
+      }
+    }
+
+    // The rows within a sequence are sorted already, but the sequences
+    // themselves can be in any order
+    sequences.sort(by: {
+                     unsortedRows[$0.lowerBound].address
+                       < unsortedRows[$1.lowerBound].address
+                   })
+
+    var rows: [Row] = []
+    rows.reserveCapacity(unsortedRows.count)
+    var end: Address = 0
+    for sequence in sequences {
+      // Overlapping sequences shouldn't happen any more, keep the first
+      if !rows.isEmpty && unsortedRows[sequence.lowerBound].address < end {
+        continue
+      }
+      rows += unsortedRows[sequence]
+      end = unsortedRows[sequence.upperBound - 1].address
+    }
+
+    self.info = info
+    self.rows = rows
+  }
+
+  /// Finds the row covering `address`, if any.
+  func lookup(_ address: Address) -> Row? {
+    // Find the first row after `address`
+    var min = 0, max = rows.count
+    while min < max {
+      let mid = min + (max - min) / 2
+      if rows[mid].address <= address {
+        min = mid + 1
+      } else {
+        max = mid
+      }
+    }
+
+    guard min > 0, !rows[min - 1].isEndSequence else {
+      return nil
+    }
+    return rows[min - 1]
+  }
+
+  func sourceLocation(for address: Address) -> SourceLocation? {
+    guard let row = lookup(address) else {
+      return nil
+    }
+    return SourceLocation(
+      path: info.fullPathForFile(index: Int(row.file)),
+      line: Int(row.line),
+      column: Int(row.column)
+    )
+  }
+}
+
 // .. Testing ..................................................................
 
 @_spi(DwarfTest)
@@ -2277,3 +2813,30 @@ public func testDwarfReaderFor(path: String) -> Bool {
     return false
   }
 }
+
+/// Looks up the source locations of addresses in a 64-bit ELF image, for
+/// benchmarking.
+@_spi(DwarfTest)
+public final class DwarfSourceLocationLookup {
+  private let image: Elf64Image
+
+  /// The start addresses of all functions in the image's symbol table.
+  public let functionAddresses: [UInt64]
+
+  public init?(path: String) {
+    guard let source = try? ImageSource(path: path),
+          let image = try? Elf64Image(source: source) else {
+      return nil
+    }
+    self.image = image
+    self.functionAddresses = image.symbolTable.symbols.map { UInt64($0.value) }
+  }
+
+  /// Returns the source location of `address` as `file:line`, if known.
+  public func sourceLocation(for address: UInt64) -> String? {
+    guard let location = try? image.sourceLocation(for: address) else {
+      return nil
+    }
+    return "\(location.path):\(location.line)"
+  }
+}
@@ -181,6 +181,7 @@ let internal_SWIPR_DT_ENCODING        = CProfileRecorderSwiftELF.internal_SWIPR_
 let internal_SWIPR_DT_PREINIT_ARRAY   = CProfileRecorderSwiftELF.internal_SWIPR_DT_PREINIT_ARRAY
 let internal_SWIPR_DT_PREINIT_ARRAYSZ = CProfileRecorderSwiftELF.internal_SWIPR_DT_PREINIT_ARRAYSZ
 let internal_SWIPR_DT_LOOS            = CProfileRecorderSwiftELF.internal_SWIPR_DT_LOOS
+let internal_SWIPR_DT_GNU_HASH        = CProfileRecorderSwiftELF.internal_SWIPR_DT_GNU_HASH
 let internal_SWIPR_DT_HIOS            = CProfileRecorderSwiftELF.internal_SWIPR_DT_HIOS
 let internal_SWIPR_DT_LOPROC          = CProfileRecorderSwiftELF.internal_SWIPR_DT_LOPROC
 let internal_SWIPR_DT_HIPROC          = CProfileRecorderSwiftELF.internal_SWIPR_DT_HIPROC
@@ -1055,13 +1056,9 @@ protocol ElfSymbolProtocol: Equatable {
   associatedtype Address: FixedWidthInteger
   associatedtype Size: FixedWidthInteger
 
-  var name: String { get set }
-  var value: Address { get set }
-  var size: Size { get set }
-  var sectionIndex: Int { get set }
-  var binding: SWIPR_Elf_Sym_Binding { get set }
-  var type: SWIPR_Elf_Sym_Type { get set }
-  var visibility: SWIPR_Elf_Sym_Visibility { get set }
+  var name: String { get }
+  var value: Address { get }
+  var size: Size { get }
 }
 
 protocol ElfSymbolTableProtocol {
@@ -1084,6 +1081,13 @@ protocol ElfSymbolLookupProtocol {
 }
 
 
+/// The function symbols of an image, sorted by address (and size).
+///
+/// The table is stored as parallel arrays rather than an array of symbols:
+/// the binary search only touches the packed address array, and the names
+/// stay in the image's string table(s) until a lookup actually returns them.
+/// Big Swift binaries have hundreds of thousands of symbols but a profile
+/// only ever asks for a few thousand of them.
 struct ElfSymbolTable<SomeElfTraits: ElfTraits>: ElfSymbolTableProtocol {
   typealias Traits = SomeElfTraits
 
@@ -1094,28 +1098,48 @@ struct ElfSymbolTable<SomeElfTraits: ElfTraits>: ElfSymbolTableProtocol {
     var name: String
     var value: Address
     var size: Size
-    var sectionIndex: Int
-    var binding: SWIPR_Elf_Sym_Binding
-    var type: SWIPR_Elf_Sym_Type
-    var visibility: SWIPR_Elf_Sym_Visibility
   }
 
-  private var _symbols: [Symbol] = []
+  /// A symbol as it's read from `.symtab`, before its name is decoded.
+  struct Entry {
+    var value: Traits.Address
+    var size: Traits.Size
+    var nameOffset: UInt32
+  }
+
+  private var addresses: [Traits.Address] = []
+  private var sizes: [Traits.Size] = []
+  private var nameOffsets: [UInt32] = []
+  /// Which of `stringSections` the name at the same index is in, only
+  /// merged tables have more than one.
+  private var nameSections: [UInt8] = []
+  private var stringSections: [ElfStringSection] = []
 
   init() {}
 
   @_specialize(kind: full, where SomeElfTraits == Elf32Traits)
   @_specialize(kind: full, where SomeElfTraits == Elf64Traits)
   init?(image: ElfImage<Traits>) {
-    guard let strtab = image.getSection(".strtab", debug: false),
-          let symtab = image.getSection(".symtab", debug: false) else {
-      return nil
+    let strtab: ImageSource
+    let symtab: ImageSource
+    if image.source.isMappedImage {
+      // Only the dynamic symbols are loaded, `.symtab` is in the file.
+      guard let dynamic = image.getDynamicSymbolTable() else {
+        return nil
+      }
+      (symtab, strtab) = (dynamic.symbols, dynamic.strings)
+    } else {
+      guard let fileStrtab = image.getSection(".strtab", debug: false),
+            let fileSymtab = image.getSection(".symtab", debug: false) else {
+        return nil
+      }
+      (symtab, strtab) = (fileSymtab, fileStrtab)
     }
 
-    let stringSect = ElfStringSection(source: strtab)
-
     // Extract all the data
+    var entries: [Entry] = []
     symtab.bytes.withMemoryRebound(to: Traits.Sym.self) { symbols in
+      entries.reserveCapacity(symbols.count)
       for symbol in symbols {
         // Ignore things that are not functions
         if symbol.st_type != .internal_SWIPR_STT_FUNC {
@@ -1127,107 +1151,182 @@ struct ElfSymbolTable<SomeElfTraits: ElfTraits>: ElfSymbolTableProtocol {
           continue
         }
 
-        _symbols.append(
-          Symbol(
-            name: (stringSect.getStringAt(index: Int(symbol.st_name))
-                     ?? "<unknown>"),
-            value: symbol.st_value,
-            size: symbol.st_size,
-            sectionIndex: Int(symbol.st_shndx),
-            binding: symbol.st_binding,
-            type: symbol.st_type,
-            visibility: symbol.st_visibility
-          )
+        entries.append(
+          Entry(value: symbol.st_value,
+                size: symbol.st_size,
+                nameOffset: UInt32(symbol.st_name))
         )
       }
     }
 
+    self.init(entries: entries, strings: ElfStringSection(source: strtab))
+  }
+
+  /// Makes a table of `entries` (in any order) whose names are in `strings`.
+  @_specialize(kind: full, where SomeElfTraits == Elf32Traits)
+  @_specialize(kind: full, where SomeElfTraits == Elf64Traits)
+  init(entries: [Entry], strings: ElfStringSection) {
+    var entries = entries
+
     // Now sort by address
-    _symbols.sort(by: {
-                    $0.value < $1.value || (
-                      $0.value == $1.value && $0.size < $1.size
-                    )
-                  })
+    entries.sort(by: {
+                   $0.value < $1.value || (
+                     $0.value == $1.value && $0.size < $1.size
+                   )
+                 })
+
+    addresses = entries.map { $0.value }
+    sizes = entries.map { $0.size }
+    nameOffsets = entries.map { $0.nameOffset }
+    nameSections = Array(repeating: 0, count: entries.count)
+    stringSections = [strings]
+  }
+
+  /// The number of symbols in this table.
+  var count: Int {
+    return addresses.count
   }
 
-  private init(sortedSymbols: [Symbol]) {
-    _symbols = sortedSymbols
+  /// A rough estimate of the memory used by this table.
+  var estimatedByteCount: Int {
+    return count * (MemoryLayout<Traits.Address>.stride
+                      + MemoryLayout<Traits.Size>.stride
+                      + MemoryLayout<UInt32>.stride
+                      + MemoryLayout<UInt8>.stride)
+  }
+
+  /// All symbols, sorted by address (and size).
+  ///
+  /// The names are decoded as the symbols are accessed.
+  var symbols: LazyMapCollection<Range<Int>, Symbol> {
+    return (0..<addresses.count).lazy.map { self.symbol(at: $0) }
+  }
+
+  private func symbol(at index: Int) -> Symbol {
+    let strings = stringSections[Int(nameSections[index])]
+    return Symbol(
+      name: strings.getStringAt(index: Int(nameOffsets[index])) ?? "<unknown>",
+      value: addresses[index],
+      size: sizes[index]
+    )
+  }
+
+  /// The NUL terminated name of the symbol at `index`, without decoding it.
+  private func nameBytes(at index: Int) -> UnsafeRawBufferPointer {
+    let bytes = stringSections[Int(nameSections[index])].source.bytes
+    let offset = Int(nameOffsets[index])
+    guard offset < bytes.count else {
+      return UnsafeRawBufferPointer(start: nil, count: 0)
+    }
+    let slice = UnsafeRawBufferPointer(rebasing: bytes[offset...])
+    return UnsafeRawBufferPointer(rebasing: slice[..<strnlen(slice.baseAddress!, slice.count)])
   }
 
   @_specialize(kind: full, where SomeElfTraits == Elf32Traits)
   @_specialize(kind: full, where SomeElfTraits == Elf64Traits)
   public func merged(with other: ElfSymbolTable<Traits>) -> ElfSymbolTable<Traits> {
-    var merged: [Symbol] = []
+    var merged = ElfSymbolTable()
+    let capacity = count + other.count
+    merged.addresses.reserveCapacity(capacity)
+    merged.sizes.reserveCapacity(capacity)
+    merged.nameOffsets.reserveCapacity(capacity)
+    merged.nameSections.reserveCapacity(capacity)
+    merged.stringSections = stringSections + other.stringSections
+
+    let theirSectionBase = UInt8(stringSections.count)
+
+    func appendOurs(_ ndx: Int) {
+      merged.addresses.append(addresses[ndx])
+      merged.sizes.append(sizes[ndx])
+      merged.nameOffsets.append(nameOffsets[ndx])
+      merged.nameSections.append(nameSections[ndx])
+    }
+
+    func appendTheirs(_ ndx: Int) {
+      merged.addresses.append(other.addresses[ndx])
+      merged.sizes.append(other.sizes[ndx])
+      merged.nameOffsets.append(other.nameOffsets[ndx])
+      merged.nameSections.append(theirSectionBase + other.nameSections[ndx])
+    }
 
     var ourNdx = 0, theirNdx = 0
 
-    while ourNdx < _symbols.count && theirNdx < other._symbols.count {
-        let ourSym = _symbols[ourNdx]
-        let theirSym = other._symbols[theirNdx]
-
-        if ourSym.value < theirSym.value {
-          merged.append(ourSym)
-          ourNdx += 1
-        } else if ourSym.value > theirSym.value {
-          merged.append(theirSym)
-          theirNdx += 1
-        } else if ourSym == theirSym {
-          merged.append(ourSym)
-          ourNdx += 1
-          theirNdx += 1
+    while ourNdx < count && theirNdx < other.count {
+      let ourValue = addresses[ourNdx]
+      let theirValue = other.addresses[theirNdx]
+
+      if ourValue < theirValue {
+        appendOurs(ourNdx)
+        ourNdx += 1
+      } else if ourValue > theirValue {
+        appendTheirs(theirNdx)
+        theirNdx += 1
+      } else if sizes[ourNdx] == other.sizes[theirNdx]
+                  && nameBytes(at: ourNdx).elementsEqual(other.nameBytes(at: theirNdx)) {
+        // The same symbol in both tables (the usual case with a debug image)
+        appendOurs(ourNdx)
+        ourNdx += 1
+        theirNdx += 1
+      } else {
+        // Different symbols at the same address, keep both, smaller first
+        if sizes[ourNdx] <= other.sizes[theirNdx] {
+          appendOurs(ourNdx)
+          appendTheirs(theirNdx)
         } else {
-          if ourSym.size <= theirSym.size {
-            merged.append(ourSym)
-          }
-          merged.append(theirSym)
-          if ourSym.size > theirSym.size {
-            merged.append(theirSym)
-          }
-          ourNdx += 1
-          theirNdx += 1
+          appendTheirs(theirNdx)
+          appendOurs(ourNdx)
         }
+        ourNdx += 1
+        theirNdx += 1
       }
+    }
 
-      if ourNdx < _symbols.count {
-        merged.append(contentsOf:_symbols[ourNdx...])
-      }
-      if theirNdx < other._symbols.count {
-        merged.append(contentsOf:other._symbols[theirNdx...])
-      }
+    while ourNdx < count {
+      appendOurs(ourNdx)
+      ourNdx += 1
+    }
+    while theirNdx < other.count {
+      appendTheirs(theirNdx)
+      theirNdx += 1
+    }
 
-      return ElfSymbolTable(sortedSymbols: merged)
+    return merged
   }
 
+  /// Finds the symbol containing `address`: the last one starting at or
+  /// before it, or the first (smallest) one if several start exactly there.
   @_specialize(kind: full, where SomeElfTraits == Elf32Traits)
   @_specialize(kind: full, where SomeElfTraits == Elf64Traits)
   public func lookupSymbol(address: Traits.Address) -> Symbol? {
-    var min = 0
-    var max = _symbols.count
-
-    while min < max {
-      let mid = min + (max - min) / 2
-      let symbol = _symbols[mid]
-      let nextValue: Traits.Address
-      if mid == _symbols.count - 1 {
-        nextValue = ~Traits.Address(0)
-      } else {
-        nextValue = _symbols[mid + 1].value
+    let ndx: Int? = addresses.withUnsafeBufferPointer { addresses in
+      guard !addresses.isEmpty else {
+        return nil
       }
 
-      if symbol.value <= address && nextValue > address {
-        var ndx = mid
-        while ndx > 0 && _symbols[ndx - 1].value == address {
-          ndx -= 1
-        }
-        return _symbols[ndx]
-      } else if symbol.value <= address {
-        min = mid + 1
-      } else if symbol.value > address {
-        max = mid
+      // Branchless binary search for the first symbol starting after
+      // `address`; the loop only ever narrows down `base`, so the
+      // comparison compiles to a conditional move rather than a branch that
+      // mispredicts half of the time.
+      var base = 0
+      var length = addresses.count
+      while length > 1 {
+        let half = length / 2
+        base = addresses[base + half] <= address ? base + half : base
+        length -= half
+      }
+      let after = base + (addresses[base] <= address ? 1 : 0)
+      guard after > 0 else {
+        return nil
+      }
+
+      var ndx = after - 1
+      while ndx > 0 && addresses[ndx - 1] == address {
+        ndx -= 1
       }
+      return ndx
     }
 
-    return nil
+    return ndx.map { symbol(at: $0) }
   }
 }
 
@@ -1452,6 +1551,20 @@ final class ElfImage<SomeElfTraits: ElfTraits>
     return nil
   }
 
+  /// Says whether `other` has the same PT_LOAD segments as this image
+  private func hasSameLoadSegments(as other: ElfImage<Traits>) -> Bool {
+    let loadSegments = { (image: ElfImage<Traits>) in
+      image.programHeaders.filter {
+        $0.p_type == .internal_SWIPR_PT_LOAD
+      }.map {
+        [UInt64($0.p_offset), UInt64($0.p_vaddr),
+         UInt64($0.p_filesz), UInt64($0.p_memsz)]
+      }
+    }
+    let segments = loadSegments(self)
+    return !segments.isEmpty && segments == loadSegments(other)
+  }
+
   private var _debugLinkCRC: UInt32?
   var debugLinkCRC: UInt32 {
     if let crc = _debugLinkCRC {
@@ -1604,6 +1717,23 @@ final class ElfImage<SomeElfTraits: ElfTraits>
       }
     }
 
+    // Mapped images only have their loaded segments, everything else comes
+    // from the file they were loaded from, as long as it's still the same.
+    // Without a build ID, that's only assumed if the file's loaded segments
+    // are laid out exactly like the mapped ones.
+    if source.isMappedImage {
+      if let imagePath = source.path, let image = tryPath(imagePath),
+         image.uuid == uuid,
+         uuid != nil || hasSameLoadSegments(as: image) {
+        _debugImage = image
+        _checkedDebugImage = true
+        return image
+      }
+      _debugImage = nil
+      _checkedDebugImage = true
+      return nil
+    }
+
     if let imagePath = source.path, let realImagePath = realPath(imagePath) {
       let imageDir = dirname(realImagePath)
       let debugLink = getDebugLink()
@@ -1725,7 +1855,9 @@ final class ElfImage<SomeElfTraits: ElfTraits>
     }
 
     if debug, let image = debugImage {
-      return image.getSection(name)
+      // For mapped images, the "debug image" is the file on disk which may
+      // itself have separate debug information.
+      return image.getSection(name, debug: source.isMappedImage)
     }
 
     return nil
@@ -1787,6 +1919,127 @@ final class ElfImage<SomeElfTraits: ElfTraits>
     return DebugAltLinkInfo(link: link, uuid: uuid)
   }
 
+  /// Find the dynamic symbol table (`.dynsym` and `.dynstr`) of a mapped
+  /// image through its `PT_DYNAMIC` segment, there are no section headers
+  /// in memory.
+  func getDynamicSymbolTable() -> (symbols: ImageSource, strings: ImageSource)? {
+    guard source.isMappedImage, !shouldByteSwap,
+          let dynamicHeader = programHeaders.first(where: {
+            $0.p_type == .internal_SWIPR_PT_DYNAMIC
+          }) else {
+      return nil
+    }
+
+    let entryCount = Int(dynamicHeader.p_memsz)
+      / (2 * MemoryLayout<Traits.Address>.size)
+    guard let words = try? source.fetch(
+            from: ImageSource.Address(dynamicHeader.p_vaddr),
+            count: 2 * entryCount,
+            as: Traits.Address.self
+          ) else {
+      return nil
+    }
+
+    // The dynamic linker may have relocated the addresses in there (glibc
+    // does, musl doesn't), if so they're relative to where we're loaded.
+    let imageStart = UInt64(UInt(bitPattern: source.bytes.baseAddress))
+    let imageSize = UInt64(source.count)
+    func imageAddress(_ value: UInt64) -> ImageSource.Address? {
+      if value >= imageStart && value - imageStart < imageSize {
+        return value - imageStart
+      }
+      return value < imageSize ? value : nil
+    }
+
+    var symtab: ImageSource.Address? = nil
+    var strtab: ImageSource.Address? = nil
+    var strsz: ImageSource.Size? = nil
+    var syment = ImageSource.Size(MemoryLayout<Traits.Sym>.size)
+    var hash: ImageSource.Address? = nil
+    var gnuHash: ImageSource.Address? = nil
+    for entry in 0..<entryCount {
+      let tag = UInt64(words[2 * entry])
+      let value = UInt64(words[2 * entry + 1])
+      if tag == UInt64(internal_SWIPR_DT_NULL) {
+        break
+      }
+      switch tag {
+        case UInt64(internal_SWIPR_DT_SYMTAB): symtab = imageAddress(value)
+        case UInt64(internal_SWIPR_DT_STRTAB): strtab = imageAddress(value)
+        case UInt64(internal_SWIPR_DT_STRSZ): strsz = value
+        case UInt64(internal_SWIPR_DT_SYMENT): syment = value
+        case UInt64(internal_SWIPR_DT_HASH): hash = imageAddress(value)
+        case UInt64(internal_SWIPR_DT_GNU_HASH): gnuHash = imageAddress(value)
+        default: continue
+      }
+    }
+    guard let symtab = symtab, let strtab = strtab, let strsz = strsz,
+          syment == ImageSource.Size(MemoryLayout<Traits.Sym>.size) else {
+      return nil
+    }
+
+    // The dynamic section doesn't say how many symbols there are, but the
+    // hash tables know.
+    var symbolCount: ImageSource.Size? = nil
+    if let hash = hash {
+      // That's `nchain`, which is the number of symbols.
+      symbolCount = (try? source.fetch(from: hash + 4, as: UInt32.self))
+        .map { ImageSource.Size($0) }
+    } else if let gnuHash = gnuHash {
+      symbolCount = gnuHashSymbolCount(at: gnuHash)
+    }
+    // Bad values are rejected here without overflowing, and reads outside
+    // the loaded segments give empty sources.
+    guard let symbolCount = symbolCount,
+          symtab <= imageSize, symbolCount <= (imageSize - symtab) / syment,
+          strtab <= imageSize, strsz <= imageSize - strtab else {
+      return nil
+    }
+
+    return (symbols: source[symtab..<symtab + symbolCount * syment],
+            strings: source[strtab..<strtab + strsz])
+  }
+
+  /// The number of symbols covered by the `DT_GNU_HASH` table at `address`.
+  ///
+  /// The symbols are sorted by bucket, so that's the end of the chain of the
+  /// highest bucket, whose last entry has the lowest bit set.
+  private func gnuHashSymbolCount(
+    at address: ImageSource.Address
+  ) -> ImageSource.Size? {
+    guard let header = try? source.fetch(from: address, count: 4,
+                                         as: UInt32.self) else {
+      return nil
+    }
+    let bucketCount = header[0]
+    let symbolOffset = header[1]
+    let bloomSize = ImageSource.Address(header[2])
+    let bucketsAddress = address + 16
+      + bloomSize * ImageSource.Address(MemoryLayout<Traits.Address>.size)
+    let chainsAddress = bucketsAddress + 4 * ImageSource.Address(bucketCount)
+    guard let buckets = try? source.fetch(from: bucketsAddress,
+                                          count: Int(bucketCount),
+                                          as: UInt32.self) else {
+      return nil
+    }
+    guard var last = buckets.max(), last >= symbolOffset else {
+      // No hashed symbols at all.
+      return ImageSource.Size(symbolOffset)
+    }
+    while true {
+      let chainAddress = chainsAddress
+        + 4 * ImageSource.Address(last - symbolOffset)
+      guard let chain = try? source.fetch(from: chainAddress,
+                                          as: UInt32.self) else {
+        return nil
+      }
+      if chain & 1 != 0 {
+        return ImageSource.Size(last) + 1
+      }
+      last += 1
+    }
+  }
+
   /// Find the named section and read a string out of it.
   func getSectionAsString(_ name: String) -> String? {
     guard let sectionSource = getSection(name) else {
@@ -1809,6 +2062,10 @@ final class ElfImage<SomeElfTraits: ElfTraits>
   var _symbolTable: SymbolTable? = nil
   var symbolTable: SymbolTable { return _getSymbolTable(debug: false) }
 
+  /// If set, symbol and inline call site lookups are answered from this
+  /// (usually cached on disk) index instead of the symbol table and DWARF.
+  var symbolIndex: SymbolIndex? = nil
+
   func _getSymbolTable(debug: Bool) -> SymbolTable {
     if let table = _symbolTable {
       return table
@@ -1816,7 +2073,7 @@ final class ElfImage<SomeElfTraits: ElfTraits>
 
     let debugTable: SymbolTable?
     if !debug, let debugImage = debugImage {
-      debugTable = debugImage._getSymbolTable(debug: true)
+      debugTable = debugImage._getSymbolTable(debug: !source.isMappedImage)
         as any ElfSymbolTableProtocol
         as? SymbolTable
     } else {
@@ -1845,6 +2102,13 @@ final class ElfImage<SomeElfTraits: ElfTraits>
 
   public func lookupSymbol(address: Traits.Address) -> ImageSymbol? {
     let relativeAddress = address - Traits.Address(baseAddress)
+    if let symbolIndex = symbolIndex {
+      guard let symbol = symbolIndex.lookupSymbol(address: UInt64(relativeAddress)) else {
+        return nil
+      }
+      return ImageSymbol(name: symbol.name,
+                         offset: Int(UInt64(relativeAddress) - symbol.value))
+    }
     guard let symbol = symbolTable.lookupSymbol(address: relativeAddress) else {
       return nil
     }
@@ -1856,6 +2120,11 @@ final class ElfImage<SomeElfTraits: ElfTraits>
   static var pathSeparator: String { "/" }
 
   func getDwarfSection(_ section: DwarfSection) -> ImageSource? {
+    // The debug sections of mapped images aren't loaded, so they come from
+    // the file on disk (or its separate debug information) instead.
+    let getSection = { (name: String) in
+      self.getSection(name, debug: self.source.isMappedImage)
+    }
     switch section {
       case .debugAbbrev: return getSection(".debug_abbrev")
       case .debugAddr: return getSection(".debug_addr")
@@ -1882,15 +2151,34 @@ final class ElfImage<SomeElfTraits: ElfTraits>
     }
   }
 
-  private lazy var dwarfReader = { [unowned self] in
-    try? DwarfReader(source: self, shouldSwap: header.shouldByteSwap)
-  }()
+  private var _dwarfReader: DwarfReader<ElfImage>?? = nil
+  private var dwarfReader: DwarfReader<ElfImage>? {
+    if let reader = _dwarfReader {
+      return reader
+    }
+    let reader = try? DwarfReader(source: self,
+                                  shouldSwap: header.shouldByteSwap)
+    _dwarfReader = .some(reader)
+    return reader
+  }
 
   typealias CallSiteInfo = DwarfReader<ElfImage>.CallSiteInfo
 
   func inlineCallSites(
     at address: Traits.Address
   ) -> ArraySlice<CallSiteInfo> {
+    if let symbolIndex = symbolIndex {
+      return symbolIndex.inlineCallSites(at: UInt64(address)).map { callSite in
+        CallSiteInfo(depth: callSite.depth,
+                     rawName: nil,
+                     name: callSite.name,
+                     lowPC: callSite.lowPC,
+                     highPC: callSite.highPC,
+                     filename: callSite.filename,
+                     line: callSite.line,
+                     column: callSite.column)
+      }[...]
+    }
     guard let dwarfReader else {
       return [][0..<0]
     }
@@ -1900,7 +2188,48 @@ final class ElfImage<SomeElfTraits: ElfTraits>
     )
   }
 
-  
+  /// Build the symbol table and the DWARF address to unit mapping now rather
+  /// than on the first lookup.
+  ///
+  /// The units themselves are still only indexed when a lookup needs them.
+  func prewarm() {
+    if symbolIndex != nil {
+      return
+    }
+    _ = symbolTable
+    dwarfReader?.prewarm()
+  }
+
+  /// The memory this image reads from: its file mapping and those of its
+  /// debug image and symbol index, if they are loaded.
+  var mappedSources: [ImageSource] {
+    var sources = [source]
+    if let debugImage = _debugImage {
+      sources += debugImage.mappedSources
+    }
+    if let symbolIndex = symbolIndex {
+      sources.append(symbolIndex.imageSource)
+    }
+    return sources
+  }
+
+  /// A rough estimate of the memory used by the lookup structures built so
+  /// far, not counting the mapped files.
+  var estimatedTableByteCount: Int {
+    var total = _symbolTable?.estimatedByteCount ?? 0
+    if let reader = _dwarfReader ?? nil {
+      total += reader.estimatedByteCount
+    }
+    if let debugImage = _debugImage {
+      total += debugImage.estimatedTableByteCount
+    }
+    return total
+  }
+
+  /// All inline call sites of this image, sorted by `lowPC`.
+  var allInlineCallSites: [CallSiteInfo] {
+    return dwarfReader?.inlineCallSites ?? []
+  }
 
   func sourceLocation(
     for address: Traits.Address
@@ -36,6 +36,7 @@
 struct ImageSymbol {
   var name: String
   var offset: Int
+  var sourceLocation: SourceLocation? = nil
 }
 
 
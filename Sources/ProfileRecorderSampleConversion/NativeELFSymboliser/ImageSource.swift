@@ -111,6 +111,14 @@ struct ImageSource: CustomStringConvertible {
       }
     }
 
+    /// Says whether the buffer is a file we mapped
+    var isFileMapping: Bool {
+      if case .mapped = kind {
+        return true
+      }
+      return false
+    }
+
     @inline(__always)
     private func _rangeCheck(_ ndx: Int) {
       if ndx < 0 || ndx >= count {
@@ -364,9 +372,18 @@ struct ImageSource: CustomStringConvertible {
   /// Says whether we are looking at a loaded (i.e. with ld.so or dyld) image.
   private(set) var isMappedImage: Bool
 
+  /// Says whether this ImageSource is a whole file we mapped ourselves.
+  var isFileMapping: Bool { return storage.isFileMapping }
+
   /// If this ImageSource knows its path, this will be non-nil.
   private(set) var path: String?
 
+  /// The parts of the storage that may be read, `nil` if all of it.
+  ///
+  /// Loaded images span all their segments, but the gaps between the
+  /// segments aren't mapped (or not readable), reading them would crash.
+  private var readableRanges: [Range<Int>]? = nil
+
   var description: String {
     return "ImageSource(storage: \(storage), isMappedImage: \(isMappedImage), path: \(String(describing: path))"
   }
@@ -395,6 +412,39 @@ struct ImageSource: CustomStringConvertible {
               isMappedImage: isMappedImage, path: path)
   }
 
+  /// Initialise from an image loaded into this process, of which only
+  /// `segments` (offsets into `loadedImage`) are readable
+  init(loadedImage: UnsafeRawBufferPointer, segments: [Range<Int>],
+       path: String? = nil) {
+    self.init(storage: Storage(unowned: loadedImage),
+              isMappedImage: true, path: path)
+    self.readableRanges = segments
+  }
+
+  /// Says whether all of `range` may be read
+  func isReadable(_ range: Range<Int>) -> Bool {
+    guard range.lowerBound >= 0 && range.upperBound <= count else {
+      return false
+    }
+    guard let readableRanges = readableRanges else {
+      return true
+    }
+    return readableRanges.contains {
+      $0.lowerBound <= range.lowerBound && range.upperBound <= $0.upperBound
+    }
+  }
+
+  /// The end of the readable part of the storage that contains `offset`
+  private func readableEnd(containing offset: Int) -> Int? {
+    guard offset >= 0 && offset < count else {
+      return nil
+    }
+    guard let readableRanges = readableRanges else {
+      return count
+    }
+    return readableRanges.first { $0.contains(offset) }?.upperBound
+  }
+
   /// Initialise with a specified capacity
   init(capacity: Int, isMappedImage: Bool, path: String? = nil) {
     self.init(storage: Storage(capacity: capacity),
@@ -408,7 +458,13 @@ struct ImageSource: CustomStringConvertible {
   }
 
   /// Get a sub-range of this ImageSource as an ImageSource
+  ///
+  /// If the sub-range isn't (entirely) readable, the result is empty.
   subscript(range: Range<Address>) -> ImageSource {
+    guard range.upperBound <= Address(Int.max),
+          isReadable(Int(range.lowerBound)..<Int(range.upperBound)) else {
+      return ImageSource(isMappedImage: isMappedImage, path: path)
+    }
     let intRange = Int(range.lowerBound)..<Int(range.upperBound)
     return ImageSource(storage: storage[intRange],
                        isMappedImage: isMappedImage,
@@ -431,38 +487,95 @@ struct ImageSource: CustomStringConvertible {
 extension ImageSource: MemoryReader {
   public func fetch(from address: Address,
                     into buffer: UnsafeMutableRawBufferPointer) throws {
-    let offset = Int(address)
-    guard bytes.count >= buffer.count &&
-            offset <= bytes.count - buffer.count else {
+    guard address <= Address(Int.max - buffer.count),
+          isReadable(Int(address)..<Int(address) + buffer.count) else {
       throw ImageSourceError.outOfBoundsRead
     }
+    let offset = Int(address)
     buffer.copyMemory(from: UnsafeRawBufferPointer(
                         rebasing: bytes[offset..<offset + buffer.count]))
   }
 
   public func fetch<T>(from address: Address, as type: T.Type) throws -> T {
     let size = MemoryLayout<T>.size
-    let offset = Int(address)
-    guard offset <= bytes.count - size else {
+    guard address <= Address(Int.max - size),
+          isReadable(Int(address)..<Int(address) + size) else {
       throw ImageSourceError.outOfBoundsRead
     }
+    let offset = Int(address)
     return bytes.loadUnaligned(fromByteOffset: offset, as: type)
   }
 
   public func fetchString(from address: Address) throws -> String? {
+    guard address <= Address(Int.max),
+          let end = readableEnd(containing: Int(address)) else {
+      throw ImageSourceError.outOfBoundsRead
+    }
     let offset = Int(address)
-    let len = strnlen(bytes.baseAddress! + offset, bytes.count - offset)
+    let len = strnlen(bytes.baseAddress! + offset, end - offset)
     let stringBytes = bytes[offset..<offset+len]
     return String(decoding: stringBytes, as: UTF8.self)
   }
 
   public func fetchString(from address: Address, length: Int) throws -> String? {
+    guard address <= Address(Int.max - length),
+          isReadable(Int(address)..<Int(address) + length) else {
+      throw ImageSourceError.outOfBoundsRead
+    }
     let offset = Int(address)
     let stringBytes = bytes[offset..<offset+length]
     return String(decoding: stringBytes, as: UTF8.self)
   }
 }
 
+// Memory residency
+
+extension ImageSource {
+  /// The number of bytes of this file mapping that are resident in memory,
+  /// or `nil` if it isn't a file mapping (or the OS won't tell us).
+  var residentByteCount: Int? {
+    #if os(Windows)
+    return nil
+    #else
+    guard isFileMapping, let base = bytes.baseAddress, bytes.count > 0 else {
+      return nil
+    }
+    let pageSize = Int(sysconf(Int32(_SC_PAGESIZE)))
+    var residency = [UInt8](repeating: 0,
+                            count: (bytes.count + pageSize - 1) / pageSize)
+    let result = residency.withUnsafeMutableBufferPointer { residency in
+      #if canImport(Darwin)
+      return residency.withMemoryRebound(to: CChar.self) { residency in
+        mincore(base, bytes.count, residency.baseAddress)
+      }
+      #else
+      return mincore(UnsafeMutableRawPointer(mutating: base), bytes.count,
+                     residency.baseAddress)
+      #endif
+    }
+    guard result == 0 else {
+      return nil
+    }
+    return residency.reduce(0) { $0 + Int($1 & 1) } * pageSize
+    #endif
+  }
+
+  /// Tells the OS that the pages of this file mapping won't be needed any
+  /// time soon, so they don't count towards our resident size any more.
+  ///
+  /// They're read from the file again when they are accessed, so this is
+  /// always safe. Does nothing if this isn't a file mapping.
+  func adviseNotNeeded() {
+    #if !os(Windows)
+    guard isFileMapping, let base = bytes.baseAddress, bytes.count > 0 else {
+      return
+    }
+    _ = madvise(UnsafeMutableRawPointer(mutating: base), bytes.count,
+                MADV_DONTNEED)
+    #endif
+  }
+}
+
 /// Used as a cursor by the DWARF code
 
 struct ImageSourceCursor {
@@ -0,0 +1,155 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+/// The address range of an inline call site.
+protocol InlineCallSiteRange {
+    var lowPC: UInt64 { get }
+    var highPC: UInt64 { get }
+    var depth: Int { get }
+}
+
+/// Address ranges sorted by `lowPC`, each linked to the ranges enclosing it.
+///
+/// Every range links to its parent, the closest range before it that also contains its `lowPC`, and knows the largest
+/// `highPC` of all its ancestors. Every range containing an address is an ancestor of (or is) the last range starting
+/// at or before that address. So a lookup is a binary search followed by a walk up the parents, which stops once no
+/// ancestor reaches the address. For properly nested ranges, which inline call sites are, that's O(log n + depth).
+/// Ranges that overlap without nesting are still found, only the walk may get longer.
+protocol NestedAddressRanges {
+    var rangeCount: Int { get }
+    func lowPC(_ index: Int) -> UInt64
+    func highPC(_ index: Int) -> UInt64
+    /// The index of the parent of the range at `index`, ``AddressRangeNesting/noParent`` if there is none.
+    func parent(_ index: Int) -> UInt32
+    /// The largest `highPC` of all ancestors of the range at `index`, 0 if there are none.
+    func ancestorsHighPC(_ index: Int) -> UInt64
+}
+
+extension NestedAddressRanges {
+    /// Calls `body` with the index of every range containing `address`, innermost range first.
+    @inline(__always)
+    func forEachRange(containing address: UInt64, _ body: (Int) -> Void) {
+        // Find the first range starting after `address`.
+        var low = 0
+        var high = self.rangeCount
+        while low < high {
+            let mid = low + (high - low) / 2
+            if self.lowPC(mid) <= address {
+                low = mid + 1
+            } else {
+                high = mid
+            }
+        }
+        guard low > 0 else {
+            return
+        }
+        var index = low - 1
+        while true {
+            if self.highPC(index) > address {
+                body(index)
+            }
+            // Parents always come first, which also rejects `noParent` (and garbage from corrupt indexes).
+            let parent = Int(self.parent(index))
+            guard self.ancestorsHighPC(index) > address, parent < index else {
+                return
+            }
+            index = parent
+        }
+    }
+}
+
+/// The parent links of ``NestedAddressRanges``.
+struct AddressRangeNesting {
+    static let noParent = UInt32.max
+
+    private(set) var parents: [UInt32]
+    private(set) var ancestorsHighPCs: [UInt64]
+
+    /// Links the ranges `lowPCs[i]..<highPCs[i]`, which must be sorted like ``sort(_:)`` does.
+    init(lowPCs: [UInt64], highPCs: [UInt64]) {
+        precondition(lowPCs.count == highPCs.count)
+        precondition(lowPCs.count < Int(Self.noParent))
+        self.parents = []
+        self.ancestorsHighPCs = []
+        self.parents.reserveCapacity(lowPCs.count)
+        self.ancestorsHighPCs.reserveCapacity(lowPCs.count)
+
+        // The parent chain of the current range: every range on it contains the `lowPC` of the one above it.
+        var chain: [Int] = []
+        for index in lowPCs.indices {
+            while let last = chain.last, highPCs[last] <= lowPCs[index] {
+                chain.removeLast()
+            }
+            if let parent = chain.last {
+                self.parents.append(UInt32(parent))
+                self.ancestorsHighPCs.append(max(highPCs[parent], self.ancestorsHighPCs[parent]))
+            } else {
+                self.parents.append(Self.noParent)
+                self.ancestorsHighPCs.append(0)
+            }
+            chain.append(index)
+        }
+    }
+
+    /// Sorts `ranges` by `lowPC`, enclosing ranges first.
+    static func sort<Range: InlineCallSiteRange>(_ ranges: inout [Range]) {
+        ranges.sort { a, b in
+            (a.lowPC, b.highPC, a.depth) < (b.lowPC, a.highPC, b.depth)
+        }
+    }
+}
+
+/// An immutable index of inline call sites that finds the call sites containing an address in O(log n + depth).
+struct InlineCallSiteIndex<CallSite: InlineCallSiteRange>: NestedAddressRanges {
+    /// All call sites, sorted by `lowPC`, enclosing call sites first.
+    let callSites: [CallSite]
+    private let nesting: AddressRangeNesting
+
+    init(_ callSites: [CallSite]) {
+        var callSites = callSites
+        AddressRangeNesting.sort(&callSites)
+        self.callSites = callSites
+        self.nesting = AddressRangeNesting(lowPCs: callSites.map { $0.lowPC }, highPCs: callSites.map { $0.highPC })
+    }
+
+    var rangeCount: Int {
+        return self.callSites.count
+    }
+
+    func lowPC(_ index: Int) -> UInt64 {
+        return self.callSites[index].lowPC
+    }
+
+    func highPC(_ index: Int) -> UInt64 {
+        return self.callSites[index].highPC
+    }
+
+    func parent(_ index: Int) -> UInt32 {
+        return self.nesting.parents[index]
+    }
+
+    func ancestorsHighPC(_ index: Int) -> UInt64 {
+        return self.nesting.ancestorsHighPCs[index]
+    }
+
+    /// The call sites containing `address`, outermost first.
+    func callSites(containing address: UInt64) -> [CallSite] {
+        var result: [CallSite] = []
+        self.forEachRange(containing: address) { index in
+            result.append(self.callSites[index])
+        }
+        result.reverse()
+        return result
+    }
+}
@@ -0,0 +1,51 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import ProfileRecorder
+
+/// The images (executable and dynamic libraries) loaded into this process, as found by `dl_iterate_phdr`.
+internal enum LoadedImages {
+    /// An ``ImageSource`` reading the image at `path` straight from this process's memory, `nil` if there's no image
+    /// at `path` loaded with `segmentSlide`.
+    ///
+    /// The source spans the image's loaded segments and is addressed by virtual address, like ``ElfImage`` expects of
+    /// mapped images. That way, the image can be symbolised even if the file on disk has since been replaced (or
+    /// deleted) and it isn't mapped a second time. Only images whose first segment starts at virtual address 0
+    /// (shared libraries and position independent executables) are supported. The gaps between the segments usually
+    /// aren't mapped, so reads that aren't within one of the segments fail (or give empty sources).
+    static func imageSource(path: String, segmentSlide: UInt) -> ImageSource? {
+        #if os(Linux)
+        let segments = ProfileRecorderSampler._listLoadedImageSegments().filter { segment in
+            segment.path == path && segment.segmentSlide == segmentSlide
+        }
+        guard
+            let start = segments.map({ $0.segmentStartAddress }).min(),
+            let end = segments.map({ $0.segmentEndAddress }).max(),
+            start == segmentSlide,
+            let base = UnsafeRawPointer(bitPattern: segmentSlide)
+        else {
+            return nil
+        }
+        return ImageSource(
+            loadedImage: UnsafeRawBufferPointer(start: base, count: Int(end - start)),
+            segments: segments.map { segment in
+                Int(segment.segmentStartAddress - start)..<Int(segment.segmentEndAddress - start)
+            },
+            path: path
+        )
+        #else
+        return nil
+        #endif
+    }
+}
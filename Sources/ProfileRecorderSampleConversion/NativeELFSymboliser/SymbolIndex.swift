@@ -0,0 +1,486 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+#if canImport(Darwin)
+import Darwin
+#elseif canImport(Glibc)
+import Glibc
+#elseif canImport(Musl)
+import Musl
+#endif
+import Logging
+
+enum SymbolIndexError: Error {
+    case truncated
+    case badMagic
+    case unsupportedVersion(UInt32)
+    case tooLarge
+    case posixError(path: String, errno: CInt)
+}
+
+/// A compact, immutable index of the function symbols and inline call sites of an ELF image.
+///
+/// The serialised form is designed to be `mmap`ped and used in place: lookups binary search directly in the mapped
+/// memory and only decode the strings of the entries they return. That makes it suitable as an on-disk cache, keyed by
+/// the image's GNU build ID, that is shared between runs and between processes.
+///
+/// ## Format
+///
+/// All integers are little endian, all sections start 8-byte aligned.
+///
+/// ```
+/// header       magic "SWIPRIDX", version: UInt32, reserved: UInt32,
+///              symbolCount: UInt64, callSiteCount: UInt64, stringPoolSize: UInt64
+/// symbols      address: [UInt64], nameOffset: [UInt32]
+/// call sites   lowPC: [UInt64], highPC: [UInt64], ancestorsHighPC: [UInt64], depth: [UInt32], nameOffset: [UInt32],
+///              filenameOffset: [UInt32], line: [UInt32], column: [UInt32], parent: [UInt32]
+/// strings      NUL terminated UTF-8 strings, referenced by their offset into this section
+/// ```
+///
+/// Symbols are sorted by address (and size). Call sites are sorted by `lowPC` with enclosing call sites first, and
+/// `parent` and `ancestorsHighPC` link them up as described in ``NestedAddressRanges``.
+struct SymbolIndex: NestedAddressRanges {
+    static let magic: UInt64 = 0x5844_4952_5049_5753  // "SWIPRIDX"
+    static let version: UInt32 = 2
+    static let fileExtension = "swipridx"
+
+    private static let headerSize = 40
+    private static let noString = UInt32.max
+
+    struct CallSite: InlineCallSiteRange {
+        var depth: Int
+        var name: String?
+        var lowPC: UInt64
+        var highPC: UInt64
+        var filename: String
+        var line: Int
+        var column: Int
+    }
+
+    private let source: ImageSource
+    let symbolCount: Int
+    let callSiteCount: Int
+    private let symbolNamesOffset: Int
+    private let callSitesOffset: Int
+    private let stringPoolOffset: Int
+    private let stringPoolSize: Int
+
+    /// The number of bytes of this index.
+    var byteCount: Int {
+        return self.source.count
+    }
+
+    /// Where the index is read from, usually a mapping of the cached file.
+    var imageSource: ImageSource {
+        return self.source
+    }
+
+    init(source: ImageSource) throws {
+        let bytes = source.bytes
+        guard source.count >= Self.headerSize else {
+            throw SymbolIndexError.truncated
+        }
+        guard UInt64(littleEndian: bytes.loadUnaligned(fromByteOffset: 0, as: UInt64.self)) == Self.magic else {
+            throw SymbolIndexError.badMagic
+        }
+        let version = UInt32(littleEndian: bytes.loadUnaligned(fromByteOffset: 8, as: UInt32.self))
+        guard version == Self.version else {
+            throw SymbolIndexError.unsupportedVersion(version)
+        }
+        let symbolCount = UInt64(littleEndian: bytes.loadUnaligned(fromByteOffset: 16, as: UInt64.self))
+        let callSiteCount = UInt64(littleEndian: bytes.loadUnaligned(fromByteOffset: 24, as: UInt64.self))
+        let stringPoolSize = UInt64(littleEndian: bytes.loadUnaligned(fromByteOffset: 32, as: UInt64.self))
+        guard symbolCount < UInt32.max, callSiteCount < UInt32.max, stringPoolSize < UInt32.max else {
+            throw SymbolIndexError.truncated
+        }
+        let layout = Self.layout(
+            symbolCount: Int(symbolCount),
+            callSiteCount: Int(callSiteCount),
+            stringPoolSize: Int(stringPoolSize)
+        )
+        guard layout.totalSize <= source.count else {
+            throw SymbolIndexError.truncated
+        }
+
+        self.source = source
+        self.symbolCount = Int(symbolCount)
+        self.callSiteCount = Int(callSiteCount)
+        self.symbolNamesOffset = layout.symbolNamesOffset
+        self.callSitesOffset = layout.callSitesOffset
+        self.stringPoolOffset = layout.stringPoolOffset
+        self.stringPoolSize = Int(stringPoolSize)
+    }
+
+    /// Maps the index at `path`.
+    init(path: String) throws {
+        try self.init(source: try ImageSource(path: path))
+    }
+
+    private static func alignedTo8(_ value: Int) -> Int {
+        return (value + 7) & ~7
+    }
+
+    private static func layout(
+        symbolCount: Int,
+        callSiteCount: Int,
+        stringPoolSize: Int
+    ) -> (symbolNamesOffset: Int, callSitesOffset: Int, stringPoolOffset: Int, totalSize: Int) {
+        let symbolNamesOffset = Self.headerSize + 8 * symbolCount
+        let callSitesOffset = Self.alignedTo8(symbolNamesOffset + 4 * symbolCount)
+        let stringPoolOffset = Self.alignedTo8(callSitesOffset + 48 * callSiteCount)
+        return (symbolNamesOffset, callSitesOffset, stringPoolOffset, stringPoolOffset + stringPoolSize)
+    }
+
+    // MARK: - Reading
+
+    @inline(__always)
+    private func loadUInt64(_ offset: Int) -> UInt64 {
+        return UInt64(littleEndian: self.source.bytes.loadUnaligned(fromByteOffset: offset, as: UInt64.self))
+    }
+
+    @inline(__always)
+    private func loadUInt32(_ offset: Int) -> UInt32 {
+        return UInt32(littleEndian: self.source.bytes.loadUnaligned(fromByteOffset: offset, as: UInt32.self))
+    }
+
+    @inline(__always)
+    private func symbolAddress(_ index: Int) -> UInt64 {
+        return self.loadUInt64(Self.headerSize + 8 * index)
+    }
+
+    @inline(__always)
+    private func callSiteLowPC(_ index: Int) -> UInt64 {
+        return self.loadUInt64(self.callSitesOffset + 8 * index)
+    }
+
+    @inline(__always)
+    private func callSiteHighPC(_ index: Int) -> UInt64 {
+        return self.loadUInt64(self.callSitesOffset + 8 * (self.callSiteCount + index))
+    }
+
+    @inline(__always)
+    private func callSiteUInt32Field(_ field: Int, _ index: Int) -> UInt32 {
+        // depth (0), name (1), filename (2), line (3), column (4), parent (5) follow the three UInt64 arrays.
+        let fieldOffset = 4 * (field * self.callSiteCount + index)
+        return self.loadUInt32(self.callSitesOffset + 24 * self.callSiteCount + fieldOffset)
+    }
+
+    var rangeCount: Int {
+        return self.callSiteCount
+    }
+
+    func lowPC(_ index: Int) -> UInt64 {
+        return self.callSiteLowPC(index)
+    }
+
+    func highPC(_ index: Int) -> UInt64 {
+        return self.callSiteHighPC(index)
+    }
+
+    func parent(_ index: Int) -> UInt32 {
+        return self.callSiteUInt32Field(5, index)
+    }
+
+    func ancestorsHighPC(_ index: Int) -> UInt64 {
+        return self.loadUInt64(self.callSitesOffset + 8 * (2 * self.callSiteCount + index))
+    }
+
+    private func string(at offset: UInt32) -> String? {
+        guard offset != Self.noString, Int(offset) < self.stringPoolSize else {
+            return nil
+        }
+        let bytes = self.source.bytes
+        let start = self.stringPoolOffset + Int(offset)
+        let limit = self.stringPoolOffset + self.stringPoolSize
+        var end = start
+        while end < limit && bytes[end] != 0 {
+            end += 1
+        }
+        return String(decoding: UnsafeRawBufferPointer(rebasing: bytes[start..<end]), as: UTF8.self)
+    }
+
+    /// Finds the symbol containing `address`, following the same rules as `ElfSymbolTable.lookupSymbol`.
+    func lookupSymbol(address: UInt64) -> (name: String, value: UInt64)? {
+        // Find the first symbol starting after `address`.
+        var low = 0
+        var high = self.symbolCount
+        while low < high {
+            let mid = low + (high - low) / 2
+            if self.symbolAddress(mid) <= address {
+                low = mid + 1
+            } else {
+                high = mid
+            }
+        }
+        guard low > 0 else {
+            return nil
+        }
+        var index = low - 1
+        while index > 0 && self.symbolAddress(index - 1) == address {
+            index -= 1
+        }
+        let name = self.string(at: self.loadUInt32(self.symbolNamesOffset + 4 * index)) ?? "<unknown>"
+        return (name, self.symbolAddress(index))
+    }
+
+    /// Finds the inline call sites covering `address`, outermost first like `DwarfReader.lookupInlineCallSites`.
+    func inlineCallSites(at address: UInt64) -> [CallSite] {
+        var callSites: [CallSite] = []
+        self.forEachRange(containing: address) { index in
+            callSites.append(self.callSite(index))
+        }
+        callSites.reverse()
+        return callSites
+    }
+
+    private func callSite(_ index: Int) -> CallSite {
+        return CallSite(
+            depth: Int(self.callSiteUInt32Field(0, index)),
+            name: self.string(at: self.callSiteUInt32Field(1, index)),
+            lowPC: self.callSiteLowPC(index),
+            highPC: self.callSiteHighPC(index),
+            filename: self.string(at: self.callSiteUInt32Field(2, index)) ?? "",
+            line: Int(self.callSiteUInt32Field(3, index)),
+            column: Int(self.callSiteUInt32Field(4, index))
+        )
+    }
+
+    // MARK: - Building
+
+    /// Accumulates symbols and call sites and serialises them into the index format.
+    struct Builder {
+        private var symbolAddresses: [UInt64] = []
+        private var symbolNames: [UInt32] = []
+        /// A call site with its strings interned.
+        private struct PendingCallSite: InlineCallSiteRange {
+            var lowPC: UInt64
+            var highPC: UInt64
+            var depth: Int
+            var nameOffset: UInt32
+            var filenameOffset: UInt32
+            var line: Int
+            var column: Int
+        }
+
+        private var callSites: [PendingCallSite] = []
+        private var stringPool: [UInt8] = []
+        private var stringOffsets: [String: UInt32] = [:]
+        private var overflowed = false
+
+        private mutating func intern(_ string: String?) -> UInt32 {
+            guard let string = string else {
+                return SymbolIndex.noString
+            }
+            if let offset = self.stringOffsets[string] {
+                return offset
+            }
+            guard self.stringPool.count + string.utf8.count + 1 < Int(SymbolIndex.noString) else {
+                self.overflowed = true
+                return SymbolIndex.noString
+            }
+            let offset = UInt32(self.stringPool.count)
+            self.stringPool.append(contentsOf: string.utf8)
+            self.stringPool.append(0)
+            self.stringOffsets[string] = offset
+            return offset
+        }
+
+        /// Adds a symbol, symbols must be added in the order they should be looked up in (sorted by address).
+        mutating func addSymbol(address: UInt64, name: String) {
+            self.symbolAddresses.append(address)
+            self.symbolNames.append(self.intern(name))
+        }
+
+        /// Adds an inline call site, in any order.
+        mutating func addCallSite(_ callSite: CallSite) {
+            self.callSites.append(
+                PendingCallSite(
+                    lowPC: callSite.lowPC,
+                    highPC: callSite.highPC,
+                    depth: callSite.depth,
+                    nameOffset: self.intern(callSite.name),
+                    filenameOffset: self.intern(callSite.filename),
+                    line: callSite.line,
+                    column: callSite.column
+                )
+            )
+        }
+
+        func serialise() throws -> [UInt8] {
+            guard !self.overflowed else {
+                throw SymbolIndexError.tooLarge
+            }
+            let callSites = InlineCallSiteIndex(self.callSites)
+            let layout = SymbolIndex.layout(
+                symbolCount: self.symbolAddresses.count,
+                callSiteCount: callSites.rangeCount,
+                stringPoolSize: self.stringPool.count
+            )
+            var output: [UInt8] = []
+            output.reserveCapacity(layout.totalSize)
+
+            func append<Value: FixedWidthInteger>(_ value: Value) {
+                withUnsafeBytes(of: value.littleEndian) { output.append(contentsOf: $0) }
+            }
+            func padTo(_ offset: Int) {
+                assert(output.count <= offset)
+                output.append(contentsOf: repeatElement(0, count: offset - output.count))
+            }
+
+            append(SymbolIndex.magic)
+            append(SymbolIndex.version)
+            append(UInt32(0))
+            append(UInt64(self.symbolAddresses.count))
+            append(UInt64(callSites.rangeCount))
+            append(UInt64(self.stringPool.count))
+            self.symbolAddresses.forEach { append($0) }
+            assert(output.count == layout.symbolNamesOffset)
+            self.symbolNames.forEach { append($0) }
+            padTo(layout.callSitesOffset)
+            callSites.callSites.forEach { append($0.lowPC) }
+            callSites.callSites.forEach { append($0.highPC) }
+            callSites.callSites.indices.forEach { append(callSites.ancestorsHighPC($0)) }
+            callSites.callSites.forEach { append(UInt32(clamping: $0.depth)) }
+            callSites.callSites.forEach { append($0.nameOffset) }
+            callSites.callSites.forEach { append($0.filenameOffset) }
+            callSites.callSites.forEach { append(UInt32(clamping: $0.line)) }
+            callSites.callSites.forEach { append(UInt32(clamping: $0.column)) }
+            callSites.callSites.indices.forEach { append(callSites.parent($0)) }
+            padTo(layout.stringPoolOffset)
+            output.append(contentsOf: self.stringPool)
+            assert(output.count == layout.totalSize)
+            return output
+        }
+    }
+
+    // MARK: - On-disk cache
+
+    /// The path of the cached index for the image with GNU build ID `buildID` in `cacheDirectory`.
+    static func cachePath(cacheDirectory: String, buildID: [UInt8]) -> String {
+        let hexBuildID = buildID.map { byte in
+            byte < 0x10 ? "0" + String(byte, radix: 16) : String(byte, radix: 16)
+        }.joined()
+        return "\(cacheDirectory)/\(hexBuildID).\(Self.fileExtension)"
+    }
+
+    /// Atomically writes `bytes` to `path` (creating its directory if necessary) so that concurrent readers only ever
+    /// see complete indexes.
+    static func save(_ bytes: [UInt8], to path: String) throws {
+        if let lastSlash = path.lastIndex(of: "/"), lastSlash != path.startIndex {
+            let directory = String(path[..<lastSlash])
+            if mkdir(directory, 0o755) != 0 && errno != EEXIST {
+                throw SymbolIndexError.posixError(path: directory, errno: errno)
+            }
+        }
+        let temporaryPath = "\(path).\(getpid()).tmp"
+        let fd = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC, 0o644)
+        guard fd >= 0 else {
+            throw SymbolIndexError.posixError(path: temporaryPath, errno: errno)
+        }
+        var success = false
+        defer {
+            close(fd)
+            if !success {
+                unlink(temporaryPath)
+            }
+        }
+        try bytes.withUnsafeBytes { buffer in
+            var written = 0
+            while written < buffer.count {
+                let result = write(fd, buffer.baseAddress! + written, buffer.count - written)
+                if result < 0 {
+                    guard errno == EINTR else {
+                        throw SymbolIndexError.posixError(path: temporaryPath, errno: errno)
+                    }
+                    continue
+                }
+                written += result
+            }
+        }
+        guard rename(temporaryPath, path) == 0 else {
+            throw SymbolIndexError.posixError(path: path, errno: errno)
+        }
+        success = true
+    }
+}
+
+extension ElfImage {
+    /// Builds a `SymbolIndex` holding all function symbols and inline call sites of this image.
+    ///
+    /// - note: This requires the full symbol table and a full scan of the DWARF information, so it's expensive.
+    func makeSymbolIndex() throws -> [UInt8] {
+        var builder = SymbolIndex.Builder()
+        for symbol in self.symbolTable.symbols {
+            builder.addSymbol(address: UInt64(symbol.value), name: symbol.name)
+        }
+        for callSite in self.allInlineCallSites {
+            builder.addCallSite(
+                SymbolIndex.CallSite(
+                    depth: callSite.depth,
+                    name: callSite.name,
+                    lowPC: callSite.lowPC,
+                    highPC: callSite.highPC,
+                    filename: callSite.filename,
+                    line: callSite.line,
+                    column: callSite.column
+                )
+            )
+        }
+        return try builder.serialise()
+    }
+
+    /// Makes this image use the `SymbolIndex` cached in `cacheDirectory`, if there is one.
+    ///
+    /// This only maps an existing index, it never builds one (see ``writeSymbolIndex(cacheDirectory:logger:)``), so
+    /// it's cheap enough for the lookup path. Images without a GNU build ID can't be cached and are left alone.
+    func attachCachedSymbolIndex(cacheDirectory: String, logger: Logger) {
+        guard self.symbolIndex == nil, let buildID = self.uuid, !buildID.isEmpty else {
+            return
+        }
+        let path = SymbolIndex.cachePath(cacheDirectory: cacheDirectory, buildID: buildID)
+        do {
+            self.symbolIndex = try SymbolIndex(path: path)
+            logger.trace("using cached symbol index", metadata: ["image": "\(self.imageName)", "index": "\(path)"])
+        } catch {
+            logger.trace(
+                "no usable cached symbol index",
+                metadata: ["image": "\(self.imageName)", "index": "\(path)", "error": "\(error)"]
+            )
+        }
+    }
+
+    /// Builds this image's `SymbolIndex`, caches it in `cacheDirectory` and makes this image use it, unless it
+    /// already uses one.
+    ///
+    /// - note: This is expensive (see ``makeSymbolIndex()``), so it's done when prewarming rather than on lookups.
+    func writeSymbolIndex(cacheDirectory: String, logger: Logger) {
+        guard self.symbolIndex == nil, let buildID = self.uuid, !buildID.isEmpty else {
+            return
+        }
+        let path = SymbolIndex.cachePath(cacheDirectory: cacheDirectory, buildID: buildID)
+        do {
+            let index = try self.makeSymbolIndex()
+            try SymbolIndex.save(index, to: path)
+            // Map the file we just wrote rather than keeping `index` on the heap, that way the pages are shared with
+            // every other process using the same index.
+            self.symbolIndex = try SymbolIndex(path: path)
+            logger.debug("wrote symbol index", metadata: ["image": "\(self.imageName)", "index": "\(path)"])
+        } catch {
+            logger.debug(
+                "could not write symbol index",
+                metadata: ["image": "\(self.imageName)", "index": "\(path)", "error": "\(error)"]
+            )
+        }
+    }
+}
@@ -0,0 +1,153 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import NIOCore
+
+extension DifferentialProfile {
+    /// Writes one line per unique stack with its base and new sample counts, the input `flamegraph.pl` takes for a
+    /// differential flame graph (and what `difffolded.pl` writes).
+    func writeCollapsed(normalized: Bool, interner: SymbolInterner, into output: inout ByteBuffer) {
+        let baseCounts = self.baseCounts(normalized: normalized)
+        let strings = interner.strings()
+        var locationIDs: [UInt32] = []
+        for node in self.callTree.parents.indices
+        where node != Int(self.root) && (baseCounts[node] > 0 || self.newCounts[node] > 0) {
+            self.callTree.locationIDs(of: CallTree.NodeID(node), into: &locationIDs)
+            var first = true
+            for locationID in locationIDs.reversed() {
+                if !first {
+                    output.writeString(";")
+                }
+                output.writeString(strings[SymbolInterner.ID(rawValue: locationID)])
+                first = false
+            }
+            output.writeString(" \(baseCounts[node]) \(self.newCounts[node])\n")
+        }
+    }
+
+    /// Writes a flame graph of the new capture coloured by the difference to the base: frames that grew are red,
+    /// frames that shrank blue, the more saturated the bigger the change.
+    ///
+    /// Like `flamegraph.pl`'s differential flame graphs, stacks that only the base capture has aren't visible.
+    func writeFlamegraphSVG(
+        normalized: Bool,
+        writer: FlamegraphSVGWriter,
+        interner: SymbolInterner,
+        into output: inout ByteBuffer
+    ) {
+        let baseTotals = self.callTree.inclusiveSums(of: self.baseCounts(normalized: normalized))
+        let newTotals = self.callTree.inclusiveSums(of: self.newCounts)
+        let maximumDelta = zip(baseTotals, newTotals).lazy.map { abs($1 - $0) }.max() ?? 0
+        writer.write(
+            self.callTree,
+            widths: newTotals,
+            title: "Differential Flame Graph (\(self.newTotal) samples, base \(self.baseTotal) samples)",
+            interner: interner,
+            into: &output
+        ) { node, name in
+            let count = newTotals[Int(node)]
+            let delta = count - baseTotals[Int(node)]
+            let deltaPercentage = FlamegraphSVGWriter.percentage(abs(delta), of: self.newTotal)
+            // White if unchanged, fully saturated for the biggest change.
+            let color: FlamegraphSVGWriter.Color
+            if delta == 0 {
+                color = (red: 255, green: 255, blue: 255)
+            } else {
+                let fade = 210 - abs(delta) * 210 / maximumDelta
+                color = delta < 0 ? (red: fade, green: fade, blue: 255) : (red: 255, green: fade, blue: fade)
+            }
+            return (
+                details: "\(count) samples, \(FlamegraphSVGWriter.percentage(count, of: self.newTotal))%; "
+                    + "\(delta < 0 ? "-" : "+")\(deltaPercentage)%",
+                color: color
+            )
+        }
+    }
+
+    /// Writes a pprof profile of the difference, the way `pprof -diff_base` computes it.
+    ///
+    /// Every stack has a sample with its new count and one with its negated base count, labelled `pprof::base`, so
+    /// the values add up to the change and pprof can still tell the two apart.
+    func writePprof(normalized: Bool, interner: SymbolInterner, into output: inout ByteBuffer) {
+        typealias FieldNumber = PprofOutputRenderer.FieldNumber
+        let baseCounts = self.baseCounts(normalized: normalized)
+        var stringTable = ProtobufStringTable(interner: interner)
+        var messageScratch = ByteBuffer()
+        var labelScratch = ByteBuffer()
+
+        let samplesID = stringTable.index("samples")
+        let countID = stringTable.index("count")
+        let baseLabelKeyID = stringTable.index("pprof::base")
+        let trueID = stringTable.index("true")
+
+        output.writeProtobufMessage(field: FieldNumber.Profile.sampleType, scratch: &messageScratch) { valueType in
+            valueType.writeProtobufInt64(field: FieldNumber.ValueType.type, samplesID)
+            valueType.writeProtobufInt64(field: FieldNumber.ValueType.unit, countID)
+        }
+
+        // There's one location (with one line) per function, both with the same ID.
+        var functionIDs: [UInt32: UInt64] = [:]
+        var functionNames: [SymbolInterner.ID] = []
+        var locationIDs: [UInt32] = []
+        for node in self.callTree.parents.indices
+        where node != Int(self.root) && (baseCounts[node] > 0 || self.newCounts[node] > 0) {
+            self.callTree.locationIDs(of: CallTree.NodeID(node), into: &locationIDs)
+            for index in locationIDs.indices {
+                let functionName = locationIDs[index]
+                if let id = functionIDs[functionName] {
+                    locationIDs[index] = UInt32(id)
+                } else {
+                    functionNames.append(SymbolInterner.ID(rawValue: functionName))
+                    functionIDs[functionName] = UInt64(functionNames.count)
+                    locationIDs[index] = UInt32(functionNames.count)
+                }
+            }
+
+            for (value, isBase) in [(self.newCounts[node], false), (-baseCounts[node], true)] where value != 0 {
+                output.writeProtobufMessage(field: FieldNumber.Profile.sample, scratch: &messageScratch) { sample in
+                    sample.writeProtobufPackedUInt64(
+                        field: FieldNumber.Sample.locationID,
+                        locationIDs.lazy.map { UInt64($0) }
+                    )
+                    sample.writeProtobufPackedUInt64(
+                        field: FieldNumber.Sample.value,
+                        CollectionOfOne(UInt64(bitPattern: Int64(value)))
+                    )
+                    if isBase {
+                        sample.writeProtobufMessage(field: FieldNumber.Sample.label, scratch: &labelScratch) { label in
+                            label.writeProtobufInt64(field: FieldNumber.Label.key, baseLabelKeyID)
+                            label.writeProtobufInt64(field: FieldNumber.Label.str, trueID)
+                        }
+                    }
+                }
+            }
+        }
+
+        for (index, functionName) in functionNames.enumerated() {
+            let id = UInt64(index + 1)
+            output.writeProtobufMessage(field: FieldNumber.Profile.location, scratch: &messageScratch) { location in
+                location.writeProtobufUInt64(field: FieldNumber.Location.id, id)
+                location.writeProtobufMessage(field: FieldNumber.Location.line, scratch: &labelScratch) {
+                    $0.writeProtobufUInt64(field: FieldNumber.Line.functionID, id)
+                }
+            }
+            output.writeProtobufMessage(field: FieldNumber.Profile.function, scratch: &messageScratch) { function in
+                function.writeProtobufUInt64(field: FieldNumber.Function.id, id)
+                function.writeProtobufInt64(field: FieldNumber.Function.name, stringTable.index(functionName))
+            }
+        }
+
+        stringTable.write(field: FieldNumber.Profile.stringTable, into: &output)
+    }
+}
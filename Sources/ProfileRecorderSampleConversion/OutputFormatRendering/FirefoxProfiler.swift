@@ -0,0 +1,306 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import NIOCore
+
+/// Renders a profile for the [Firefox Profiler](https://profiler.firefox.com) in its Gecko profile format.
+///
+/// Every thread gets its own string, frame and stack tables. Identical stacks share one stack table entry (the stack
+/// table is a prefix tree) and the samples are just `[stack, time]` rows, keeping each sample's timestamp so the
+/// profiler can show a real timeline. The sample rows are rendered as the samples come in, everything else is written
+/// when finalising.
+///
+/// The Gecko format is what Firefox itself hands to the profiler, which then converts it into its internal "processed"
+/// format. That processed format changes with every profiler release, the Gecko format is stable.
+public struct FirefoxProfilerOutputRenderer: ProfileRecorderSampleConversionOutputRenderer {
+    private struct ThreadKey: Hashable, Sendable {
+        var pid: Int
+        var tid: Int
+        var name: SymbolInterner.ID
+    }
+
+    private struct FrameKey: Hashable, Sendable {
+        /// Index into the thread's string table.
+        var location: Int
+        var line: Int?
+    }
+
+    private struct StackKey: Hashable, Sendable {
+        /// Index into the thread's stack table, `nil` for the outermost frame.
+        var prefix: Int?
+        /// Index into the thread's frame table.
+        var frame: Int
+    }
+
+    private struct ThreadTables: Sendable {
+        var key: ThreadKey
+        var stringIndices: [SymbolInterner.ID: Int] = [:]
+        var strings: [SymbolInterner.ID] = []
+        var frameIndices: [FrameKey: Int] = [:]
+        var frames: [FrameKey] = []
+        var stackIndices: [StackKey: Int] = [:]
+        var stacks: [StackKey] = []
+        /// The rendered rows of the samples table, comma separated.
+        var samples = ByteBuffer()
+        var sampleCount = 0
+
+        init(key: ThreadKey) {
+            self.key = key
+        }
+
+        mutating func stringIndex(_ string: SymbolInterner.ID) -> Int {
+            if let index = self.stringIndices[string] {
+                return index
+            }
+            let index = self.strings.count
+            self.strings.append(string)
+            self.stringIndices[string] = index
+            return index
+        }
+
+        mutating func frameIndex(_ frame: InternedStackFrame.SingleFrame) -> Int {
+            let key = FrameKey(location: self.stringIndex(frame.functionName), line: frame.line)
+            if let index = self.frameIndices[key] {
+                return index
+            }
+            let index = self.frames.count
+            self.frames.append(key)
+            self.frameIndices[key] = index
+            return index
+        }
+
+        mutating func stackIndex(prefix: Int?, frame: Int) -> Int {
+            let key = StackKey(prefix: prefix, frame: frame)
+            if let index = self.stackIndices[key] {
+                return index
+            }
+            let index = self.stacks.count
+            self.stacks.append(key)
+            self.stackIndices[key] = index
+            return index
+        }
+    }
+
+    private var threadIndices: [ThreadKey: Int] = [:]
+    private var threads: [ThreadTables] = []
+    /// The time of the first sample, in nanoseconds. The sample times are relative to it.
+    private var startTime: Int? = nil
+
+    public init() {}
+
+    public mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        var output = ByteBuffer()
+        try self.consumeSingleSample(sample, configuration: configuration, symbolizer: symbolizer, into: &output)
+        return output
+    }
+
+    public mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        let time = sample.timeSec * 1_000_000_000 + sample.timeNSec
+        let startTime = self.startTime ?? time
+        self.startTime = startTime
+
+        let key = ThreadKey(pid: sample.pid, tid: sample.tid, name: symbolizer.interner.intern(sample.threadName))
+        let threadIndex: Int
+        if let index = self.threadIndices[key] {
+            threadIndex = index
+        } else {
+            threadIndex = self.threads.count
+            self.threads.append(ThreadTables(key: key))
+            self.threadIndices[key] = threadIndex
+        }
+
+        var stack: Int? = nil
+        // The stack table goes from the outermost frame inwards, that includes the inlined frames.
+        for stackFrame in sample.stack.reversed() {
+            for frame in try symbolizer.symboliseInterned(stackFrame).allFrames.reversed() {
+                let frameIndex = self.threads[threadIndex].frameIndex(frame)
+                stack = self.threads[threadIndex].stackIndex(prefix: stack, frame: frameIndex)
+            }
+        }
+
+        if self.threads[threadIndex].sampleCount > 0 {
+            self.threads[threadIndex].samples.writeStaticString(",")
+        }
+        self.threads[threadIndex].samples.writeStaticString("[")
+        self.threads[threadIndex].samples.writeString(stack.map { String($0) } ?? "null")
+        self.threads[threadIndex].samples.writeStaticString(",")
+        self.threads[threadIndex].samples.writeString(Self.milliseconds(nanoseconds: time - startTime))
+        self.threads[threadIndex].samples.writeStaticString(",0]")
+        self.threads[threadIndex].sampleCount += 1
+    }
+
+    private static func milliseconds(nanoseconds: Int) -> String {
+        return String(Double(nanoseconds) / 1_000_000)
+    }
+
+    public mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        var output = ByteBuffer()
+        try self.finalise(
+            sampleConfiguration: sampleConfiguration,
+            configuration: configuration,
+            symbolizer: symbolizer,
+            into: &output
+        )
+        return output
+    }
+
+    public mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        // Every thread's string table is looked up, so without taking the interner's lock for every string.
+        let strings = symbolizer.interner.strings()
+        let startTime =
+            self.startTime
+            ?? (sampleConfiguration.currentTimeSeconds * 1_000_000_000 + sampleConfiguration.currentTimeNanoseconds)
+
+        output.writeStaticString("{")
+        output.writeJSONKey("meta")
+        output.writeStaticString("{")
+        output.writeJSONKey("version")
+        output.writeStaticString("24,")
+        output.writeJSONKey("product")
+        output.writeStaticString("\"Swift Profile Recorder\",")
+        output.writeJSONKey("startTime")
+        output.writeString(Self.milliseconds(nanoseconds: startTime))
+        output.writeStaticString(",")
+        output.writeJSONKey("shutdownTime")
+        output.writeStaticString("null,")
+        output.writeJSONKey("interval")
+        output.writeString(Self.milliseconds(nanoseconds: sampleConfiguration.microSecondsBetweenSamples * 1_000))
+        output.writeStaticString(",")
+        output.writeJSONKey("stackwalk")
+        output.writeStaticString("1,")
+        output.writeJSONKey("debug")
+        output.writeStaticString("0,")
+        output.writeJSONKey("gcpoison")
+        output.writeStaticString("0,")
+        output.writeJSONKey("asyncstack")
+        output.writeStaticString("0,")
+        output.writeJSONKey("processType")
+        output.writeStaticString("0,")
+        output.writeJSONKey("presymbolicated")
+        output.writeStaticString("true,")
+        output.writeJSONKey("categories")
+        output.writeStaticString(#"[{"name":"Other","color":"grey","subcategories":["Other"]}],"#)
+        output.writeJSONKey("markerSchema")
+        output.writeStaticString("[]")
+        output.writeStaticString("},")
+        output.writeJSONKey("libs")
+        output.writeStaticString("[],")
+        output.writeJSONKey("pausedRanges")
+        output.writeStaticString("[],")
+        output.writeJSONKey("processes")
+        output.writeStaticString("[],")
+
+        output.writeJSONKey("threads")
+        output.writeStaticString("[")
+        for (threadIndex, thread) in self.threads.enumerated() {
+            if threadIndex > 0 {
+                output.writeStaticString(",")
+            }
+            self.writeThread(thread, strings: strings, into: &output)
+        }
+        output.writeStaticString("]}\n")
+
+        self.threadIndices.removeAll()
+        self.threads.removeAll()
+        self.startTime = nil
+    }
+
+    private func writeThread(_ thread: ThreadTables, strings: SymbolInterner.Strings, into output: inout ByteBuffer) {
+        output.writeStaticString("{")
+        output.writeJSONKey("name")
+        output.writeJSONString(strings[thread.key.name])
+        output.writeStaticString(",")
+        output.writeJSONKey("processType")
+        output.writeStaticString("\"default\",")
+        output.writeJSONKey("pid")
+        output.writeString(String(thread.key.pid))
+        output.writeStaticString(",")
+        output.writeJSONKey("tid")
+        output.writeString(String(thread.key.tid))
+        output.writeStaticString(",")
+        output.writeJSONKey("registerTime")
+        output.writeStaticString("0,")
+        output.writeJSONKey("unregisterTime")
+        output.writeStaticString("null,")
+
+        output.writeJSONKey("markers")
+        output.writeStaticString(
+            #"{"schema":{"name":0,"startTime":1,"endTime":2,"phase":3,"category":4,"data":5},"data":[]},"#
+        )
+
+        output.writeJSONKey("samples")
+        output.writeStaticString(#"{"schema":{"stack":0,"time":1,"eventDelay":2},"data":["#)
+        output.writeImmutableBuffer(thread.samples)
+        output.writeStaticString("]},")
+
+        output.writeJSONKey("stackTable")
+        output.writeStaticString(#"{"schema":{"prefix":0,"frame":1},"data":["#)
+        for (index, stack) in thread.stacks.enumerated() {
+            if index > 0 {
+                output.writeStaticString(",")
+            }
+            output.writeStaticString("[")
+            output.writeString(stack.prefix.map { String($0) } ?? "null")
+            output.writeStaticString(",")
+            output.writeString(String(stack.frame))
+            output.writeStaticString("]")
+        }
+        output.writeStaticString("]},")
+
+        output.writeJSONKey("frameTable")
+        output.writeStaticString(
+            #"{"schema":{"location":0,"relevantForJS":1,"innerWindowID":2,"implementation":3,"line":4,"column":5,"#
+        )
+        output.writeStaticString(#""category":6,"subcategory":7},"data":["#)
+        for (index, frame) in thread.frames.enumerated() {
+            if index > 0 {
+                output.writeStaticString(",")
+            }
+            output.writeStaticString("[")
+            output.writeString(String(frame.location))
+            output.writeStaticString(",false,0,null,")
+            output.writeString(frame.line.map { String($0) } ?? "null")
+            output.writeStaticString(",null,0,0]")
+        }
+        output.writeStaticString("]},")
+
+        output.writeJSONKey("stringTable")
+        output.writeStaticString("[")
+        for (index, string) in thread.strings.enumerated() {
+            if index > 0 {
+                output.writeStaticString(",")
+            }
+            output.writeJSONString(strings[string])
+        }
+        output.writeStaticString("]}")
+    }
+}
@@ -12,43 +12,220 @@
 //
 //===----------------------------------------------------------------------===//
 
+
 import NIOCore
 
+/// Renders the collapsed stack format used by flame graph tools: one line per unique stack with its weight.
+///
+/// Identical stacks are aggregated in memory and only written out when finalising, in the order they were first seen.
+/// So the output size scales with the number of unique stacks rather than the number of samples. By default frames are
+/// only told apart by their function, so samples at different instructions of the same functions end up on one line.
 public struct FlamegraphCollapsedOutputRenderer: ProfileRecorderSampleConversionOutputRenderer {
-    public init() {
+    /// What the weight of a stack stands for.
+    public enum Weight: Sendable {
+        /// The number of samples that had the stack.
+        case sampleCount
+        /// The number of samples that had the stack multiplied by the time between samples, in nanoseconds.
+        case nanoseconds
+    }
+
+    private struct StackKey: Hashable, Sendable {
+        /// The interned function names (or rendered frames, with addresses), root first.
+        var frames: [SymbolInterner.ID]
+    }
+
+    private let weight: Weight
+    private let includeAddresses: Bool
+    private var stackIndices: [StackKey: Int] = [:]
+    private var stacks: [StackKey] = []
+    private var sampleCounts: [Int] = []
+
+    /// - parameters:
+    ///   - includeAddresses: Whether to suffix every frame with its address (like `main<1234>`), that gives every
+    ///     instruction its own frame. Off by default, it multiplies the number of unique stacks.
+    public init(weight: Weight = .sampleCount, includeAddresses: Bool = false) {
+        self.weight = weight
+        self.includeAddresses = includeAddresses
     }
 
-    public func consumeSingleSample(
+    public mutating func consumeSingleSample(
         _ sample: Sample,
         configuration: ProfileRecorderSampleConversionConfiguration,
         symbolizer: CachedSymbolizer
     ) throws -> NIOCore.ByteBuffer {
         var output = ByteBuffer()
-        output.reserveCapacity(256 + sample.stack.count * 128)
+        try self.consumeSingleSample(sample, configuration: configuration, symbolizer: symbolizer, into: &output)
+        return output
+    }
 
-        var first = true
-        for stackFrame in sample.stack.reversed() {
-            let framesIncludingInlinedFrames = try symbolizer.symbolise(stackFrame).allFrames.reversed()
-            for frame in framesIncludingInlinedFrames {
-                if !first {
-                    output.writeString(";")
+    public mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        var key = StackKey(frames: [])
+        key.frames.reserveCapacity(sample.stack.count)
+        if self.includeAddresses {
+            let interner = symbolizer.interner
+            for stackFrame in sample.stack.reversed() {
+                let frameID = try symbolizer.renderedFrameID(stackFrame, style: .flamegraphCollapsed) {
+                    frame,
+                    storage in
+                    Self.renderFrame(frame, interner: interner, into: &storage)
+                }
+                if let frameID = frameID {
+                    key.frames.append(frameID)
+                }
+            }
+        } else {
+            for stackFrame in sample.stack.reversed() {
+                for frame in try symbolizer.symboliseInterned(stackFrame).allFrames.reversed() {
+                    key.frames.append(frame.functionName)
                 }
-                output.writeString("\(frame.functionName)<\(String(frame.address, radix: 16))>")
-
-                first = false
             }
         }
-        // Use ns as the weight
-        output.writeString(" \(sample.timeSec * 1_000_000_000 +  sample.timeNSec)\n")
+        self.add(key, count: 1)
+    }
 
-        return output
+    private mutating func add(_ key: StackKey, count: Int) {
+        if let index = self.stackIndices[key] {
+            self.sampleCounts[index] += count
+        } else {
+            self.stackIndices[key] = self.stacks.count
+            self.stacks.append(key)
+            self.sampleCounts.append(count)
+        }
     }
 
-    public func finalise(
+    private static func renderFrame(
+        _ stackFrame: InternedStackFrame,
+        interner: SymbolInterner,
+        into output: inout ByteBuffer
+    ) {
+        var first = true
+        for frame in stackFrame.allFrames.reversed() {
+            if !first {
+                output.writeString(";")
+            }
+            output.writeString("\(interner.string(frame.functionName))<\(String(frame.address, radix: 16))>")
+
+            first = false
+        }
+    }
+
+    public mutating func finalise(
         sampleConfiguration: SampleConfig,
         configuration: ProfileRecorderSampleConversionConfiguration,
         symbolizer: CachedSymbolizer
     ) -> ByteBuffer {
-        return ByteBuffer()
+        var output = ByteBuffer()
+        self.finalise(
+            sampleConfiguration: sampleConfiguration,
+            configuration: configuration,
+            symbolizer: symbolizer,
+            into: &output
+        )
+        return output
+    }
+
+    public mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) {
+        let weightPerSample: Int
+        switch self.weight {
+        case .sampleCount:
+            weightPerSample = 1
+        case .nanoseconds:
+            weightPerSample = sampleConfiguration.microSecondsBetweenSamples * 1_000
+        }
+        self.writeStacks(weightPerSample: weightPerSample, interner: symbolizer.interner, into: &output)
+    }
+
+    /// Writes and forgets the aggregated stacks.
+    private mutating func writeStacks(weightPerSample: Int, interner: SymbolInterner, into output: inout ByteBuffer) {
+        let strings = interner.strings()
+        for (stack, sampleCount) in zip(self.stacks, self.sampleCounts) {
+            var first = true
+            for frameID in stack.frames {
+                if !first {
+                    output.writeString(";")
+                }
+                output.writeString(strings[frameID])
+                first = false
+            }
+            output.writeString(" \(sampleCount * weightPerSample)\n")
+        }
+
+        self.stackIndices.removeAll()
+        self.stacks.removeAll()
+        self.sampleCounts.removeAll()
+    }
+}
+
+extension FlamegraphCollapsedOutputRenderer {
+    /// Writes the samples of `aggregator` with one line per unique stack (across threads), with the frames rendered
+    /// like when consuming samples.
+    ///
+    /// Threads with a ``SampleAggregator/ThreadInfo/source`` get it as an extra outermost frame.
+    static func write(
+        _ aggregator: SampleAggregator,
+        includeAddresses: Bool = false,
+        interner: SymbolInterner,
+        into output: inout ByteBuffer
+    ) {
+        guard includeAddresses else {
+            // The aggregator's locations are addresses, so stacks through the same functions need aggregating again.
+            var renderer = FlamegraphCollapsedOutputRenderer()
+            aggregator.callTree.forEachStack { locationIDs, thread, count in
+                var key = StackKey(frames: [])
+                if let source = thread.source {
+                    key.frames.append(source)
+                }
+                for locationID in locationIDs.reversed() {
+                    for functionID in aggregator.locations[Int(locationID) - 1].functions.reversed() {
+                        key.frames.append(aggregator.functions[functionID - 1].name)
+                    }
+                }
+                renderer.add(key, count: count)
+            }
+            renderer.writeStacks(weightPerSample: 1, interner: interner, into: &output)
+            return
+        }
+
+        // The aggregator has a tree per thread, merge them (but keep the sources apart).
+        var stacks = CallTree()
+        let noName = interner.intern("")
+        aggregator.callTree.forEachStack { locationIDs, thread, count in
+            var node = stacks.root(of: SampleAggregator.ThreadInfo(tid: 0, name: noName, source: thread.source))
+            for locationID in locationIDs.reversed() {
+                node = stacks.child(of: node, location: locationID)
+            }
+            stacks.addSamples(count, at: node)
+        }
+
+        let strings = interner.strings()
+        stacks.forEachStack { locationIDs, thread, count in
+            var first = true
+            if let source = thread.source {
+                output.writeString(strings[source])
+                first = false
+            }
+            for locationID in locationIDs.reversed() {
+                let location = aggregator.locations[Int(locationID) - 1]
+                for functionID in location.functions.reversed() {
+                    if !first {
+                        output.writeString(";")
+                    }
+                    let name = strings[aggregator.functions[functionID - 1].name]
+                    output.writeString("\(name)<\(String(location.address, radix: 16))>")
+                    first = false
+                }
+            }
+            output.writeString(" \(count)\n")
+        }
     }
 }
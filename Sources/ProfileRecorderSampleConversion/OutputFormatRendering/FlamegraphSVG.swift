@@ -0,0 +1,288 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import NIOCore
+
+/// Renders a flame graph as a self-contained SVG, the picture `stackcollapse-perf.pl | flamegraph.pl` would draw.
+///
+/// The stacks of all threads are merged into one call tree which is laid out with the outermost frames at the bottom,
+/// every frame as wide as its share of the samples. Frames narrower than `minimumFrameWidth` pixels are left out
+/// together with everything above them, that bounds the output size no matter how many unique stacks there are.
+/// Hovering over a frame shows its full name and sample count.
+public struct FlamegraphSVGOutputRenderer: ProfileRecorderSampleConversionOutputRenderer {
+    private let writer: FlamegraphSVGWriter
+    /// The merged stacks of all threads, the locations are the interned function names.
+    private var callTree = CallTree()
+
+    /// - parameters:
+    ///   - imageWidth: The width of the SVG, in pixels.
+    ///   - minimumFrameWidth: Frames narrower than this (in pixels) are left out.
+    public init(imageWidth: Int = 1200, minimumFrameWidth: Double = 0.5) {
+        self.writer = FlamegraphSVGWriter(imageWidth: imageWidth, minimumFrameWidth: minimumFrameWidth)
+    }
+
+    public mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        var output = ByteBuffer()
+        try self.consumeSingleSample(sample, configuration: configuration, symbolizer: symbolizer, into: &output)
+        return output
+    }
+
+    public mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        let allThreads = SampleAggregator.ThreadInfo(tid: 0, name: symbolizer.interner.intern("all"))
+        var node = self.callTree.root(of: allThreads)
+        // The tree starts at the outermost frame, that includes the inlined frames.
+        for stackFrame in sample.stack.reversed() {
+            for frame in try symbolizer.symboliseInterned(stackFrame).allFrames.reversed() {
+                node = self.callTree.child(of: node, location: frame.functionName.rawValue)
+            }
+        }
+        self.callTree.addSample(at: node)
+    }
+
+    public mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        var output = ByteBuffer()
+        try self.finalise(
+            sampleConfiguration: sampleConfiguration,
+            configuration: configuration,
+            symbolizer: symbolizer,
+            into: &output
+        )
+        return output
+    }
+
+    public mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        let totals = self.callTree.inclusiveCounts()
+        // There's only the one root, so it's the first node (if there were any samples at all).
+        let totalSamples = totals.first ?? 0
+        self.writer.write(
+            self.callTree,
+            widths: totals,
+            title: "Flame Graph (\(totalSamples) samples)",
+            interner: symbolizer.interner,
+            into: &output
+        ) { node, name in
+            let count = totals[Int(node)]
+            return (
+                details: "\(count) samples, \(FlamegraphSVGWriter.percentage(count, of: totalSamples))%",
+                color: FlamegraphSVGWriter.warmColor(name)
+            )
+        }
+
+        self.callTree = CallTree()
+    }
+}
+
+/// Lays out and writes the SVG of a flame graph, shared by the plain and the differential flame graphs.
+///
+/// The call tree must have a single root (node 0) and its locations must be interned function names.
+internal struct FlamegraphSVGWriter: Sendable {
+    typealias Color = (red: Int, green: Int, blue: Int)
+
+    private enum Layout {
+        static let frameHeight = 16
+        static let fontSize = 12
+        /// The average width of a character, relative to the font size.
+        static let fontWidth = 0.59
+        static let horizontalPadding = 10
+        /// Leaves room for the title.
+        static let topPadding = 40
+        static let bottomPadding = 10
+    }
+
+    private struct PlacedFrame {
+        var node: CallTree.NodeID
+        var name: String
+        var x: Double
+        var depth: Int
+    }
+
+    var imageWidth: Int
+    var minimumFrameWidth: Double
+
+    /// Writes the flame graph of `callTree` to `output`.
+    ///
+    /// - parameters:
+    ///   - widths: What each node's width is proportional to (indexed by node), usually its inclusive sample count.
+    ///   - describe: Returns what to show in a frame's tooltip after its name and the frame's colour.
+    func write(
+        _ callTree: CallTree,
+        widths: [Int],
+        title: String,
+        interner: SymbolInterner,
+        into output: inout ByteBuffer,
+        describe: (_ node: CallTree.NodeID, _ name: String) -> (details: String, color: Color)
+    ) {
+        let (childStarts, children) = callTree.childrenByParent()
+        let strings = interner.strings()
+        let totalWidth = widths.first ?? 0
+        let pixelsPerUnit =
+            totalWidth > 0
+            ? Double(self.imageWidth - 2 * Layout.horizontalPadding) / Double(totalWidth)
+            : 0
+
+        // Lay out the frames that are wide enough, depth first. Narrow frames aren't visited, so the work done here
+        // is bounded by the output size, not the tree size.
+        var frames: [PlacedFrame] = []
+        var pending: [PlacedFrame] = []
+        var maxDepth = 0
+        if totalWidth > 0 {
+            pending.append(PlacedFrame(node: 0, name: "all", x: Double(Layout.horizontalPadding), depth: 0))
+        }
+        var visibleChildren: [PlacedFrame] = []
+        while let frame = pending.popLast() {
+            frames.append(frame)
+            maxDepth = max(maxDepth, frame.depth)
+
+            visibleChildren.removeAll(keepingCapacity: true)
+            for child in children[childStarts[Int(frame.node)]..<childStarts[Int(frame.node) + 1]]
+            where widths[Int(child)] > 0 && Double(widths[Int(child)]) * pixelsPerUnit >= self.minimumFrameWidth {
+                let name = strings[SymbolInterner.ID(rawValue: callTree.locations[Int(child)])]
+                visibleChildren.append(PlacedFrame(node: child, name: name, x: 0, depth: frame.depth + 1))
+            }
+            // Like flamegraph.pl, siblings are in alphabetical order.
+            visibleChildren.sort { $0.name < $1.name }
+            var x = frame.x
+            for var child in visibleChildren {
+                child.x = x
+                x += Double(widths[Int(child.node)]) * pixelsPerUnit
+                pending.append(child)
+            }
+        }
+
+        let imageHeight = Layout.topPadding + (maxDepth + 1) * Layout.frameHeight + Layout.bottomPadding
+        output.writeStaticString(#"<?xml version="1.0" standalone="no"?>"#)
+        output.writeStaticString("\n")
+        output.writeString(
+            #"<svg version="1.1" width="\#(self.imageWidth)" height="\#(imageHeight)" "#
+                + #"viewBox="0 0 \#(self.imageWidth) \#(imageHeight)" xmlns="http://www.w3.org/2000/svg">"#
+        )
+        output.writeStaticString("\n<style>")
+        output.writeString("text { font-family: Verdana, sans-serif; font-size: \(Layout.fontSize)px; fill: #000; }")
+        output.writeStaticString("</style>\n")
+        output.writeStaticString(#"<rect x="0" y="0" width="100%" height="100%" fill="#f8f8f8"/>"#)
+        output.writeStaticString("\n")
+        output.writeString(#"<text x="\#(self.imageWidth / 2)" y="24" text-anchor="middle" style="font-size: 17px">"#)
+        output.writeXMLEscaped(title)
+        output.writeStaticString("</text>\n")
+
+        for frame in frames {
+            let width = Double(widths[Int(frame.node)]) * pixelsPerUnit
+            let y = imageHeight - Layout.bottomPadding - (frame.depth + 1) * Layout.frameHeight
+            let (details, color) = describe(frame.node, frame.name)
+
+            output.writeStaticString("<g><title>")
+            output.writeXMLEscaped(frame.name)
+            output.writeStaticString(" (")
+            output.writeXMLEscaped(details)
+            output.writeStaticString(")</title>")
+            output.writeStaticString(#"<rect x=""#)
+            output.writeSVGNumber(frame.x)
+            output.writeString(#"" y="\#(y)" width=""#)
+            output.writeSVGNumber(width)
+            output.writeString(
+                #"" height="\#(Layout.frameHeight - 1)" fill="rgb(\#(color.red),\#(color.green),\#(color.blue))" "#
+            )
+            output.writeStaticString(#"rx="2" ry="2"/>"#)
+
+            // Only label frames that fit at least a few characters.
+            let maximumCharacters = Int((width - 6) / (Double(Layout.fontSize) * Layout.fontWidth))
+            if maximumCharacters >= 3 {
+                output.writeStaticString(#"<text x=""#)
+                output.writeSVGNumber(frame.x + 3)
+                output.writeString(#"" y="\#(y + Layout.frameHeight - 5)">"#)
+                if frame.name.count <= maximumCharacters {
+                    output.writeXMLEscaped(frame.name)
+                } else {
+                    output.writeXMLEscaped(String(frame.name.prefix(maximumCharacters - 2)))
+                    output.writeStaticString("..")
+                }
+                output.writeStaticString("</text>")
+            }
+            output.writeStaticString("</g>\n")
+        }
+        output.writeStaticString("</svg>\n")
+    }
+
+    /// The percentage that `count` is of `total`, with two decimals.
+    static func percentage(_ count: Int, of total: Int) -> String {
+        guard total > 0 else {
+            return "0.00"
+        }
+        let hundredths = (count * 10_000 + total / 2) / total
+        let fraction = hundredths % 100
+        return "\(hundredths / 100).\(fraction < 10 ? "0" : "")\(fraction)"
+    }
+
+    /// A warm colour derived from `name`, so the same function has the same colour everywhere.
+    static func warmColor(_ name: String) -> Color {
+        // FNV-1a
+        var hash: UInt64 = 0xcbf2_9ce4_8422_2325
+        for byte in name.utf8 {
+            hash ^= UInt64(byte)
+            hash &*= 0x100_0000_01b3
+        }
+        return (
+            red: 205 + Int(hash & 0xff) * 50 / 255,
+            green: Int((hash >> 8) & 0xff) * 230 / 255,
+            blue: Int((hash >> 16) & 0xff) * 55 / 255
+        )
+    }
+}
+
+extension ByteBuffer {
+    /// Writes `string` escaped for use in XML text and attribute values.
+    mutating func writeXMLEscaped(_ string: String) {
+        for byte in string.utf8 {
+            switch byte {
+            case UInt8(ascii: "&"):
+                self.writeStaticString("&amp;")
+            case UInt8(ascii: "<"):
+                self.writeStaticString("&lt;")
+            case UInt8(ascii: ">"):
+                self.writeStaticString("&gt;")
+            case UInt8(ascii: "\""):
+                self.writeStaticString("&quot;")
+            case 0..<0x20:
+                // Control characters aren't allowed in XML (except for whitespace, which we don't want either).
+                self.writeInteger(UInt8(ascii: " "))
+            default:
+                self.writeInteger(byte)
+            }
+        }
+    }
+
+    /// Writes a non-negative `value` rounded to one decimal.
+    fileprivate mutating func writeSVGNumber(_ value: Double) {
+        let tenths = Int((value * 10).rounded())
+        self.writeString("\(tenths / 10).\(tenths % 10)")
+    }
+}
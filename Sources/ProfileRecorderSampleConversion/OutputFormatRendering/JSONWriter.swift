@@ -0,0 +1,63 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import NIOCore
+
+/// Helpers to write JSON straight into a `ByteBuffer`, for the renderers whose output is too large to go through
+/// `Codable` first.
+extension ByteBuffer {
+    /// Writes `string` as a quoted and escaped JSON string.
+    mutating func writeJSONString(_ string: String) {
+        self.writeInteger(UInt8(ascii: "\""))
+        var string = string
+        string.withUTF8 { utf8 in
+            var runStart = 0
+            for index in utf8.indices {
+                let byte = utf8[index]
+                guard byte < 0x20 || byte == UInt8(ascii: "\"") || byte == UInt8(ascii: "\\") else {
+                    continue
+                }
+                self.writeBytes(UnsafeBufferPointer(rebasing: utf8[runStart..<index]))
+                switch byte {
+                case UInt8(ascii: "\""):
+                    self.writeStaticString("\\\"")
+                case UInt8(ascii: "\\"):
+                    self.writeStaticString("\\\\")
+                case UInt8(ascii: "\n"):
+                    self.writeStaticString("\\n")
+                case UInt8(ascii: "\r"):
+                    self.writeStaticString("\\r")
+                case UInt8(ascii: "\t"):
+                    self.writeStaticString("\\t")
+                default:
+                    self.writeStaticString("\\u00")
+                    self.writeInteger(Self.hexDigits[Int(byte >> 4)])
+                    self.writeInteger(Self.hexDigits[Int(byte & 0xf)])
+                }
+                runStart = index + 1
+            }
+            self.writeBytes(UnsafeBufferPointer(rebasing: utf8[runStart...]))
+        }
+        self.writeInteger(UInt8(ascii: "\""))
+    }
+
+    /// Writes `"key":`, `key` must not need escaping.
+    mutating func writeJSONKey(_ key: StaticString) {
+        self.writeInteger(UInt8(ascii: "\""))
+        self.writeStaticString(key)
+        self.writeStaticString("\":")
+    }
+
+    private static let hexDigits: [UInt8] = Array("0123456789abcdef".utf8)
+}
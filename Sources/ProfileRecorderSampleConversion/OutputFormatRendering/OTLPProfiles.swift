@@ -0,0 +1,380 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import NIOCore
+
+/// Renders an OpenTelemetry `ProfilesData` message (`opentelemetry/proto/profiles/v1development/profiles.proto` as of
+/// opentelemetry-proto v1.7.0).
+///
+/// The mappings, locations, functions, attributes and strings live in the `ProfilesDictionary` which the single
+/// profile refers to by index. Samples carry the `thread.id` and `thread.name` attributes, mappings carry the
+/// `process.executable.build_id.gnu` attribute if the `VMAP` record had a build ID.
+///
+/// Like pprof, this is written field by field from the ``SampleAggregator`` in `finalise`.
+public struct OTLPProfilesOutputRenderer: ProfileRecorderSampleConversionOutputRenderer {
+    var aggregator: SampleAggregator = SampleAggregator()
+
+    public init() {}
+
+    public mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        var output = ByteBuffer()
+        try self.consumeSingleSample(sample, configuration: configuration, symbolizer: symbolizer, into: &output)
+        return output
+    }
+
+    public mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        // OTLP profiles are only written out in `finalise`.
+        let symbolisedStack = try sample.stack.map { frame in
+            try symbolizer.symboliseInterned(frame)
+        }
+        let threadInfo = SampleAggregator.ThreadInfo(
+            tid: sample.tid,
+            name: symbolizer.interner.intern(sample.threadName)
+        )
+        self.aggregator.add(symbolisedStack, threadInfo: threadInfo, interner: symbolizer.interner)
+    }
+
+    public mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        var output = ByteBuffer()
+        try self.finalise(
+            sampleConfiguration: sampleConfiguration,
+            configuration: configuration,
+            symbolizer: symbolizer,
+            into: &output
+        )
+        return output
+    }
+
+    /// Writes the `ProfilesData` message field by field, straight from the aggregator.
+    ///
+    /// The profile and the dictionary are each written into a buffer of their own first because the enclosing messages
+    /// need their lengths. The string table is shared by both and is written last, at the end of the dictionary.
+    public mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        let interner = symbolizer.interner
+        var stringTable = ProtobufStringTable(interner: interner)
+        var messageScratch = ByteBuffer()
+        var lineScratch = ByteBuffer()
+
+        // Every table starts with its zero value, so the aggregator's IDs (which start at 1) are the table indices.
+        let threads = self.aggregator.callTree.threads
+        var threadAttributeIndices: [SampleAggregator.ThreadInfo: UInt64] = [:]
+        for (threadIndex, thread) in threads.enumerated() {
+            // `thread.id` and `thread.name` are next to each other.
+            threadAttributeIndices[thread] = UInt64(1 + 2 * threadIndex)
+        }
+        var mappings: [SymbolInterner.MappingID] = []
+        var mappingIndices: [SymbolInterner.MappingID: Int64] = [:]
+        for location in self.aggregator.locations {
+            guard let mapping = location.mapping, mappingIndices[mapping] == nil else {
+                continue
+            }
+            mappings.append(mapping)
+            mappingIndices[mapping] = Int64(mappings.count)
+        }
+
+        var profile = ByteBuffer()
+        profile.writeProtobufMessage(field: FieldNumber.Profile.sampleType, scratch: &messageScratch) { valueType in
+            valueType.writeProtobufInt64(field: FieldNumber.ValueType.typeStrindex, stringTable.index("samples"))
+            valueType.writeProtobufInt64(field: FieldNumber.ValueType.unitStrindex, stringTable.index("count"))
+        }
+        var locationIndices: [UInt64] = []
+        self.aggregator.callTree.forEachStack { locationIDs, threadInfo, count in
+            let locationsStartIndex = locationIndices.count
+            locationIndices.append(contentsOf: locationIDs.lazy.map { UInt64($0) })
+            let threadAttributeIndex = threadAttributeIndices[threadInfo]!
+            profile.writeProtobufMessage(field: FieldNumber.Profile.sample, scratch: &messageScratch) { sample in
+                sample.writeProtobufInt64(field: FieldNumber.Sample.locationsStartIndex, Int64(locationsStartIndex))
+                sample.writeProtobufInt64(field: FieldNumber.Sample.locationsLength, Int64(locationIDs.count))
+                sample.writeProtobufPackedUInt64(
+                    field: FieldNumber.Sample.value,
+                    CollectionOfOne(UInt64(bitPattern: Int64(count)))
+                )
+                sample.writeProtobufPackedUInt64(
+                    field: FieldNumber.Sample.attributeIndices,
+                    [threadAttributeIndex, threadAttributeIndex + 1]
+                )
+            }
+        }
+        profile.writeProtobufPackedUInt64(field: FieldNumber.Profile.locationIndices, locationIndices)
+        profile.writeProtobufInt64(
+            field: FieldNumber.Profile.timeNanos,
+            (Int64(sampleConfiguration.currentTimeSeconds) * 1_000_000_000)
+                + Int64(sampleConfiguration.currentTimeNanoseconds)
+        )
+        profile.writeProtobufInt64(
+            field: FieldNumber.Profile.durationNanos,
+            Int64(sampleConfiguration.sampleCount) * Int64(sampleConfiguration.microSecondsBetweenSamples) * 1_000
+        )
+        profile.writeProtobufMessage(field: FieldNumber.Profile.periodType, scratch: &messageScratch) { valueType in
+            valueType.writeProtobufInt64(field: FieldNumber.ValueType.typeStrindex, stringTable.index("cpu"))
+            valueType.writeProtobufInt64(field: FieldNumber.ValueType.unitStrindex, stringTable.index("nanoseconds"))
+        }
+        profile.writeProtobufInt64(
+            field: FieldNumber.Profile.period,
+            Int64(sampleConfiguration.microSecondsBetweenSamples) * 1_000
+        )
+
+        var dictionary = ByteBuffer()
+        var buildIDs: [String] = []
+        dictionary.writeProtobufLengthDelimitedHeader(field: FieldNumber.Dictionary.mappingTable, length: 0)
+        for mappingID in mappings {
+            let mapping = interner.mapping(mappingID)
+            dictionary.writeProtobufMessage(
+                field: FieldNumber.Dictionary.mappingTable,
+                scratch: &messageScratch
+            ) { outMapping in
+                outMapping.writeProtobufUInt64(
+                    field: FieldNumber.Mapping.memoryStart,
+                    UInt64(mapping.segmentStartAddress)
+                )
+                outMapping.writeProtobufUInt64(
+                    field: FieldNumber.Mapping.memoryLimit,
+                    UInt64(mapping.segmentEndAddress)
+                )
+                // We only know the segment's virtual address in the file, for code segments that's its file offset.
+                outMapping.writeProtobufUInt64(
+                    field: FieldNumber.Mapping.fileOffset,
+                    UInt64(mapping.segmentStartAddress &- mapping.segmentSlide)
+                )
+                outMapping.writeProtobufInt64(
+                    field: FieldNumber.Mapping.filenameStrindex,
+                    stringTable.index(mapping.path)
+                )
+                if let buildID = mapping.buildID {
+                    buildIDs.append(buildID)
+                    outMapping.writeProtobufPackedUInt64(
+                        field: FieldNumber.Mapping.attributeIndices,
+                        CollectionOfOne(UInt64(1 + 2 * threads.count + buildIDs.count - 1))
+                    )
+                }
+            }
+        }
+
+        dictionary.writeProtobufLengthDelimitedHeader(field: FieldNumber.Dictionary.locationTable, length: 0)
+        for location in self.aggregator.locations {
+            dictionary.writeProtobufMessage(
+                field: FieldNumber.Dictionary.locationTable,
+                scratch: &messageScratch
+            ) { outLocation in
+                var address = UInt64(location.address)
+                if let mapping = location.mapping {
+                    outLocation.writeProtobufInt64(field: FieldNumber.Location.mappingIndex, mappingIndices[mapping]!)
+                    // The aggregator has file addresses, OTLP wants them within the mapping's memory range.
+                    address &+= UInt64(interner.mapping(mapping).segmentSlide)
+                }
+                outLocation.writeProtobufUInt64(field: FieldNumber.Location.address, address)
+                for functionID in location.functions {
+                    outLocation.writeProtobufMessage(field: FieldNumber.Location.line, scratch: &lineScratch) {
+                        $0.writeProtobufInt64(field: FieldNumber.Line.functionIndex, Int64(functionID))
+                    }
+                }
+            }
+        }
+
+        dictionary.writeProtobufLengthDelimitedHeader(field: FieldNumber.Dictionary.functionTable, length: 0)
+        for function in self.aggregator.functions {
+            dictionary.writeProtobufMessage(field: FieldNumber.Dictionary.functionTable, scratch: &messageScratch) {
+                $0.writeProtobufInt64(field: FieldNumber.Function.nameStrindex, stringTable.index(function.name))
+            }
+        }
+
+        dictionary.writeProtobufLengthDelimitedHeader(field: FieldNumber.Dictionary.attributeTable, length: 0)
+        for thread in threads {
+            dictionary.writeProtobufMessage(field: FieldNumber.Dictionary.attributeTable, scratch: &messageScratch) {
+                $0.writeOTLPKeyValue(key: "thread.id", intValue: Int64(thread.tid), scratch: &lineScratch)
+            }
+            dictionary.writeProtobufMessage(field: FieldNumber.Dictionary.attributeTable, scratch: &messageScratch) {
+                $0.writeOTLPKeyValue(
+                    key: "thread.name",
+                    stringValue: interner.string(thread.name),
+                    scratch: &lineScratch
+                )
+            }
+        }
+        for buildID in buildIDs {
+            dictionary.writeProtobufMessage(field: FieldNumber.Dictionary.attributeTable, scratch: &messageScratch) {
+                $0.writeOTLPKeyValue(
+                    key: "process.executable.build_id.gnu",
+                    stringValue: buildID,
+                    scratch: &lineScratch
+                )
+            }
+        }
+
+        stringTable.write(field: FieldNumber.Dictionary.stringTable, into: &dictionary)
+
+        var scope = ByteBuffer()
+        scope.writeProtobufRepeatedString(field: FieldNumber.InstrumentationScope.name, "swift-profile-recorder")
+        let scopeProfilesLength =
+            ByteBuffer.protobufLengthDelimitedFieldSize(
+                field: FieldNumber.ScopeProfiles.scope,
+                length: scope.readableBytes
+            )
+            + ByteBuffer.protobufLengthDelimitedFieldSize(
+                field: FieldNumber.ScopeProfiles.profiles,
+                length: profile.readableBytes
+            )
+        output.writeProtobufLengthDelimitedHeader(
+            field: FieldNumber.ProfilesData.resourceProfiles,
+            length: ByteBuffer.protobufLengthDelimitedFieldSize(
+                field: FieldNumber.ResourceProfiles.scopeProfiles,
+                length: scopeProfilesLength
+            )
+        )
+        output.writeProtobufLengthDelimitedHeader(
+            field: FieldNumber.ResourceProfiles.scopeProfiles,
+            length: scopeProfilesLength
+        )
+        output.writeProtobufLengthDelimitedHeader(field: FieldNumber.ScopeProfiles.scope, length: scope.readableBytes)
+        output.writeImmutableBuffer(scope)
+        output.writeProtobufLengthDelimitedHeader(
+            field: FieldNumber.ScopeProfiles.profiles,
+            length: profile.readableBytes
+        )
+        output.writeImmutableBuffer(profile)
+        output.writeProtobufLengthDelimitedHeader(
+            field: FieldNumber.ProfilesData.dictionary,
+            length: dictionary.readableBytes
+        )
+        output.writeImmutableBuffer(dictionary)
+
+        self.aggregator = SampleAggregator()
+    }
+}
+
+extension OTLPProfilesOutputRenderer {
+    /// The field numbers from `profiles.proto` (and `common.proto`) that we write.
+    enum FieldNumber {
+        enum ProfilesData {
+            static let resourceProfiles = 1
+            static let dictionary = 2
+        }
+
+        enum Dictionary {
+            static let mappingTable = 1
+            static let locationTable = 2
+            static let functionTable = 3
+            static let stringTable = 5
+            static let attributeTable = 6
+        }
+
+        enum ResourceProfiles {
+            static let scopeProfiles = 2
+        }
+
+        enum ScopeProfiles {
+            static let scope = 1
+            static let profiles = 2
+        }
+
+        enum InstrumentationScope {
+            static let name = 1
+        }
+
+        enum Profile {
+            static let sampleType = 1
+            static let sample = 2
+            static let locationIndices = 3
+            static let timeNanos = 4
+            static let durationNanos = 5
+            static let periodType = 6
+            static let period = 7
+        }
+
+        enum ValueType {
+            static let typeStrindex = 1
+            static let unitStrindex = 2
+        }
+
+        enum Sample {
+            static let locationsStartIndex = 1
+            static let locationsLength = 2
+            static let value = 3
+            static let attributeIndices = 4
+        }
+
+        enum Mapping {
+            static let memoryStart = 1
+            static let memoryLimit = 2
+            static let fileOffset = 3
+            static let filenameStrindex = 4
+            static let attributeIndices = 5
+        }
+
+        enum Location {
+            static let mappingIndex = 1
+            static let address = 2
+            static let line = 3
+        }
+
+        enum Line {
+            static let functionIndex = 1
+        }
+
+        enum Function {
+            static let nameStrindex = 1
+        }
+
+        enum KeyValue {
+            static let key = 1
+            static let value = 2
+        }
+
+        enum AnyValue {
+            static let stringValue = 1
+            static let intValue = 3
+        }
+    }
+}
+
+extension ByteBuffer {
+    /// Writes the fields of an OTLP `KeyValue` holding a string.
+    fileprivate mutating func writeOTLPKeyValue(key: String, stringValue: String, scratch: inout ByteBuffer) {
+        typealias FieldNumber = OTLPProfilesOutputRenderer.FieldNumber
+        self.writeProtobufRepeatedString(field: FieldNumber.KeyValue.key, key)
+        self.writeProtobufMessage(field: FieldNumber.KeyValue.value, scratch: &scratch) { value in
+            // `AnyValue` is a `oneof`, so the value has to be written even if it's empty.
+            value.writeProtobufRepeatedString(field: FieldNumber.AnyValue.stringValue, stringValue)
+        }
+    }
+
+    /// Writes the fields of an OTLP `KeyValue` holding an integer.
+    fileprivate mutating func writeOTLPKeyValue(key: String, intValue: Int64, scratch: inout ByteBuffer) {
+        typealias FieldNumber = OTLPProfilesOutputRenderer.FieldNumber
+        self.writeProtobufRepeatedString(field: FieldNumber.KeyValue.key, key)
+        self.writeProtobufMessage(field: FieldNumber.KeyValue.value, scratch: &scratch) { value in
+            // `AnyValue` is a `oneof`, so the value has to be written even if it's zero.
+            value.writeProtobufTag(field: FieldNumber.AnyValue.intValue, wireType: .varint)
+            value.writeProtobufVarint(UInt64(bitPattern: intValue))
+        }
+    }
+}
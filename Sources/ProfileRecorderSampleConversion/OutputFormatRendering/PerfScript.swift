@@ -33,7 +33,16 @@ public struct PerfScriptOutputRenderer: ProfileRecorderSampleConversionOutputRen
     ) throws -> ByteBuffer {
         var output = ByteBuffer()
         output.reserveCapacity(256 + sample.stack.count * 128)
+        try self.consumeSingleSample(sample, configuration: configuration, symbolizer: symbolizer, into: &output)
+        return output
+    }
 
+    public func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
         output.writeString(
             """
             \(sample.threadName)-T\(sample.tid)     \
@@ -43,32 +52,49 @@ public struct PerfScriptOutputRenderer: ProfileRecorderSampleConversionOutputRen
 
             """
         )
+        let interner = symbolizer.interner
+        let style = CachedSymbolizer.RenderedFrameStyle.perfScript(
+            includeFileLineInformation: configuration.includeFileLineInformation
+        )
         for stackFrame in sample.stack {
-            let framesIncludingInlinedFrames = try symbolizer.symbolise(stackFrame).allFrames
-            let hasMultiple = framesIncludingInlinedFrames.count > 1
-            for index in framesIncludingInlinedFrames.indices {
-                let symbolicatedFrame = framesIncludingInlinedFrames[index]
-                let isLast = index == framesIncludingInlinedFrames.endIndex - 1
-
-                output.writeString(
-                    """
-                    \t    \
-                    \(String(symbolicatedFrame.address, radix: 16)) \
-                    \(symbolicatedFrame.functionName)\(hasMultiple && !isLast ? " [inlined]" :"")\
-                    +0x\(String(symbolicatedFrame.functionOffset, radix: 16)) \
-                    (\(symbolicatedFrame.library))
-
-                    """
+            try symbolizer.writeRenderedFrame(stackFrame, style: style, into: &output) { frame, storage in
+                Self.renderFrame(
+                    frame,
+                    interner: interner,
+                    includeFileLineInformation: configuration.includeFileLineInformation,
+                    into: &storage
                 )
-                if configuration.includeFileLineInformation,
-                    let file = symbolicatedFrame.file, let line = symbolicatedFrame.line
-                {
-                    output.writeString("  \(file):\(line)\n")
-                }
             }
         }
         output.writeString("\n")
-        return output
+    }
+
+    private static func renderFrame(
+        _ frame: InternedStackFrame,
+        interner: SymbolInterner,
+        includeFileLineInformation: Bool,
+        into output: inout ByteBuffer
+    ) {
+        let framesIncludingInlinedFrames = frame.allFrames
+        let hasMultiple = framesIncludingInlinedFrames.count > 1
+        for index in framesIncludingInlinedFrames.indices {
+            let symbolicatedFrame = framesIncludingInlinedFrames[index]
+            let isLast = index == framesIncludingInlinedFrames.endIndex - 1
+
+            output.writeString(
+                """
+                \t    \
+                \(String(symbolicatedFrame.address, radix: 16)) \
+                \(interner.string(symbolicatedFrame.functionName))\(hasMultiple && !isLast ? " [inlined]" :"")\
+                +0x\(String(symbolicatedFrame.functionOffset, radix: 16)) \
+                (\(interner.string(symbolicatedFrame.library)))
+
+                """
+            )
+            if includeFileLineInformation, let file = symbolicatedFrame.file, let line = symbolicatedFrame.line {
+                output.writeString("  \(interner.string(file)):\(line)\n")
+            }
+        }
     }
 
     public func finalise(
@@ -78,4 +104,12 @@ public struct PerfScriptOutputRenderer: ProfileRecorderSampleConversionOutputRen
     ) -> ByteBuffer {
         return ByteBuffer()
     }
+
+    public func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) {
+    }
 }
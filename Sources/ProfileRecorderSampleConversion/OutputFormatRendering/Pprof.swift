@@ -13,157 +13,219 @@
 //===----------------------------------------------------------------------===//
 
 import NIO
-import ProfileRecorderPprofFormat
-import SwiftProtobuf
 
 public struct PprofOutputRenderer: ProfileRecorderSampleConversionOutputRenderer {
     var aggregator: SampleAggregator = SampleAggregator()
 
     public init() {}
 
+    /// Renders the samples already in `aggregator` (and any that follow).
+    internal init(aggregator: SampleAggregator) {
+        self.aggregator = aggregator
+    }
+
     public mutating func consumeSingleSample(
         _ sample: Sample,
         configuration: ProfileRecorderSampleConversionConfiguration,
         symbolizer: CachedSymbolizer
     ) throws -> ByteBuffer {
         let symbolisedStack = try sample.stack.map { frame in
-            try symbolizer.symbolise(frame)
+            try symbolizer.symboliseInterned(frame)
         }
-        let threadInfo = SampleAggregator.ThreadInfo(tid: sample.tid, name: sample.threadName)
-        self.aggregator.add(symbolisedStack, threadInfo: threadInfo)
+        let threadInfo = SampleAggregator.ThreadInfo(
+            tid: sample.tid,
+            name: symbolizer.interner.intern(sample.threadName)
+        )
+        self.aggregator.add(symbolisedStack, threadInfo: threadInfo, interner: symbolizer.interner)
         return ByteBuffer()
     }
 
+    public mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        // pprof is only written out in `finalise`.
+        _ = try self.consumeSingleSample(sample, configuration: configuration, symbolizer: symbolizer)
+    }
+
     public mutating func finalise(
         sampleConfiguration: SampleConfig,
         configuration: ProfileRecorderSampleConversionConfiguration,
         symbolizer: CachedSymbolizer
     ) throws -> ByteBuffer {
-        var stringTable: [String: StringWithID] = [:]
-        for function in self.aggregator.functions.values {
-            _ = stringTable.addAndGetID(function.name, type: StringWithID.self)
-        }
-        let samplesID = stringTable.addAndGetID("samples", type: StringWithID.self)
-        let countID = stringTable.addAndGetID("count", type: StringWithID.self)
-        let cpuID = stringTable.addAndGetID("cpu", type: StringWithID.self)
-        let nanosecondsID = stringTable.addAndGetID("nanoseconds", type: StringWithID.self)
-
-        // Thread label string table entries
-        let threadIDKeyID = stringTable.addAndGetID("thread_id", type: StringWithID.self)
-        let threadNameKeyID = stringTable.addAndGetID("thread_name", type: StringWithID.self)
-        for sampleKey in self.aggregator.samples.keys {
-            _ = stringTable.addAndGetID(sampleKey.threadInfo.name, type: StringWithID.self)
+        var output = ByteBuffer()
+        try self.finalise(
+            sampleConfiguration: sampleConfiguration,
+            configuration: configuration,
+            symbolizer: symbolizer,
+            into: &output
+        )
+        return output
+    }
+
+    /// Writes the `perftools.profiles.Profile` message field by field, straight from the aggregator.
+    ///
+    /// Protobuf doesn't care about the order of fields, so the string table is built up whilst writing everything else
+    /// and only written at the very end.
+    public mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        var stringTable = ProtobufStringTable(interner: symbolizer.interner)
+        var messageScratch = ByteBuffer()
+        var labelScratch = ByteBuffer()
+
+        let samplesID = stringTable.index("samples")
+        let countID = stringTable.index("count")
+        let cpuID = stringTable.index("cpu")
+        let nanosecondsID = stringTable.index("nanoseconds")
+        let threadIDKeyID = stringTable.index("thread_id")
+        let threadNameKeyID = stringTable.index("thread_name")
+
+        output.writeProtobufMessage(field: FieldNumber.Profile.sampleType, scratch: &messageScratch) { valueType in
+            valueType.writeProtobufInt64(field: FieldNumber.ValueType.type, samplesID)
+            valueType.writeProtobufInt64(field: FieldNumber.ValueType.unit, countID)
         }
 
-        let profile = Perftools_Profiles_Profile.with { profile in
-            profile.location = self.aggregator.locations.values.sorted(by: { $0.id < $1.id }).map { location in
-                .with {
-                    $0.id = UInt64(location.id)
-                    $0.address = UInt64(location.address)
-                    $0.line = location.functions.map { functionID in
-                        .with {
-                            $0.functionID = UInt64(functionID)
-                        }
+        self.aggregator.callTree.forEachStack { locationIDs, threadInfo, count in
+            output.writeProtobufMessage(field: FieldNumber.Profile.sample, scratch: &messageScratch) { sample in
+                sample.writeProtobufPackedUInt64(
+                    field: FieldNumber.Sample.locationID,
+                    locationIDs.lazy.map { UInt64($0) }
+                )
+                sample.writeProtobufPackedUInt64(
+                    field: FieldNumber.Sample.value,
+                    CollectionOfOne(UInt64(bitPattern: Int64(count)))
+                )
+                sample.writeProtobufMessage(field: FieldNumber.Sample.label, scratch: &labelScratch) { label in
+                    label.writeProtobufInt64(field: FieldNumber.Label.key, threadIDKeyID)
+                    label.writeProtobufInt64(field: FieldNumber.Label.num, Int64(threadInfo.tid))
+                }
+                sample.writeProtobufMessage(field: FieldNumber.Sample.label, scratch: &labelScratch) { label in
+                    label.writeProtobufInt64(field: FieldNumber.Label.key, threadNameKeyID)
+                    label.writeProtobufInt64(field: FieldNumber.Label.str, stringTable.index(threadInfo.name))
+                }
+                if let source = threadInfo.source {
+                    sample.writeProtobufMessage(field: FieldNumber.Sample.label, scratch: &labelScratch) { label in
+                        label.writeProtobufInt64(field: FieldNumber.Label.key, stringTable.index("source"))
+                        label.writeProtobufInt64(field: FieldNumber.Label.str, stringTable.index(source))
                     }
                 }
             }
-            profile.function = self.aggregator.functions.values.sorted(by: { $0.id < $1.id }).map { function in
-                .with {
-                    $0.id = UInt64(function.id)
-                    $0.name = Int64(stringTable[function.name]!.id)
+        }
+
+        for location in self.aggregator.locations {
+            output.writeProtobufMessage(field: FieldNumber.Profile.location, scratch: &messageScratch) { outLocation in
+                outLocation.writeProtobufUInt64(field: FieldNumber.Location.id, UInt64(location.id))
+                outLocation.writeProtobufUInt64(field: FieldNumber.Location.address, UInt64(location.address))
+                // Innermost first, the last line is the function the others were inlined into.
+                for (functionID, line) in zip(location.functions, location.lines) {
+                    outLocation.writeProtobufMessage(field: FieldNumber.Location.line, scratch: &labelScratch) {
+                        $0.writeProtobufUInt64(field: FieldNumber.Line.functionID, UInt64(functionID))
+                        $0.writeProtobufInt64(field: FieldNumber.Line.line, Int64(line))
+                    }
                 }
             }
-            profile.sampleType = [
-                .with {
-                    $0.type = Int64(samplesID)
-                    $0.unit = Int64(countID)
-                }
-            ]
-            profile.sample = self.aggregator.samples.map { (sampleKey, count) in
-                Perftools_Profiles_Sample.with { outSample in
-                    outSample.locationID = sampleKey.locationIDs.map { UInt64($0) }
-                    outSample.value = [Int64(count)]
-                    outSample.label = [
-                        Perftools_Profiles_Label.with {
-                            $0.key = Int64(threadIDKeyID)
-                            $0.num = Int64(sampleKey.threadInfo.tid)
-                        },
-                        Perftools_Profiles_Label.with {
-                            if let entry = stringTable[sampleKey.threadInfo.name] {
-                                $0.key = Int64(threadNameKeyID)
-                                $0.str = Int64(entry.id)
-                            } else {
-                                assertionFailure(
-                                    "thread name '\(sampleKey.threadInfo.name)' missing from string table"
-                                )
-                            }
-                        },
-                    ]
+        }
+
+        for function in self.aggregator.functions {
+            output.writeProtobufMessage(field: FieldNumber.Profile.function, scratch: &messageScratch) { outFunction in
+                outFunction.writeProtobufUInt64(field: FieldNumber.Function.id, UInt64(function.id))
+                outFunction.writeProtobufInt64(field: FieldNumber.Function.name, stringTable.index(function.name))
+                if let filename = function.filename {
+                    outFunction.writeProtobufInt64(field: FieldNumber.Function.filename, stringTable.index(filename))
                 }
             }
-            profile.periodType = Perftools_Profiles_ValueType.with {
-                $0.type = Int64(cpuID)
-                $0.unit = Int64(nanosecondsID)
+        }
+
+        /*
+         we are symbolized already...
+        profile.mapping = symbolizer.dynamicLibraryMappings.enumerated().map { (index, vmap) in
+            .with {
+                $0.filename = stringTable.index(vmap.path)
+                $0.id = UInt64(index + 1)
+                $0.memoryStart = UInt64(vmap.segmentStartAddress)
+                $0.memoryLimit = UInt64(vmap.segmentEndAddress)
+                $0.fileOffset = UInt64(vmap.segmentSlide)
             }
-            profile.timeNanos =
-                (Int64(sampleConfiguration.currentTimeSeconds) * 1_000_000_000)
+        }
+         */
+
+        output.writeProtobufInt64(
+            field: FieldNumber.Profile.timeNanos,
+            (Int64(sampleConfiguration.currentTimeSeconds) * 1_000_000_000)
                 + Int64(sampleConfiguration.currentTimeNanoseconds)
-            profile.durationNanos =
-                Int64(sampleConfiguration.sampleCount) * Int64(sampleConfiguration.microSecondsBetweenSamples) * 1_000
-            profile.period = Int64(sampleConfiguration.microSecondsBetweenSamples) * 1_000
-
-            /*
-             we are symbolized already...
-            profile.mapping = symbolizer.dynamicLibraryMappings.enumerated().map { (index, vmap) in
-                .with {
-                    $0.filename = Int64(stringTable.addAndGetID(vmap.path, type: StringWithID.self))
-                    $0.id = UInt64(index + 1)
-                    $0.memoryStart = UInt64(vmap.segmentStartAddress)
-                    $0.memoryLimit = UInt64(vmap.segmentEndAddress)
-                    $0.fileOffset = UInt64(vmap.segmentSlide)
-                }
-            }
-             */
-            profile.stringTable = [""] + stringTable.values.sorted(by: { $0.id < $1.id }).map { $0.value }
+        )
+        output.writeProtobufInt64(
+            field: FieldNumber.Profile.durationNanos,
+            Int64(sampleConfiguration.sampleCount) * Int64(sampleConfiguration.microSecondsBetweenSamples) * 1_000
+        )
+        output.writeProtobufMessage(field: FieldNumber.Profile.periodType, scratch: &messageScratch) { valueType in
+            valueType.writeProtobufInt64(field: FieldNumber.ValueType.type, cpuID)
+            valueType.writeProtobufInt64(field: FieldNumber.ValueType.unit, nanosecondsID)
         }
-        let output: ByteBufferForProto = try profile.serializedBytes()
+        output.writeProtobufInt64(
+            field: FieldNumber.Profile.period,
+            Int64(sampleConfiguration.microSecondsBetweenSamples) * 1_000
+        )
+
+        stringTable.write(field: FieldNumber.Profile.stringTable, into: &output)
 
         self.aggregator = SampleAggregator()
-        return output.bytes
     }
 }
 
-struct StringWithID: HasID {
-    var id: Int
-    var value: String
-
-    func updatingID(_ newID: Int) -> StringWithID {
-        var new = self
-        new.id = newID
-        return new
-    }
-}
+extension PprofOutputRenderer {
+    /// The field numbers from `profile.proto` that we write.
+    enum FieldNumber {
+        enum Profile {
+            static let sampleType = 1
+            static let sample = 2
+            static let location = 4
+            static let function = 5
+            static let stringTable = 6
+            static let timeNanos = 9
+            static let durationNanos = 10
+            static let periodType = 11
+            static let period = 12
+        }
 
-struct ByteBufferForProto: SwiftProtobufContiguousBytes {
-    private(set) var bytes: ByteBuffer
+        enum ValueType {
+            static let type = 1
+            static let unit = 2
+        }
 
-    init(repeating: UInt8, count: Int) {
-        self.bytes = ByteBuffer(repeating: repeating, count: count)
-    }
+        enum Sample {
+            static let locationID = 1
+            static let value = 2
+            static let label = 3
+        }
 
-    init<Bytes>(_ bytes: Bytes) where Bytes: Sequence, Bytes.Element == UInt8 {
-        self.bytes = ByteBuffer(bytes: bytes)
-    }
+        enum Label {
+            static let key = 1
+            static let str = 2
+            static let num = 3
+        }
 
-    var count: Int {
-        return self.bytes.readableBytes
-    }
+        enum Location {
+            static let id = 1
+            static let address = 3
+            static let line = 4
+        }
 
-    func withUnsafeBytes<R>(_ body: (UnsafeRawBufferPointer) throws -> R) rethrows -> R {
-        return try self.bytes.withUnsafeReadableBytes(body)
-    }
+        enum Line {
+            static let functionID = 1
+            static let line = 2
+        }
 
-    mutating func withUnsafeMutableBytes<R>(_ body: (UnsafeMutableRawBufferPointer) throws -> R) rethrows -> R {
-        return try self.bytes.withUnsafeMutableReadableBytes(body)
+        enum Function {
+            static let id = 1
+            static let name = 2
+            static let filename = 4
+        }
     }
 }
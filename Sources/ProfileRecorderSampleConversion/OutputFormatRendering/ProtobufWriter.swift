@@ -0,0 +1,144 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import NIOCore
+
+/// Just enough of the protobuf wire format to write messages field by field, without building them in memory first.
+///
+/// Like proto3 serialisers, the singular scalar field writers omit fields holding the default value (zero).
+extension ByteBuffer {
+    enum ProtobufWireType: UInt64 {
+        case varint = 0
+        case fixed64 = 1
+        case lengthDelimited = 2
+        case fixed32 = 5
+    }
+
+    mutating func writeProtobufVarint(_ value: UInt64) {
+        var value = value
+        while value >= 0x80 {
+            self.writeInteger(UInt8(truncatingIfNeeded: value) | 0x80)
+            value >>= 7
+        }
+        self.writeInteger(UInt8(value))
+    }
+
+    mutating func writeProtobufTag(field: Int, wireType: ProtobufWireType) {
+        self.writeProtobufVarint(UInt64(field) << 3 | wireType.rawValue)
+    }
+
+    mutating func writeProtobufUInt64(field: Int, _ value: UInt64) {
+        guard value != 0 else {
+            return
+        }
+        self.writeProtobufTag(field: field, wireType: .varint)
+        self.writeProtobufVarint(value)
+    }
+
+    mutating func writeProtobufInt64(field: Int, _ value: Int64) {
+        self.writeProtobufUInt64(field: field, UInt64(bitPattern: value))
+    }
+
+    /// Writes one element of a repeated `string` field, unlike the scalar writers this also writes empty strings.
+    mutating func writeProtobufRepeatedString(field: Int, _ value: String) {
+        self.writeProtobufTag(field: field, wireType: .lengthDelimited)
+        self.writeProtobufVarint(UInt64(value.utf8.count))
+        self.writeString(value)
+    }
+
+    mutating func writeProtobufPackedUInt64<Values: Collection>(
+        field: Int,
+        _ values: Values
+    ) where Values.Element == UInt64 {
+        guard !values.isEmpty else {
+            return
+        }
+        var length = 0
+        for value in values {
+            length += Self.protobufVarintSize(value)
+        }
+        self.writeProtobufTag(field: field, wireType: .lengthDelimited)
+        self.writeProtobufVarint(UInt64(length))
+        for value in values {
+            self.writeProtobufVarint(value)
+        }
+    }
+
+    /// Writes an embedded message, `body` writes the message's fields.
+    ///
+    /// The message's length precedes it on the wire, so `body` writes into `scratch` first. Pass the same `scratch`
+    /// buffer for all messages at the same nesting level to reuse its storage.
+    mutating func writeProtobufMessage(
+        field: Int,
+        scratch: inout ByteBuffer,
+        _ body: (inout ByteBuffer) throws -> Void
+    ) rethrows {
+        scratch.clear()
+        try body(&scratch)
+        self.writeProtobufLengthDelimitedHeader(field: field, length: scratch.readableBytes)
+        self.writeImmutableBuffer(scratch)
+    }
+
+    /// Writes the tag and length of a length delimited field, the caller writes the `length` bytes of payload next.
+    mutating func writeProtobufLengthDelimitedHeader(field: Int, length: Int) {
+        self.writeProtobufTag(field: field, wireType: .lengthDelimited)
+        self.writeProtobufVarint(UInt64(length))
+    }
+
+    /// The size of a length delimited field with `length` bytes of payload, including its tag and length.
+    static func protobufLengthDelimitedFieldSize(field: Int, length: Int) -> Int {
+        return Self.protobufVarintSize(UInt64(field) << 3 | ProtobufWireType.lengthDelimited.rawValue)
+            + Self.protobufVarintSize(UInt64(length))
+            + length
+    }
+
+    static func protobufVarintSize(_ value: UInt64) -> Int {
+        // One byte per started group of 7 bits, at least one byte.
+        return ((64 - (value | 1).leadingZeroBitCount) + 6) / 7
+    }
+}
+
+/// A protobuf string table (as used by pprof and OTLP profiles), built up as strings get referenced. The empty string
+/// is always at index 0.
+struct ProtobufStringTable {
+    private let interner: SymbolInterner
+    private var indices: [SymbolInterner.ID: Int64] = [:]
+    private var entries: [SymbolInterner.ID] = []
+
+    init(interner: SymbolInterner) {
+        self.interner = interner
+        _ = self.index("")
+    }
+
+    mutating func index(_ string: String) -> Int64 {
+        return self.index(self.interner.intern(string))
+    }
+
+    mutating func index(_ id: SymbolInterner.ID) -> Int64 {
+        if let index = self.indices[id] {
+            return index
+        }
+        let index = Int64(self.entries.count)
+        self.indices[id] = index
+        self.entries.append(id)
+        return index
+    }
+
+    func write(field: Int, into output: inout ByteBuffer) {
+        let strings = self.interner.strings()
+        for id in self.entries {
+            output.writeProtobufRepeatedString(field: field, strings[id])
+        }
+    }
+}
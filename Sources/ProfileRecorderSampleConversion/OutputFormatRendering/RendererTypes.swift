@@ -37,4 +37,54 @@ public protocol ProfileRecorderSampleConversionOutputRenderer: Sendable {
         configuration: ProfileRecorderSampleConversionConfiguration,
         symbolizer: CachedSymbolizer
     ) throws -> ByteBuffer
+
+    /// Renders `sample` by appending to `output`.
+    ///
+    /// The converter passes the same `output` buffer for all samples and flushes it in large chunks, so implementing
+    /// this avoids allocating (and writing) a buffer per sample. The default implementation appends the result of
+    /// ``consumeSingleSample(_:configuration:symbolizer:)``.
+    @available(*, noasync, message: "blocks the calling thread")
+    mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws
+
+    /// Renders whatever is left by appending to `output`.
+    ///
+    /// The default implementation appends the result of ``finalise(sampleConfiguration:configuration:symbolizer:)``.
+    mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws
+}
+
+extension ProfileRecorderSampleConversionOutputRenderer {
+    @available(*, noasync, message: "blocks the calling thread")
+    public mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        var rendered = try self.consumeSingleSample(sample, configuration: configuration, symbolizer: symbolizer)
+        output.writeBuffer(&rendered)
+    }
+
+    public mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        var rendered = try self.finalise(
+            sampleConfiguration: sampleConfiguration,
+            configuration: configuration,
+            symbolizer: symbolizer
+        )
+        output.writeBuffer(&rendered)
+    }
 }
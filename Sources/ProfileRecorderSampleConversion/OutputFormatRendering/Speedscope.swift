@@ -0,0 +1,198 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import NIOCore
+
+/// Renders speedscope's file format (https://www.speedscope.app/file-format-schema.json) with one "sampled" profile
+/// per thread.
+///
+/// All profiles share one frame table and every unique stack is listed once per thread with its weight, so the output
+/// is much smaller than perf script output and speedscope doesn't need to parse any text. Everything is written when
+/// finalising.
+public struct SpeedscopeOutputRenderer: ProfileRecorderSampleConversionOutputRenderer {
+    private struct FrameKey: Hashable, Sendable {
+        var name: SymbolInterner.ID
+        /// The source file if known, the library otherwise.
+        var file: SymbolInterner.ID
+        var line: Int?
+    }
+
+    private var frameIndices: [FrameKey: UInt32] = [:]
+    private var frames: [FrameKey] = []
+    /// The stacks of all threads, the locations in the tree are indices into `frames`.
+    private var callTree = CallTree()
+
+    public init() {}
+
+    public mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        var output = ByteBuffer()
+        try self.consumeSingleSample(sample, configuration: configuration, symbolizer: symbolizer, into: &output)
+        return output
+    }
+
+    public mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        let thread = SampleAggregator.ThreadInfo(
+            tid: sample.tid,
+            name: symbolizer.interner.intern(sample.threadName)
+        )
+        var node = self.callTree.root(of: thread)
+        // speedscope wants the stacks outermost frame first, that includes the inlined frames.
+        for stackFrame in sample.stack.reversed() {
+            for frame in try symbolizer.symboliseInterned(stackFrame).allFrames.reversed() {
+                node = self.callTree.child(of: node, location: self.frameIndex(frame))
+            }
+        }
+        self.callTree.addSample(at: node)
+    }
+
+    private mutating func frameIndex(_ frame: InternedStackFrame.SingleFrame) -> UInt32 {
+        let key = FrameKey(name: frame.functionName, file: frame.file ?? frame.library, line: frame.line)
+        if let index = self.frameIndices[key] {
+            return index
+        }
+        let index = UInt32(self.frames.count)
+        self.frames.append(key)
+        self.frameIndices[key] = index
+        return index
+    }
+
+    public mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        var output = ByteBuffer()
+        try self.finalise(
+            sampleConfiguration: sampleConfiguration,
+            configuration: configuration,
+            symbolizer: symbolizer,
+            into: &output
+        )
+        return output
+    }
+
+    public mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        into output: inout ByteBuffer
+    ) throws {
+        // Looked up for every frame, so without taking the interner's lock every time.
+        let strings = symbolizer.interner.strings()
+        // Without the time between samples, we can only count samples.
+        let weightPerSample = sampleConfiguration.microSecondsBetweenSamples * 1_000
+        let unit: StaticString = weightPerSample > 0 ? "nanoseconds" : "none"
+
+        output.writeStaticString("{")
+        output.writeJSONKey("$schema")
+        output.writeStaticString("\"https://www.speedscope.app/file-format-schema.json\",")
+        output.writeJSONKey("exporter")
+        output.writeStaticString("\"swift-profile-recorder\",")
+        output.writeJSONKey("name")
+        output.writeStaticString("\"Swift Profile Recorder samples\",")
+        output.writeJSONKey("activeProfileIndex")
+        output.writeStaticString("0,")
+
+        output.writeJSONKey("shared")
+        output.writeStaticString("{")
+        output.writeJSONKey("frames")
+        output.writeStaticString("[")
+        for (index, frame) in self.frames.enumerated() {
+            if index > 0 {
+                output.writeStaticString(",")
+            }
+            output.writeStaticString("{")
+            output.writeJSONKey("name")
+            output.writeJSONString(strings[frame.name])
+            output.writeStaticString(",")
+            output.writeJSONKey("file")
+            output.writeJSONString(strings[frame.file])
+            if let line = frame.line {
+                output.writeStaticString(",")
+                output.writeJSONKey("line")
+                output.writeString(String(line))
+            }
+            output.writeStaticString("}")
+        }
+        output.writeStaticString("]},")
+
+        output.writeJSONKey("profiles")
+        output.writeStaticString("[")
+        var stackFrameIndices: [UInt32] = []
+        for (threadIndex, stacks) in self.callTree.stacksByThread().enumerated() {
+            let thread = self.callTree.threads[threadIndex]
+            if threadIndex > 0 {
+                output.writeStaticString(",")
+            }
+            output.writeStaticString("{")
+            output.writeJSONKey("type")
+            output.writeStaticString("\"sampled\",")
+            output.writeJSONKey("name")
+            output.writeJSONString("\(strings[thread.name])-T\(thread.tid)")
+            output.writeStaticString(",")
+            output.writeJSONKey("unit")
+            output.writeStaticString("\"")
+            output.writeStaticString(unit)
+            output.writeStaticString("\",")
+            output.writeJSONKey("startValue")
+            output.writeStaticString("0,")
+            output.writeJSONKey("endValue")
+            let sampleCount = stacks.reduce(0) { $0 + self.callTree.count(of: $1) }
+            output.writeString(String(sampleCount * max(weightPerSample, 1)))
+            output.writeStaticString(",")
+
+            output.writeJSONKey("samples")
+            output.writeStaticString("[")
+            for (index, node) in stacks.enumerated() {
+                if index > 0 {
+                    output.writeStaticString(",")
+                }
+                output.writeStaticString("[")
+                self.callTree.locationIDs(of: node, into: &stackFrameIndices)
+                for (frameNumber, frameIndex) in stackFrameIndices.reversed().enumerated() {
+                    if frameNumber > 0 {
+                        output.writeStaticString(",")
+                    }
+                    output.writeString(String(frameIndex))
+                }
+                output.writeStaticString("]")
+            }
+            output.writeStaticString("],")
+
+            output.writeJSONKey("weights")
+            output.writeStaticString("[")
+            for (index, node) in stacks.enumerated() {
+                if index > 0 {
+                    output.writeStaticString(",")
+                }
+                output.writeString(String(self.callTree.count(of: node) * max(weightPerSample, 1)))
+            }
+            output.writeStaticString("]}")
+        }
+        output.writeStaticString("]}\n")
+
+        self.frameIndices.removeAll()
+        self.frames.removeAll()
+        self.callTree = CallTree()
+    }
+}
@@ -0,0 +1,221 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import NIO
+import Logging
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import ProfileRecorder
+import ProfileRecorderPprofFormat
+
+/// Compares two captures, a base and a new one, and renders the difference.
+///
+/// Both inputs can be raw Swift Profile Recorder captures (recognised by their leading `[SWIPR]` line) or pprof
+/// profiles (optionally gzip compressed). Raw captures are symbolised through one pool of symbolisers, so captures of
+/// the same process cost barely more to compare than converting one of them.
+///
+/// The supported output formats are
+/// - ``ProfileRecorderOutputFormat/flamegraphCollapsedSymbolized``: collapsed stacks with two counts, base and new,
+/// - ``ProfileRecorderOutputFormat/flamegraphSVGSymbolized``: a differential flame graph,
+/// - ``ProfileRecorderOutputFormat/pprofSymbolized``: pprof with the base samples subtracted (as negative values).
+public struct ProfileRecorderDifferentialConverter: Sendable {
+    let symbolizerConfiguration: SymbolizerConfiguration
+    let threadPool: NIOThreadPool
+    let group: EventLoopGroup
+    let symbolizer: any Symbolizer
+    /// Whether to scale the base capture's sample counts so it has as many samples as the new capture.
+    public var normalizeBaseSampleCount: Bool = true
+    /// How to compress the output, applied to the whole output stream (after rendering).
+    public var outputCompression: ProfileRecorderOutputCompression = .none
+
+    public struct Error: Swift.Error {
+        var message: String
+    }
+
+    public init(
+        config: SymbolizerConfiguration,
+        threadPool: NIOThreadPool = .singleton,
+        group: any EventLoopGroup = .singletonMultiThreadedEventLoopGroup,
+        symbolizer: any Symbolizer
+    ) {
+        self.symbolizerConfiguration = config
+        self.threadPool = threadPool
+        self.group = group
+        self.symbolizer = symbolizer
+    }
+
+    public func convert(
+        baseInputPath: String,
+        newInputPath: String,
+        outputPath toPath: String,
+        format: ProfileRecorderOutputFormat,
+        logger: Logger
+    ) async throws {
+        return try await self.threadPool.runIfActive {
+            try self.convertSync(
+                baseInputPath: baseInputPath,
+                newInputPath: newInputPath,
+                outputPath: toPath,
+                format: format,
+                logger: logger
+            )
+        }
+    }
+
+    @available(*, noasync, message: "blocks calling thread")
+    public func convertSync(
+        baseInputPath: String,
+        newInputPath: String,
+        outputPath toPath: String,
+        format: ProfileRecorderOutputFormat,
+        logger: Logger
+    ) throws {
+        try ProfileRecorderSampleConverter.withOutputFile(toPath) { outputChunkHandler in
+            try self.convertSync(
+                baseInputPath: baseInputPath,
+                newInputPath: newInputPath,
+                format: format,
+                logger: logger,
+                outputChunkHandler: outputChunkHandler
+            )
+        }
+    }
+
+    @available(*, noasync, message: "blocks calling thread")
+    public func convertSync(
+        baseInputPath: String,
+        newInputPath: String,
+        format: ProfileRecorderOutputFormat,
+        logger: Logger,
+        outputChunkHandler: (ByteBuffer) throws -> Void
+    ) throws {
+        switch format {
+        case .flamegraphCollapsedSymbolized, .flamegraphSVGSymbolized, .pprofSymbolized:
+            ()
+        case .perfSymbolized, .speedscopeSymbolized, .firefoxProfilerSymbolized, .otlpProfilesSymbolized, .raw:
+            throw Error(message: "Differential profiles can't be rendered as \(format)")
+        }
+        guard baseInputPath != "-" || newInputPath != "-" else {
+            throw Error(message: "Only one of the inputs can be read from stdin")
+        }
+
+        let symbolizerPool = CachedSymbolizerPool(
+            configuration: self.symbolizerConfiguration,
+            underlyingSymbolizer: self.symbolizer
+        )
+        let interner = symbolizerPool.interner
+        var profile = DifferentialProfile(interner: interner)
+        try self.addSamples(at: baseInputPath, to: .base, of: &profile, symbolizerPool: symbolizerPool, logger: logger)
+        try self.addSamples(at: newInputPath, to: .new, of: &profile, symbolizerPool: symbolizerPool, logger: logger)
+        logger.info(
+            "comparing profiles",
+            metadata: ["base-samples": "\(profile.baseTotal)", "new-samples": "\(profile.newTotal)"]
+        )
+
+        var output = ByteBuffer()
+        switch format {
+        case .flamegraphCollapsedSymbolized:
+            profile.writeCollapsed(normalized: self.normalizeBaseSampleCount, interner: interner, into: &output)
+        case .flamegraphSVGSymbolized:
+            profile.writeFlamegraphSVG(
+                normalized: self.normalizeBaseSampleCount,
+                writer: FlamegraphSVGWriter(imageWidth: 1200, minimumFrameWidth: 0.5),
+                interner: interner,
+                into: &output
+            )
+        case .pprofSymbolized:
+            profile.writePprof(normalized: self.normalizeBaseSampleCount, interner: interner, into: &output)
+        case .perfSymbolized, .speedscopeSymbolized, .firefoxProfilerSymbolized, .otlpProfilesSymbolized, .raw:
+            preconditionFailure("unsupported format \(format) should have been rejected")
+        }
+        try ProfileRecorderSampleConverter.withOutputCompression(self.outputCompression, outputChunkHandler) {
+            try $0(output)
+        }
+    }
+
+    @available(*, noasync, message: "blocks calling thread")
+    private func addSamples(
+        at path: String,
+        to side: DifferentialProfile.Side,
+        of profile: inout DifferentialProfile,
+        symbolizerPool: CachedSymbolizerPool,
+        logger: Logger
+    ) throws {
+        let input = path == "-" ? stdin : fopen(path, "r")
+        guard let input = input else {
+            throw Error(message: "Could not open \(path), errno: \(errno)")
+        }
+        defer {
+            if path != "-" {
+                fclose(input)
+            }
+        }
+
+        let firstByte = getc(input)
+        guard firstByte != EOF else {
+            throw Error(message: "\(path) is empty")
+        }
+        if firstByte == CInt(UInt8(ascii: "[")) {
+            // Raw samples, put the byte back for the converter (which reads stdin through the same FILE).
+            ungetc(firstByte, input)
+            var converter = ProfileRecorderSampleConverter(
+                config: self.symbolizerConfiguration,
+                threadPool: self.threadPool,
+                group: self.group,
+                renderer: DifferentialProfileCollector(profile: profile, side: side),
+                symbolizer: .symbolizer(self.symbolizer)
+            )
+            try converter.convertSync(
+                inputRawProfileRecorderFormatPath: path,
+                underlyingSymbolizer: self.symbolizer,
+                format: .raw,
+                logger: logger,
+                symbolizerPool: symbolizerPool,
+                outputChunkHandler: { _ in }
+            )
+            profile = (converter.renderer as! DifferentialProfileCollector).profile
+            return
+        }
+
+        var bytes = ByteBuffer()
+        bytes.writeInteger(UInt8(truncatingIfNeeded: firstByte))
+        var result = 0
+        repeat {
+            result = bytes.writeWithUnsafeMutableBytes(minimumWritableBytes: 64 * 1024) { ptr in
+                fread(ptr.baseAddress!, 1, ptr.count, input)
+            }
+        } while result > 0
+        guard ferror(input) == 0 else {
+            throw Error(message: "Could not read \(path), errno: \(errno)")
+        }
+        if GzipDecompressor.isGzipCompressed(bytes) {
+            bytes = try GzipDecompressor.decompress(bytes)
+        }
+        let pprof: Perftools_Profiles_Profile
+        do {
+            pprof = try Perftools_Profiles_Profile(serializedBytes: Array(bytes.readableBytesView))
+        } catch {
+            throw Error(message: "\(path) is neither raw Swift Profile Recorder samples nor pprof: \(error)")
+        }
+        try profile.add(
+            pprof,
+            to: side,
+            interner: symbolizerPool.interner,
+            demangleSymbols: self.symbolizerConfiguration.demangleSymbols
+        )
+    }
+}
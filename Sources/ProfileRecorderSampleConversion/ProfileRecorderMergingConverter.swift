@@ -0,0 +1,270 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import NIO
+import NIOConcurrencyHelpers
+import Logging
+import ProfileRecorder
+
+/// Merges the raw captures of many processes (typically replicas running the same build) into one profile.
+///
+/// The inputs are parsed and symbolised in parallel, each worker aggregating its share of the inputs, and the workers'
+/// aggregates are merged at the end. So memory use scales with the number of unique stacks (times the number of
+/// workers), not with the size of the inputs. Symbolisation results are shared by image build ID, so every unique
+/// address of a binary is only symbolised once across all inputs.
+///
+/// The supported output formats are ``ProfileRecorderOutputFormat/pprofSymbolized`` and
+/// ``ProfileRecorderOutputFormat/flamegraphCollapsedSymbolized``.
+public struct ProfileRecorderMergingConverter: Sendable {
+    private struct PartialMerge: Sendable {
+        var aggregator = SampleAggregator()
+        var sampleConfiguration: SampleConfig? = nil
+
+        mutating func merge(_ other: PartialMerge) {
+            self.aggregator.merge(other.aggregator)
+            self.merge(other.sampleConfiguration)
+        }
+
+        /// Records one more capture: the earliest start time wins and the sample counts add up.
+        mutating func merge(_ other: SampleConfig?) {
+            guard var merged = self.sampleConfiguration, let other = other else {
+                self.sampleConfiguration = self.sampleConfiguration ?? other
+                return
+            }
+            if (other.currentTimeSeconds, other.currentTimeNanoseconds)
+                < (merged.currentTimeSeconds, merged.currentTimeNanoseconds)
+            {
+                merged.currentTimeSeconds = other.currentTimeSeconds
+                merged.currentTimeNanoseconds = other.currentTimeNanoseconds
+            }
+            merged.sampleCount += other.sampleCount
+            self.sampleConfiguration = merged
+        }
+    }
+
+    let symbolizerConfiguration: SymbolizerConfiguration
+    let threadPool: NIOThreadPool
+    let group: EventLoopGroup
+    let symbolizer: any Symbolizer
+    /// Whether to label every sample with the path of the input it came from.
+    ///
+    /// In pprof, that's the `source` label, in the collapsed format an extra outermost frame.
+    public var labelSamplesWithSource: Bool = false
+    /// The maximum number of inputs converted at the same time.
+    public var maximumConcurrency: Int = System.coreCount
+    /// How to compress the output, applied to the whole output stream (after rendering).
+    public var outputCompression: ProfileRecorderOutputCompression = .none
+
+    public struct Error: Swift.Error {
+        var message: String
+    }
+
+    public init(
+        config: SymbolizerConfiguration,
+        threadPool: NIOThreadPool = .singleton,
+        group: any EventLoopGroup = .singletonMultiThreadedEventLoopGroup,
+        symbolizer: any Symbolizer
+    ) {
+        self.symbolizerConfiguration = config
+        self.threadPool = threadPool
+        self.group = group
+        self.symbolizer = symbolizer
+    }
+
+    public func convert(
+        inputRawProfileRecorderFormatPaths fromPaths: [String],
+        outputPath toPath: String,
+        format: ProfileRecorderOutputFormat,
+        logger: Logger
+    ) async throws {
+        let (merged, interner) = try await self.merge(fromPaths, format: format, logger: logger)
+        try await self.threadPool.runIfActive {
+            try ProfileRecorderSampleConverter.withOutputFile(toPath) { outputChunkHandler in
+                try self.render(merged, interner: interner, format: format, logger: logger, outputChunkHandler)
+            }
+        }
+    }
+
+    /// Merges the raw samples at `fromPaths` and hands the rendered output to `outputChunkHandler` in chunks.
+    ///
+    /// `outputChunkHandler` is called on a thread of the converter's thread pool.
+    public func convert(
+        inputRawProfileRecorderFormatPaths fromPaths: [String],
+        format: ProfileRecorderOutputFormat,
+        logger: Logger,
+        outputChunkHandler: @Sendable @escaping (ByteBuffer) throws -> Void
+    ) async throws {
+        let (merged, interner) = try await self.merge(fromPaths, format: format, logger: logger)
+        try await self.threadPool.runIfActive {
+            try self.render(merged, interner: interner, format: format, logger: logger, outputChunkHandler)
+        }
+    }
+
+    private func merge(
+        _ fromPaths: [String],
+        format: ProfileRecorderOutputFormat,
+        logger: Logger
+    ) async throws -> (PartialMerge, SymbolInterner) {
+        switch format {
+        case .pprofSymbolized, .flamegraphCollapsedSymbolized:
+            ()
+        case .perfSymbolized, .flamegraphSVGSymbolized, .speedscopeSymbolized, .firefoxProfilerSymbolized,
+            .otlpProfilesSymbolized, .raw:
+            throw Error(message: "Merged profiles can't be rendered as \(format)")
+        }
+        guard !fromPaths.isEmpty else {
+            throw Error(message: "No inputs to merge")
+        }
+        guard fromPaths.filter({ $0 == "-" }).count <= 1 else {
+            throw Error(message: "Only one of the inputs can be read from stdin")
+        }
+
+        let interner = SymbolInterner()
+        let symbolizer = ImageSharingSymbolizer(underlying: self.symbolizer)
+        // The workers take the next input from here until there are none left.
+        let nextInput = NIOLockedValueBox(0)
+        let workerCount = max(1, min(self.maximumConcurrency, fromPaths.count))
+        let merged = try await withThrowingTaskGroup(of: PartialMerge.self) { group in
+            for _ in 0..<workerCount {
+                group.addTask {
+                    try await self.threadPool.runIfActive {
+                        var partialMerge = PartialMerge()
+                        while true {
+                            let index = nextInput.withLockedValue { next in
+                                defer {
+                                    next += 1
+                                }
+                                return next
+                            }
+                            guard index < fromPaths.count else {
+                                break
+                            }
+                            try self.aggregate(
+                                fromPaths[index],
+                                into: &partialMerge,
+                                symbolizer: symbolizer,
+                                interner: interner,
+                                logger: logger
+                            )
+                        }
+                        return partialMerge
+                    }
+                }
+            }
+
+            var merged: PartialMerge? = nil
+            for try await partialMerge in group {
+                if merged == nil {
+                    merged = partialMerge
+                } else {
+                    merged!.merge(partialMerge)
+                }
+            }
+            return merged ?? PartialMerge()
+        }
+        logger.info(
+            "merged profiles",
+            metadata: [
+                "inputs": "\(fromPaths.count)",
+                "workers": "\(workerCount)",
+                "locations": "\(merged.aggregator.locations.count)",
+                "call-tree-nodes": "\(merged.aggregator.callTree.nodeCount)",
+                "sym": "\(symbolizer)",
+            ]
+        )
+        return (merged, interner)
+    }
+
+    @available(*, noasync, message: "blocks calling thread")
+    private func aggregate(
+        _ fromPath: String,
+        into partialMerge: inout PartialMerge,
+        symbolizer: ImageSharingSymbolizer,
+        interner: SymbolInterner,
+        logger: Logger
+    ) throws {
+        var converter = ProfileRecorderSampleConverter(
+            config: self.symbolizerConfiguration,
+            threadPool: self.threadPool,
+            group: self.group,
+            renderer: SampleAggregatorCollector(
+                aggregator: partialMerge.aggregator,
+                source: self.labelSamplesWithSource ? interner.intern(fromPath) : nil
+            ),
+            symbolizer: .symbolizer(symbolizer)
+        )
+        // The converter holds the only reference now, so the aggregator isn't copied when it's mutated.
+        partialMerge.aggregator = SampleAggregator()
+        try converter.convertSync(
+            inputRawProfileRecorderFormatPath: fromPath,
+            underlyingSymbolizer: symbolizer,
+            format: .raw,
+            logger: logger,
+            // A pool for this input only, the symbolisers cache by instruction pointer which is only meaningful in
+            // one process. It's the `ImageSharingSymbolizer` that shares the results across inputs.
+            symbolizerPool: CachedSymbolizerPool(
+                configuration: self.symbolizerConfiguration,
+                underlyingSymbolizer: symbolizer,
+                interner: interner
+            ),
+            outputChunkHandler: { _ in }
+        )
+        let collector = converter.renderer as! SampleAggregatorCollector
+        partialMerge.aggregator = collector.aggregator
+        partialMerge.merge(collector.sampleConfiguration)
+    }
+
+    @available(*, noasync, message: "blocks calling thread")
+    private func render(
+        _ merged: PartialMerge,
+        interner: SymbolInterner,
+        format: ProfileRecorderOutputFormat,
+        logger: Logger,
+        _ outputChunkHandler: (ByteBuffer) throws -> Void
+    ) throws {
+        var output = ByteBuffer()
+        switch format {
+        case .pprofSymbolized:
+            var renderer = PprofOutputRenderer(aggregator: merged.aggregator)
+            try renderer.finalise(
+                sampleConfiguration: merged.sampleConfiguration
+                    ?? SampleConfig(
+                        currentTimeSeconds: 0,
+                        currentTimeNanoseconds: 0,
+                        microSecondsBetweenSamples: 1,
+                        sampleCount: 0
+                    ),
+                configuration: .default,
+                // Only used for its interner, everything's symbolised already.
+                symbolizer: CachedSymbolizer(
+                    configuration: .default,
+                    symbolizer: self.symbolizer,
+                    dynamicLibraryMappings: [],
+                    interner: interner,
+                    group: self.group,
+                    logger: logger
+                ),
+                into: &output
+            )
+        case .flamegraphCollapsedSymbolized:
+            FlamegraphCollapsedOutputRenderer.write(merged.aggregator, interner: interner, into: &output)
+        case .perfSymbolized, .flamegraphSVGSymbolized, .speedscopeSymbolized, .firefoxProfilerSymbolized,
+            .otlpProfilesSymbolized, .raw:
+            preconditionFailure("unsupported format \(format) should have been rejected")
+        }
+        try ProfileRecorderSampleConverter.withOutputCompression(self.outputCompression, outputChunkHandler) {
+            try $0(output)
+        }
+    }
+}
@@ -27,6 +27,8 @@ public struct ProfileRecorderSampleConverter: Sendable {
     let threadPool: NIOThreadPool
     let group: EventLoopGroup
     let symbolizer: SymbolizerMaker
+    /// How to compress the output, applied to the whole output stream (after rendering).
+    public var outputCompression: ProfileRecorderOutputCompression = .none
 
     public struct Error: Swift.Error {
         var message: String
@@ -102,6 +104,28 @@ public struct ProfileRecorderSampleConverter: Sendable {
         }
     }
 
+    /// Converts the raw samples at `fromPath` and hands the rendered output to `outputChunkHandler` in chunks.
+    ///
+    /// This allows streaming the output somewhere other than a file (for example an HTTP response). The chunks are
+    /// handed over as the internal output buffer fills up, `outputChunkHandler` is called on a thread of the
+    /// converter's thread pool and may block it to apply backpressure.
+    public func convert(
+        inputRawProfileRecorderFormatPath fromPath: String,
+        format: ProfileRecorderOutputFormat,
+        logger: Logger,
+        outputChunkHandler: @Sendable @escaping (ByteBuffer) throws -> Void
+    ) async throws {
+        return try await self.threadPool.runIfActive {
+            var `self` = self
+            try self.convertSync(
+                inputRawProfileRecorderFormatPath: fromPath,
+                format: format,
+                logger: logger,
+                outputChunkHandler: outputChunkHandler
+            )
+        }
+    }
+
     @available(*, noasync, message: "blocks calling thread")
     public mutating func convertSync(
         inputRawProfileRecorderFormatPath fromPath: String,
@@ -109,38 +133,120 @@ public struct ProfileRecorderSampleConverter: Sendable {
         format: ProfileRecorderOutputFormat,
         logger: Logger
     ) throws {
-        switch self.symbolizer {
-        case .symbolizer(let symbolizer):
-            return try self.convertSync(
+        try Self.withOutputFile(toPath) { outputChunkHandler in
+            try self.convertSync(
                 inputRawProfileRecorderFormatPath: fromPath,
-                outputPath: toPath,
-                underlyingSymbolizer: symbolizer,
                 format: format,
-                logger: logger
+                logger: logger,
+                outputChunkHandler: outputChunkHandler
             )
-        case .maker(let maker):
-            let symbolizer = try maker()
-            try symbolizer.start()
-            defer {
-                try! symbolizer.shutdown()
+        }
+    }
+
+    /// Runs `body` with an output chunk handler that writes the chunks to the file at `toPath` (`-` for stdout).
+    @available(*, noasync, message: "blocks calling thread")
+    internal static func withOutputFile(
+        _ toPath: String,
+        _ body: ((ByteBuffer) throws -> Void) throws -> Void
+    ) throws {
+        let output = toPath == "-" ? stdout : fopen(toPath, "w")
+        guard let output = output else {
+            throw Error(message: "Could not open \(toPath), errno: \(errno)")
+        }
+        defer {
+            if toPath != "-" {
+                fclose(output)
             }
-            return try self.convertSync(
-                inputRawProfileRecorderFormatPath: fromPath,
-                outputPath: toPath,
-                underlyingSymbolizer: symbolizer,
-                format: format,
-                logger: logger
-            )
+        }
+        let outputFD = fileno(output)
+        try body { chunk in
+            try chunk.withUnsafeReadableBytes { chunkPtr in
+                var written = 0
+                while written < chunkPtr.count {
+                    let result = write(outputFD, chunkPtr.baseAddress! + written, chunkPtr.count - written)
+                    if result < 0 {
+                        if errno == EINTR {
+                            continue
+                        }
+                        throw Error(message: "Could not write to \(toPath), errno: \(errno)")
+                    }
+                    written += result
+                }
+            }
+        }
+    }
+
+    @available(*, noasync, message: "blocks calling thread")
+    public mutating func convertSync(
+        inputRawProfileRecorderFormatPath fromPath: String,
+        format: ProfileRecorderOutputFormat,
+        logger: Logger,
+        outputChunkHandler: (ByteBuffer) throws -> Void
+    ) throws {
+        try Self.withOutputCompression(self.outputCompression, outputChunkHandler) { outputChunkHandler in
+            switch self.symbolizer {
+            case .symbolizer(let symbolizer):
+                return try self.convertSync(
+                    inputRawProfileRecorderFormatPath: fromPath,
+                    underlyingSymbolizer: symbolizer,
+                    format: format,
+                    logger: logger,
+                    outputChunkHandler: outputChunkHandler
+                )
+            case .maker(let maker):
+                let symbolizer = try maker()
+                try symbolizer.start()
+                defer {
+                    try! symbolizer.shutdown()
+                }
+                return try self.convertSync(
+                    inputRawProfileRecorderFormatPath: fromPath,
+                    underlyingSymbolizer: symbolizer,
+                    format: format,
+                    logger: logger,
+                    outputChunkHandler: outputChunkHandler
+                )
+            }
+        }
+    }
+
+    /// Runs `body` with an output chunk handler that compresses the chunks before passing them to
+    /// `outputChunkHandler`.
+    internal static func withOutputCompression(
+        _ compression: ProfileRecorderOutputCompression,
+        _ outputChunkHandler: (ByteBuffer) throws -> Void,
+        _ body: ((ByteBuffer) throws -> Void) throws -> Void
+    ) throws {
+        switch compression {
+        case .none:
+            try body(outputChunkHandler)
+        case .gzip:
+            let compressor = try GzipCompressor()
+            var compressed = ByteBuffer()
+            try body { chunk in
+                compressed.clear()
+                try compressor.compress(chunk, into: &compressed)
+                if compressed.readableBytes > 0 {
+                    try outputChunkHandler(compressed)
+                }
+            }
+            compressed.clear()
+            try compressor.finish(into: &compressed)
+            try outputChunkHandler(compressed)
         }
     }
 
+    /// - parameters:
+    ///   - symbolizerPool: Where to get the symbolisers from, pass the same pool to several conversions to share the
+    ///     interner and the symbolisation results between them. If `nil`, this conversion uses its own.
     @available(*, noasync, message: "blocks calling thread")
     internal mutating func convertSync(
         inputRawProfileRecorderFormatPath fromPath: String,
-        outputPath toPath: String,
         underlyingSymbolizer: any Symbolizer,
         format: ProfileRecorderOutputFormat,
-        logger: Logger
+        logger: Logger,
+        symbolizerPool: CachedSymbolizerPool? = nil,
+        outputChunkHandler: (ByteBuffer) throws -> Void
     ) throws {
         var accumulatedErrors: [any Swift.Error] = []
         do {
@@ -153,15 +259,7 @@ public struct ProfileRecorderSampleConverter: Sendable {
                     fclose(input)
                 }
             }
-            let output = toPath == "-" ? stdout : fopen(toPath, "w")
-            guard let output = output else {
-                throw Error(message: "Could not open \(toPath), errno: \(errno)")
-            }
-            defer {
-                if toPath != "-" {
-                    fclose(output)
-                }
-            }
+            var output = BufferedOutputWriter()
             let decoder = JSONDecoder()
 
             var config = ProfileRecorderSampleConversionConfiguration.default
@@ -184,18 +282,31 @@ public struct ProfileRecorderSampleConverter: Sendable {
                 buffer!.deallocate()
             }
 
+            // Shared by all the symbolisers we create below so renderers can keep using the interned frames across
+            // changes of the dynamic library mappings.
+            let interner = symbolizerPool?.interner ?? SymbolInterner()
             var symboliser: CachedSymbolizer? = nil
+            // Samples waiting to be symbolised in one batch, see `SymbolizerConfiguration.symbolisationBatchSize`.
+            var pendingSamples = PendingSampleBatch()
             defer {
                 if let symboliser = symboliser {
                     do {
-                        let renderedSample = try self.renderer.finalise(
+                        try self.consumeSamples(
+                            &pendingSamples,
+                            configuration: config,
+                            symbolizer: symboliser,
+                            output: &output,
+                            accumulatedErrors: &accumulatedErrors,
+                            logger: logger,
+                            outputChunkHandler: outputChunkHandler
+                        )
+                        try self.renderer.finalise(
                             sampleConfiguration: sampleConfig,
                             configuration: config,
-                            symbolizer: symboliser
+                            symbolizer: symboliser,
+                            into: &output.buffer
                         )
-                        renderedSample.withUnsafeReadableBytes { renderedPtr in
-                            _ = fwrite(renderedPtr.baseAddress, 1, renderedPtr.count, output)
-                        }
+                        try output.flush(to: outputChunkHandler)
                         logger.info("done symbolising", metadata: ["cached-sym": "\(symboliser.description)"])
                     } catch {
                         accumulatedErrors.append(error)
@@ -271,6 +382,18 @@ public struct ProfileRecorderSampleConverter: Sendable {
                     }
 
                     if vmapsRead {
+                        if let symboliser = symboliser {
+                            // The pending samples belong to the old mappings.
+                            try self.consumeSamples(
+                                &pendingSamples,
+                                configuration: config,
+                                symbolizer: symboliser,
+                                output: &output,
+                                accumulatedErrors: &accumulatedErrors,
+                                logger: logger,
+                                outputChunkHandler: outputChunkHandler
+                            )
+                        }
                         symboliser = nil
                         vmaps.removeAll()
                         vmapsRead = false
@@ -279,13 +402,18 @@ public struct ProfileRecorderSampleConverter: Sendable {
                 case "SMPL":
                     vmapsRead = true
                     if symboliser == nil {
-                        symboliser = CachedSymbolizer(
-                            configuration: .default,
-                            symbolizer: underlyingSymbolizer,
-                            dynamicLibraryMappings: vmaps,
-                            group: group,
-                            logger: logger
-                        )
+                        if let symbolizerPool = symbolizerPool {
+                            symboliser = symbolizerPool.symbolizer(for: vmaps, group: self.group, logger: logger)
+                        } else {
+                            symboliser = CachedSymbolizer(
+                                configuration: self.symbolizerConfiguration,
+                                symbolizer: underlyingSymbolizer,
+                                dynamicLibraryMappings: vmaps,
+                                interner: interner,
+                                group: group,
+                                logger: logger
+                            )
+                        }
                     }
                     guard
                         let header = try? decoder.decode(
@@ -320,36 +448,48 @@ public struct ProfileRecorderSampleConverter: Sendable {
                     currentSample?.stack.append(stackFrame)
                 case "DONE":
                     if let sample = currentSample, let symbolizer = symboliser {
-                        do {
-                            var sample = sample
-                            sample.stack = sample.stack.dropFirst().map { frame in
-                                // We would have received the instruction pointer just _behind_ the actual instruction,
-                                // so to accurately get the right frame, we need to get the intruction prior. On ARM
-                                // that's easy (subtract 4) but on Intel that's impossible so we just subtract 1
-                                // instead.
-                                var fixedUpStackFrame = frame
-                                if fixedUpStackFrame.instructionPointer >= 4 {
-                                    #if arch(arm) || arch(arm64)
-                                    // Known fixed-width instruction format
-                                    fixedUpStackFrame.instructionPointer -= 4
-                                    #else
-                                    // Unknown, subtract 1
-                                    fixedUpStackFrame.instructionPointer -= 1
-                                    #endif
-                                }
-
-                                return fixedUpStackFrame
+                        var sample = sample
+                        sample.stack = sample.stack.dropFirst().map { frame in
+                            // We would have received the instruction pointer just _behind_ the actual instruction,
+                            // so to accurately get the right frame, we need to get the intruction prior. On ARM
+                            // that's easy (subtract 4) but on Intel that's impossible so we just subtract 1
+                            // instead.
+                            var fixedUpStackFrame = frame
+                            if fixedUpStackFrame.instructionPointer >= 4 {
+                                #if arch(arm) || arch(arm64)
+                                // Known fixed-width instruction format
+                                fixedUpStackFrame.instructionPointer -= 4
+                                #else
+                                // Unknown, subtract 1
+                                fixedUpStackFrame.instructionPointer -= 1
+                                #endif
                             }
-                            let renderedSample = try self.renderer.consumeSingleSample(
+
+                            return fixedUpStackFrame
+                        }
+                        if self.symbolizerConfiguration.symbolisationBatchSize == 0 {
+                            // Not batching, render straight away.
+                            try self.consumeSample(
                                 sample,
                                 configuration: config,
-                                symbolizer: symbolizer
+                                symbolizer: symbolizer,
+                                output: &output,
+                                accumulatedErrors: &accumulatedErrors,
+                                outputChunkHandler: outputChunkHandler
                             )
-                            renderedSample.withUnsafeReadableBytes { renderedPtr in
-                                _ = fwrite(renderedPtr.baseAddress, 1, renderedPtr.count, output)
+                        } else {
+                            pendingSamples.append(sample)
+                            if pendingSamples.frameCount >= self.symbolizerConfiguration.symbolisationBatchSize {
+                                try self.consumeSamples(
+                                    &pendingSamples,
+                                    configuration: config,
+                                    symbolizer: symbolizer,
+                                    output: &output,
+                                    accumulatedErrors: &accumulatedErrors,
+                                    logger: logger,
+                                    outputChunkHandler: outputChunkHandler
+                                )
                             }
-                        } catch {
-                            accumulatedErrors.append(error)
                         }
                     }
                 default:
@@ -367,4 +507,155 @@ public struct ProfileRecorderSampleConverter: Sendable {
             throw firstError
         }
     }
+
+    /// Renders the samples of `pendingSamples` and empties it, symbolising the new addresses of all of them in one
+    /// batch first.
+    @available(*, noasync, message: "blocks calling thread")
+    private mutating func consumeSamples(
+        _ pendingSamples: inout PendingSampleBatch,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        output: inout BufferedOutputWriter,
+        accumulatedErrors: inout [any Swift.Error],
+        logger: Logger,
+        outputChunkHandler: (ByteBuffer) throws -> Void
+    ) throws {
+        defer {
+            pendingSamples.removeAll()
+        }
+        if !pendingSamples.samples.isEmpty {
+            do {
+                try symbolizer.prefetch(pendingSamples.samples.lazy.flatMap { $0.stack })
+            } catch {
+                // Not fatal, the frames are symbolised one by one when they're rendered.
+                logger.warning("batch symbolisation failed", metadata: ["error": "\(error)"])
+            }
+        }
+        for sample in pendingSamples.samples {
+            try self.consumeSample(
+                sample,
+                configuration: configuration,
+                symbolizer: symbolizer,
+                output: &output,
+                accumulatedErrors: &accumulatedErrors,
+                outputChunkHandler: outputChunkHandler
+            )
+        }
+    }
+
+    /// Renders `sample`, symbolising its frames as needed.
+    @available(*, noasync, message: "blocks calling thread")
+    private mutating func consumeSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer,
+        output: inout BufferedOutputWriter,
+        accumulatedErrors: inout [any Swift.Error],
+        outputChunkHandler: (ByteBuffer) throws -> Void
+    ) throws {
+        let writerIndex = output.buffer.writerIndex
+        do {
+            try self.renderer.consumeSingleSample(
+                sample,
+                configuration: configuration,
+                symbolizer: symbolizer,
+                into: &output.buffer
+            )
+        } catch {
+            // Don't leave half a sample behind, the output is shared with the other samples.
+            output.buffer.moveWriterIndex(to: writerIndex)
+            accumulatedErrors.append(error)
+        }
+        // Not caught, there's no point carrying on if we can't get rid of the output.
+        try output.flushIfFull(to: outputChunkHandler)
+    }
+}
+
+/// The samples collected for the next symbolisation batch.
+internal struct PendingSampleBatch {
+    private(set) var samples: [Sample] = []
+    /// The total number of stack frames in `samples`.
+    private(set) var frameCount = 0
+
+    mutating func append(_ sample: Sample) {
+        self.samples.append(sample)
+        self.frameCount += sample.stack.count
+    }
+
+    /// Empties the batch, keeping its capacity for the next one.
+    mutating func removeAll() {
+        self.samples.removeAll(keepingCapacity: true)
+        self.frameCount = 0
+    }
+}
+
+/// Hands out one ``CachedSymbolizer`` per set of dynamic library mappings, all sharing one interner.
+///
+/// Converting several captures of the same process with one pool symbolises every address only once. Captures of
+/// different processes (with different mappings) still share the underlying symboliser and its loaded debug info.
+internal final class CachedSymbolizerPool {
+    let interner: SymbolInterner
+    private let configuration: SymbolizerConfiguration
+    private let underlyingSymbolizer: any Symbolizer
+    private var symbolizers: [[DynamicLibMapping]: CachedSymbolizer] = [:]
+
+    init(
+        configuration: SymbolizerConfiguration = .default,
+        underlyingSymbolizer: any Symbolizer,
+        interner: SymbolInterner = SymbolInterner()
+    ) {
+        self.configuration = configuration
+        self.underlyingSymbolizer = underlyingSymbolizer
+        self.interner = interner
+    }
+
+    func symbolizer(
+        for dynamicLibraryMappings: [DynamicLibMapping],
+        group: any EventLoopGroup,
+        logger: Logger
+    ) -> CachedSymbolizer {
+        if let symbolizer = self.symbolizers[dynamicLibraryMappings] {
+            return symbolizer
+        }
+        let symbolizer = CachedSymbolizer(
+            configuration: self.configuration,
+            symbolizer: self.underlyingSymbolizer,
+            dynamicLibraryMappings: dynamicLibraryMappings,
+            interner: self.interner,
+            group: group,
+            logger: logger
+        )
+        self.symbolizers[dynamicLibraryMappings] = symbolizer
+        return symbolizer
+    }
+}
+
+/// Collects the rendered output of a conversion so it can be handed on in large chunks.
+internal struct BufferedOutputWriter {
+    static let defaultFlushThreshold = 1024 * 1024
+
+    var buffer: ByteBuffer
+    private let flushThreshold: Int
+
+    init(flushThreshold: Int = BufferedOutputWriter.defaultFlushThreshold) {
+        self.flushThreshold = flushThreshold
+        self.buffer = ByteBuffer()
+        // A little extra so a sample rendered right below the threshold doesn't need to reallocate.
+        self.buffer.reserveCapacity(flushThreshold + flushThreshold / 4)
+    }
+
+    mutating func flushIfFull(to outputChunkHandler: (ByteBuffer) throws -> Void) throws {
+        if self.buffer.readableBytes >= self.flushThreshold {
+            try self.flush(to: outputChunkHandler)
+        }
+    }
+
+    mutating func flush(to outputChunkHandler: (ByteBuffer) throws -> Void) throws {
+        guard self.buffer.readableBytes > 0 else {
+            return
+        }
+        try outputChunkHandler(self.buffer)
+        // If the handler held on to the chunk, the next write reallocates. Otherwise we reuse the storage.
+        self.buffer.clear()
+    }
 }
@@ -12,100 +12,173 @@
 //
 //===----------------------------------------------------------------------===//
 
+import NIOCore
+
 struct SampleAggregator: Sendable {
     struct Location: Sendable {
         var id: Int
         var address: UInt
+        var mapping: SymbolInterner.MappingID?
+        /// The image of `mapping`, see ``SymbolInterner/image(of:)``.
+        var image: SymbolInterner.ImageID?
         var functions: [Int]
+        /// The source line of every entry in `functions`, 0 if unknown.
+        var lines: [Int]
     }
 
-    struct Function: Sendable & HasID {
+    struct Function: Sendable {
         var id: Int
-        var name: String
-
-        init(id: Int, name: String) {
-            self.id = id
-            self.name = name
-        }
-
-        init(id: Int, value: String) {
-            self = .init(id: id, name: value)
-        }
-
-        var value: String {
-            return self.name
-        }
-
-        func updatingID(_ newID: Int) -> Self {
-            var new = self
-            new.id = newID
-            return new
-        }
+        var name: SymbolInterner.ID
+        /// The source file, from the first frame of the function that had one.
+        var filename: SymbolInterner.ID?
     }
 
     struct ThreadInfo: Sendable, Hashable {
         var tid: Int
-        var name: String
-    }
-
-    struct SampleKey: Sendable, Hashable {
-        var locationIDs: [Int]
-        var threadInfo: ThreadInfo
+        var name: SymbolInterner.ID
+        /// Where the samples came from when merging several captures, `nil` if not labelled.
+        var source: SymbolInterner.ID? = nil
     }
 
-    var locations: [UInt: Location] = [:]
-    var functions: [String: Function] = [:]
-    var samples: [SampleKey: Int] = [:]
-
-    mutating func add(_ sample: [SymbolisedStackFrame], threadInfo: ThreadInfo) {
-        let locationIDs = self.resolveLocationIDs(sample)
-        let key = SampleKey(locationIDs: locationIDs, threadInfo: threadInfo)
-        self.samples[key, default: 0] += 1
+    /// Locations are the same if they're at the same file address of the same image.
+    struct LocationKey: Sendable, Hashable {
+        var image: SymbolInterner.ImageID?
+        var address: UInt
     }
 
-    private mutating func resolveLocationIDs(_ sample: [SymbolisedStackFrame]) -> [Int] {
-        return sample.compactMap { stackFrame -> Int? in
-            guard let address = stackFrame.allFrames.first?.address else {
-                assertionFailure("empty stack? \(stackFrame)")
-                return nil
+    /// All locations, the location with ID `n` is at index `n - 1`.
+    var locations: [Location] = []
+    var locationIndices: [LocationKey: Int] = [:]
+    /// All functions, the function with ID `n` is at index `n - 1`.
+    var functions: [Function] = []
+    var functionIndices: [SymbolInterner.ID: Int] = [:]
+    /// The samples, as a call tree of location IDs.
+    var callTree = CallTree()
+
+    /// Adds `sample`, whose frames must have been interned by `interner`.
+    mutating func add(_ sample: [InternedStackFrame], threadInfo: ThreadInfo, interner: SymbolInterner) {
+        var node = self.callTree.root(of: threadInfo)
+        // The innermost frame comes first but the tree starts at the outermost one.
+        for stackFrame in sample.reversed() {
+            guard let locationID = self.resolveLocationID(stackFrame, interner: interner) else {
+                continue
             }
+            node = self.callTree.child(of: node, location: UInt32(locationID))
+        }
+        self.callTree.addSample(at: node)
+    }
 
-            if let location = self.locations[address] {
-                return location.id
+    /// Adds all samples of `other`, which must use the same ``SymbolInterner``.
+    ///
+    /// Locations are matched up by image and address like when adding samples and functions by name, so merging the
+    /// aggregators of captures from the same build (even with different ASLR slides) deduplicates everything.
+    mutating func merge(_ other: SampleAggregator) {
+        var locationIDs: [UInt32] = []
+        locationIDs.reserveCapacity(other.locations.count)
+        for location in other.locations {
+            let key = LocationKey(image: location.image, address: location.address)
+            if let index = self.locationIndices[key] {
+                locationIDs.append(UInt32(self.locations[index].id))
+                continue
             }
-
-            let nextID = self.locations.count + 1
-            self.locations[address] = Location(
-                id: nextID,
-                address: address,
-                functions: stackFrame.allFrames.map { frame in
-                    self.functions.addAndGetID(frame.functionName, type: Function.self)
-                }
+            let merged = Location(
+                id: self.locations.count + 1,
+                address: location.address,
+                mapping: location.mapping,
+                image: location.image,
+                functions: location.functions.map { functionID in
+                    let function = other.functions[functionID - 1]
+                    return self.resolveFunctionID(function.name, filename: function.filename)
+                },
+                lines: location.lines
             )
-            return nextID
+            self.locationIndices[key] = self.locations.count
+            self.locations.append(merged)
+            locationIDs.append(UInt32(merged.id))
+        }
+        self.callTree.merge(other.callTree) { locationID in
+            locationIDs[Int(locationID) - 1]
         }
     }
-}
 
-protocol HasID: Sendable {
-    var id: Int { get }
+    private mutating func resolveLocationID(_ stackFrame: InternedStackFrame, interner: SymbolInterner) -> Int? {
+        guard let firstFrame = stackFrame.allFrames.first else {
+            assertionFailure("empty stack? \(stackFrame)")
+            return nil
+        }
 
-    var value: String { get }
+        let key = LocationKey(image: firstFrame.vmap.map { interner.image(of: $0) }, address: firstFrame.address)
+        if let index = self.locationIndices[key] {
+            return self.locations[index].id
+        }
 
-    init(id: Int, value: String)
+        let location = Location(
+            id: self.locations.count + 1,
+            address: firstFrame.address,
+            mapping: firstFrame.vmap,
+            image: key.image,
+            functions: stackFrame.allFrames.map { frame in
+                self.resolveFunctionID(frame.functionName, filename: frame.file)
+            },
+            lines: stackFrame.allFrames.map { frame in
+                frame.line ?? 0
+            }
+        )
+        self.locationIndices[key] = self.locations.count
+        self.locations.append(location)
+        return location.id
+    }
 
-    func updatingID(_ newID: Int) -> Self
+    private mutating func resolveFunctionID(_ name: SymbolInterner.ID, filename: SymbolInterner.ID?) -> Int {
+        if let index = self.functionIndices[name] {
+            if self.functions[index].filename == nil {
+                self.functions[index].filename = filename
+            }
+            return self.functions[index].id
+        }
+        let function = Function(id: self.functions.count + 1, name: name, filename: filename)
+        self.functionIndices[name] = self.functions.count
+        self.functions.append(function)
+        return function.id
+    }
 }
 
-extension HasID {
-    mutating func spuriousMutation() -> Self {
-        return self
+/// Collects the samples of a capture into a ``SampleAggregator`` instead of rendering them.
+struct SampleAggregatorCollector: ProfileRecorderSampleConversionOutputRenderer {
+    var aggregator: SampleAggregator
+    /// The label of the samples' threads, see ``SampleAggregator/ThreadInfo/source``.
+    let source: SymbolInterner.ID?
+    /// The configuration of the capture, known once finalised.
+    private(set) var sampleConfiguration: SampleConfig? = nil
+
+    init(aggregator: SampleAggregator, source: SymbolInterner.ID?) {
+        self.aggregator = aggregator
+        self.source = source
+    }
+
+    mutating func consumeSingleSample(
+        _ sample: Sample,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        let symbolisedStack = try sample.stack.map { frame in
+            try symbolizer.symboliseInterned(frame)
+        }
+        let threadInfo = SampleAggregator.ThreadInfo(
+            tid: sample.tid,
+            name: symbolizer.interner.intern(sample.threadName),
+            source: self.source
+        )
+        self.aggregator.add(symbolisedStack, threadInfo: threadInfo, interner: symbolizer.interner)
+        return ByteBuffer()
     }
-}
 
-extension Dictionary where Key == String, Value: HasID {
-    mutating func addAndGetID(_ key: Key, type: Value.Type = Value.self) -> Int {
-        let nextID = self.count + 1
-        return self[key, default: Value(id: nextID, value: key)].spuriousMutation().id
+    mutating func finalise(
+        sampleConfiguration: SampleConfig,
+        configuration: ProfileRecorderSampleConversionConfiguration,
+        symbolizer: CachedSymbolizer
+    ) throws -> ByteBuffer {
+        self.sampleConfiguration = sampleConfiguration
+        return ByteBuffer()
     }
 }
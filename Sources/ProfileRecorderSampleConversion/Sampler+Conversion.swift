@@ -22,15 +22,25 @@ public enum ProfileRecorderOutputFormat: String, Codable & Sendable {
     case perfSymbolized
     case pprofSymbolized
     case flamegraphCollapsedSymbolized
+    case flamegraphSVGSymbolized
+    case speedscopeSymbolized
+    case firefoxProfilerSymbolized
+    case otlpProfilesSymbolized
     case raw
 }
 
+public enum ProfileRecorderOutputCompression: String, Codable & Sendable {
+    case none
+    case gzip
+}
+
 extension ProfileRecorderSampler {
     public func _withSamples<R: Sendable>(
         sampleCount: Int,
         timeBetweenSamples: TimeAmount,
         format: ProfileRecorderOutputFormat,
         symbolizer: any Symbolizer,
+        symbolizerConfiguration: SymbolizerConfiguration = .default,
         logger: Logger,
         _ body: (String) async throws -> R
     ) async throws -> R {
@@ -55,6 +65,18 @@ extension ProfileRecorderSampler {
             case .flamegraphCollapsedSymbolized:
                 symbolisedSamplesPath = tmpDirPath.appending("samples.flamegraph.collapsed")
                 logger[metadataKey: "symbolicated-samples-path"] = "\(symbolisedSamplesPath.string)"
+            case .flamegraphSVGSymbolized:
+                symbolisedSamplesPath = tmpDirPath.appending("samples.flamegraph.svg")
+                logger[metadataKey: "symbolicated-samples-path"] = "\(symbolisedSamplesPath.string)"
+            case .speedscopeSymbolized:
+                symbolisedSamplesPath = tmpDirPath.appending("samples.speedscope.json")
+                logger[metadataKey: "symbolicated-samples-path"] = "\(symbolisedSamplesPath.string)"
+            case .firefoxProfilerSymbolized:
+                symbolisedSamplesPath = tmpDirPath.appending("samples.firefox.json")
+                logger[metadataKey: "symbolicated-samples-path"] = "\(symbolisedSamplesPath.string)"
+            case .otlpProfilesSymbolized:
+                symbolisedSamplesPath = tmpDirPath.appending("samples.otlp.pb")
+                logger[metadataKey: "symbolicated-samples-path"] = "\(symbolisedSamplesPath.string)"
             case .raw:
                 symbolisedSamplesPath = tmpDirPath.appending("samples.raw")
             }
@@ -69,21 +91,10 @@ extension ProfileRecorderSampler {
             )
             let sampleDuration = NIODeadline.now() - sampleStart
             logger.info("raw samples complete", metadata: ["duration": "\(sampleDuration.formattedString)"])
-            switch format {
-            case .perfSymbolized, .pprofSymbolized, .flamegraphCollapsedSymbolized:
-                let renderer: any ProfileRecorderSampleConversionOutputRenderer
-                switch format {
-                case .perfSymbolized:
-                    renderer = PerfScriptOutputRenderer()
-                case .pprofSymbolized:
-                    renderer = PprofOutputRenderer()
-                case .flamegraphCollapsedSymbolized:
-                    renderer = FlamegraphCollapsedOutputRenderer()
-                case .raw:
-                    fatalError("we shouldn't be here")
-                }
+            switch Self.makeRenderer(format: format) {
+            case .some(let renderer):
                 let converter = ProfileRecorderSampleConverter(
-                    config: .default,
+                    config: symbolizerConfiguration,
                     renderer: renderer,
                     symbolizer: symbolizer
                 )
@@ -97,13 +108,132 @@ extension ProfileRecorderSampler {
                 let convertDuration = NIODeadline.now() - convertStart
                 logger.info("samples symbolicated", metadata: ["duration": "\(convertDuration.formattedString)"])
                 return try await body(symbolisedSamplesPath.string)
-            case .raw:
+            case .none:
                 return try await body(rawSamplesPath.string)
             }
         }
     }
 
-    public static func _makeDefaultSymbolizer() -> some Symbolizer {
+    /// Like ``_withSamples(sampleCount:timeBetweenSamples:format:symbolizer:symbolizerConfiguration:logger:_:)`` but
+    /// hands the output to `writeChunk` as it is produced instead of writing it to a file first.
+    ///
+    /// `writeChunk` is called sequentially and the conversion waits for each call to return before producing more
+    /// output. With a `compression` other than `.none`, the chunks are compressed as they are produced.
+    public func _streamSamples(
+        sampleCount: Int,
+        timeBetweenSamples: TimeAmount,
+        format: ProfileRecorderOutputFormat,
+        compression: ProfileRecorderOutputCompression = .none,
+        symbolizer: any Symbolizer,
+        symbolizerConfiguration: SymbolizerConfiguration = .default,
+        logger: Logger,
+        writeChunk: @Sendable @escaping (ByteBuffer) async throws -> Void
+    ) async throws {
+        try await FileSystem.shared.withTemporaryDirectory { tmpDirHandle, tmpDirPath in
+            let rawSamplesPath = tmpDirPath.appending("samples.raw")
+
+            var logger = logger
+            logger[metadataKey: "sample-count"] = "\(sampleCount)"
+            logger[metadataKey: "time-between-samples"] = "\(timeBetweenSamples.prettyPrint)"
+            logger[metadataKey: "raw-samples-path"] = "\(rawSamplesPath)"
+            logger[metadataKey: "symbolizer"] = "\(symbolizer)"
+
+            logger.info("requesting raw samples")
+            let sampleStart = NIODeadline.now()
+            try await self.requestSamples(
+                outputFilePath: rawSamplesPath.string,
+                failIfFileExists: true,
+                count: sampleCount,
+                timeBetweenSamples: timeBetweenSamples
+            )
+            let sampleDuration = NIODeadline.now() - sampleStart
+            logger.info("raw samples complete", metadata: ["duration": "\(sampleDuration.formattedString)"])
+
+            guard let renderer = Self.makeRenderer(format: format) else {
+                try await FileSystem.shared.withFileHandle(forReadingAt: rawSamplesPath) { handle in
+                    var reader = handle.bufferedReader()
+                    let compressor: GzipCompressor? = compression == .gzip ? try GzipCompressor() : nil
+                    var compressed = ByteBuffer()
+                    while true {
+                        let chunk = try await reader.read(.mebibytes(4))
+                        guard chunk.readableBytes > 0 else { break }
+                        if let compressor = compressor {
+                            compressed.clear()
+                            try compressor.compress(chunk, into: &compressed)
+                            if compressed.readableBytes > 0 {
+                                try await writeChunk(compressed)
+                            }
+                        } else {
+                            try await writeChunk(chunk)
+                        }
+                    }
+                    if let compressor = compressor {
+                        compressed.clear()
+                        try compressor.finish(into: &compressed)
+                        try await writeChunk(compressed)
+                    }
+                }
+                return
+            }
+            // A dedicated thread because the conversion blocks it while waiting for `writeChunk`, that would otherwise
+            // tie up a thread of the shared pool for as long as the client takes to read the output.
+            let threadPool = NIOThreadPool(numberOfThreads: 1)
+            threadPool.start()
+            var converter = ProfileRecorderSampleConverter(
+                config: symbolizerConfiguration,
+                threadPool: threadPool,
+                renderer: renderer,
+                symbolizer: symbolizer
+            )
+            converter.outputCompression = compression
+            let eventLoop = MultiThreadedEventLoopGroup.singleton.any()
+            let convertStart = NIODeadline.now()
+            try await asyncDo {
+                try await converter.convert(
+                    inputRawProfileRecorderFormatPath: rawSamplesPath.string,
+                    format: format,
+                    logger: logger
+                ) { chunk in
+                    // Blocking the conversion thread until the chunk is written applies backpressure, at most one
+                    // chunk is in flight.
+                    try eventLoop.makeFutureWithTask {
+                        try await writeChunk(chunk)
+                    }.wait()
+                }
+            } finally: { _ in
+                try? await threadPool.shutdownGracefully()
+            }
+            let convertDuration = NIODeadline.now() - convertStart
+            logger.info("samples symbolicated", metadata: ["duration": "\(convertDuration.formattedString)"])
+        }
+    }
+
+    private static func makeRenderer(
+        format: ProfileRecorderOutputFormat
+    ) -> (any ProfileRecorderSampleConversionOutputRenderer)? {
+        switch format {
+        case .perfSymbolized:
+            return PerfScriptOutputRenderer()
+        case .pprofSymbolized:
+            return PprofOutputRenderer()
+        case .flamegraphCollapsedSymbolized:
+            return FlamegraphCollapsedOutputRenderer()
+        case .flamegraphSVGSymbolized:
+            return FlamegraphSVGOutputRenderer()
+        case .speedscopeSymbolized:
+            return SpeedscopeOutputRenderer()
+        case .firefoxProfilerSymbolized:
+            return FirefoxProfilerOutputRenderer()
+        case .otlpProfilesSymbolized:
+            return OTLPProfilesOutputRenderer()
+        case .raw:
+            return nil
+        }
+    }
+
+    public static func _makeDefaultSymbolizer(
+        nativeConfiguration: NativeELFSymboliserConfiguration = .default
+    ) -> some Symbolizer {
         #if canImport(Darwin)
         #if os(iOS) || os(macOS) || os(tvOS) || os(watchOS)
         let symbolizer = CoreSymbolicationSymboliser()
@@ -112,11 +242,25 @@ extension ProfileRecorderSampler {
         let symbolizer = _ProfileRecorderFakeSymbolizer()
         #endif
         #else
-        let symbolizer = NativeELFSymboliser()
+        let symbolizer = NativeELFSymboliser(configuration: nativeConfiguration)
         #endif
         return symbolizer
     }
 
+    /// The dynamic library mappings of this process, equivalent to the `VMAP` records of a raw sample.
+    public static func _currentDynamicLibraryMappings() -> [DynamicLibMapping] {
+        return Self._listLoadedImageSegments().map { segment in
+            DynamicLibMapping(
+                path: segment.path,
+                architecture: segment.architecture.isEmpty
+                    ? ProfileRecorderSystemInformation.defaultArchitecture : segment.architecture,
+                segmentSlide: segment.segmentSlide,
+                segmentStartAddress: segment.segmentStartAddress,
+                segmentEndAddress: segment.segmentEndAddress
+            )
+        }
+    }
+
     public func withSymbolizedSamplesInPerfScriptFormat<R: Sendable>(
         sampleCount: Int,
         timeBetweenSamples: TimeAmount,
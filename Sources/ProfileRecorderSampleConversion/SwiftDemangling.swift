@@ -0,0 +1,74 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+#if canImport(Glibc)
+@preconcurrency import Glibc
+#elseif canImport(Musl)
+@preconcurrency import Musl
+#elseif canImport(Darwin)
+import Darwin
+#endif
+
+/// The Swift runtime's demangler, the same one `swift demangle` uses.
+@_silgen_name("swift_demangle")
+private func _swift_demangle(
+    mangledName: UnsafePointer<CChar>?,
+    mangledNameLength: Int,
+    outputBuffer: UnsafeMutablePointer<CChar>?,
+    outputBufferSize: UnsafeMutablePointer<Int>?,
+    flags: UInt32
+) -> UnsafeMutablePointer<CChar>?
+
+internal enum SwiftDemangling {
+    /// The prefixes of the mangled Swift symbols the runtime can demangle (Swift 4 and later, and embedded Swift).
+    private static let mangledPrefixes: [StaticString] = ["$s", "_$s", "$S", "_$S", "$e", "_$e", "_T0"]
+
+    /// Whether `name` looks like a mangled Swift symbol, without allocating.
+    static func isMangledSwiftSymbol(_ name: String) -> Bool {
+        var name = name
+        return name.withUTF8 { utf8 in
+            Self.mangledPrefixes.contains { prefix in
+                prefix.utf8CodeUnitCount < utf8.count
+                    && memcmp(utf8.baseAddress!, prefix.utf8Start, prefix.utf8CodeUnitCount) == 0
+            }
+        }
+    }
+
+    /// Demangles `name`, `nil` if it isn't a mangled Swift symbol.
+    static func demangle(_ name: String) -> String? {
+        guard Self.isMangledSwiftSymbol(name) else {
+            return nil
+        }
+        var name = name
+        return name.withUTF8 { utf8 in
+            utf8.withMemoryRebound(to: CChar.self) { mangled in
+                guard
+                    let demangled = _swift_demangle(
+                        mangledName: mangled.baseAddress,
+                        mangledNameLength: mangled.count,
+                        outputBuffer: nil,
+                        outputBufferSize: nil,
+                        flags: 0
+                    )
+                else {
+                    return nil
+                }
+                defer {
+                    free(demangled)
+                }
+                return String(cString: demangled)
+            }
+        }
+    }
+}
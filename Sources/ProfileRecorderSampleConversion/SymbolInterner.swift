@@ -0,0 +1,267 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import NIOConcurrencyHelpers
+
+/// Assigns small integer IDs to the function names, libraries, files and mappings of symbolised frames.
+///
+/// One interner is shared by everything that takes part in a conversion, so every string is stored (and hashed) only
+/// once, regardless of how many frames or ``CachedSymbolizer``s refer to it. Renderers keep working with the IDs and
+/// only look up the strings when writing their output.
+public final class SymbolInterner: Sendable, CustomStringConvertible {
+    /// The ID of an interned string.
+    public struct ID: Sendable, Hashable, Comparable {
+        public var rawValue: UInt32
+
+        public init(rawValue: UInt32) {
+            self.rawValue = rawValue
+        }
+
+        public static func < (lhs: ID, rhs: ID) -> Bool {
+            return lhs.rawValue < rhs.rawValue
+        }
+    }
+
+    /// The ID of an interned ``DynamicLibMapping``.
+    public struct MappingID: Sendable, Hashable {
+        public var rawValue: UInt32
+
+        public init(rawValue: UInt32) {
+            self.rawValue = rawValue
+        }
+    }
+
+    /// The ID of an image (executable or library), see ``image(of:)``.
+    public struct ImageID: Sendable, Hashable {
+        public var rawValue: UInt32
+
+        public init(rawValue: UInt32) {
+            self.rawValue = rawValue
+        }
+    }
+
+    private struct State: Sendable {
+        var strings: [String] = []
+        var stringIDs: [String: ID] = [:]
+        var mappings: [DynamicLibMapping] = []
+        var mappingIDs: [DynamicLibMapping: MappingID] = [:]
+        /// The image of every mapping, indexed like `mappings`.
+        var mappingImages: [ImageID] = []
+        var imageIDs: [String: ImageID] = [:]
+        /// The demangled version of every function name demangled so far, the ID itself if it's not mangled.
+        var demangledIDs: [ID: ID] = [:]
+
+        mutating func intern(_ string: String) -> ID {
+            if let id = self.stringIDs[string] {
+                return id
+            }
+            let id = ID(rawValue: UInt32(self.strings.count))
+            self.strings.append(string)
+            self.stringIDs[string] = id
+            return id
+        }
+
+        mutating func intern(_ mapping: DynamicLibMapping) -> MappingID {
+            if let id = self.mappingIDs[mapping] {
+                return id
+            }
+            let id = MappingID(rawValue: UInt32(self.mappings.count))
+            self.mappings.append(mapping)
+            self.mappingIDs[mapping] = id
+
+            let image = mapping.buildID.map { "build-id:\($0)" } ?? "path:\(mapping.path)"
+            if let imageID = self.imageIDs[image] {
+                self.mappingImages.append(imageID)
+            } else {
+                let imageID = ImageID(rawValue: UInt32(self.imageIDs.count))
+                self.imageIDs[image] = imageID
+                self.mappingImages.append(imageID)
+            }
+            return id
+        }
+    }
+
+    private let state: NIOLockedValueBox<State> = NIOLockedValueBox(State())
+
+    public init() {}
+
+    /// The number of distinct strings interned so far.
+    public var count: Int {
+        return self.state.withLockedValue { $0.strings.count }
+    }
+
+    public func intern(_ string: String) -> ID {
+        return self.state.withLockedValue { $0.intern(string) }
+    }
+
+    public func intern(_ mapping: DynamicLibMapping) -> MappingID {
+        return self.state.withLockedValue { $0.intern(mapping) }
+    }
+
+    /// The ID of the demangled version of the Swift symbol `id`, `id` itself if it's not a mangled Swift symbol.
+    ///
+    /// Every string is demangled at most once, no matter how many frames refer to it.
+    public func demangled(_ id: ID) -> ID {
+        let mangled: String? = self.state.withLockedValue { state in
+            state.demangledIDs[id] == nil ? state.strings[Int(id.rawValue)] : nil
+        }
+        // Demangling is slow-ish, so it's done without holding the lock. Racing threads demangle the same string
+        // twice but come to the same result.
+        let demangled = mangled.flatMap { SwiftDemangling.demangle($0) }
+        return self.state.withLockedValue { state in
+            if let demangledID = state.demangledIDs[id] {
+                return demangledID
+            }
+            let demangledID = demangled.map { state.intern($0) } ?? id
+            state.demangledIDs[id] = demangledID
+            // Demangling the demangled name again is a no-op.
+            state.demangledIDs[demangledID] = demangledID
+            return demangledID
+        }
+    }
+
+    /// `frame` with all function names demangled, see ``demangled(_:)``.
+    public func demangled(_ frame: InternedStackFrame) -> InternedStackFrame {
+        var frame = frame
+        for index in frame.allFrames.indices {
+            frame.allFrames[index].functionName = self.demangled(frame.allFrames[index].functionName)
+        }
+        return frame
+    }
+
+    /// The interned strings, looked up without taking the lock.
+    ///
+    /// Taking a snapshot is cheap, it shares the interner's storage. It doesn't see the strings interned after it was
+    /// taken though, so it's meant for writing output once everything is interned.
+    public struct Strings: Sendable {
+        private let strings: [String]
+
+        fileprivate init(_ strings: [String]) {
+            self.strings = strings
+        }
+
+        public subscript(id: ID) -> String {
+            return self.strings[Int(id.rawValue)]
+        }
+    }
+
+    /// A snapshot of all strings interned so far, see ``Strings``.
+    ///
+    /// Use this rather than ``string(_:)`` to look up many strings, that takes the lock for every one of them.
+    public func strings() -> Strings {
+        return self.state.withLockedValue { Strings($0.strings) }
+    }
+
+    public func string(_ id: ID) -> String {
+        return self.state.withLockedValue { $0.strings[Int(id.rawValue)] }
+    }
+
+    public func mapping(_ id: MappingID) -> DynamicLibMapping {
+        return self.state.withLockedValue { $0.mappings[Int(id.rawValue)] }
+    }
+
+    /// The image mapped by `id`.
+    ///
+    /// All mappings of the same build share one image, wherever they were loaded. Images are told apart by their GNU
+    /// build ID or, if they don't have one, by their path.
+    public func image(of id: MappingID) -> ImageID {
+        return self.state.withLockedValue { $0.mappingImages[Int(id.rawValue)] }
+    }
+
+    public func intern(_ frame: SymbolisedStackFrame) -> InternedStackFrame {
+        return self.state.withLockedValue { state in
+            InternedStackFrame(
+                allFrames: frame.allFrames.map { frame in
+                    InternedStackFrame.SingleFrame(
+                        address: frame.address,
+                        functionName: state.intern(frame.functionName),
+                        functionOffset: frame.functionOffset,
+                        library: state.intern(frame.library),
+                        hasExplicitLibrary: frame._library != nil,
+                        vmap: frame.vmap.map { state.intern($0) },
+                        file: frame.file.map { state.intern($0) },
+                        line: frame.line
+                    )
+                }
+            )
+        }
+    }
+
+    /// Turns an ``InternedStackFrame`` back into the ``SymbolisedStackFrame`` it was made from.
+    public func resolve(_ frame: InternedStackFrame) -> SymbolisedStackFrame {
+        return self.state.withLockedValue { state in
+            SymbolisedStackFrame(
+                allFrames: frame.allFrames.map { frame in
+                    SymbolisedStackFrame.SingleFrame(
+                        address: frame.address,
+                        functionName: state.strings[Int(frame.functionName.rawValue)],
+                        functionOffset: frame.functionOffset,
+                        library: frame.hasExplicitLibrary ? state.strings[Int(frame.library.rawValue)] : nil,
+                        vmap: frame.vmap.map { state.mappings[Int($0.rawValue)] },
+                        file: frame.file.map { state.strings[Int($0.rawValue)] },
+                        line: frame.line
+                    )
+                }
+            )
+        }
+    }
+
+    public var description: String {
+        return self.state.withLockedValue { state in
+            "SymbolInterner(strings: \(state.strings.count), mappings: \(state.mappings.count))"
+        }
+    }
+}
+
+/// A ``SymbolisedStackFrame`` whose strings live in a ``SymbolInterner``.
+public struct InternedStackFrame: Sendable & Hashable {
+    public struct SingleFrame: Sendable & Hashable {
+        public var address: UInt
+        public var functionOffset: UInt
+        public var functionName: SymbolInterner.ID
+        /// The library name to display, this is ``SymbolisedStackFrame/SingleFrame/library``.
+        public var library: SymbolInterner.ID
+        /// Whether the symboliser set the library name or it was derived from the mapping.
+        public var hasExplicitLibrary: Bool
+        public var vmap: Optional<SymbolInterner.MappingID>
+        public var file: Optional<SymbolInterner.ID>
+        public var line: Optional<Int>
+
+        public init(
+            address: UInt,
+            functionName: SymbolInterner.ID,
+            functionOffset: UInt,
+            library: SymbolInterner.ID,
+            hasExplicitLibrary: Bool,
+            vmap: SymbolInterner.MappingID?,
+            file: SymbolInterner.ID? = nil,
+            line: Int? = nil
+        ) {
+            self.address = address
+            self.functionName = functionName
+            self.functionOffset = functionOffset
+            self.library = library
+            self.hasExplicitLibrary = hasExplicitLibrary
+            self.vmap = vmap
+            self.file = file
+            self.line = line
+        }
+    }
+
+    public var allFrames: [SingleFrame]
+
+    public init(allFrames: [InternedStackFrame.SingleFrame]) {
+        self.allFrames = allFrames
+    }
+}
@@ -12,6 +12,14 @@
 //
 //===----------------------------------------------------------------------===//
 
+#if canImport(Glibc)
+@preconcurrency import Glibc
+#elseif canImport(Musl)
+@preconcurrency import Musl
+#elseif canImport(Darwin)
+import Darwin
+#endif
+
 import NIO
 #if canImport(FoundationEssentials)
 import FoundationEssentials
@@ -62,6 +70,18 @@ public struct SymbolisedStackFrame: Sendable & Hashable {
     }
 }
 
+/// One address to symbolise, see ``Symbolizer/symbolise(_:logger:)``.
+public struct SymbolisationQuery: Sendable & Hashable {
+    /// The address relative to the file, that is the instruction pointer minus the library's segment slide.
+    public var fileVirtualAddressIP: UInt
+    public var library: DynamicLibMapping
+
+    public init(fileVirtualAddressIP: UInt, library: DynamicLibMapping) {
+        self.fileVirtualAddressIP = fileVirtualAddressIP
+        self.library = library
+    }
+}
+
 public protocol Symbolizer: Sendable {
     @available(*, noasync, message: "blocks the calling thread")
     func start() throws
@@ -73,67 +93,167 @@ public protocol Symbolizer: Sendable {
         logger: Logger
     ) throws -> SymbolisedStackFrame
 
+    /// Symbolises all of `queries` and returns the results in the same order.
+    ///
+    /// Symbolisers that can have many addresses in flight at once (like one talking to a helper process) should
+    /// implement this, the default implementation symbolises one query after the other.
+    @available(*, noasync, message: "blocks the calling thread")
+    func symbolise(_ queries: [SymbolisationQuery], logger: Logger) throws -> [SymbolisedStackFrame]
+
     @available(*, noasync, message: "blocks the calling thread")
     func shutdown() throws
 
+    /// Loads everything required to symbolise addresses in `libraries` ahead of time.
+    ///
+    /// Pre-warming is an optimisation only, it stops once it used up `cpuBudget` worth of CPU time on the calling
+    /// thread or once `isCancelled` returns `true` (checked between libraries). The default implementation does
+    /// nothing.
+    @available(*, noasync, message: "blocks the calling thread")
+    func prewarm(
+        libraries: [DynamicLibMapping],
+        cpuBudget: TimeAmount,
+        logger: Logger,
+        isCancelled: () -> Bool
+    ) throws
+
     var description: String { get }
 }
 
+extension Symbolizer {
+    @available(*, noasync, message: "blocks the calling thread")
+    public func prewarm(
+        libraries: [DynamicLibMapping],
+        cpuBudget: TimeAmount,
+        logger: Logger,
+        isCancelled: () -> Bool
+    ) throws {}
+
+    @available(*, noasync, message: "blocks the calling thread")
+    public func prewarm(libraries: [DynamicLibMapping], cpuBudget: TimeAmount, logger: Logger) throws {
+        try self.prewarm(libraries: libraries, cpuBudget: cpuBudget, logger: logger, isCancelled: { false })
+    }
+
+    @available(*, noasync, message: "blocks the calling thread")
+    public func symbolise(_ queries: [SymbolisationQuery], logger: Logger) throws -> [SymbolisedStackFrame] {
+        return try queries.map { query in
+            try self.symbolise(fileVirtualAddressIP: query.fileVirtualAddressIP, library: query.library, logger: logger)
+        }
+    }
+}
+
 enum AnyElfImage {
     case elf32(Elf32Image)
     case elf64(Elf64Image)
 
-    func lookupRealAndInlinedFrames(address: UInt64, logger: Logger) -> [ImageSymbol]? {
+    /// Looks up the real function at `address` and the functions inlined into it there, innermost first.
+    ///
+    /// With `includeSourceLocations`, the innermost frame gets the line table's location of `address` and every other
+    /// frame the call site of the frame inlined into it.
+    func lookupRealAndInlinedFrames(
+        address: UInt64,
+        includeSourceLocations: Bool,
+        logger: Logger
+    ) -> [ImageSymbol]? {
         switch self {
         case .elf32(let image):
-            guard let realFrame = image.lookupSymbol(address: UInt32(truncatingIfNeeded: address)) else {
-                logger.trace(
-                    "could not find symbol",
-                    metadata: [
-                        "address": "0x\(String(address, radix: 16))",
-                        "image": "\(image)",
-                        "image-name": "\(image.imageName)",
-                        "inline-frames": "\(image.inlineCallSites(at: UInt32(truncatingIfNeeded: address)))",
-                    ]
-                )
-                return nil
-            }
-            var symbols: [ImageSymbol] = []
-            for inlineFrame in image.inlineCallSites(at: UInt32(truncatingIfNeeded: address)) {
-                symbols.append(
-                    ImageSymbol(
-                        name: inlineFrame.name ?? "unknown in \(inlineFrame.filename)",
-                        offset: 0
-                    )
-                )
-            }
-            symbols.append(realFrame)
-            return symbols
+            return Self.lookupRealAndInlinedFrames(
+                image: image,
+                address: address,
+                includeSourceLocations: includeSourceLocations,
+                logger: logger
+            )
         case .elf64(let image):
-            guard let realFrame = image.lookupSymbol(address: address) else {
-                logger.trace(
-                    "could not find symbol",
+            return Self.lookupRealAndInlinedFrames(
+                image: image,
+                address: address,
+                includeSourceLocations: includeSourceLocations,
+                logger: logger
+            )
+        }
+    }
+
+    private static func lookupRealAndInlinedFrames<Traits: ElfTraits>(
+        image: ElfImage<Traits>,
+        address: UInt64,
+        includeSourceLocations: Bool,
+        logger: Logger
+    ) -> [ImageSymbol]? {
+        let imageAddress = Traits.Address(truncatingIfNeeded: address)
+        guard let realFrame = image.lookupSymbol(address: imageAddress) else {
+            logger.trace(
+                "could not find symbol",
+                metadata: [
+                    "address": "0x\(String(address, radix: 16))",
+                    "image": "\(image)",
+                    "image-name": "\(image.imageName)",
+                    "inline-frames": "\(image.inlineCallSites(at: imageAddress))",
+                ]
+            )
+            return nil
+        }
+
+        // The call sites come sorted by address, the frames must be sorted by nesting depth.
+        let inlineFrames = image.inlineCallSites(at: imageAddress).sorted { $0.depth > $1.depth }
+        var symbols: [ImageSymbol] = []
+        symbols.reserveCapacity(inlineFrames.count + 1)
+        for inlineFrame in inlineFrames {
+            symbols.append(
+                ImageSymbol(
+                    name: inlineFrame.name ?? "unknown in \(inlineFrame.filename)",
+                    offset: 0
+                )
+            )
+        }
+        symbols.append(realFrame)
+
+        if includeSourceLocations {
+            do {
+                symbols[0].sourceLocation = try image.sourceLocation(for: imageAddress)
+            } catch {
+                logger.debug(
+                    "could not read line table",
                     metadata: [
                         "address": "0x\(String(address, radix: 16))",
-                        "image": "\(image)",
                         "image-name": "\(image.imageName)",
-                        "inline-frames": "\(image.inlineCallSites(at: address))",
+                        "error": "\(error)",
                     ]
                 )
-                return nil
             }
-
-            var symbols: [ImageSymbol] = []
-            for inlineFrame in image.inlineCallSites(at: address) {
-                symbols.append(
-                    ImageSymbol(
-                        name: inlineFrame.name ?? "unknown in \(inlineFrame.filename)",
-                        offset: 0
-                    )
+            for (index, inlineFrame) in inlineFrames.enumerated() where inlineFrame.filename != "<unknown>" {
+                symbols[index + 1].sourceLocation = SourceLocation(
+                    path: inlineFrame.filename,
+                    line: inlineFrame.line,
+                    column: inlineFrame.column
                 )
             }
-            symbols.append(realFrame)
-            return symbols
+        }
+        return symbols
+    }
+
+    func prewarm() {
+        switch self {
+        case .elf32(let image):
+            image.prewarm()
+        case .elf64(let image):
+            image.prewarm()
+        }
+    }
+
+    func attachCachedSymbolIndex(cacheDirectory: String, logger: Logger) {
+        switch self {
+        case .elf32(let image):
+            image.attachCachedSymbolIndex(cacheDirectory: cacheDirectory, logger: logger)
+        case .elf64(let image):
+            image.attachCachedSymbolIndex(cacheDirectory: cacheDirectory, logger: logger)
+        }
+    }
+
+    func writeSymbolIndex(cacheDirectory: String, logger: Logger) {
+        switch self {
+        case .elf32(let image):
+            image.writeSymbolIndex(cacheDirectory: cacheDirectory, logger: logger)
+        case .elf64(let image):
+            image.writeSymbolIndex(cacheDirectory: cacheDirectory, logger: logger)
         }
     }
 
@@ -145,37 +265,299 @@ enum AnyElfImage {
             return try image.sourceLocation(for: address)
         }
     }
+
+    /// The hex encoded GNU build ID of the image, if it has one.
+    var buildID: String? {
+        switch self {
+        case .elf32(let image):
+            return image.uuid.map { hex($0) }
+        case .elf64(let image):
+            return image.uuid.map { hex($0) }
+        }
+    }
+
+    var mappedSources: [ImageSource] {
+        switch self {
+        case .elf32(let image):
+            return image.mappedSources
+        case .elf64(let image):
+            return image.mappedSources
+        }
+    }
+
+    var estimatedTableByteCount: Int {
+        switch self {
+        case .elf32(let image):
+            return image.estimatedTableByteCount
+        case .elf64(let image):
+            return image.estimatedTableByteCount
+        }
+    }
+
+    func adviseMappedSourcesNotNeeded() {
+        for source in self.mappedSources {
+            source.adviseNotNeeded()
+        }
+    }
 }
 
 internal struct LockedELFSourceCacheReference: @unchecked /* the ElfImage types aren't */ Sendable {
-    private let value: NIOLockedValueBox<[String: AnyElfImage]> = NIOLockedValueBox([:])
+    /// The image at one path, loaded on first use.
+    ///
+    /// Each slot has its own lock, so loading an image (which can take seconds) only blocks the lookups in that very
+    /// image. The lock also serialises the lookups in the image, its lookup structures are built lazily.
+    private final class ImageSlot {
+        let image: NIOLockedValueBox<AnyElfImage?> = NIOLockedValueBox(nil)
+        /// When the image was last used, in ``Slots/useCount`` ticks. Only accessed with the slots locked.
+        var lastUse: UInt64 = 0
+        /// Whether the image is loaded. Only accessed with the slots locked.
+        var isLoaded = false
+    }
+
+    private struct Slots {
+        var slots: [String: ImageSlot] = [:]
+        var useCount: UInt64 = 0
+        var usesSinceBudgetCheck = 0
+    }
+
+    /// The number of lookups after which the memory budget is checked again, the lookup structures grow with them.
+    private static let budgetCheckInterval = 1024
+
+    /// The slots by path, only locked to find (or add) a slot.
+    ///
+    /// Lock order: an image's lock may be taken first and then this one, never the other way round.
+    private let slots: NIOLockedValueBox<Slots> = NIOLockedValueBox(Slots())
+    private let symbolIndexCacheDirectory: Optional<String>
+    private let resolveSourceLocations: Bool
+    private let memoryBudget: Optional<Int>
+    private let readLoadedImagesFromMemory: Bool
+    /// Called with the path of every image about to be loaded, with the image's lock held. For tests.
+    private let willLoadImage: Optional<@Sendable (String) -> Void>
+
+    init(
+        symbolIndexCacheDirectory: String? = nil,
+        resolveSourceLocations: Bool = false,
+        memoryBudget: Int? = nil,
+        readLoadedImagesFromMemory: Bool = false,
+        willLoadImage: (@Sendable (String) -> Void)? = nil
+    ) {
+        self.symbolIndexCacheDirectory = symbolIndexCacheDirectory
+        self.resolveSourceLocations = resolveSourceLocations
+        self.memoryBudget = memoryBudget
+        self.readLoadedImagesFromMemory = readLoadedImagesFromMemory
+        self.willLoadImage = willLoadImage
+    }
 
     enum Error: Swift.Error {
         case loadFailed
         case lookupFailed
     }
 
+    /// Why ``prewarm(path:library:cpuBudget:logger:)`` failed, separate from ``Error`` so that lookups can't fail for
+    /// lack of CPU budget.
+    enum PrewarmError: Swift.Error {
+        case loadFailed
+        case outOfCPUBudget
+    }
+
+    /// The number of images that are loaded.
     var count: Int {
-        return self.value.withLockedValue { $0.count }
+        return self.slots.withLockedValue { state in
+            state.slots.values.filter { $0.isLoaded }.count
+        }
     }
 
-    @available(*, noasync, message: "blocks the calling thread")
-    func lookup(library: DynamicLibMapping, fileVirtualAddressIP: UInt, logger: Logger) -> Result<[ImageSymbol], Error>
-    {
-        return self.value.withLockedValue { elfSourceCache in
-            var elfImage: AnyElfImage? = elfSourceCache[library.path]
-            if elfImage == nil {
-                if let source = try? ImageSource(path: library.path) {
-                    if let image = try? Elf64Image(source: source) {
-                        elfImage = .elf64(image)
-                    } else if let image = try? Elf32Image(source: source) {
-                        elfImage = .elf32(image)
-                    } else {
-                        elfImage = nil
+    private func loadImage(path: String, library: DynamicLibMapping?, logger: Logger) -> AnyElfImage? {
+        if self.readLoadedImagesFromMemory, let library = library,
+            let source = LoadedImages.imageSource(path: path, segmentSlide: library.segmentSlide),
+            let elfImage = Self.makeImage(source: source),
+            // Same path and slide in this process, but the samples may still be of another process.
+            library.buildID == nil || library.buildID == elfImage.buildID
+        {
+            logger.trace("reading loaded image from memory", metadata: ["library": "\(library)"])
+            return self.attachingCachedSymbolIndex(to: elfImage, logger: logger)
+        }
+        guard let source = try? ImageSource(path: path), let elfImage = Self.makeImage(source: source) else {
+            return nil
+        }
+        return self.attachingCachedSymbolIndex(to: elfImage, logger: logger)
+    }
+
+    private static func makeImage(source: ImageSource) -> AnyElfImage? {
+        if let image = try? Elf64Image(source: source) {
+            return .elf64(image)
+        } else if let image = try? Elf32Image(source: source) {
+            return .elf32(image)
+        } else {
+            return nil
+        }
+    }
+
+    private func attachingCachedSymbolIndex(to elfImage: AnyElfImage, logger: Logger) -> AnyElfImage {
+        if let symbolIndexCacheDirectory = self.symbolIndexCacheDirectory {
+            elfImage.attachCachedSymbolIndex(cacheDirectory: symbolIndexCacheDirectory, logger: logger)
+        }
+        return elfImage
+    }
+
+    /// Runs `body` with the image at `path` (loading it first if necessary) while holding the image's lock.
+    ///
+    /// `library` is where the image is loaded, if known. Images that fail to load aren't cached, the next call tries
+    /// again.
+    private func withImage<R>(
+        path: String,
+        library: DynamicLibMapping? = nil,
+        logger: Logger,
+        _ body: (AnyElfImage?) -> R
+    ) -> R {
+        var checkBudget = false
+        let slot = self.slots.withLockedValue { state in
+            state.useCount += 1
+            state.usesSinceBudgetCheck += 1
+            checkBudget = state.usesSinceBudgetCheck >= Self.budgetCheckInterval
+            let slot = state.slots[path] ?? ImageSlot()
+            state.slots[path] = slot
+            slot.lastUse = state.useCount
+            return slot
+        }
+        let result = slot.image.withLockedValue { image in
+            if image == nil {
+                self.willLoadImage?(path)
+                image = self.loadImage(path: path, library: library, logger: logger)
+                if image != nil {
+                    checkBudget = true
+                    self.slots.withLockedValue { _ in
+                        slot.isLoaded = true
                     }
                 }
-                elfSourceCache[library.path] = elfImage
             }
+            return body(image)
+        }
+        if checkBudget && self.memoryBudget != nil {
+            self.enforceMemoryBudget(sparing: path, logger: logger)
+        }
+        return result
+    }
+
+    /// The memory used by every loaded image, least recently used first.
+    @available(*, noasync, message: "blocks the calling thread")
+    func memoryUsage() -> [NativeELFSymboliser.ImageMemoryUsage] {
+        return self.loadedSlots().compactMap { path, slot in
+            slot.image.withLockedValue { image in
+                image.map { NativeELFSymboliser.ImageMemoryUsage(path: path, image: $0) }
+            }
+        }
+    }
+
+    private func loadedSlots() -> [(path: String, slot: ImageSlot)] {
+        return self.slots.withLockedValue { state in
+            return state.slots.filter { $0.value.isLoaded }
+                .sorted { $0.value.lastUse < $1.value.lastUse }
+                .map { (path: $0.key, slot: $0.value) }
+        }
+    }
+
+    /// Brings the memory used by the loaded images back under the budget, if it's over.
+    ///
+    /// First, the least recently used images' mapped files are dropped from memory with `madvise`, they're paged in
+    /// again when needed. If that's not enough, the least recently used images are unloaded altogether, including
+    /// their lookup structures. The image at `path` (which was just used) is spared.
+    @available(*, noasync, message: "blocks the calling thread")
+    private func enforceMemoryBudget(sparing path: String, logger: Logger) {
+        guard let memoryBudget = self.memoryBudget else {
+            return
+        }
+        self.slots.withLockedValue { state in
+            state.usesSinceBudgetCheck = 0
+        }
+        let candidates = self.loadedSlots()
+        let usages = candidates.map { candidate in
+            candidate.slot.image.withLockedValue { image in
+                image.map { NativeELFSymboliser.ImageMemoryUsage(path: candidate.path, image: $0) }
+            }
+        }
+        var totalBytes = usages.reduce(0) { $0 + ($1?.totalBytes ?? 0) }
+        guard totalBytes > memoryBudget else {
+            return
+        }
+
+        var advised = 0
+        for (candidate, usage) in zip(candidates, usages) where totalBytes > memoryBudget && candidate.path != path {
+            guard let usage = usage, usage.residentMappedBytes > 0 else {
+                continue
+            }
+            candidate.slot.image.withLockedValue { image in
+                image?.adviseMappedSourcesNotNeeded()
+            }
+            totalBytes -= usage.residentMappedBytes
+            advised += 1
+        }
+
+        var evicted = 0
+        for (candidate, usage) in zip(candidates, usages) where totalBytes > memoryBudget && candidate.path != path {
+            guard let usage = usage else {
+                continue
+            }
+            candidate.slot.image.withLockedValue { image in
+                image = nil
+                self.slots.withLockedValue { _ in
+                    candidate.slot.isLoaded = false
+                }
+            }
+            totalBytes -= usage.estimatedTableBytes
+            evicted += 1
+        }
+        logger.debug(
+            "ELF image cache over memory budget",
+            metadata: [
+                "memory-budget": "\(memoryBudget)",
+                "images": "\(candidates.count)",
+                "advised-not-needed": "\(advised)",
+                "evicted": "\(evicted)",
+                "remaining-bytes": "\(totalBytes)",
+            ]
+        )
+    }
+
+    /// Loads the image at `path` (if not already cached) and builds its lookup structures.
+    ///
+    /// With a symbol index cache, this is also where missing symbol indexes are built and written. Lookups only use
+    /// the indexes that are already cached, building one takes far too long for the lookup path. Until then, they
+    /// use the image's own (lazily built) lookup structures.
+    ///
+    /// The steps (loading, building the symbol index, building the lookup structures) can't be interrupted, but no
+    /// step is started once `cpuBudget` worth of CPU time is used up on the calling thread. Then this fails with
+    /// ``PrewarmError/outOfCPUBudget`` and the rest is built lazily, when needed.
+    @available(*, noasync, message: "blocks the calling thread")
+    func prewarm(
+        path: String,
+        library: DynamicLibMapping? = nil,
+        cpuBudget: TimeAmount? = nil,
+        logger: Logger
+    ) -> Result<Void, PrewarmError> {
+        let cpuTimeAtStart = currentThreadCPUTime()
+        let hasCPUBudgetLeft = {
+            cpuBudget.map { currentThreadCPUTime() - cpuTimeAtStart < $0 } ?? true
+        }
+        return self.withImage(path: path, library: library, logger: logger) { elfImage in
+            guard let elfImage = elfImage else {
+                return .failure(.loadFailed)
+            }
+            if let symbolIndexCacheDirectory = self.symbolIndexCacheDirectory, hasCPUBudgetLeft() {
+                elfImage.writeSymbolIndex(cacheDirectory: symbolIndexCacheDirectory, logger: logger)
+            }
+            guard hasCPUBudgetLeft() else {
+                return .failure(.outOfCPUBudget)
+            }
+            elfImage.prewarm()
+            return .success(())
+        }
+    }
+
+    @available(*, noasync, message: "blocks the calling thread")
+    func lookup(library: DynamicLibMapping, fileVirtualAddressIP: UInt, logger: Logger) -> Result<[ImageSymbol], Error>
+    {
+        return self.withImage(path: library.path, library: library, logger: logger) { elfImage in
             guard let elfImage = elfImage else {
                 return .failure(.loadFailed)
             }
@@ -183,6 +565,7 @@ internal struct LockedELFSourceCacheReference: @unchecked /* the ElfImage types
             guard
                 let results = elfImage.lookupRealAndInlinedFrames(
                     address: UInt64(fileVirtualAddressIP),
+                    includeSourceLocations: self.resolveSourceLocations,
                     logger: logger
                 )
             else {
@@ -193,10 +576,65 @@ internal struct LockedELFSourceCacheReference: @unchecked /* the ElfImage types
     }
 }
 
+/// The configuration for ``NativeELFSymboliser``.
+public struct NativeELFSymboliserConfiguration: Sendable {
+    /// A directory to cache symbol indexes in, `nil` (the default) disables the cache.
+    ///
+    /// The symbol index of an image holds its function symbols and inline call sites in a compact format. It's keyed
+    /// by the image's GNU build ID and memory mapped when used, so later runs (and other processes on the same host)
+    /// don't have to build the symbol tables and scan the DWARF information again. Missing indexes are built when the
+    /// images are prewarmed, never during lookups. Images without a build ID are never cached.
+    public var symbolIndexCacheDirectory: Optional<String>
+    /// Whether to resolve the file and line of every frame (from the DWARF line tables), defaults to `false`.
+    ///
+    /// Inlined frames are attributed to the call site of the frame inlined into them. This makes every lookup scan
+    /// the line table of the address's unit, so only enable it when the output shows the file and line (see
+    /// ``SymbolizerConfiguration/perfScriptOutputWithFileLineInformation``).
+    public var resolveSourceLocations: Bool
+    /// The memory (in bytes) the loaded images may use, `nil` (the default) for no limit.
+    ///
+    /// That's the resident part of the images' mapped files plus an estimate of their lookup structures. Once over
+    /// budget, the mapped files of the least recently used images are dropped from memory (they're paged in again when
+    /// needed) and if that isn't enough, the least recently used images are unloaded. Meant for long-running
+    /// processes that load many images over time, see ``NativeELFSymboliser/imageMemoryUsage()``.
+    public var memoryBudget: Optional<Int>
+    /// Whether to read images that are loaded into this process from memory rather than from disk, defaults to
+    /// `false`. Only meant for processes symbolising their own samples, like the profile recorder server does.
+    ///
+    /// The ELF headers, dynamic symbols and unwind information are read straight from the loaded segments (found with
+    /// `dl_iterate_phdr`), the file on disk is only opened for what isn't loaded: the full symbol table and the debug
+    /// information. If the file has been replaced since it was loaded (say during a rolling deployment), it's not used
+    /// and the dynamic symbols are still available. Images loaded elsewhere are read from disk as usual.
+    public var readLoadedImagesFromMemory: Bool
+
+    public init(
+        symbolIndexCacheDirectory: String? = nil,
+        resolveSourceLocations: Bool = false,
+        memoryBudget: Int? = nil,
+        readLoadedImagesFromMemory: Bool = false
+    ) {
+        self.symbolIndexCacheDirectory = symbolIndexCacheDirectory
+        self.resolveSourceLocations = resolveSourceLocations
+        self.memoryBudget = memoryBudget
+        self.readLoadedImagesFromMemory = readLoadedImagesFromMemory
+    }
+
+    public static var `default`: NativeELFSymboliserConfiguration {
+        return NativeELFSymboliserConfiguration()
+    }
+}
+
 public final class NativeELFSymboliser: Symbolizer & Sendable {
-    private let elfSourceCache = LockedELFSourceCacheReference()
+    private let elfSourceCache: LockedELFSourceCacheReference
 
-    public init() {}
+    public init(configuration: NativeELFSymboliserConfiguration = .default) {
+        self.elfSourceCache = LockedELFSourceCacheReference(
+            symbolIndexCacheDirectory: configuration.symbolIndexCacheDirectory,
+            resolveSourceLocations: configuration.resolveSourceLocations,
+            memoryBudget: configuration.memoryBudget,
+            readLoadedImagesFromMemory: configuration.readLoadedImagesFromMemory
+        )
+    }
 
     public func start() throws {}
 
@@ -243,8 +681,9 @@ public final class NativeELFSymboliser: Symbolizer & Sendable {
                     functionOffset: UInt(exactly: result.offset) ?? 0,
                     library: nil,
                     vmap: library,
-                    file: nil,
-                    line: nil
+                    file: result.sourceLocation?.path,
+                    // Line 0 is code without a source line.
+                    line: result.sourceLocation.flatMap { $0.line > 0 ? $0.line : nil }
                 )
             }
         )
@@ -252,13 +691,116 @@ public final class NativeELFSymboliser: Symbolizer & Sendable {
 
     public func shutdown() throws {}
 
+    public func prewarm(
+        libraries: [DynamicLibMapping],
+        cpuBudget: TimeAmount,
+        logger: Logger,
+        isCancelled: () -> Bool
+    ) throws {
+        let cpuTimeAtStart = currentThreadCPUTime()
+        var seenPaths = Set<String>()
+        var prewarmed = 0
+        for library in libraries where seenPaths.insert(library.path).inserted {
+            guard !isCancelled() else {
+                logger.debug("symbol pre-warming cancelled", metadata: ["prewarmed": "\(prewarmed)"])
+                return
+            }
+            let cpuTimeUsed = currentThreadCPUTime() - cpuTimeAtStart
+            let remainingCPUBudget = cpuBudget - cpuTimeUsed
+            // An image can't be prewarmed partially, so don't start one that likely won't fit. The images prewarmed
+            // so far are the best estimate of what the next one costs.
+            let expectedCPUTime: TimeAmount =
+                prewarmed > 0 ? .nanoseconds(cpuTimeUsed.nanoseconds / Int64(prewarmed)) : .zero
+            guard remainingCPUBudget > .zero && remainingCPUBudget >= expectedCPUTime else {
+                logger.debug(
+                    "symbol pre-warming ran out of CPU budget",
+                    metadata: [
+                        "cpu-budget": "\(cpuBudget)",
+                        "prewarmed": "\(prewarmed)",
+                    ]
+                )
+                return
+            }
+            switch self.elfSourceCache.prewarm(
+                path: library.path,
+                library: library,
+                cpuBudget: remainingCPUBudget,
+                logger: logger
+            ) {
+            case .success:
+                prewarmed += 1
+            case .failure(.outOfCPUBudget):
+                logger.debug(
+                    "symbol pre-warming ran out of CPU budget",
+                    metadata: [
+                        "cpu-budget": "\(cpuBudget)",
+                        "prewarmed": "\(prewarmed)",
+                        "library": "\(library)",
+                    ]
+                )
+                return
+            case .failure(let error):
+                logger.trace("could not pre-warm library", metadata: ["library": "\(library)", "error": "\(error)"])
+            }
+        }
+        logger.debug(
+            "symbol pre-warming done",
+            metadata: [
+                "prewarmed": "\(prewarmed)",
+                "cpu-time": "\(currentThreadCPUTime() - cpuTimeAtStart)",
+            ]
+        )
+    }
+
+    /// The memory used by every loaded image, least recently used first.
+    @available(*, noasync, message: "blocks the calling thread")
+    public func imageMemoryUsage() -> [ImageMemoryUsage] {
+        return self.elfSourceCache.memoryUsage()
+    }
+
     public var description: String {
         return "NativeELFSymboliser(cachedELFs: \(self.elfSourceCache.count))"
     }
 }
 
+extension NativeELFSymboliser {
+    /// The memory used by one loaded image (and its debug image and symbol index, if any).
+    public struct ImageMemoryUsage: Sendable, Hashable, CustomStringConvertible {
+        /// The path of the image.
+        public var path: String
+        /// The number of bytes of the image's mapped files that are resident in memory.
+        public var residentMappedBytes: Int
+        /// An estimate of the number of bytes used by the image's lookup structures.
+        public var estimatedTableBytes: Int
+
+        public var totalBytes: Int {
+            return self.residentMappedBytes + self.estimatedTableBytes
+        }
+
+        init(path: String, image: AnyElfImage) {
+            self.path = path
+            self.residentMappedBytes = image.mappedSources.reduce(0) { $0 + ($1.residentByteCount ?? 0) }
+            self.estimatedTableBytes = image.estimatedTableByteCount
+        }
+
+        public var description: String {
+            return "\(self.path): \(self.residentMappedBytes) bytes mapped, \(self.estimatedTableBytes) bytes of tables"
+        }
+    }
+}
+
 public struct SymbolizerConfiguration: Sendable {
     public var perfScriptOutputWithFileLineInformation: Bool
+    /// Whether to demangle Swift function names (like `swift demangle` does) before they're rendered.
+    ///
+    /// Every unique name is demangled only once, see ``SymbolInterner/demangled(_:)``.
+    public var demangleSymbols: Bool = false
+    /// How many stack frames to collect (across samples) before symbolising all new addresses among them in one
+    /// batch, 0 (the default) symbolises sample by sample.
+    ///
+    /// Worth it for symbolisers that can work on many addresses at once, like the `llvm-symbolizer` backend, see
+    /// ``Symbolizer/symbolise(_:logger:)``.
+    public var symbolisationBatchSize: Int = 0
 
     public static var `default`: SymbolizerConfiguration {
         return SymbolizerConfiguration(
@@ -270,6 +812,8 @@ public struct SymbolizerConfiguration: Sendable {
 /// Symbolises `StackFrame`s.
 public final class CachedSymbolizer: Sendable & CustomStringConvertible {
     public let dynamicLibraryMappings: [DynamicLibMapping]
+    /// The interner holding the strings of all frames this symboliser returned.
+    public let interner: SymbolInterner
     private let group: EventLoopGroup
     private let symbolizer: any (Symbolizer & Sendable)
     private let logger: Logger
@@ -277,17 +821,62 @@ public final class CachedSymbolizer: Sendable & CustomStringConvertible {
     private let state: NIOLockedValueBox<State> = NIOLockedValueBox(State())
 
     private struct State: Sendable {
-        var cache: [UInt: SymbolisedStackFrame] = [:]
+        var cache: [UInt: InternedStackFrame] = [:]
+        /// Where in `renderedFrameStorage` the rendered text for an instruction pointer & style lives.
+        var renderedFrames: [RenderedFrameKey: Range<Int>] = [:]
+        /// The arena holding the text of `renderedFrames`, only ``writeRenderedFrame(_:style:into:render:)`` (that is
+        /// perf script output) writes to it.
+        ///
+        /// Perf script output copies every frame's text straight into the output, interning the text instead would
+        /// cost a `String` per rendered frame and a lookup per written frame. All other renderers work on IDs (see
+        /// ``renderedFrameID(_:style:render:)``), so the arena stays empty for them.
+        var renderedFrameStorage: ByteBuffer = ByteBuffer()
+        /// The interned rendered text for an instruction pointer & style, `nil` if it rendered to nothing.
+        var renderedFrameIDs: [RenderedFrameKey: Optional<SymbolInterner.ID>] = [:]
+
+        /// Empties the caches if they hold too many frames (or would after adding `adding` frames to `cache`).
+        mutating func removeAllIfTooLarge(adding: Int = 0) {
+            if self.cache.count + adding > 16_000 {
+                self.cache.removeAll(keepingCapacity: true)
+                self.renderedFrames.removeAll(keepingCapacity: true)
+                self.renderedFrameStorage.clear()
+                self.renderedFrameIDs.removeAll(keepingCapacity: true)
+            }
+        }
+
+        /// Empties the rendered frame arena if it's too large, that doesn't require symbolising anything again.
+        mutating func removeRenderedFramesIfTooLarge() {
+            if self.renderedFrameStorage.readableBytes > 32 * 1024 * 1024 {
+                self.renderedFrames.removeAll(keepingCapacity: true)
+                self.renderedFrameStorage.clear()
+            }
+        }
+    }
+
+    /// The different ways renderers turn a symbolised frame into text.
+    internal enum RenderedFrameStyle: Hashable, Sendable {
+        case perfScript(includeFileLineInformation: Bool)
+        case flamegraphCollapsed
+    }
+
+    private struct RenderedFrameKey: Hashable, Sendable {
+        var instructionPointer: UInt
+        var style: RenderedFrameStyle
     }
 
+    /// - parameters:
+    ///   - interner: The ``SymbolInterner`` to intern symbolised frames into, pass the same one to all symbolisers
+    ///               that take part in a conversion.
     public init(
         configuration: SymbolizerConfiguration,
         symbolizer: Symbolizer,
         dynamicLibraryMappings: [DynamicLibMapping],
+        interner: SymbolInterner = SymbolInterner(),
         group: EventLoopGroup,
         logger: Logger
     ) {
         self.configuration = configuration
+        self.interner = interner
         self.dynamicLibraryMappings =
             dynamicLibraryMappings
             .compactMap { mapping in
@@ -310,7 +899,29 @@ public final class CachedSymbolizer: Sendable & CustomStringConvertible {
         return self.state.withLockedValue { $0.cache.count }
     }
 
+    /// What's needed to symbolise a stack frame, see ``match(_:)``.
+    private enum Match {
+        /// The frame is in a library, so the underlying symboliser needs to symbolise `query`.
+        case query(SymbolisationQuery)
+        /// The frame can't be symbolised, this is its final result.
+        case unsymbolisable(SymbolisedStackFrame)
+    }
+
     private func symboliseSlow(_ stackFrame: StackFrame) throws -> SymbolisedStackFrame {
+        switch self.match(stackFrame) {
+        case .query(let query):
+            return try self.symbolizer.symbolise(
+                fileVirtualAddressIP: query.fileVirtualAddressIP,
+                library: query.library,
+                logger: self.logger
+            )
+        case .unsymbolisable(let symbolised):
+            return symbolised
+        }
+    }
+
+    /// Finds the library `stackFrame` belongs to.
+    private func match(_ stackFrame: StackFrame) -> Match {
         let matchedIndex = self.dynamicLibraryMappings.binarySearch { candidate in
             if stackFrame.instructionPointer < candidate.segmentStartAddress {
                 return .candidateIsTooHigh
@@ -351,18 +962,20 @@ public final class CachedSymbolizer: Sendable & CustomStringConvertible {
                     "ip": "0x\(String(stackFrame.instructionPointer, radix: 16))"
                 ]
             )
-            return SymbolisedStackFrame(
-                allFrames: [
-                    SymbolisedStackFrame.SingleFrame(
-                        address: stackFrame.instructionPointer,
-                        functionName: "unknown @ 0x\(String(stackFrame.instructionPointer, radix: 16))",
-                        functionOffset: 0,
-                        library: nil,
-                        vmap: nil,
-                        file: nil,
-                        line: nil
-                    )
-                ]
+            return .unsymbolisable(
+                SymbolisedStackFrame(
+                    allFrames: [
+                        SymbolisedStackFrame.SingleFrame(
+                            address: stackFrame.instructionPointer,
+                            functionName: "unknown @ 0x\(String(stackFrame.instructionPointer, radix: 16))",
+                            functionOffset: 0,
+                            library: nil,
+                            vmap: nil,
+                            file: nil,
+                            line: nil
+                        )
+                    ]
+                )
             )
         }
 
@@ -374,18 +987,20 @@ public final class CachedSymbolizer: Sendable & CustomStringConvertible {
                     "segmentSlide": "0x\(String(matched.segmentSlide, radix: 16))",
                 ]
             )
-            return SymbolisedStackFrame(
-                allFrames: [
-                    SymbolisedStackFrame.SingleFrame(
-                        address: stackFrame.instructionPointer,
-                        functionName: "malformed-input @ 0x\(String(stackFrame.instructionPointer, radix: 16))",
-                        functionOffset: 0,
-                        library: nil,
-                        vmap: nil,
-                        file: nil,
-                        line: nil
-                    )
-                ]
+            return .unsymbolisable(
+                SymbolisedStackFrame(
+                    allFrames: [
+                        SymbolisedStackFrame.SingleFrame(
+                            address: stackFrame.instructionPointer,
+                            functionName: "malformed-input @ 0x\(String(stackFrame.instructionPointer, radix: 16))",
+                            functionOffset: 0,
+                            library: nil,
+                            vmap: nil,
+                            file: nil,
+                            line: nil
+                        )
+                    ]
+                )
             )
         }
 
@@ -399,27 +1014,148 @@ public final class CachedSymbolizer: Sendable & CustomStringConvertible {
             ]
         )
 
-        return try self.symbolizer.symbolise(
-            fileVirtualAddressIP: fileVirtualAddressIP,
-            library: matched,
-            logger: self.logger
-        )
+        return .query(SymbolisationQuery(fileVirtualAddressIP: fileVirtualAddressIP, library: matched))
     }
 
     public func symbolise(_ stackFrame: StackFrame) throws -> SymbolisedStackFrame {
+        return self.interner.resolve(try self.symboliseInterned(stackFrame))
+    }
+
+    /// Symbolises `stackFrame` without materialising any strings, look them up in ``interner`` when needed.
+    public func symboliseInterned(_ stackFrame: StackFrame) throws -> InternedStackFrame {
         return try self.state.withLockedValue { state in
             defer {
-                if state.cache.count > 16_000 {
-                    state.cache.removeAll(keepingCapacity: true)
-                }
+                state.removeAllIfTooLarge()
+            }
+            return try self.symboliseInterned(stackFrame, state: &state)
+        }
+    }
+
+    private func symboliseInterned(_ stackFrame: StackFrame, state: inout State) throws -> InternedStackFrame {
+        if let symd = state.cache[stackFrame.instructionPointer] {
+            return symd
+        } else {
+            let symd = self.intern(try self.symboliseSlow(stackFrame))
+            state.cache[stackFrame.instructionPointer] = symd
+            return symd
+        }
+    }
+
+    private func intern(_ symbolised: SymbolisedStackFrame) -> InternedStackFrame {
+        let symd = self.interner.intern(symbolised)
+        return self.configuration.demangleSymbols ? self.interner.demangled(symd) : symd
+    }
+
+    /// Symbolises those of `stackFrames` that aren't cached yet in one batch, so that looking them up afterwards
+    /// hits the cache.
+    ///
+    /// This only pays off if the underlying symboliser implements ``Symbolizer/symbolise(_:logger:)`` better than
+    /// one query at a time. At most a few thousand frames should be prefetched at once, the cache doesn't hold many
+    /// more.
+    @available(*, noasync, message: "blocks the calling thread")
+    public func prefetch(_ stackFrames: some Sequence<StackFrame>) throws {
+        var seen = Set<UInt>()
+        let missing = self.state.withLockedValue { state in
+            stackFrames.filter { stackFrame in
+                state.cache[stackFrame.instructionPointer] == nil && seen.insert(stackFrame.instructionPointer).inserted
+            }
+        }
+        guard !missing.isEmpty else {
+            return
+        }
+
+        var queries: [SymbolisationQuery] = []
+        var queriedFrames: [StackFrame] = []
+        var symbolised: [(StackFrame, SymbolisedStackFrame)] = []
+        queries.reserveCapacity(missing.count)
+        queriedFrames.reserveCapacity(missing.count)
+        for stackFrame in missing {
+            switch self.match(stackFrame) {
+            case .query(let query):
+                queries.append(query)
+                queriedFrames.append(stackFrame)
+            case .unsymbolisable(let unsymbolisable):
+                symbolised.append((stackFrame, unsymbolisable))
+            }
+        }
+        // Not under the lock, the batch may take a while.
+        let results = queries.isEmpty ? [] : try self.symbolizer.symbolise(queries, logger: self.logger)
+        precondition(results.count == queries.count, "\(self.symbolizer) returned \(results.count) frames")
+        symbolised.append(contentsOf: zip(queriedFrames, results))
+
+        let interned = symbolised.map { ($0.0.instructionPointer, self.intern($0.1)) }
+        self.state.withLockedValue { state in
+            state.removeAllIfTooLarge(adding: interned.count)
+            for (instructionPointer, symd) in interned {
+                state.cache[instructionPointer] = symd
+            }
+        }
+    }
+
+    /// Appends the text for the symbolised `stackFrame` to `output`.
+    ///
+    /// The text is produced by `render` the first time `stackFrame`'s instruction pointer is seen in `style`, after
+    /// that it's copied from the cache.
+    ///
+    /// - returns: The number of bytes written.
+    @discardableResult
+    internal func writeRenderedFrame(
+        _ stackFrame: StackFrame,
+        style: RenderedFrameStyle,
+        into output: inout ByteBuffer,
+        render: (InternedStackFrame, inout ByteBuffer) throws -> Void
+    ) throws -> Int {
+        return try self.state.withLockedValue { state in
+            defer {
+                state.removeRenderedFramesIfTooLarge()
+                state.removeAllIfTooLarge()
             }
-            if let symd = state.cache[stackFrame.instructionPointer] {
-                return symd
+            let key = RenderedFrameKey(instructionPointer: stackFrame.instructionPointer, style: style)
+            let range: Range<Int>
+            if let cachedRange = state.renderedFrames[key] {
+                range = cachedRange
             } else {
-                let symd = try self.symboliseSlow(stackFrame)
-                state.cache[stackFrame.instructionPointer] = symd
-                return symd
+                let symd = try self.symboliseInterned(stackFrame, state: &state)
+                let start = state.renderedFrameStorage.writerIndex
+                do {
+                    try render(symd, &state.renderedFrameStorage)
+                } catch {
+                    state.renderedFrameStorage.moveWriterIndex(to: start)
+                    throw error
+                }
+                range = start..<state.renderedFrameStorage.writerIndex
+                state.renderedFrames[key] = range
+            }
+            state.renderedFrameStorage.withUnsafeReadableBytes { storage in
+                output.writeBytes(UnsafeRawBufferPointer(rebasing: storage[range]))
             }
+            return range.count
+        }
+    }
+
+    /// Like ``writeRenderedFrame(_:style:into:render:)`` but returns the rendered text as an ID in ``interner``.
+    ///
+    /// Unlike the instruction pointer, the ID stays meaningful across symbolisers sharing the interner, so it can be
+    /// used to aggregate stacks. Returns `nil` if the frame rendered to nothing.
+    internal func renderedFrameID(
+        _ stackFrame: StackFrame,
+        style: RenderedFrameStyle,
+        render: (InternedStackFrame, inout ByteBuffer) throws -> Void
+    ) throws -> SymbolInterner.ID? {
+        return try self.state.withLockedValue { state in
+            defer {
+                state.removeAllIfTooLarge()
+            }
+            let key = RenderedFrameKey(instructionPointer: stackFrame.instructionPointer, style: style)
+            if let id = state.renderedFrameIDs[key] {
+                return id
+            }
+            let symd = try self.symboliseInterned(stackFrame, state: &state)
+            var rendered = ByteBuffer()
+            try render(symd, &rendered)
+            let id = rendered.readableBytes > 0 ? self.interner.intern(String(buffer: rendered)) : nil
+            state.renderedFrameIDs[key] = .some(id)
+            return id
         }
     }
 
@@ -428,12 +1164,22 @@ public final class CachedSymbolizer: Sendable & CustomStringConvertible {
             CachedSymbolizer(\
             cache: \(self.cacheCount), \
             vmaps: \(self.dynamicLibraryMappings.count), \
+            interner: \(self.interner.count), \
             sym: \(self.symbolizer.description)\
             )
             """
     }
 }
 
+/// The CPU time the calling thread has consumed so far.
+internal func currentThreadCPUTime() -> TimeAmount {
+    var now = timespec()
+    guard clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) == 0 else {
+        return .zero
+    }
+    return .seconds(Int64(now.tv_sec)) + .nanoseconds(Int64(now.tv_nsec))
+}
+
 internal enum BinarySearchOrder {
     case candidateIsTooLow
     case found
@@ -91,6 +91,26 @@ public struct ProfileRecorderServerConfiguration: Sendable {
     internal var unixDomainSocketPath: Optional<String>
     internal let pprofRootSlug = ["debug"]
 
+    /// The CPU time budget for pre-warming the symbolizer when the server starts, `nil` (the default) disables
+    /// pre-warming.
+    ///
+    /// With pre-warming, the server loads the symbol tables and inline frame information of all the images loaded
+    /// into the process on a low-priority background thread. That way, the first profile request doesn't have to wait
+    /// for them.
+    public var symbolizerPrewarmingCPUBudget: Optional<TimeAmount> = nil
+
+    /// A directory to cache the native symbolizer's symbol indexes in, `nil` (the default) disables the cache.
+    ///
+    /// Symbol indexes are keyed by GNU build ID, so a restarted server (or another process running the same binaries)
+    /// doesn't need to build them again. See ``NativeELFSymboliserConfiguration/symbolIndexCacheDirectory``.
+    public var symbolIndexCacheDirectory: Optional<String> = nil
+
+    /// The memory (in bytes) the native symbolizer's loaded images may use, `nil` (the default) for no limit.
+    ///
+    /// Long-running servers load the images of every library they ever see, this caps the memory they use. See
+    /// ``NativeELFSymboliserConfiguration/memoryBudget``.
+    public var symbolizerMemoryBudget: Optional<Int> = nil
+
     /// The default configuration for a profile recording server.
     public static var `default`: Self {
         return ProfileRecorderServerConfiguration(
@@ -130,6 +150,17 @@ public struct ProfileRecorderServerConfiguration: Sendable {
     /// - `PROFILE_RECORDER_SERVER_URL_PATTERN`
     ///   Same as above, but may contain `{PID}` or `{UUID}` which are expanded at runtime.
     ///
+    /// - `PROFILE_RECORDER_SERVER_PREWARM_CPU_BUDGET`
+    ///   Enables symbolizer pre-warming with the given CPU time budget, for example `10 s` (the unit defaults to
+    ///   seconds). See ``symbolizerPrewarmingCPUBudget``.
+    ///
+    /// - `PROFILE_RECORDER_SERVER_SYMBOL_INDEX_CACHE_DIR`
+    ///   Caches the symbol indexes in the given directory. See ``symbolIndexCacheDirectory``.
+    ///
+    /// - `PROFILE_RECORDER_SERVER_SYMBOLIZER_MEMORY_BUDGET`
+    ///   Caps the memory used by the symbolizer's loaded images to the given number of bytes. See
+    ///   ``symbolizerMemoryBudget``.
+    ///
     /// The direct URL key takes precedence over the pattern key.
     /// If neither key is provided, the default configuration (no bind target) is returned.
     /// The event loop group is always set to the shared singleton group.
@@ -141,13 +172,31 @@ public struct ProfileRecorderServerConfiguration: Sendable {
     }
 
     package static func _parseFromEnvironment(_ env: [String: String]) throws -> Self {
+        var configuration: Self
         if let direct = env["PROFILE_RECORDER_SERVER_URL"] {
-            return try Self.parseBindTarget(from: direct, pattern: false)
+            configuration = try Self.parseBindTarget(from: direct, pattern: false)
+        } else if let pattern = env["PROFILE_RECORDER_SERVER_URL_PATTERN"] {
+            configuration = try Self.parseBindTarget(from: pattern, pattern: true)
+        } else {
+            configuration = .default
         }
-        if let pattern = env["PROFILE_RECORDER_SERVER_URL_PATTERN"] {
-            return try Self.parseBindTarget(from: pattern, pattern: true)
+        if let prewarmBudget = env["PROFILE_RECORDER_SERVER_PREWARM_CPU_BUDGET"] {
+            configuration.symbolizerPrewarmingCPUBudget = try TimeAmount(prewarmBudget, defaultUnit: "s")
         }
-        return .default
+        if let symbolIndexCacheDirectory = env["PROFILE_RECORDER_SERVER_SYMBOL_INDEX_CACHE_DIR"],
+            !symbolIndexCacheDirectory.isEmpty
+        {
+            configuration.symbolIndexCacheDirectory = symbolIndexCacheDirectory
+        }
+        if let memoryBudget = env["PROFILE_RECORDER_SERVER_SYMBOLIZER_MEMORY_BUDGET"] {
+            guard let bytes = Int(memoryBudget), bytes > 0 else {
+                throw ProfileRecorderServer.Error(
+                    message: "'\(memoryBudget)' is not a valid symbolizer memory budget (a number of bytes)"
+                )
+            }
+            configuration.symbolizerMemoryBudget = bytes
+        }
+        return configuration
     }
 
     #if compiler(>=6.2)
@@ -391,10 +440,22 @@ public struct ProfileRecorderServer: Sendable {
             return try await (body(ServerInfo(startResult: .couldNotStart(error))))
         }
 
-        let symbolizer = ProfileRecorderSampler._makeDefaultSymbolizer()
+        let symbolizer = ProfileRecorderSampler._makeDefaultSymbolizer(
+            nativeConfiguration: NativeELFSymboliserConfiguration(
+                symbolIndexCacheDirectory: self.configuration.symbolIndexCacheDirectory,
+                memoryBudget: self.configuration.symbolizerMemoryBudget,
+                // The server only ever symbolises its own process.
+                readLoadedImagesFromMemory: true
+            )
+        )
         try await NIOThreadPool.singleton.runIfActive {
             try symbolizer.start()
         }
+        let prewarmTask = self.configuration.symbolizerPrewarmingCPUBudget.map { cpuBudget in
+            Task.detached(priority: .background) {
+                await Self.prewarm(symbolizer: symbolizer, cpuBudget: cpuBudget, logger: logger)
+            }
+        }
 
         return try await asyncDo {
             return try await serverChannel.executeThenClose { server in
@@ -473,12 +534,49 @@ public struct ProfileRecorderServer: Sendable {
             if let udsPath = configuration.unixDomainSocketPath {
                 _ = try? await FileSystem.shared.removeItem(at: FilePath(udsPath))
             }
+            // Pre-warming is pointless once we're shutting down, it stops before the next library.
+            prewarmTask?.cancel()
+            await prewarmTask?.value
             try await NIOThreadPool.singleton.runIfActive {
                 try symbolizer.shutdown()
             }
         }
     }
 
+    private static func prewarm(symbolizer: any Symbolizer, cpuBudget: TimeAmount, logger: Logger) async {
+        // A dedicated thread so that we can lower its priority without affecting anybody else.
+        let threadPool = NIOThreadPool(numberOfThreads: 1)
+        threadPool.start()
+        let prewarmStart = NIODeadline.now()
+        // The pre-warming runs on the thread pool, outside of this task, so it can't check for cancellation itself.
+        let cancelled = NIOLockedValueBox(false)
+        do {
+            try await withTaskCancellationHandler {
+                try await threadPool.runIfActive {
+                    #if os(Linux)
+                    // On Linux, the nice value is per thread.
+                    _ = setpriority(PRIO_PROCESS, 0, 19)
+                    #endif
+                    try symbolizer.prewarm(
+                        libraries: ProfileRecorderSampler._currentDynamicLibraryMappings(),
+                        cpuBudget: cpuBudget,
+                        logger: logger,
+                        isCancelled: { cancelled.withLockedValue { $0 } }
+                    )
+                }
+            } onCancel: {
+                cancelled.withLockedValue { $0 = true }
+            }
+            logger.debug(
+                "symbolizer pre-warming complete",
+                metadata: ["duration": "\((NIODeadline.now() - prewarmStart).prettyPrint)"]
+            )
+        } catch {
+            logger.info("symbolizer pre-warming failed, continuing regardless", metadata: ["error": "\(error)"])
+        }
+        try? await threadPool.shutdownGracefully()
+    }
+
     func respondWithFailure(string: String, code: HTTPResponseStatus, _ outbound: Outbound) async throws {
         try await outbound.write(
             .head(
@@ -551,7 +649,7 @@ public struct ProfileRecorderServer: Sendable {
                 curl \(exampleCURLArgs.joined(separator: " ")) > /tmp/samples.perf
                 ```
 
-                To also immediately demangle the symbols, run
+                To also immediately demangle the symbols, add `"demangle": true` to the body or run
 
                 ```
                 curl \(exampleCURLArgs.joined(separator: " ")) | swift demangle --simplified > /tmp/samples.perf
@@ -571,6 +669,9 @@ public struct ProfileRecorderServer: Sendable {
                 open /tmp/samples.svg
                 ```
 
+                Or let the server draw the flame graph: `GET /debug/flamegraph.svg?seconds=10` responds with an SVG
+                that any browser can display (`seconds` and `rate` work like for `/debug/pprof/profile`).
+
                 ### Firefox Profiler (https://profiler.firefox.com):
 
                 How to use it?
@@ -619,6 +720,32 @@ public struct ProfileRecorderServer: Sendable {
         )
     }
 
+    /// Makes a `SampleRequest` from Go-style `seconds`, `rate`, `symbolizer` and `demangle` query parameters.
+    func makeSampleRequest(fromQueryOf decodedURI: DecodedURL, format: ProfileRecorderOutputFormat) -> SampleRequest {
+        let seconds = (Int(decodedURI.queryParams["seconds"].flatMap { $0 } ?? "not set") ?? 30)
+            .clamping(to: 0...1000) // 30 s seems to be Golang's default
+        let symbolizerKind =
+            decodedURI.queryParams["symbolizer"].flatMap { kind in
+                ProfileRecorderSymbolizerKind(rawValue: kind ?? "n/a")
+            } ?? (decodedURI.components.contains("symbolizer=fake") ? .fake : .native)
+        let sampleRate = (Int(decodedURI.queryParams["rate"].flatMap { $0 } ?? "not set") ?? 100)
+            .clamping(to: 0...1000) // 100 Hz, seems to be Golang's default
+        let numberOfSamples = seconds * sampleRate
+        let timeIntervalBetweenSamplesMS = (1000 / sampleRate).clamping(to: 1...100_000)
+        // `?demangle`, `?demangle=1` and `?demangle=true` all turn it on.
+        let demangle = decodedURI.queryParams["demangle"].map { value in
+            value.map { ["1", "true", "yes"].contains($0.lowercased()) } ?? true
+        }
+
+        return SampleRequest(
+            numberOfSamples: numberOfSamples,
+            timeInterval: .milliseconds(Int64(timeIntervalBetweenSamplesMS)),
+            format: format,
+            symbolizer: symbolizerKind,
+            demangle: demangle ?? false
+        )
+    }
+
     func handleRequest(
         _ request: NIOHTTPServerRequestFull,
         outbound: NIOAsyncChannelOutboundWriter<HTTPPart<HTTPResponseHead, ByteBuffer>>,
@@ -633,23 +760,13 @@ public struct ProfileRecorderServer: Sendable {
                 prefix: self.configuration.pprofRootSlug,
                 oneOfPaths: [["pprof", "profile"], ["pprof", "symbolizer=fake", "profile"]]
             ) != nil:
-                let seconds = (Int(decodedURI.queryParams["seconds"].flatMap { $0 } ?? "not set") ?? 30)
-                    .clamping(to: 0...1000) // 30 s seems to be Golang's default
-                let symbolizerKind =
-                    decodedURI.queryParams["symbolizer"].flatMap { kind in
-                        ProfileRecorderSymbolizerKind(rawValue: kind ?? "n/a")
-                    } ?? (decodedURI.components.contains("symbolizer=fake") ? .fake : .native)
-                let sampleRate = (Int(decodedURI.queryParams["rate"].flatMap { $0 } ?? "not set") ?? 100)
-                    .clamping(to: 0...1000) // 100 Hz, seems to be Golang's default
-                let numberOfSamples = seconds * sampleRate
-                let timeIntervalBetweenSamplesMS = (1000 / sampleRate).clamping(to: 1...100_000)
-
-                sampleRequest = SampleRequest(
-                    numberOfSamples: numberOfSamples,
-                    timeInterval: .milliseconds(Int64(timeIntervalBetweenSamplesMS)),
-                    format: .pprofSymbolized,
-                    symbolizer: symbolizerKind
-                )
+                sampleRequest = self.makeSampleRequest(fromQueryOf: decodedURI, format: .pprofSymbolized)
+            case (.GET, .some(let decodedURI))
+            where decodedURI.components.matches(
+                prefix: self.configuration.pprofRootSlug,
+                oneOfPaths: [["flamegraph.svg"]]
+            ) != nil:
+                sampleRequest = self.makeSampleRequest(fromQueryOf: decodedURI, format: .flamegraphSVGSymbolized)
             case (.POST, .some(let decodedURI))
             where decodedURI.components.isEmpty
                 || decodedURI.components.matches(
@@ -700,40 +817,61 @@ public struct ProfileRecorderServer: Sendable {
                 try await self.sendNotFoundErrorWithExplainer(outbound)
                 return
             }
-            try await ProfileRecorderSampler.sharedInstance._withSamples(
-                sampleCount: sampleRequest.numberOfSamples,
-                timeBetweenSamples: sampleRequest.timeInterval,
-                format: sampleRequest.format,
-                symbolizer: sampleRequest.symbolizer == .native ? symbolizer : _ProfileRecorderFakeSymbolizer(),
-                logger: logger
-            ) { samples in
-                try await FileSystem.shared.withFileHandle(forReadingAt: FilePath(samples)) { handle in
-                    try await outbound.write(
-                        .head(
-                            HTTPResponseHead(
-                                version: .http1_1,
-                                status: .ok,
-                                headers: [
-                                    "connection": "close",
-                                    "content-disposition": "filename=\"samples-\(getpid())-\(time(nil)).perf\"",
-                                    "content-type": "application/octet-stream",
-                                ]
-                            )
-                        )
-                    )
-                    var reader = handle.bufferedReader()
-                    while true {
-                        let chunk = try await reader.read(.mebibytes(4))
-                        guard chunk.readableBytes > 0 else { break }
-                        do {
-                            try await outbound.write(.body(chunk))
-                        } catch {
-                            break
-                        }
+            // Compressing is worth it for all formats, perf script output in particular is very repetitive.
+            let compression: ProfileRecorderOutputCompression =
+                request.head.headers.acceptsContentEncoding("gzip") ? .gzip : .none
+            var responseHead = HTTPResponseHead(
+                version: .http1_1,
+                status: .ok,
+                headers: [
+                    "connection": "close",
+                    "content-type": sampleRequest.format.contentType,
+                    "vary": "accept-encoding",
+                ]
+            )
+            let fileName = "samples-\(getpid())-\(time(nil)).\(sampleRequest.format.fileExtension)"
+            if sampleRequest.format == .flamegraphSVGSymbolized {
+                // So browsers show the flame graph rather than downloading it.
+                responseHead.headers.add(name: "content-disposition", value: "inline; filename=\"\(fileName)\"")
+            } else {
+                responseHead.headers.add(name: "content-disposition", value: "filename=\"\(fileName)\"")
+            }
+            if compression == .gzip {
+                responseHead.headers.add(name: "content-encoding", value: "gzip")
+            }
+            let finalResponseHead = responseHead
+            // We only send the response head once there's output, so failures before that still get reported.
+            let responseStarted = NIOLockedValueBox(false)
+            @Sendable func startResponseIfNeeded() async throws {
+                let needsHead = responseStarted.withLockedValue { started in
+                    defer {
+                        started = true
                     }
-                    try? await outbound.write(.end(nil))
+                    return !started
+                }
+                if needsHead {
+                    try await outbound.write(.head(finalResponseHead))
+                }
+            }
+            do {
+                try await ProfileRecorderSampler.sharedInstance._streamSamples(
+                    sampleCount: sampleRequest.numberOfSamples,
+                    timeBetweenSamples: sampleRequest.timeInterval,
+                    format: sampleRequest.format,
+                    compression: compression,
+                    symbolizer: sampleRequest.symbolizer == .native ? symbolizer : _ProfileRecorderFakeSymbolizer(),
+                    symbolizerConfiguration: sampleRequest.symbolizerConfiguration,
+                    logger: logger
+                ) { chunk in
+                    try await startResponseIfNeeded()
+                    try await outbound.write(.body(chunk))
                 }
+                try await startResponseIfNeeded()
+            } catch let error where responseStarted.withLockedValue({ $0 }) {
+                // Too late to send an error response, the client will see the response cut short.
+                logger.warning("failed to stream samples", metadata: ["error": "\(error)"])
             }
+            try? await outbound.write(.end(nil))
         } catch {
             try await self.respondWithFailure(string: "\(error)", code: .internalServerError, outbound)
             return
@@ -741,6 +879,40 @@ public struct ProfileRecorderServer: Sendable {
     }
 }
 
+extension ProfileRecorderOutputFormat {
+    var contentType: String {
+        switch self {
+        case .flamegraphSVGSymbolized:
+            return "image/svg+xml"
+        case .speedscopeSymbolized, .firefoxProfilerSymbolized:
+            return "application/json"
+        case .perfSymbolized, .pprofSymbolized, .flamegraphCollapsedSymbolized, .otlpProfilesSymbolized, .raw:
+            return "application/octet-stream"
+        }
+    }
+
+    var fileExtension: String {
+        switch self {
+        case .perfSymbolized:
+            return "perf"
+        case .pprofSymbolized:
+            return "pb"
+        case .flamegraphCollapsedSymbolized:
+            return "collapsed"
+        case .flamegraphSVGSymbolized:
+            return "svg"
+        case .speedscopeSymbolized:
+            return "speedscope.json"
+        case .firefoxProfilerSymbolized:
+            return "json"
+        case .otlpProfilesSymbolized:
+            return "otlp.pb"
+        case .raw:
+            return "raw"
+        }
+    }
+}
+
 enum ProfileRecorderSymbolizerKind: String, Sendable & Codable {
     case native
     case fake
@@ -751,6 +923,8 @@ struct SampleRequest: Sendable & Codable {
     var timeInterval: TimeAmount
     var format: ProfileRecorderOutputFormat
     var symbolizer: ProfileRecorderSymbolizerKind
+    /// Whether to demangle the Swift function names, saves piping the output through `swift demangle`.
+    var demangle: Bool
 
     typealias SampleFormat = ProfileRecorderOutputFormat
 
@@ -759,18 +933,27 @@ struct SampleRequest: Sendable & Codable {
         case timeInterval
         case format
         case symbolizer
+        case demangle
     }
 
     internal init(
         numberOfSamples: Int,
         timeInterval: TimeAmount,
         format: SampleFormat,
-        symbolizer: ProfileRecorderSymbolizerKind
+        symbolizer: ProfileRecorderSymbolizerKind,
+        demangle: Bool = false
     ) {
         self.numberOfSamples = numberOfSamples
         self.timeInterval = timeInterval
         self.format = format
         self.symbolizer = symbolizer
+        self.demangle = demangle
+    }
+
+    var symbolizerConfiguration: SymbolizerConfiguration {
+        var configuration = SymbolizerConfiguration.default
+        configuration.demangleSymbols = self.demangle
+        return configuration
     }
 
     init(from decoder: any Decoder) throws {
@@ -784,6 +967,7 @@ struct SampleRequest: Sendable & Codable {
         self.format = try container.decodeIfPresent(SampleFormat.self, forKey: .format) ?? .perfSymbolized
         self.symbolizer =
             try container.decodeIfPresent(ProfileRecorderSymbolizerKind.self, forKey: .symbolizer) ?? .native
+        self.demangle = try container.decodeIfPresent(Bool.self, forKey: .demangle) ?? false
     }
 
     func encode(to encoder: any Encoder) throws {
@@ -799,6 +983,9 @@ struct SampleRequest: Sendable & Codable {
         if self.symbolizer != .native {
             try container.encode(self.symbolizer, forKey: .symbolizer)
         }
+        if self.demangle {
+            try container.encode(self.demangle, forKey: .demangle)
+        }
     }
 }
 
@@ -899,6 +1086,31 @@ extension Array where Element == String {
     }
 }
 
+extension HTTPHeaders {
+    /// Whether the `accept-encoding` header allows `contentEncoding` (say `gzip`), honouring `q=0` exclusions.
+    func acceptsContentEncoding(_ contentEncoding: String) -> Bool {
+        var accepted = false
+        for value in self[canonicalForm: "accept-encoding"] {
+            let parameters = value.split(separator: ";").map { String($0.filter { !$0.isWhitespace }).lowercased() }
+            guard let coding = parameters.first, coding == contentEncoding || coding == "*" else {
+                continue
+            }
+            let quality = parameters.dropFirst().lazy.compactMap { parameter -> Double? in
+                guard parameter.hasPrefix("q=") else {
+                    return nil
+                }
+                return Double(parameter.dropFirst(2))
+            }.first ?? 1
+            if coding == contentEncoding {
+                // An explicit mention wins over the wildcard.
+                return quality > 0
+            }
+            accepted = quality > 0
+        }
+        return accepted
+    }
+}
+
 extension BinaryInteger {
     func clamping(to: ClosedRange<Self>) -> Self {
         if self < to.lowerBound {
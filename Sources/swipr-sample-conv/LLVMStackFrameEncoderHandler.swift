@@ -28,6 +28,8 @@ final internal class LLVMSymbolizerEncoderHandler: ChannelOutboundHandler {
 
     private let fileManager: FileManager
     private let logger: Logger
+    /// Whether the library at a path exists, so that we only check once per library rather than once per query.
+    private var fileExists: [String: Bool] = [:]
 
     internal init(logger: Logger) {
         self.fileManager = FileManager.default
@@ -39,7 +41,14 @@ final internal class LLVMSymbolizerEncoderHandler: ChannelOutboundHandler {
 
         var buffer = context.channel.allocator.buffer(capacity: 256)
 
-        if self.fileManager.fileExists(atPath: query.library.path) {
+        let fileExists: Bool
+        if let cached = self.fileExists[query.library.path] {
+            fileExists = cached
+        } else {
+            fileExists = self.fileManager.fileExists(atPath: query.library.path)
+            self.fileExists[query.library.path] = fileExists
+        }
+        if fileExists {
             buffer.writeString("\"")
             buffer.writeString(query.library.path)
             buffer.writeString("\" 0x")
@@ -28,6 +28,9 @@ import NIOExtras
 public struct LLVMSymboliserConfig: Sendable {
     var viaJSON: Bool
     var unstuckerWorkaround: Bool
+    /// How many `llvm-symbolizer` processes to run. Each library is always symbolised by the same process, so its
+    /// debug information is only loaded once.
+    var processCount: Int = 1
 }
 
 #if canImport(Darwin) && !os(macOS)
@@ -62,17 +65,46 @@ internal final class LLVMSymboliser: Symbolizer & Sendable {
     }
 }
 #else
-/// Symbolises `StackFrame`s using `llvm-symbolizer`.
+/// Symbolises `StackFrame`s using a pool of `llvm-symbolizer` processes.
+///
+/// The libraries are sharded across the processes. Queries are pipelined: a batch of queries is written to the
+/// processes all at once and `llvm-symbolizer` answers them in order, so a batch costs roughly one round trip per
+/// process rather than one per address.
 internal final class LLVMSymboliser: Symbolizer & Sendable {
+    private static let timeout: TimeAmount = .seconds(10)
+
     private let group: EventLoopGroup
     private let logger: Logger
     private let config: LLVMSymboliserConfig
     private let state = NIOLockedValueBox(State())
 
+    struct TimeoutError: Error {
+        var query: SymbolisationQuery
+    }
+
+    struct Instance: Sendable {
+        var process: Process
+        var channel: Channel
+        var unstucker: RepeatedTask?
+        /// The answer to the query written last, only accessed on the channel's event loop.
+        var lastAnswer: NIOLoopBoundBox<EventLoopFuture<SymbolisedStackFrame>?>
+    }
+
     struct State: Sendable {
-        var process: Process? = nil
-        var channel: Channel? = nil
-        var unstucker: RepeatedTask? = nil
+        var instances: [Instance] = []
+        /// The index of the instance symbolising a library, by the library's path.
+        var shards: [String: Int] = [:]
+
+        mutating func shard(for path: String) -> Int {
+            if let shard = self.shards[path] {
+                return shard
+            }
+            precondition(!self.instances.isEmpty, "LLVMSymboliser not started")
+            // Round robin, that spreads the first few (and usually busiest) libraries across all processes.
+            let shard = self.shards.count % self.instances.count
+            self.shards[path] = shard
+            return shard
+        }
     }
 
     internal init(
@@ -87,6 +119,24 @@ internal final class LLVMSymboliser: Symbolizer & Sendable {
 
     @available(*, noasync, message: "Blocks the calling thread")
     internal func start() throws {
+        var instances: [Instance] = []
+        do {
+            for _ in 0..<max(1, self.config.processCount) {
+                instances.append(try self.startInstance())
+            }
+        } catch {
+            try? Self.shutdown(instances)
+            throw error
+        }
+
+        self.state.withLockedValue { state in
+            assert(state.instances.isEmpty)
+            state.instances = instances
+        }
+    }
+
+    @available(*, noasync, message: "Blocks the calling thread")
+    private func startInstance() throws -> Instance {
         let stdIn = Pipe()
         let stdOut = Pipe()
 
@@ -111,37 +161,58 @@ internal final class LLVMSymboliser: Symbolizer & Sendable {
             ] + (self.config.viaJSON ? ["--output-style=JSON"] : [])
         try process.run()
 
-        let channel: Channel = try NIOPipeBootstrap(group: self.group)
-            .channelInitializer {
-                [
-                    logger = self.logger,
-                    viaJSON = self.config.viaJSON
-                ] channel in
-                do {
-                    try channel.pipeline.syncOperations.addHandlers([
-                        ByteToMessageHandler(LineBasedFrameDecoder()),
-                        viaJSON ? LLVMJSONOutputParserHandler() : LLVMOutputParserHandler(),
-                        LLVMSymbolizerEncoderHandler(logger: logger),
-                        LogErrorHandler(logger: logger),
-                        RequestResponseHandler<LLVMSymbolizerQuery, SymbolisedStackFrame>(),
-                    ])
-                    return channel.eventLoop.makeSucceededVoidFuture()
-                } catch {
-                    return channel.eventLoop.makeFailedFuture(error)
+        let channel: Channel
+        do {
+            channel = try NIOPipeBootstrap(group: self.group)
+                .channelInitializer {
+                    [
+                        logger = self.logger,
+                        viaJSON = self.config.viaJSON
+                    ] channel in
+                    do {
+                        try channel.pipeline.syncOperations.addHandlers([
+                            ByteToMessageHandler(LineBasedFrameDecoder()),
+                            viaJSON ? LLVMJSONOutputParserHandler() : LLVMOutputParserHandler(),
+                            LLVMSymbolizerEncoderHandler(logger: logger),
+                            LogErrorHandler(logger: logger),
+                            RequestResponseHandler<LLVMSymbolizerQuery, SymbolisedStackFrame>(),
+                        ])
+                        return channel.eventLoop.makeSucceededVoidFuture()
+                    } catch {
+                        return channel.eventLoop.makeFailedFuture(error)
+                    }
                 }
-            }
-            .takingOwnershipOfDescriptors(
-                input: dup(stdOut.fileHandleForReading.fileDescriptor),
-                output: dup(stdIn.fileHandleForWriting.fileDescriptor)
-            ).wait()
+                .takingOwnershipOfDescriptors(
+                    input: dup(stdOut.fileHandleForReading.fileDescriptor),
+                    output: dup(stdIn.fileHandleForWriting.fileDescriptor)
+                ).wait()
+        } catch {
+            process.terminate()
+            throw error
+        }
+        let lastAnswer = NIOLoopBoundBox<EventLoopFuture<SymbolisedStackFrame>?>.makeEmptyBox(
+            eventLoop: channel.eventLoop
+        )
         var unstucker: RepeatedTask? = nil
         if self.config.unstuckerWorkaround {
             unstucker = channel.eventLoop.scheduleRepeatedTask(
                 initialDelay: .milliseconds(1000),
                 delay: .milliseconds(1000)
             ) { _ in
+                let ping = LLVMSymbolizerQuery(
+                    address: .max,
+                    library: DynamicLibMapping(
+                        path: "",
+                        architecture: "",
+                        segmentSlide: 0,
+                        segmentStartAddress: 0,
+                        segmentEndAddress: 0
+                    )
+                )
                 let p = channel.eventLoop.makePromise(of: SymbolisedStackFrame.self)
-                channel.writeAndFlush((StackFrame(instructionPointer: .max, stackPointer: 0), p)).cascadeFailure(to: p)
+                // The ping is answered in order with the queries, so the next query's timeout waits for it too.
+                lastAnswer.value = p.futureResult
+                channel.writeAndFlush((ping, p)).cascadeFailure(to: p)
                 p.futureResult.whenSuccess { str in
                     if !(str.allFrames.first?.address ?? 0 == .max) {
                         fputs("unexpected PING message result '\(str)'\n", stderr)
@@ -149,16 +220,12 @@ internal final class LLVMSymboliser: Symbolizer & Sendable {
                 }
             }
         }
-
-        self.state.withLockedValue { state in
-            assert(state.channel == nil)
-            assert(state.process == nil)
-            assert(state.unstucker == nil)
-
-            state.channel = channel
-            state.process = process
-            state.unstucker = unstucker
-        }
+        return Instance(
+            process: process,
+            channel: channel,
+            unstucker: unstucker,
+            lastAnswer: lastAnswer
+        )
     }
 
     @available(*, noasync, message: "Blocks the calling thread")
@@ -167,26 +234,60 @@ internal final class LLVMSymboliser: Symbolizer & Sendable {
         library: DynamicLibMapping,
         logger: Logger
     ) throws -> SymbolisedStackFrame {
-        struct TimeoutError: Error {
-            var fileVirtualAddressIP: UInt
-            var library: DynamicLibMapping
-        }
-        let channel = self.state.withLockedValue { $0.channel }!
-        let promise = channel.eventLoop.makePromise(of: SymbolisedStackFrame.self)
-        let sched = promise.futureResult.eventLoop.scheduleTask(in: .seconds(10)) {
-            promise.fail(TimeoutError(fileVirtualAddressIP: fileVirtualAddressIP, library: library))
+        return try self.symbolise(
+            [SymbolisationQuery(fileVirtualAddressIP: fileVirtualAddressIP, library: library)],
+            logger: logger
+        )[0]
+    }
+
+    @available(*, noasync, message: "Blocks the calling thread")
+    internal func symbolise(_ queries: [SymbolisationQuery], logger: Logger) throws -> [SymbolisedStackFrame] {
+        let (instances, shards) = self.state.withLockedValue { state in
+            (state.instances, queries.map { state.shard(for: $0.library.path) })
         }
-        do {
-            let query = LLVMSymbolizerQuery(address: fileVirtualAddressIP, library: library)
-            try channel.writeAndFlush((query, promise)).wait()
-        } catch {
-            self.logger.error("write to llvm-symbolizer pipe failed", metadata: ["error": "\(error)"])
-            promise.fail(error)
+        var pendingPerInstance = Array(
+            repeating: [(SymbolisationQuery, EventLoopPromise<SymbolisedStackFrame>)](),
+            count: instances.count
+        )
+        var results: [EventLoopFuture<SymbolisedStackFrame>] = []
+        results.reserveCapacity(queries.count)
+        for (query, shard) in zip(queries, shards) {
+            let promise = instances[shard].channel.eventLoop.makePromise(of: SymbolisedStackFrame.self)
+            pendingPerInstance[shard].append((query, promise))
+            results.append(promise.futureResult)
         }
-        promise.futureResult.whenComplete { _ in
-            sched.cancel()
+
+        // One hop to each process's event loop and one flush for all its queries.
+        for (instance, pending) in zip(instances, pendingPerInstance) where !pending.isEmpty {
+            let channel = instance.channel
+            channel.eventLoop.execute { [logger = self.logger] in
+                for (query, promise) in pending {
+                    // The process answers in order, so a query's timeout only starts once the query before it is
+                    // answered. Otherwise the last queries of a big batch would time out whilst still queued.
+                    let startTimeout = {
+                        let sched = channel.eventLoop.scheduleTask(in: Self.timeout) {
+                            promise.fail(TimeoutError(query: query))
+                        }
+                        promise.futureResult.whenComplete { _ in
+                            sched.cancel()
+                        }
+                    }
+                    if let previousAnswer = instance.lastAnswer.value {
+                        previousAnswer.whenComplete { _ in startTimeout() }
+                    } else {
+                        startTimeout()
+                    }
+                    instance.lastAnswer.value = promise.futureResult
+                    let llvmQuery = LLVMSymbolizerQuery(address: query.fileVirtualAddressIP, library: query.library)
+                    channel.write((llvmQuery, promise)).whenFailure { error in
+                        logger.error("write to llvm-symbolizer pipe failed", metadata: ["error": "\(error)"])
+                        promise.fail(error)
+                    }
+                }
+                channel.flush()
+            }
         }
-        return try promise.futureResult.wait()
+        return try results.map { try $0.wait() }
     }
 
     @available(*, noasync, message: "Blocks the calling thread")
@@ -197,30 +298,34 @@ internal final class LLVMSymboliser: Symbolizer & Sendable {
             state = State()
             return oldState
         }
-        state.unstucker?.cancel(promise: nil)
-
-        state.process?.terminate()
+        try Self.shutdown(state.instances)
+    }
 
-        do {
-            try state.channel?.close().wait()
-        } catch ChannelError.alreadyClosed {
-            // ok
+    @available(*, noasync, message: "Blocks the calling thread")
+    private static func shutdown(_ instances: [Instance]) throws {
+        var firstError: (any Error)? = nil
+        for instance in instances {
+            instance.unstucker?.cancel(promise: nil)
+            instance.process.terminate()
+            do {
+                try instance.channel.close().wait()
+            } catch ChannelError.alreadyClosed {
+                // ok
+            } catch {
+                firstError = firstError ?? error
+            }
+        }
+        if let firstError = firstError {
+            throw firstError
         }
     }
 
     deinit {
-        assert(
-            self.state.withLockedValue { state in
-                assert(state.channel == nil)
-                assert(state.process == nil)
-                assert(state.unstucker == nil)
-                return state.channel == nil && state.process == nil && state.unstucker == nil
-            }
-        )
+        assert(self.state.withLockedValue { $0.instances.isEmpty })
     }
 
     public var description: String {
-        return "LLVMSymbolizer"
+        return "LLVMSymbolizer(processes: \(self.config.processCount))"
     }
 }
 #endif
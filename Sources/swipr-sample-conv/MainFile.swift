@@ -45,9 +45,26 @@ struct ProfileRecorderSampleConverterCommand: AsyncParsableCommand {
     @Option(help: "Enable the llvm-symbolizer getting stuck workaround?")
     var unstuckerWorkaround: Bool = false
 
+    @Option(help: "How many llvm-symbolizer processes to run (each library is symbolised by one of them)")
+    var llvmSymbolizerProcesses: Int = min(4, System.coreCount)
+
+    @Option(
+        help: """
+            How many stack frames to symbolise in one batch, 0 to symbolise sample by sample (default: 4096 with \
+            llvm-symbolizer, 0 otherwise)
+            """
+    )
+    var symbolisationBatchSize: Int? = nil
+
     @Option(help: "Should we attempt to print file:line information?")
     var enableFileLine: Bool = false
 
+    @Option(help: "Demangle Swift symbols? (saves piping the output through 'swift demangle')")
+    var demangle: Bool = false
+
+    @Option(help: "Directory to cache the native symboliser's symbol indexes in (keyed by GNU build ID)")
+    var symbolIndexCacheDirectory: String? = nil
+
     @Option(
         help: "Which output format",
         transform: { stringValue in
@@ -58,6 +75,14 @@ struct ProfileRecorderSampleConverterCommand: AsyncParsableCommand {
                 return .pprofSymbolized
             case "collapsed":
                 return .flamegraphCollapsedSymbolized
+            case "svg":
+                return .flamegraphSVGSymbolized
+            case "speedscope":
+                return .speedscopeSymbolized
+            case "firefox":
+                return .firefoxProfilerSymbolized
+            case "otlp":
+                return .otlpProfilesSymbolized
             case "raw":
                 return .raw
             default:
@@ -67,6 +92,27 @@ struct ProfileRecorderSampleConverterCommand: AsyncParsableCommand {
     )
     var format: ProfileRecorderOutputFormat = .perfSymbolized
 
+    @Option(help: "Compress the output with gzip? (pprof files are conventionally gzip compressed)")
+    var gzip: Bool = false
+
+    @Option(
+        name: [.customLong("base")],
+        help: """
+            Compare the input against this base profile (raw or pprof) and write a differential profile instead \
+            (formats 'collapsed', 'svg' and 'pprof' only)
+            """
+    )
+    var baseInputPath: String? = nil
+
+    @Option(help: "When comparing profiles, scale the base profile to the input's number of samples?")
+    var normalize: Bool = true
+
+    @Option(help: "When merging several inputs, label every sample with the input it came from?")
+    var labelSource: Bool = false
+
+    @Option(help: "When merging several inputs, how many to convert in parallel")
+    var jobs: Int = System.coreCount
+
     @Option(
         help: "Log level to use",
         transform: { stringValue in
@@ -84,8 +130,23 @@ struct ProfileRecorderSampleConverterCommand: AsyncParsableCommand {
     @Option(name: [.customLong("output"), .customShort("o")], help: "Where to write to?")
     var outputPath: String = "-"
 
-    @Argument(help: "Input file path (in raw Swift Profile Recorder format)")
-    var inputPath: String = "-"
+    @Argument(
+        help: """
+            Input file paths (in raw Swift Profile Recorder format, or pprof when comparing with --base), several \
+            inputs are merged into one profile (formats 'collapsed' and 'pprof' only)
+            """
+    )
+    var inputPaths: [String] = []
+
+    var inputPath: String {
+        return self.inputPaths.first ?? "-"
+    }
+
+    /// Only llvm-symbolizer is faster with batches, the native symboliser gains nothing from them.
+    var effectiveSymbolisationBatchSize: Int {
+        let usesLLVMSymbolizer = !self.useNativeSymbolizer && !self.useFakeSymbolizer
+        return self.symbolisationBatchSize ?? (usesLLVMSymbolizer ? 4096 : 0)
+    }
 
     func run() async throws {
         var logger = Logger(label: "swipr-sample-conv")
@@ -93,12 +154,18 @@ struct ProfileRecorderSampleConverterCommand: AsyncParsableCommand {
 
         let llvmSymbolizerConfig = LLVMSymboliserConfig(
             viaJSON: self.viaJSON,
-            unstuckerWorkaround: self.unstuckerWorkaround
+            unstuckerWorkaround: self.unstuckerWorkaround,
+            processCount: self.llvmSymbolizerProcesses
         )
         let symboliser: any Symbolizer
         switch (self.useNativeSymbolizer, self.useFakeSymbolizer) {
         case (true, false):
-            symboliser = ProfileRecorderSampler._makeDefaultSymbolizer()
+            symboliser = ProfileRecorderSampler._makeDefaultSymbolizer(
+                nativeConfiguration: NativeELFSymboliserConfiguration(
+                    symbolIndexCacheDirectory: self.symbolIndexCacheDirectory,
+                    resolveSourceLocations: self.enableFileLine
+                )
+            )
         case (false, false):
             symboliser = LLVMSymboliser(
                 config: llvmSymbolizerConfig,
@@ -123,6 +190,45 @@ struct ProfileRecorderSampleConverterCommand: AsyncParsableCommand {
             }
 
             do {
+                if self.inputPaths.count > 1 {
+                    guard self.baseInputPath == nil else {
+                        throw ValidationError("can only compare one input against --base")
+                    }
+                    var config = SymbolizerConfiguration.default
+                    config.perfScriptOutputWithFileLineInformation = self.enableFileLine
+                    config.demangleSymbols = self.demangle
+                    config.symbolisationBatchSize = self.effectiveSymbolisationBatchSize
+                    var converter = ProfileRecorderMergingConverter(config: config, symbolizer: symboliser)
+                    converter.labelSamplesWithSource = self.labelSource
+                    converter.maximumConcurrency = self.jobs
+                    converter.outputCompression = self.gzip ? .gzip : .none
+                    try await converter.convert(
+                        inputRawProfileRecorderFormatPaths: self.inputPaths,
+                        outputPath: self.outputPath,
+                        format: self.format,
+                        logger: logger
+                    )
+                    return
+                }
+
+                if let baseInputPath = self.baseInputPath {
+                    var config = SymbolizerConfiguration.default
+                    config.perfScriptOutputWithFileLineInformation = self.enableFileLine
+                    config.demangleSymbols = self.demangle
+                    config.symbolisationBatchSize = self.effectiveSymbolisationBatchSize
+                    var converter = ProfileRecorderDifferentialConverter(config: config, symbolizer: symboliser)
+                    converter.normalizeBaseSampleCount = self.normalize
+                    converter.outputCompression = self.gzip ? .gzip : .none
+                    try await converter.convert(
+                        baseInputPath: baseInputPath,
+                        newInputPath: self.inputPath,
+                        outputPath: self.outputPath,
+                        format: self.format,
+                        logger: logger
+                    )
+                    return
+                }
+
                 let renderer: any ProfileRecorderSampleConversionOutputRenderer
                 switch self.format {
                 case .perfSymbolized:
@@ -131,6 +237,14 @@ struct ProfileRecorderSampleConverterCommand: AsyncParsableCommand {
                     renderer = PprofOutputRenderer()
                 case .flamegraphCollapsedSymbolized:
                     renderer = FlamegraphCollapsedOutputRenderer()
+                case .flamegraphSVGSymbolized:
+                    renderer = FlamegraphSVGOutputRenderer()
+                case .speedscopeSymbolized:
+                    renderer = SpeedscopeOutputRenderer()
+                case .firefoxProfilerSymbolized:
+                    renderer = FirefoxProfilerOutputRenderer()
+                case .otlpProfilesSymbolized:
+                    renderer = OTLPProfilesOutputRenderer()
                 case .raw:
                     throw ValidationError("the input file is already in raw format")
                 }
@@ -139,7 +253,10 @@ struct ProfileRecorderSampleConverterCommand: AsyncParsableCommand {
                     outputPath: self.outputPath,
                     symbolizer: symboliser,
                     printFileLine: self.enableFileLine,
+                    demangle: self.demangle,
+                    symbolisationBatchSize: self.effectiveSymbolisationBatchSize,
                     renderer: renderer,
+                    outputCompression: self.gzip ? .gzip : .none,
                     logger: logger
                 )
             } catch {
@@ -158,20 +275,26 @@ struct ProfileRecorderSampleConverterCommand: AsyncParsableCommand {
         outputPath: String,
         symbolizer: any Symbolizer,
         printFileLine: Bool,
+        demangle: Bool = false,
+        symbolisationBatchSize: Int = 0,
         renderer: any ProfileRecorderSampleConversionOutputRenderer,
+        outputCompression: ProfileRecorderOutputCompression = .none,
         threadPool: NIOThreadPool = .singleton,
         group: any EventLoopGroup = .singletonMultiThreadedEventLoopGroup,
         logger: Logger
     ) async throws {
         var config = SymbolizerConfiguration.default
         config.perfScriptOutputWithFileLineInformation = printFileLine
-        let converter = ProfileRecorderSampleConverter(
+        config.demangleSymbols = demangle
+        config.symbolisationBatchSize = symbolisationBatchSize
+        var converter = ProfileRecorderSampleConverter(
             config: config,
             threadPool: threadPool,
             group: group,
             renderer: renderer,
             symbolizer: symbolizer
         )
+        converter.outputCompression = outputCompression
 
         try await converter.convert(
             inputRawProfileRecorderFormatPath: inputPath,
@@ -15,6 +15,7 @@
 import Logging
 import XCTest
 import NIO
+import NIOConcurrencyHelpers
 
 @testable import _ProfileRecorderSampleConversion
 
@@ -59,6 +60,174 @@ final class CachedSymbolizerTests: XCTestCase {
         XCTAssertEqual(expected, actual)
     }
 
+    func testInterningSharesStringsAcrossSymbolizers() throws {
+        let mapping = DynamicLibMapping(
+            path: "/lib/libbar.so",
+            architecture: "arm64",
+            segmentSlide: 0x1000,
+            segmentStartAddress: 0x2000,
+            segmentEndAddress: 0x3000
+        )
+        let otherSymbolizer = CachedSymbolizer(
+            configuration: .default,
+            symbolizer: self.underlyingSymbolizer!,
+            dynamicLibraryMappings: [mapping],
+            interner: self.symbolizer.interner,
+            group: .singletonMultiThreadedEventLoopGroup,
+            logger: self.logger
+        )
+
+        let first = try self.symbolizer.symboliseInterned(StackFrame(instructionPointer: 0x2345, stackPointer: .max))
+        let second = try otherSymbolizer.symboliseInterned(StackFrame(instructionPointer: 0x2456, stackPointer: .max))
+        XCTAssertEqual(1, first.allFrames.count)
+        XCTAssertEqual(1, second.allFrames.count)
+        XCTAssertEqual(first.allFrames[0].functionName, second.allFrames[0].functionName)
+        XCTAssertEqual(first.allFrames[0].library, second.allFrames[0].library)
+        XCTAssertNotEqual(first.allFrames[0].vmap, second.allFrames[0].vmap)
+        XCTAssertEqual("fake", self.symbolizer.interner.string(first.allFrames[0].functionName))
+        XCTAssertEqual("libfoo", self.symbolizer.interner.string(second.allFrames[0].library))
+        XCTAssertEqual(mapping, self.symbolizer.interner.mapping(second.allFrames[0].vmap!))
+
+        XCTAssertEqual(
+            try otherSymbolizer.symbolise(StackFrame(instructionPointer: 0x2456, stackPointer: .max)),
+            self.symbolizer.interner.resolve(second)
+        )
+    }
+
+    func testInterningDerivedLibraryNames() throws {
+        let interner = SymbolInterner()
+        let frame = SymbolisedStackFrame(
+            allFrames: [
+                SymbolisedStackFrame.SingleFrame(
+                    address: 0x1345,
+                    functionName: "inlined",
+                    functionOffset: 0,
+                    library: nil,
+                    vmap: DynamicLibMapping(
+                        path: "/lib/libfoo.so",
+                        architecture: "arm64",
+                        segmentSlide: 0x1000,
+                        segmentStartAddress: 0x2000,
+                        segmentEndAddress: 0x3000
+                    ),
+                    file: "/src/foo.swift",
+                    line: 42
+                ),
+                SymbolisedStackFrame.SingleFrame(
+                    address: 0x1345,
+                    functionName: "real",
+                    functionOffset: 5,
+                    library: nil,
+                    vmap: nil
+                ),
+            ]
+        )
+        let interned = interner.intern(frame)
+        XCTAssertEqual("/lib/libfoo.so", interner.string(interned.allFrames[0].library))
+        XCTAssertFalse(interned.allFrames[0].hasExplicitLibrary)
+        XCTAssertEqual("/src/foo.swift", interned.allFrames[0].file.map { interner.string($0) })
+        XCTAssertEqual("unknown-lib", interner.string(interned.allFrames[1].library))
+        XCTAssertEqual(frame, interner.resolve(interned))
+    }
+
+    func testDemanglingIsMemoisedPerInternedName() throws {
+        let interner = SymbolInterner()
+        let mangled = interner.intern("$sSi")
+        let demangled = interner.demangled(mangled)
+        XCTAssertEqual("Swift.Int", interner.string(demangled))
+        XCTAssertEqual(demangled, interner.demangled(mangled))
+        XCTAssertEqual(demangled, interner.demangled(demangled))
+
+        // Not mangled Swift symbols stay as they are.
+        for name in ["main", "_ZN3foo3barEv", "$", ""] {
+            let id = interner.intern(name)
+            XCTAssertEqual(id, interner.demangled(id), name)
+        }
+        XCTAssertEqual(6, interner.count)
+    }
+
+    func testStringSnapshotsAreUnaffectedByLaterInterning() throws {
+        let interner = SymbolInterner()
+        let main = interner.intern("main")
+        let strings = interner.strings()
+        let other = interner.intern("other")
+        XCTAssertEqual("main", strings[main])
+        XCTAssertEqual("other", interner.strings()[other])
+    }
+
+    func testSymbolizerDemanglesIfConfigured() throws {
+        var configuration = SymbolizerConfiguration.default
+        configuration.demangleSymbols = true
+        let symbolizer = CachedSymbolizer(
+            configuration: configuration,
+            symbolizer: FakeSymbolizer(functionName: "$sSi"),
+            dynamicLibraryMappings: self.symbolizer.dynamicLibraryMappings,
+            group: .singletonMultiThreadedEventLoopGroup,
+            logger: self.logger
+        )
+        let frame = try symbolizer.symbolise(StackFrame(instructionPointer: 0x2345, stackPointer: .max))
+        XCTAssertEqual(["Swift.Int"], frame.allFrames.map { $0.functionName })
+    }
+
+    func testPrefetchingSymbolisesAllNewFramesInOneBatch() throws {
+        let underlying = BatchRecordingSymbolizer()
+        let symbolizer = CachedSymbolizer(
+            configuration: .default,
+            symbolizer: underlying,
+            dynamicLibraryMappings: self.symbolizer.dynamicLibraryMappings,
+            group: .singletonMultiThreadedEventLoopGroup,
+            logger: self.logger
+        )
+        let frames = [0x2345, 0x2346, 0x2345, 0x3000].map { StackFrame(instructionPointer: $0, stackPointer: .max) }
+        try symbolizer.prefetch(frames)
+        // Duplicates and frames outside of any library aren't queried.
+        XCTAssertEqual([[0x1345, 0x1346]], underlying.batches.withLockedValue { $0 })
+        XCTAssertEqual(3, symbolizer.cacheCount)
+
+        for frame in frames {
+            XCTAssertEqual(try self.symbolizer.symbolise(frame), try symbolizer.symbolise(frame))
+        }
+        try symbolizer.prefetch(frames)
+        XCTAssertEqual(1, underlying.batches.withLockedValue { $0.count })
+        XCTAssertEqual(0, underlying.singleQueries.withLockedValue { $0 })
+    }
+
+    func testRenderedFramesAreCachedPerStyle() throws {
+        var renderCalls = 0
+        func render(_ marker: String) -> (InternedStackFrame, inout ByteBuffer) throws -> Void {
+            return { frame, output in
+                renderCalls += 1
+                output.writeString("\(marker)\(String(frame.allFrames[0].address, radix: 16))")
+            }
+        }
+
+        var output = ByteBuffer()
+        let frame = StackFrame(instructionPointer: 0x2345, stackPointer: .max)
+        for marker in ["A", "X"] {
+            let written = try self.symbolizer.writeRenderedFrame(
+                frame,
+                style: .flamegraphCollapsed,
+                into: &output,
+                render: render(marker)
+            )
+            XCTAssertEqual(5, written)
+        }
+        try self.symbolizer.writeRenderedFrame(
+            frame,
+            style: .perfScript(includeFileLineInformation: false),
+            into: &output,
+            render: render("B")
+        )
+        try self.symbolizer.writeRenderedFrame(
+            StackFrame(instructionPointer: 0x2346, stackPointer: .max),
+            style: .flamegraphCollapsed,
+            into: &output,
+            render: render("C")
+        )
+        XCTAssertEqual(3, renderCalls)
+        XCTAssertEqual("A1345A1345B1345C1346", String(buffer: output))
+    }
+
     // MARK: - Setup/teardown
     override func setUpWithError() throws {
         self.logger = Logger(label: "\(Self.self)")
@@ -91,6 +260,47 @@ final class CachedSymbolizerTests: XCTestCase {
     }
 
     // MARK: - Helpers
+    /// Like ``FakeSymbolizer`` but records the file addresses of every batch it's asked to symbolise.
+    private final class BatchRecordingSymbolizer: Symbolizer {
+        private let underlying = FakeSymbolizer()
+        let batches = NIOLockedValueBox<[[UInt]]>([])
+        let singleQueries = NIOLockedValueBox(0)
+
+        var description: String {
+            return "BatchRecordingSymbolizer"
+        }
+
+        func start() throws {
+        }
+
+        func symbolise(
+            fileVirtualAddressIP: UInt,
+            library: DynamicLibMapping,
+            logger: Logger
+        ) throws -> SymbolisedStackFrame {
+            self.singleQueries.withLockedValue { $0 += 1 }
+            return try self.underlying.symbolise(
+                fileVirtualAddressIP: fileVirtualAddressIP,
+                library: library,
+                logger: logger
+            )
+        }
+
+        func symbolise(_ queries: [SymbolisationQuery], logger: Logger) throws -> [SymbolisedStackFrame] {
+            self.batches.withLockedValue { $0.append(queries.map { $0.fileVirtualAddressIP }) }
+            return try queries.map { query in
+                try self.underlying.symbolise(
+                    fileVirtualAddressIP: query.fileVirtualAddressIP,
+                    library: query.library,
+                    logger: logger
+                )
+            }
+        }
+
+        func shutdown() throws {
+        }
+    }
+
     func instructionPointerFixup() -> Int {
         #if arch(arm) || arch(arm64)
         // Known fixed-width instruction format
@@ -0,0 +1,114 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import XCTest
+
+@testable import _ProfileRecorderSampleConversion
+
+final class CallTreeTests: XCTestCase {
+    private let interner = SymbolInterner()
+
+    func testCommonPrefixesAreShared() throws {
+        var tree = CallTree()
+        let thread = self.makeThread(tid: 1, name: "main")
+        // Stacks are given outermost frame first: main -> run -> a, main -> run -> b, main -> run -> a
+        for stack: [UInt32] in [[1, 2, 3], [1, 2, 4], [1, 2, 3]] {
+            tree.addSample(at: self.insert(stack, thread: thread, into: &tree))
+        }
+        // root, 1, 2, 3, 4
+        XCTAssertEqual(5, tree.nodeCount)
+
+        var stacks: [([UInt32], Int)] = []
+        tree.forEachStack { locationIDs, stackThread, count in
+            XCTAssertEqual(thread, stackThread)
+            stacks.append((locationIDs, count))
+        }
+        XCTAssertEqual([[3, 2, 1], [4, 2, 1]], stacks.map { $0.0 })
+        XCTAssertEqual([2, 1], stacks.map { $0.1 })
+    }
+
+    func testThreadsHaveSeparateTrees() throws {
+        var tree = CallTree()
+        let threads = [self.makeThread(tid: 1, name: "a"), self.makeThread(tid: 2, name: "b")]
+        for thread in threads {
+            tree.addSample(at: self.insert([1, 2], thread: thread, into: &tree))
+        }
+        // An intermediate frame can be a stack of its own.
+        tree.addSample(at: self.insert([1], thread: threads[0], into: &tree))
+        XCTAssertEqual(6, tree.nodeCount)
+
+        var stacks: [([UInt32], SampleAggregator.ThreadInfo)] = []
+        tree.forEachStack { locationIDs, thread, count in
+            XCTAssertEqual(1, count)
+            stacks.append((locationIDs, thread))
+        }
+        XCTAssertEqual([[1], [2, 1], [2, 1]], stacks.map { $0.0 })
+        XCTAssertEqual([threads[0], threads[0], threads[1]], stacks.map { $0.1 })
+    }
+
+    func testInclusiveCountsAndChildren() throws {
+        var tree = CallTree()
+        let thread = self.makeThread(tid: 1, name: "main")
+        // Nodes: 0 = root, 1 = 1, 2 = 1 -> 2, 3 = 1 -> 3, 4 = 1 -> 2 -> 4
+        for stack: [UInt32] in [[1, 2], [1, 3], [1, 2, 4], [1], [1, 2, 4]] {
+            tree.addSample(at: self.insert(stack, thread: thread, into: &tree))
+        }
+        XCTAssertEqual([5, 5, 3, 1, 2], tree.inclusiveCounts())
+
+        let (starts, children) = tree.childrenByParent()
+        XCTAssertEqual(tree.nodeCount + 1, starts.count)
+        XCTAssertEqual(
+            [[1], [2, 3], [4], [], []],
+            (0..<tree.nodeCount).map { Array(children[starts[$0]..<starts[$0 + 1]]) }
+        )
+    }
+
+    func testMergeTranslatesLocations() throws {
+        let threads = [self.makeThread(tid: 1, name: "a"), self.makeThread(tid: 2, name: "b")]
+        var tree = CallTree()
+        tree.addSample(at: self.insert([1, 2], thread: threads[0], into: &tree))
+
+        var other = CallTree()
+        other.addSample(at: self.insert([10, 20], thread: threads[0], into: &other))
+        other.addSample(at: self.insert([10, 30], thread: threads[1], into: &other))
+        other.addSample(at: self.insert([10, 30], thread: threads[1], into: &other))
+        tree.merge(other) { $0 / 10 }
+
+        var stacks: [([UInt32], Int)] = []
+        tree.forEachStack { locationIDs, _, count in
+            stacks.append((locationIDs, count))
+        }
+        XCTAssertEqual([[2, 1], [3, 1]], stacks.map { $0.0 })
+        XCTAssertEqual([2, 2], stacks.map { $0.1 })
+        // root a, 1, 2, root b, 1, 3
+        XCTAssertEqual(6, tree.nodeCount)
+    }
+
+    // MARK: - Helpers
+    private func makeThread(tid: Int, name: String) -> SampleAggregator.ThreadInfo {
+        return SampleAggregator.ThreadInfo(tid: tid, name: self.interner.intern(name))
+    }
+
+    private func insert(
+        _ stack: [UInt32],
+        thread: SampleAggregator.ThreadInfo,
+        into tree: inout CallTree
+    ) -> CallTree.NodeID {
+        var node = tree.root(of: thread)
+        for location in stack {
+            node = tree.child(of: node, location: location)
+        }
+        return node
+    }
+}
@@ -0,0 +1,292 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import Logging
+import XCTest
+import NIO
+import ProfileRecorderPprofFormat
+
+@testable import _ProfileRecorderSampleConversion
+
+final class DifferentialProfileTests: XCTestCase {
+    private let interner = SymbolInterner()
+    private var logger: Logger! = nil
+    private var tempDirectory: String! = nil
+
+    func testCollapsedHasBothCountsAndIsNormalized() throws {
+        let profile = self.makeProfile()
+        var output = ByteBuffer()
+        profile.writeCollapsed(normalized: true, interner: self.interner, into: &output)
+        // The base has half the samples, so its counts are doubled.
+        XCTAssertEqual("a;b 4 6\na;c 4 0\na;d 0 2\n", String(buffer: output))
+
+        output.clear()
+        profile.writeCollapsed(normalized: false, interner: self.interner, into: &output)
+        XCTAssertEqual("a;b 2 6\na;c 2 0\na;d 0 2\n", String(buffer: output))
+    }
+
+    func testPprofSubtractsTheBase() throws {
+        var output = ByteBuffer()
+        self.makeProfile().writePprof(normalized: true, interner: self.interner, into: &output)
+        let pprof = try Perftools_Profiles_Profile(output)
+
+        var deltas: [String: Int64] = [:]
+        var baseSamples = 0
+        for sample in pprof.sample {
+            let stack = sample.locationID.reversed().map { locationID in
+                let location = pprof.location.first { $0.id == locationID }!
+                let function = pprof.function.first { $0.id == location.line[0].functionID }!
+                return pprof.stringTable[Int(function.name)]
+            }
+            deltas[stack.joined(separator: ";"), default: 0] += sample.value[0]
+            if sample.value[0] < 0 {
+                baseSamples += 1
+                XCTAssertEqual(["pprof::base"], sample.label.map { pprof.stringTable[Int($0.key)] })
+            } else {
+                XCTAssertEqual([], sample.label)
+            }
+        }
+        XCTAssertEqual(["a;b": 2, "a;c": -4, "a;d": 2], deltas)
+        XCTAssertEqual(2, baseSamples)
+    }
+
+    func testFlamegraphSVGIsColouredByChange() throws {
+        var output = ByteBuffer()
+        self.makeProfile().writeFlamegraphSVG(
+            normalized: true,
+            writer: FlamegraphSVGWriter(imageWidth: 1200, minimumFrameWidth: 0.5),
+            interner: self.interner,
+            into: &output
+        )
+        let svg = String(buffer: output)
+        XCTAssert(svg.contains("Differential Flame Graph (8 samples, base 4 samples)"), svg)
+        // `a` didn't change overall and is white. `c` shrank the most but is gone, so it isn't drawn. `b` and `d`
+        // grew by half as much, so they're half saturated red.
+        XCTAssert(svg.contains("<title>a (8 samples, 100.00%; +0.00%)</title>"), svg)
+        XCTAssert(svg.contains("<title>b (6 samples, 75.00%; +25.00%)</title>"), svg)
+        XCTAssert(svg.contains("<title>d (2 samples, 25.00%; +25.00%)</title>"), svg)
+        XCTAssertFalse(svg.contains("<title>c "), svg)
+        XCTAssertEqual(2, svg.components(separatedBy: #"fill="rgb(255,105,105)""#).count - 1, svg)
+        XCTAssertEqual(2, svg.components(separatedBy: #"fill="rgb(255,255,255)""#).count - 1, svg)
+    }
+
+    func testPprofInputs() throws {
+        var profile = DifferentialProfile(interner: self.interner)
+        var pprof = Perftools_Profiles_Profile()
+        pprof.stringTable = ["", "cpu", "nanoseconds", "samples", "count", "main", "work", "inlined"]
+        pprof.sampleType = [
+            .with {
+                $0.type = 1
+                $0.unit = 2
+            },
+            .with {
+                $0.type = 3
+                $0.unit = 4
+            },
+        ]
+        pprof.function = [
+            .with {
+                $0.id = 1
+                $0.name = 5
+            },
+            .with {
+                $0.id = 2
+                $0.name = 6
+            },
+            .with {
+                $0.id = 3
+                $0.name = 7
+            },
+        ]
+        pprof.location = [
+            .with {
+                $0.id = 10
+                $0.line = [.with { $0.functionID = 1 }]
+            },
+            .with {
+                $0.id = 11
+                $0.line = [.with { $0.functionID = 3 }, .with { $0.functionID = 2 }]
+            },
+            .with {
+                $0.id = 12
+                $0.address = 0x1234
+            },
+        ]
+        pprof.sample = [
+            .with {
+                $0.locationID = [11, 10]
+                $0.value = [30_000_000, 3]
+            },
+            .with {
+                $0.locationID = [12, 10]
+                $0.value = [10_000_000, 1]
+            },
+        ]
+        try profile.add(pprof, to: .new, interner: self.interner)
+
+        var output = ByteBuffer()
+        profile.writeCollapsed(normalized: true, interner: self.interner, into: &output)
+        // The `samples` values are used, inlined frames are expanded.
+        XCTAssertEqual("main;work;inlined 0 3\nmain;unknown @ 0x1234 0 1\n", String(buffer: output))
+    }
+
+    func testPprofFunctionNamesAreDemangledIfConfigured() throws {
+        var pprof = Perftools_Profiles_Profile()
+        pprof.stringTable = ["", "samples", "count", "$sSi"]
+        pprof.sampleType = [
+            .with {
+                $0.type = 1
+                $0.unit = 2
+            }
+        ]
+        pprof.function = [
+            .with {
+                $0.id = 1
+                $0.name = 3
+            }
+        ]
+        pprof.location = [
+            .with {
+                $0.id = 10
+                $0.line = [.with { $0.functionID = 1 }]
+            }
+        ]
+        pprof.sample = [
+            .with {
+                $0.locationID = [10]
+                $0.value = [2]
+            }
+        ]
+
+        for (demangleSymbols, expected) in [(false, "$sSi 2 0\n"), (true, "Swift.Int 2 0\n")] {
+            var profile = DifferentialProfile(interner: self.interner)
+            try profile.add(pprof, to: .base, interner: self.interner, demangleSymbols: demangleSymbols)
+            var output = ByteBuffer()
+            profile.writeCollapsed(normalized: false, interner: self.interner, into: &output)
+            XCTAssertEqual(expected, String(buffer: output))
+        }
+    }
+
+    func testRawAndGzippedPprofInputsAreCompared() throws {
+        let basePath = try self.writeRawSamples(count: 5, name: "base.raw")
+        let newRawPath = try self.writeRawSamples(count: 10, name: "new.raw")
+        let newPprofPath = self.tempDirectory + "/new.pb.gz"
+
+        var converter = ProfileRecorderSampleConverter(
+            config: .default,
+            renderer: PprofOutputRenderer(),
+            symbolizer: FakeSymbolizer()
+        )
+        converter.outputCompression = .gzip
+        try converter.convertSync(
+            inputRawProfileRecorderFormatPath: newRawPath,
+            outputPath: newPprofPath,
+            format: .pprofSymbolized,
+            logger: self.logger
+        )
+
+        var differentialConverter = ProfileRecorderDifferentialConverter(config: .default, symbolizer: FakeSymbolizer())
+        for newPath in [newRawPath, newPprofPath] {
+            for (normalize, expected) in [(true, "fake;fake 10 10\n"), (false, "fake;fake 5 10\n")] {
+                differentialConverter.normalizeBaseSampleCount = normalize
+                var output = ByteBuffer()
+                try differentialConverter.convertSync(
+                    baseInputPath: basePath,
+                    newInputPath: newPath,
+                    format: .flamegraphCollapsedSymbolized,
+                    logger: self.logger
+                ) { chunk in
+                    output.writeImmutableBuffer(chunk)
+                }
+                XCTAssertEqual(expected, String(buffer: output), "\(newPath)")
+            }
+        }
+
+        XCTAssertThrowsError(
+            try differentialConverter.convertSync(
+                baseInputPath: basePath,
+                newInputPath: newRawPath,
+                format: .perfSymbolized,
+                logger: self.logger
+            ) { _ in }
+        )
+    }
+
+    func testSymbolizerPoolSharesSymbolizersForTheSameMappings() throws {
+        let pool = CachedSymbolizerPool(underlyingSymbolizer: FakeSymbolizer())
+        let mappings = [
+            DynamicLibMapping(
+                path: "/lib/libfoo.so",
+                architecture: "arm64",
+                segmentSlide: 0x1000,
+                segmentStartAddress: 0x2000,
+                segmentEndAddress: 0x3000
+            )
+        ]
+        let first = pool.symbolizer(for: mappings, group: .singletonMultiThreadedEventLoopGroup, logger: self.logger)
+        let second = pool.symbolizer(for: mappings, group: .singletonMultiThreadedEventLoopGroup, logger: self.logger)
+        let other = pool.symbolizer(for: [], group: .singletonMultiThreadedEventLoopGroup, logger: self.logger)
+        XCTAssert(first === second)
+        XCTAssert(first !== other)
+        XCTAssert(first.interner === other.interner)
+    }
+
+    // MARK: - Setup/teardown
+    override func setUpWithError() throws {
+        self.logger = Logger(label: "\(Self.self)")
+        self.logger.logLevel = .info
+        self.tempDirectory = NSTemporaryDirectory() + "/swipr-differential-tests-\(UUID())"
+        try FileManager.default.createDirectory(atPath: self.tempDirectory, withIntermediateDirectories: true)
+    }
+
+    override func tearDown() {
+        XCTAssertNoThrow(try FileManager.default.removeItem(atPath: self.tempDirectory))
+        self.tempDirectory = nil
+        self.logger = nil
+    }
+
+    // MARK: - Helpers
+
+    /// Base: `a;b` and `a;c` twice each. New: `a;b` six times and `a;d` twice.
+    private func makeProfile() -> DifferentialProfile {
+        var profile = DifferentialProfile(interner: self.interner)
+        profile.add(["a", "b"].map { self.interner.intern($0) }, count: 2, to: .base)
+        profile.add(["a", "c"].map { self.interner.intern($0) }, count: 2, to: .base)
+        profile.add(["a", "b"].map { self.interner.intern($0) }, count: 6, to: .new)
+        profile.add(["a", "d"].map { self.interner.intern($0) }, count: 2, to: .new)
+        return profile
+    }
+
+    private func writeRawSamples(count: Int, name: String) throws -> String {
+        var raw = """
+            [SWIPR] VERS { "version": 1}
+            [SWIPR] VMAP { "path": "/lib/libfoo.so", "architecture": "arm64", "segmentSlide": "0x1000", \
+            "segmentStartAddress": "0x2000", "segmentEndAddress": "0x3000" }
+
+            """
+        for sample in 0..<count {
+            raw += """
+                [SWIPR] SMPL { "pid": 1, "tid": \(sample % 3), "name": "thread", "timeSec": 4, "timeNSec": \(sample) }
+                [SWIPR] STCK { "ip": "0x0", "sp": "0x0" }
+                [SWIPR] STCK { "ip": "0x2345", "sp": "0x0" }
+                [SWIPR] STCK { "ip": "0x\(String(0x2400 + sample, radix: 16))", "sp": "0x0" }
+                [SWIPR] DONE
+
+                """
+        }
+        let path = self.tempDirectory + "/" + name
+        try raw.write(toFile: path, atomically: false, encoding: .utf8)
+        return path
+    }
+}
@@ -0,0 +1,116 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import XCTest
+@testable import _ProfileRecorderSampleConversion
+
+final class DwarfLineTableTests: XCTestCase {
+    private func setAddress(_ address: UInt64) -> [UInt8] {
+        return [0x00, 9, 0x02] + (0..<8).map { UInt8(truncatingIfNeeded: address >> (8 * $0)) }
+    }
+
+    private let copy: [UInt8] = [0x01]
+    private let endSequence: [UInt8] = [0x00, 1, 0x01]
+
+    private func advancePC(_ advance: UInt8) -> [UInt8] {
+        return [0x02, advance]
+    }
+
+    private func advanceLine(_ advance: UInt8) -> [UInt8] {
+        return [0x03, advance]
+    }
+
+    private func withLineTable(_ program: [UInt8], _ body: (DwarfLineTable) throws -> Void) throws {
+        try program.withUnsafeBytes { buffer in
+            let info = DwarfLineNumberInfo(
+                pathSeparator: "/",
+                baseOffset: 0,
+                version: 4,
+                addressSize: 8,
+                selectorSize: nil,
+                headerLength: 0,
+                minimumInstructionLength: 1,
+                maximumOpsPerInstruction: 1,
+                defaultIsStmt: true,
+                lineBase: -5,
+                lineRange: 14,
+                opcodeBase: 13,
+                standardOpcodeLengths: [0, 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1],
+                directories: ["/src"],
+                files: ["a.swift", "b.swift"].map {
+                    DwarfFileInfo(path: $0, directoryIndex: 0, timestamp: nil, size: nil, md5sum: nil)
+                },
+                program: ImageSource(unowned: buffer, isMappedImage: false),
+                shouldSwap: false
+            )
+            try body(try DwarfLineTable(info: info))
+        }
+    }
+
+    func testSequencesAreSortedAndLookedUp() throws {
+        let sequences: [[[UInt8]]] = [
+            // 0x2000..<0x2010 is line 20.
+            [self.setAddress(0x2000), self.advanceLine(19), self.copy, self.advancePC(0x10), self.endSequence],
+            // 0x1000..<0x1008 is line 1, 0x1008..<0x1010 line 5.
+            [
+                self.setAddress(0x1000), self.copy, self.advancePC(8), self.advanceLine(4), self.copy,
+                self.advancePC(8), self.endSequence,
+            ],
+            // Overlaps the previous sequence, so it's dropped.
+            [self.setAddress(0x1004), self.advanceLine(9), self.copy, self.advancePC(4), self.endSequence],
+        ]
+        let program = Array(sequences.joined().joined())
+
+        try self.withLineTable(program) { table in
+            XCTAssertEqual([0x1000, 0x1008, 0x1010, 0x2000, 0x2010], table.rows.map { $0.address })
+
+            XCTAssertNil(table.sourceLocation(for: 0xfff))
+            XCTAssertEqual(SourceLocation(path: "/src/b.swift", line: 1, column: 0), table.sourceLocation(for: 0x1000))
+            XCTAssertEqual(1, table.sourceLocation(for: 0x1007)?.line)
+            XCTAssertEqual(5, table.sourceLocation(for: 0x1008)?.line)
+            XCTAssertEqual(5, table.sourceLocation(for: 0x100f)?.line)
+            XCTAssertNil(table.sourceLocation(for: 0x1010))
+            XCTAssertNil(table.sourceLocation(for: 0x1fff))
+            XCTAssertEqual(20, table.sourceLocation(for: 0x2000)?.line)
+            XCTAssertEqual(20, table.sourceLocation(for: 0x200f)?.line)
+            XCTAssertNil(table.sourceLocation(for: 0x2010))
+        }
+    }
+
+    func testSequencesOfDroppedCodeAreIgnored() throws {
+        let sequences: [[[UInt8]]] = [
+            // Code the linker dropped ends up at zero, covering the real sequence below.
+            [
+                self.setAddress(0), self.advanceLine(9), self.copy, self.advancePC(0x7f), self.advancePC(0x7f),
+                self.endSequence,
+            ],
+            [self.setAddress(0x80), self.copy, self.advancePC(8), self.endSequence],
+        ]
+        let program = Array(sequences.joined().joined())
+
+        try self.withLineTable(program) { table in
+            XCTAssertEqual([0x80, 0x88], table.rows.map { $0.address })
+            XCTAssertNil(table.sourceLocation(for: 0x10))
+            XCTAssertEqual(1, table.sourceLocation(for: 0x80)?.line)
+        }
+    }
+
+    func testUnterminatedSequencesAreIgnored() throws {
+        let program = Array([self.setAddress(0x1000), self.copy, self.advancePC(8), self.copy].joined())
+        try self.withLineTable(program) { table in
+            XCTAssertEqual(0, table.rows.count)
+            XCTAssertNil(table.sourceLocation(for: 0x1004))
+        }
+    }
+}
@@ -0,0 +1,167 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import XCTest
+@testable import _ProfileRecorderSampleConversion
+
+final class DwarfUnitRangesTests: XCTestCase {
+    /// Hand assembled DWARF sections.
+    private final class Fixture: DwarfSource {
+        static let pathSeparator = "/"
+
+        private let sections: [DwarfSection: ImageSource]
+
+        init(_ sections: [DwarfSection: [UInt8]]) {
+            self.sections = sections.mapValues { bytes in
+                let source = ImageSource(capacity: bytes.count, isMappedImage: false)
+                bytes.withUnsafeBytes { source.append(bytes: $0) }
+                return source
+            }
+        }
+
+        func getDwarfSection(_ section: DwarfSection) -> ImageSource? {
+            return self.sections[section]
+        }
+    }
+
+    private func littleEndian(_ value: UInt64, size: Int) -> [UInt8] {
+        return (0..<size).map { UInt8(truncatingIfNeeded: value >> (8 * $0)) }
+    }
+
+    // DW_TAG_compile_unit without children and with the given (attribute, form) pairs.
+    private func abbrev(_ code: UInt8, _ attributes: [(UInt8, UInt8)]) -> [UInt8] {
+        return [code, 0x11, 0x00] + attributes.flatMap { [$0.0, $0.1] } + [0x00, 0x00]
+    }
+
+    // Abbrev 1: DW_AT_low_pc (addr), DW_AT_high_pc (data8).
+    // Abbrev 2: DW_AT_low_pc (addr), DW_AT_ranges (sec_offset), for DWARF 4.
+    // Abbrev 3: DW_AT_rnglists_base (sec_offset), DW_AT_ranges (rnglistx), for DWARF 5.
+    // Abbrev 4: no attributes, so only .debug_aranges knows the unit's addresses.
+    private var abbrevs: [UInt8] {
+        return self.abbrev(1, [(0x11, 0x01), (0x12, 0x07)])
+            + self.abbrev(2, [(0x11, 0x01), (0x55, 0x17)])
+            + self.abbrev(3, [(0x74, 0x17), (0x55, 0x23)])
+            + self.abbrev(4, [])
+            + [0x00]
+    }
+
+    private func unit(version: UInt16, die: [UInt8]) -> [UInt8] {
+        let header: [UInt8]
+        if version >= 5 {
+            // DW_UT_compile, address size 8, abbrevs at 0.
+            header = self.littleEndian(UInt64(version), size: 2) + [0x01, 8] + self.littleEndian(0, size: 4)
+        } else {
+            // Abbrevs at 0, address size 8.
+            header = self.littleEndian(UInt64(version), size: 2) + self.littleEndian(0, size: 4) + [8]
+        }
+        return self.littleEndian(UInt64(header.count + die.count), size: 4) + header + die
+    }
+
+    private func lowHighPCUnit(lowPC: UInt64, size: UInt64) -> [UInt8] {
+        return self.unit(version: 4, die: [1] + self.littleEndian(lowPC, size: 8) + self.littleEndian(size, size: 8))
+    }
+
+    private func aranges(infoOffset: Int, _ ranges: [(address: UInt64, length: UInt64)]) -> [UInt8] {
+        // Version 2, address size 8, no segments, padded to the tuple size of 16.
+        let header = self.littleEndian(2, size: 2) + self.littleEndian(UInt64(infoOffset), size: 4) + [8, 0, 0, 0, 0, 0]
+        let tuples = (ranges + [(0, 0)]).flatMap {
+            self.littleEndian($0.address, size: 8) + self.littleEndian($0.length, size: 8)
+        }
+        return self.littleEndian(UInt64(header.count + tuples.count), size: 4) + header + tuples
+    }
+
+    /// Units 0 and 1 start at the same address (unit 0 is bigger), unit 2 has two DWARF 4 ranges, unit 3 two DWARF 5
+    /// ranges, unit 4 two ranges in .debug_aranges and unit 5 has no ranges at all.
+    private func makeFixture() -> Fixture {
+        var info: [UInt8] = []
+        info += self.lowHighPCUnit(lowPC: 0x2000, size: 0x100)
+        info += self.lowHighPCUnit(lowPC: 0x2000, size: 0x10)
+        // The ranges are relative to the unit's low PC.
+        info += self.unit(version: 4, die: [2] + self.littleEndian(0x3000, size: 8) + self.littleEndian(0, size: 4))
+        // The offsets of the range lists start right after the .debug_rnglists header, at 12.
+        info += self.unit(version: 5, die: [3] + self.littleEndian(12, size: 4) + [0])
+        let arangesUnitOffset = info.count
+        info += self.unit(version: 4, die: [4])
+        info += self.unit(version: 4, die: [4])
+
+        let ranges = [0x0, 0x100, 0x1000, 0x1100, 0, 0].flatMap { self.littleEndian(UInt64($0), size: 8) }
+
+        // DW_RLE_start_length 0x5000 + 0x40, DW_RLE_base_address 0x6000, DW_RLE_offset_pair 0x10..<0x20,
+        // DW_RLE_end_of_list.
+        let rangeList = [0x07] + self.littleEndian(0x5000, size: 8) + [0x40]
+            + [0x05] + self.littleEndian(0x6000, size: 8) + [0x04, 0x10, 0x20]
+            + [0x00]
+        // Version 5, address size 8, no segments, one offset (to right after it).
+        let rngListsBody = self.littleEndian(5, size: 2) + [8, 0] + self.littleEndian(1, size: 4)
+            + self.littleEndian(4, size: 4) + rangeList
+        let rngLists = self.littleEndian(UInt64(rngListsBody.count), size: 4) + rngListsBody
+
+        return Fixture([
+            .debugAbbrev: self.abbrevs,
+            .debugInfo: info,
+            .debugRanges: ranges,
+            .debugRngLists: rngLists,
+            .debugARanges: self.aranges(infoOffset: arangesUnitOffset, [(0x1000, 0x100), (0x1200, 0x100)]),
+        ])
+    }
+
+    /// Runs `body` with a reader of the fixture, which only holds on to its source `unowned`.
+    private func withReader(_ body: (DwarfReader<Fixture>) throws -> Void) throws {
+        let fixture = self.makeFixture()
+        try withExtendedLifetime(fixture) {
+            try body(try DwarfReader(source: fixture))
+        }
+    }
+
+    func testUnitsAreFoundByAddress() throws {
+        try self.withReader { reader in
+            XCTAssertEqual(6, reader.units.count)
+
+            // Low and high PC, two units starting at the same address.
+            XCTAssertEqual([0], reader.unitIndices(covering: 0x2050))
+            XCTAssertEqual([0, 1], reader.unitIndices(covering: 0x2008).sorted())
+            XCTAssertEqual([], reader.unitIndices(covering: 0x2100))
+
+            // DWARF 4 .debug_ranges, relative to the low PC.
+            XCTAssertEqual([2], reader.unitIndices(covering: 0x3000))
+            XCTAssertEqual([2], reader.unitIndices(covering: 0x40ff))
+            XCTAssertEqual([], reader.unitIndices(covering: 0x3100))
+
+            // DWARF 5 .debug_rnglists.
+            XCTAssertEqual([3], reader.unitIndices(covering: 0x503f))
+            XCTAssertEqual([], reader.unitIndices(covering: 0x5040))
+            XCTAssertEqual([3], reader.unitIndices(covering: 0x6010))
+            XCTAssertEqual([], reader.unitIndices(covering: 0x6020))
+
+            // .debug_aranges.
+            XCTAssertEqual([4], reader.unitIndices(covering: 0x1000))
+            XCTAssertEqual([], reader.unitIndices(covering: 0x1100))
+            XCTAssertEqual([4], reader.unitIndices(covering: 0x12ff))
+        }
+    }
+
+    func testUnitsAreOnlyScannedWhenLookedUp() throws {
+        try self.withReader { reader in
+            XCTAssertEqual(0, reader.scannedUnitCount)
+
+            XCTAssertEqual(0, reader.lookupInlineCallSites(at: 0x6010).count)
+            XCTAssertEqual(1, reader.scannedUnitCount)
+            XCTAssertEqual(0, reader.lookupInlineCallSites(at: 0x2008).count)
+            XCTAssertEqual(3, reader.scannedUnitCount)
+            // Covered by no unit's ranges, so only the unit without any ranges is scanned (separately).
+            XCTAssertEqual(0, reader.lookupInlineCallSites(at: 0x8000).count)
+            XCTAssertEqual(3, reader.scannedUnitCount)
+        }
+    }
+}
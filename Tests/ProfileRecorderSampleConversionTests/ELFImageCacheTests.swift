@@ -0,0 +1,193 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+#if os(Linux)
+import Dispatch
+import Foundation
+import Glibc
+import Logging
+import NIOConcurrencyHelpers
+import ProfileRecorder
+import XCTest
+
+@testable import _ProfileRecorderSampleConversion
+
+final class ELFImageCacheTests: XCTestCase {
+    private let logger = Logger(label: "\(ELFImageCacheTests.self)")
+    // The test binary itself, under two paths so that it's cached twice.
+    private let paths = ["/proc/self/exe", "/proc/\(getpid())/exe"]
+    private var libraries: [DynamicLibMapping] {
+        return self.paths.map { path in
+            DynamicLibMapping(
+                path: path,
+                architecture: "",
+                segmentSlide: 0,
+                segmentStartAddress: 0,
+                segmentEndAddress: .max
+            )
+        }
+    }
+
+    func testImagesAreKeptWithoutABudget() throws {
+        let cache = LockedELFSourceCacheReference()
+        for path in self.paths {
+            XCTAssertNoThrow(try cache.prewarm(path: path, logger: self.logger).get())
+        }
+        XCTAssertEqual(2, cache.count)
+        XCTAssertEqual(self.paths, cache.memoryUsage().map { $0.path })
+    }
+
+    func testLeastRecentlyUsedImagesAreEvictedOverBudget() throws {
+        let cache = LockedELFSourceCacheReference(memoryBudget: 1)
+        for path in self.paths {
+            XCTAssertNoThrow(try cache.prewarm(path: path, logger: self.logger).get())
+        }
+        // The image that was just loaded is never evicted.
+        XCTAssertEqual([self.paths[1]], cache.memoryUsage().map { $0.path })
+
+        // An evicted image is loaded again when it's needed.
+        XCTAssertNoThrow(try cache.prewarm(path: self.paths[0], logger: self.logger).get())
+        XCTAssertEqual([self.paths[0]], cache.memoryUsage().map { $0.path })
+    }
+
+    func testImagesAreLoadedOnceAndInParallel() throws {
+        let loads = NIOLockedValueBox<[String: Int]>([:])
+        let secondImageLoading = DispatchSemaphore(value: 0)
+        let secondImageLoadedWhilstFirstWasLoading = NIOLockedValueBox(false)
+        let paths = self.paths
+        let cache = LockedELFSourceCacheReference(willLoadImage: { path in
+            loads.withLockedValue { $0[path, default: 0] += 1 }
+            if path == paths[0] {
+                // Holds the first image's lock until the second image is being loaded too.
+                let result = secondImageLoading.wait(timeout: .now() + .seconds(10))
+                secondImageLoadedWhilstFirstWasLoading.withLockedValue { $0 = result == .success }
+            } else {
+                secondImageLoading.signal()
+            }
+        })
+
+        let group = DispatchGroup()
+        for index in 0..<8 {
+            group.enter()
+            // Real threads, so that the lookups blocked on the first image can't starve the second one's.
+            Thread {
+                defer {
+                    group.leave()
+                }
+                let path = paths[index % 2]
+                XCTAssertNoThrow(try cache.prewarm(path: path, logger: self.logger).get())
+            }.start()
+        }
+        XCTAssertEqual(.success, group.wait(timeout: .now() + .seconds(60)))
+
+        XCTAssertTrue(secondImageLoadedWhilstFirstWasLoading.withLockedValue { $0 })
+        XCTAssertEqual([paths[0]: 1, paths[1]: 1], loads.withLockedValue { $0 })
+        XCTAssertEqual(2, cache.count)
+    }
+
+    func testSymbolIndexesAreOnlyWrittenWhenPrewarming() throws {
+        let buildID = try Elf64Image(source: ImageSource(path: self.paths[0])).uuid
+        guard let buildID = buildID, !buildID.isEmpty else {
+            throw XCTSkip("the test binary has no build ID")
+        }
+        let directory = NSTemporaryDirectory() + "/swipr-symbol-index-\(UUID())"
+        defer {
+            try? FileManager.default.removeItem(atPath: directory)
+        }
+        let indexPath = SymbolIndex.cachePath(cacheDirectory: directory, buildID: buildID)
+        let cache = LockedELFSourceCacheReference(symbolIndexCacheDirectory: directory)
+        let library = DynamicLibMapping(
+            path: self.paths[0],
+            architecture: "",
+            segmentSlide: 0,
+            segmentStartAddress: 0,
+            segmentEndAddress: .max
+        )
+
+        // Lookups are answered without an index rather than waiting for one to be built.
+        _ = cache.lookup(library: library, fileVirtualAddressIP: 0x1000, logger: self.logger)
+        XCTAssertFalse(FileManager.default.fileExists(atPath: indexPath))
+
+        XCTAssertNoThrow(try cache.prewarm(path: self.paths[0], logger: self.logger).get())
+        XCTAssertTrue(FileManager.default.fileExists(atPath: indexPath))
+    }
+
+    func testPrewarmingStopsWhenOutOfCPUBudget() throws {
+        let symbolizer = NativeELFSymboliser()
+        try symbolizer.prewarm(libraries: self.libraries, cpuBudget: .zero, logger: self.logger)
+        XCTAssertEqual([], symbolizer.imageMemoryUsage().map { $0.path })
+
+        try symbolizer.prewarm(libraries: self.libraries, cpuBudget: .hours(1), logger: self.logger)
+        XCTAssertEqual(self.paths, symbolizer.imageMemoryUsage().map { $0.path })
+    }
+
+    func testPrewarmingStopsWhenCancelled() throws {
+        let symbolizer = NativeELFSymboliser()
+        var checks = 0
+        try symbolizer.prewarm(libraries: self.libraries, cpuBudget: .hours(1), logger: self.logger) {
+            checks += 1
+            // Cancelled after the first library.
+            return checks > 1
+        }
+        XCTAssertEqual([self.paths[0]], symbolizer.imageMemoryUsage().map { $0.path })
+    }
+
+    func testLoadedImagesAreReadFromMemory() throws {
+        let getpidFunction: @convention(c) () -> pid_t = getpid
+        let getpidAddress = UInt(bitPattern: unsafeBitCast(getpidFunction, to: UnsafeRawPointer.self))
+        let segment = try XCTUnwrap(
+            ProfileRecorderSampler._listLoadedImageSegments().first { segment in
+                segment.segmentStartAddress <= getpidAddress && getpidAddress < segment.segmentEndAddress
+            }
+        )
+        let source = try XCTUnwrap(LoadedImages.imageSource(path: segment.path, segmentSlide: segment.segmentSlide))
+        XCTAssertTrue(source.isMappedImage)
+
+        // `getpid` is exported by the C library, so it's found in the dynamic symbols without touching the file.
+        let image = try Elf64Image(source: source)
+        XCTAssertNotNil(image.getDynamicSymbolTable())
+        let relativeAddress = UInt64(getpidAddress - segment.segmentSlide)
+        let symbol = try XCTUnwrap(image.symbolTable.lookupSymbol(address: relativeAddress))
+        XCTAssertEqual(relativeAddress, symbol.value)
+        XCTAssertNil(LoadedImages.imageSource(path: segment.path, segmentSlide: segment.segmentSlide + 1))
+    }
+
+    func testLoadedImagesAreOnlyReadWithinTheirSegments() throws {
+        let getpidFunction: @convention(c) () -> pid_t = getpid
+        let getpidAddress = UInt(bitPattern: unsafeBitCast(getpidFunction, to: UnsafeRawPointer.self))
+        let allSegments = ProfileRecorderSampler._listLoadedImageSegments()
+        let segment = try XCTUnwrap(
+            allSegments.first { segment in
+                segment.segmentStartAddress <= getpidAddress && getpidAddress < segment.segmentEndAddress
+            }
+        )
+        let segments = allSegments.filter { $0.path == segment.path && $0.segmentSlide == segment.segmentSlide }
+            .sorted { $0.segmentStartAddress < $1.segmentStartAddress }
+        let source = try XCTUnwrap(LoadedImages.imageSource(path: segment.path, segmentSlide: segment.segmentSlide))
+        XCTAssertGreaterThan(segments.count, 1)
+
+        // The C library has several segments, the end of the first one is followed by a gap or the next segment.
+        let firstEnd = ImageSource.Address(segments[0].segmentEndAddress - segment.segmentSlide)
+        XCTAssertNoThrow(try source.fetch(from: firstEnd - 1, as: UInt8.self))
+        XCTAssertThrowsError(try source.fetch(from: firstEnd - 1, as: UInt16.self))
+        XCTAssertEqual(1, source[firstEnd - 1..<firstEnd].count)
+        XCTAssertEqual(0, source[firstEnd - 1..<firstEnd + 1].count)
+        if segments[0].segmentEndAddress < segments[1].segmentStartAddress {
+            // The gap itself isn't read at all.
+            XCTAssertThrowsError(try source.fetch(from: firstEnd, as: UInt8.self))
+            XCTAssertThrowsError(try source.fetchString(from: firstEnd))
+        }
+    }
+}
+#endif
@@ -0,0 +1,94 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import XCTest
+@testable import _ProfileRecorderSampleConversion
+
+final class ElfSymbolTableTests: XCTestCase {
+    typealias SymbolTable = ElfSymbolTable<Elf64Traits>
+
+    // Offsets: first 1, small 7, big 13, last 17, extra 22.
+    private let strings = Array("\0first\0small\0big\0last\0extra\0".utf8)
+
+    private func withTable<R>(
+        _ entries: [(value: UInt64, size: UInt64, nameOffset: UInt32)],
+        _ body: (SymbolTable, ElfStringSection) throws -> R
+    ) rethrows -> R {
+        return try self.strings.withUnsafeBytes { buffer in
+            let strings = ElfStringSection(source: ImageSource(unowned: buffer, isMappedImage: false))
+            let table = SymbolTable(
+                entries: entries.map { SymbolTable.Entry(value: $0.value, size: $0.size, nameOffset: $0.nameOffset) },
+                strings: strings
+            )
+            return try body(table, strings)
+        }
+    }
+
+    func testLookups() throws {
+        // Deliberately not sorted.
+        self.withTable([(0x3000, 0x10, 17), (0x2000, 0x100, 13), (0x1000, 0x10, 1), (0x2000, 0x10, 7)]) { table, _ in
+            XCTAssertEqual(4, table.count)
+            XCTAssertEqual(["first", "small", "big", "last"], table.symbols.map { $0.name })
+
+            XCTAssertNil(table.lookupSymbol(address: 0xfff))
+            XCTAssertEqual("first", table.lookupSymbol(address: 0x1000)?.name)
+            XCTAssertEqual("first", table.lookupSymbol(address: 0x1fff)?.name)
+            XCTAssertEqual(0x1000, table.lookupSymbol(address: 0x1fff)?.value)
+            // Exactly at the start of two symbols: the first one wins, inside of them the last one.
+            XCTAssertEqual("small", table.lookupSymbol(address: 0x2000)?.name)
+            XCTAssertEqual("big", table.lookupSymbol(address: 0x2001)?.name)
+            XCTAssertEqual("last", table.lookupSymbol(address: 0x3000)?.name)
+            XCTAssertEqual("last", table.lookupSymbol(address: .max)?.name)
+        }
+        self.withTable([]) { table, _ in
+            XCTAssertNil(table.lookupSymbol(address: 0x1000))
+        }
+    }
+
+    func testLookupsMatchALinearScan() throws {
+        var entries: [(value: UInt64, size: UInt64, nameOffset: UInt32)] = []
+        for index in 0..<1000 {
+            // Some duplicate addresses, some gaps.
+            entries.append((UInt64(index / 3 * 0x20 + index % 2), UInt64(index % 5), [1, 7, 13, 17, 22][index % 5]))
+        }
+        self.withTable(entries) { table, _ in
+            let sorted = Array(table.symbols)
+            for address in stride(from: UInt64(0), through: 0x1000, by: 1) {
+                let expected = sorted.lastIndex { $0.value <= address }.map { last in
+                    sorted.firstIndex { $0.value == address } ?? last
+                }
+                XCTAssertEqual(expected.map { sorted[$0] }, table.lookupSymbol(address: address), "\(address)")
+            }
+        }
+    }
+
+    func testMerge() throws {
+        self.withTable([(0x1000, 0x10, 1), (0x2000, 0x10, 7)]) { ours, strings in
+            let theirs = SymbolTable(
+                entries: [
+                    SymbolTable.Entry(value: 0x1000, size: 0x10, nameOffset: 1),
+                    SymbolTable.Entry(value: 0x2000, size: 0x8, nameOffset: 22),
+                    SymbolTable.Entry(value: 0x3000, size: 0x10, nameOffset: 17),
+                ],
+                strings: strings
+            )
+            let merged = ours.merged(with: theirs)
+            // `first` is in both, only once. Both symbols at 0x2000 are kept, the smaller one first.
+            XCTAssertEqual(["first", "extra", "small", "last"], merged.symbols.map { $0.name })
+            XCTAssertEqual("extra", merged.lookupSymbol(address: 0x2000)?.name)
+            XCTAssertEqual("small", merged.lookupSymbol(address: 0x2004)?.name)
+            XCTAssertEqual("last", merged.lookupSymbol(address: 0x3004)?.name)
+        }
+    }
+}
@@ -0,0 +1,144 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import Logging
+import XCTest
+import NIO
+
+@testable import _ProfileRecorderSampleConversion
+
+final class FirefoxProfilerTests: XCTestCase {
+    private var symbolizer: CachedSymbolizer! = nil
+    private var underlyingSymbolizer: (any Symbolizer)! = nil
+    private var logger: Logger! = nil
+
+    private struct GeckoProfile: Decodable {
+        struct Meta: Decodable {
+            var version: Int
+            var startTime: Double
+            var interval: Double
+        }
+
+        struct Table<Row: Decodable>: Decodable {
+            var data: [Row]
+        }
+
+        struct Thread: Decodable {
+            var name: String
+            var pid: Int
+            var tid: Int
+            var samples: Table<[Double?]>
+            var stackTable: Table<[Int?]>
+            var frameTable: Table<[Line?]>
+            var stringTable: [String]
+        }
+
+        /// Frame table rows mix strings, bools, numbers and `null`s, we only look at the numbers.
+        struct Line: Decodable {
+            var number: Int?
+
+            init(from decoder: any Decoder) throws {
+                self.number = try? decoder.singleValueContainer().decode(Int.self)
+            }
+        }
+
+        var meta: Meta
+        var threads: [Thread]
+    }
+
+    func testStacksAreDedupedPerThreadAndSamplesKeepTheirTime() throws {
+        var renderer = FirefoxProfilerOutputRenderer()
+        for (tid, nanoseconds, stack) in [
+            (2, 5_000_000, [0x2345, 0x2999]),
+            (3, 6_000_000, [0x2345, 0x2999]),
+            (2, 7_500_000, [0x2999]),
+            (2, 9_000_000, [0x2345, 0x2999]),
+        ] as [(Int, Int, [UInt])] {
+            let actual = try renderer.consumeSingleSample(
+                Sample(
+                    sampleHeader: SampleHeader(
+                        pid: 1,
+                        tid: tid,
+                        name: "thread-\(tid)",
+                        timeSec: 4,
+                        timeNSec: nanoseconds
+                    ),
+                    stack: stack.map { StackFrame(instructionPointer: $0, stackPointer: .max) }
+                ),
+                configuration: .default,
+                symbolizer: self.symbolizer
+            )
+            XCTAssertEqual(ByteBuffer(), actual)
+        }
+
+        let output = try renderer.finalise(
+            sampleConfiguration: SampleConfig(
+                currentTimeSeconds: 4,
+                currentTimeNanoseconds: 0,
+                microSecondsBetweenSamples: 1_500,
+                sampleCount: 4
+            ),
+            configuration: .default,
+            symbolizer: self.symbolizer
+        )
+        let profile = try JSONDecoder().decode(GeckoProfile.self, from: Data(output.readableBytesView))
+        XCTAssertEqual(24, profile.meta.version)
+        XCTAssertEqual(4_005, profile.meta.startTime)
+        XCTAssertEqual(1.5, profile.meta.interval)
+        XCTAssertEqual(["thread-2", "thread-3"], profile.threads.map { $0.name })
+        XCTAssertEqual([2, 3], profile.threads.map { $0.tid })
+
+        let thread2 = profile.threads[0]
+        XCTAssertEqual(["fake"], thread2.stringTable)
+        XCTAssertEqual(1, thread2.frameTable.data.count)
+        // fake -> fake, the one frame stack is the prefix of the two frame one.
+        XCTAssertEqual([[nil, 0], [0, 0]], thread2.stackTable.data)
+        XCTAssertEqual([[1, 0, 0], [0, 2.5, 0], [1, 4, 0]], thread2.samples.data)
+
+        let thread3 = profile.threads[1]
+        XCTAssertEqual([[nil, 0], [0, 0]], thread3.stackTable.data)
+        XCTAssertEqual([[1, 1, 0]], thread3.samples.data)
+    }
+
+    // MARK: - Setup/teardown
+    override func setUpWithError() throws {
+        self.logger = Logger(label: "\(Self.self)")
+        self.logger.logLevel = .info
+
+        self.underlyingSymbolizer = FakeSymbolizer()
+        try self.underlyingSymbolizer!.start()
+        self.symbolizer = CachedSymbolizer(
+            configuration: .default,
+            symbolizer: self.underlyingSymbolizer!,
+            dynamicLibraryMappings: [
+                DynamicLibMapping(
+                    path: "/lib/libfoo.so",
+                    architecture: "arm64",
+                    segmentSlide: 0x1000,
+                    segmentStartAddress: 0x2000,
+                    segmentEndAddress: 0x3000
+                )
+            ],
+            group: .singletonMultiThreadedEventLoopGroup,
+            logger: self.logger
+        )
+    }
+
+    override func tearDown() {
+        XCTAssertNoThrow(try self.underlyingSymbolizer!.shutdown())
+        self.underlyingSymbolizer = nil
+        self.symbolizer = nil
+        self.logger = nil
+    }
+}
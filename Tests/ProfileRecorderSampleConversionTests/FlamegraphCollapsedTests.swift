@@ -23,124 +23,150 @@ final class FlamegraphCollapsedScriptTests: XCTestCase {
     private var underlyingSymbolizer: (any Symbolizer)! = nil
     private var logger: Logger! = nil
 
-    func testPerfScriptNumberRenderingSmallNumber() throws {
-        let renderer = FlamegraphCollapsedOutputRenderer()
-        defer {
-            let remainder = renderer.finalise(
-                sampleConfiguration: SampleConfig(
-                    currentTimeSeconds: 0,
-                    currentTimeNanoseconds: 0,
-                    microSecondsBetweenSamples: 0,
-                    sampleCount: 0
-                ),
+    func testSamplesAreOnlyRenderedWhenFinalising() throws {
+        var renderer = FlamegraphCollapsedOutputRenderer(includeAddresses: true)
+        let actual = try renderer.consumeSingleSample(
+            self.makeSample(tid: 2, stack: [0x2345, 0x2999]),
+            configuration: .default,
+            symbolizer: self.symbolizer
+        )
+        XCTAssertEqual(ByteBuffer(), actual)
+
+        let remainder = renderer.finalise(
+            sampleConfiguration: self.makeSampleConfig(),
+            configuration: .default,
+            symbolizer: self.symbolizer
+        )
+        let expected = """
+            fake<1999>;fake<1345> 1
+
+            """
+        XCTAssertEqual(expected, String(buffer: remainder))
+    }
+
+    func testIdenticalStacksAreAggregated() throws {
+        var renderer = FlamegraphCollapsedOutputRenderer(includeAddresses: true)
+        for (tid, stack) in [
+            (2, [0x2345, 0x2999]),
+            (3, [0x2345, 0x2999]),  // same stack on a different thread
+            (2, [0x2346, 0x2999]),
+            (2, [0x2345, 0x2999]),
+        ] as [(Int, [UInt])] {
+            _ = try renderer.consumeSingleSample(
+                self.makeSample(tid: tid, stack: stack),
                 configuration: .default,
                 symbolizer: self.symbolizer
             )
-            XCTAssertEqual(ByteBuffer(string: ""), remainder)
         }
-        let actual = try renderer.consumeSingleSample(
-            Sample(
-                sampleHeader: SampleHeader(
-                    pid: 1,
-                    tid: 2,
-                    name: "thread",
-                    timeSec: 4,
-                    timeNSec: 5 // important, this is a small number, so it'll get 0 prefixed
-                ),
-                stack: [
-                    StackFrame(instructionPointer: 0x2345, stackPointer: .max),
-                    StackFrame(instructionPointer: 0x2999, stackPointer: .max),
-                ]
-            ),
+
+        let remainder = renderer.finalise(
+            sampleConfiguration: self.makeSampleConfig(),
             configuration: .default,
             symbolizer: self.symbolizer
         )
-
         let expected = """
-            fake<1999>;fake<1345> 4000000005
+            fake<1999>;fake<1345> 3
+            fake<1999>;fake<1346> 1
 
             """
-        XCTAssertEqual(expected, String(buffer: actual))
+        XCTAssertEqual(expected, String(buffer: remainder))
+
+        // Finalising resets the renderer.
+        XCTAssertEqual(
+            ByteBuffer(),
+            renderer.finalise(
+                sampleConfiguration: self.makeSampleConfig(),
+                configuration: .default,
+                symbolizer: self.symbolizer
+            )
+        )
     }
 
-    func testPerfScriptNumberRenderingJustNanoseconnds() throws {
-        let renderer = FlamegraphCollapsedOutputRenderer()
-        defer {
-            let remainder = renderer.finalise(
-                sampleConfiguration: SampleConfig(
-                    currentTimeSeconds: 0,
-                    currentTimeNanoseconds: 0,
-                    microSecondsBetweenSamples: 0,
-                    sampleCount: 0
-                ),
+    func testNanosecondsWeight() throws {
+        var renderer = FlamegraphCollapsedOutputRenderer(weight: .nanoseconds, includeAddresses: true)
+        for _ in 0..<2 {
+            _ = try renderer.consumeSingleSample(
+                self.makeSample(tid: 2, stack: [0x2345, 0x2999]),
                 configuration: .default,
                 symbolizer: self.symbolizer
             )
-            XCTAssertEqual(ByteBuffer(string: ""), remainder)
         }
-        let actual = try renderer.consumeSingleSample(
-            Sample(
-                sampleHeader: SampleHeader(
-                    pid: 1,
-                    tid: 2,
-                    name: "thread",
-                    timeSec: 0,
-                    timeNSec: 5
-                ),
-                stack: [
-                    StackFrame(instructionPointer: 0x2345, stackPointer: .max),
-                    StackFrame(instructionPointer: 0x2999, stackPointer: .max),
-                ]
-            ),
+
+        let remainder = renderer.finalise(
+            sampleConfiguration: self.makeSampleConfig(microSecondsBetweenSamples: 10_000),
             configuration: .default,
             symbolizer: self.symbolizer
         )
-
         let expected = """
-            fake<1999>;fake<1345> 5
+            fake<1999>;fake<1345> 20000000
 
             """
-        XCTAssertEqual(expected, String(buffer: actual))
+        XCTAssertEqual(expected, String(buffer: remainder))
     }
 
-    func testPerfScriptNumberRenderingLargeNumber() throws {
-        let renderer = FlamegraphCollapsedOutputRenderer()
-        defer {
-            let remainder = renderer.finalise(
-                sampleConfiguration: SampleConfig(
-                    currentTimeSeconds: 0,
-                    currentTimeNanoseconds: 0,
-                    microSecondsBetweenSamples: 0,
-                    sampleCount: 0
-                ),
+    func testInstructionsOfTheSameFunctionsAreAggregated() throws {
+        var renderer = FlamegraphCollapsedOutputRenderer()
+        for stack in [[0x2345, 0x2999], [0x2346, 0x2999], [0x2345, 0x2998]] as [[UInt]] {
+            _ = try renderer.consumeSingleSample(
+                self.makeSample(tid: 2, stack: stack),
                 configuration: .default,
                 symbolizer: self.symbolizer
             )
-            XCTAssertEqual(ByteBuffer(string: ""), remainder)
         }
-        let actual = try renderer.consumeSingleSample(
-            Sample(
-                sampleHeader: SampleHeader(
-                    pid: 1,
-                    tid: 2,
-                    name: "thread",
-                    timeSec: 4,
-                    timeNSec: 987_654_321 // important, this is a large number, no zero prefixes
-                ),
-                stack: [
-                    StackFrame(instructionPointer: 0x2345, stackPointer: .max),
-                    StackFrame(instructionPointer: 0x2999, stackPointer: .max),
-                ]
-            ),
+
+        let remainder = renderer.finalise(
+            sampleConfiguration: self.makeSampleConfig(),
             configuration: .default,
             symbolizer: self.symbolizer
         )
+        // The fake symboliser puts every address into a function called `fake`.
+        let expected = """
+            fake;fake 3
 
+            """
+        XCTAssertEqual(expected, String(buffer: remainder))
+    }
+
+    func testStacksAreAggregatedAcrossSymbolizers() throws {
+        let otherSymbolizer = CachedSymbolizer(
+            configuration: .default,
+            symbolizer: self.underlyingSymbolizer!,
+            dynamicLibraryMappings: [
+                DynamicLibMapping(
+                    path: "/lib/libfoo.so",
+                    architecture: "arm64",
+                    segmentSlide: 0x11000,
+                    segmentStartAddress: 0x12000,
+                    segmentEndAddress: 0x13000
+                )
+            ],
+            interner: self.symbolizer.interner,
+            group: .singletonMultiThreadedEventLoopGroup,
+            logger: self.logger
+        )
+        var renderer = FlamegraphCollapsedOutputRenderer(includeAddresses: true)
+        _ = try renderer.consumeSingleSample(
+            self.makeSample(tid: 2, stack: [0x2345, 0x2999]),
+            configuration: .default,
+            symbolizer: self.symbolizer
+        )
+        // The library got loaded at a different address, but it's the same stack.
+        _ = try renderer.consumeSingleSample(
+            self.makeSample(tid: 2, stack: [0x12345, 0x12999]),
+            configuration: .default,
+            symbolizer: otherSymbolizer
+        )
+
+        let remainder = renderer.finalise(
+            sampleConfiguration: self.makeSampleConfig(),
+            configuration: .default,
+            symbolizer: otherSymbolizer
+        )
         let expected = """
-            fake<1999>;fake<1345> 4987654321
+            fake<1999>;fake<1345> 2
 
             """
-        XCTAssertEqual(expected, String(buffer: actual))
+        XCTAssertEqual(expected, String(buffer: remainder))
     }
 
     // MARK: - Setup/teardown
@@ -173,4 +199,21 @@ final class FlamegraphCollapsedScriptTests: XCTestCase {
         self.symbolizer = nil
         self.logger = nil
     }
+
+    // MARK: - Helpers
+    private func makeSample(tid: Int, stack: [UInt]) -> Sample {
+        return Sample(
+            sampleHeader: SampleHeader(pid: 1, tid: tid, name: "thread", timeSec: 4, timeNSec: 5),
+            stack: stack.map { StackFrame(instructionPointer: $0, stackPointer: .max) }
+        )
+    }
+
+    private func makeSampleConfig(microSecondsBetweenSamples: Int = 0) -> SampleConfig {
+        return SampleConfig(
+            currentTimeSeconds: 0,
+            currentTimeNanoseconds: 0,
+            microSecondsBetweenSamples: microSecondsBetweenSamples,
+            sampleCount: 0
+        )
+    }
 }
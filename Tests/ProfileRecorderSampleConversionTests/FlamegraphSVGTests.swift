@@ -0,0 +1,124 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import Logging
+import XCTest
+import NIO
+
+@testable import _ProfileRecorderSampleConversion
+
+final class FlamegraphSVGTests: XCTestCase {
+    private var symbolizer: CachedSymbolizer! = nil
+    private var underlyingSymbolizer: (any Symbolizer)! = nil
+    private var logger: Logger! = nil
+
+    func testFramesAreMergedAcrossThreads() throws {
+        let output = try self.render(
+            FlamegraphSVGOutputRenderer(),
+            stacks: [(2, [0x2345, 0x2999]), (3, [0x2345, 0x2999]), (2, [0x2999]), (2, [0x3000])]
+        )
+        XCTAssert(output.hasPrefix("<?xml"), output)
+        XCTAssert(output.hasSuffix("</svg>\n"), output)
+        XCTAssert(output.contains("Flame Graph (4 samples)"), output)
+        XCTAssert(output.contains("<title>all (4 samples, 100.00%)</title>"), output)
+        // The outer `fake` is on three stacks, the inner one on two.
+        XCTAssert(output.contains("<title>fake (3 samples, 75.00%)</title>"), output)
+        XCTAssert(output.contains("<title>fake (2 samples, 50.00%)</title>"), output)
+        XCTAssert(output.contains("<title>unknown @ 0x3000 (1 samples, 25.00%)</title>"), output)
+        XCTAssertEqual(4, output.components(separatedBy: "<g>").count - 1, output)
+    }
+
+    func testNarrowFramesArePruned() throws {
+        // With 4 samples over 1180 pixels, a single sample is 295 pixels wide.
+        let output = try self.render(
+            FlamegraphSVGOutputRenderer(imageWidth: 1200, minimumFrameWidth: 300),
+            stacks: [(2, [0x2345, 0x2999]), (3, [0x2345, 0x2999]), (2, [0x2999]), (2, [0x3000])]
+        )
+        XCTAssert(output.contains("<title>fake (3 samples, 75.00%)</title>"), output)
+        XCTAssert(output.contains("<title>fake (2 samples, 50.00%)</title>"), output)
+        XCTAssertFalse(output.contains("unknown"), output)
+        XCTAssertEqual(3, output.components(separatedBy: "<g>").count - 1, output)
+    }
+
+    func testNoSamples() throws {
+        let output = try self.render(FlamegraphSVGOutputRenderer(), stacks: [])
+        XCTAssert(output.contains("Flame Graph (0 samples)"), output)
+        XCTAssertFalse(output.contains("<g>"), output)
+        XCTAssert(output.hasSuffix("</svg>\n"), output)
+    }
+
+    func testXMLEscaping() {
+        var buffer = ByteBuffer()
+        buffer.writeXMLEscaped("Array<Int>.== \"&\"\u{1}")
+        XCTAssertEqual("Array&lt;Int&gt;.== &quot;&amp;&quot; ", String(buffer: buffer))
+    }
+
+    // MARK: - Setup/teardown
+    override func setUpWithError() throws {
+        self.logger = Logger(label: "\(Self.self)")
+        self.logger.logLevel = .info
+
+        self.underlyingSymbolizer = FakeSymbolizer()
+        try self.underlyingSymbolizer!.start()
+        self.symbolizer = CachedSymbolizer(
+            configuration: .default,
+            symbolizer: self.underlyingSymbolizer!,
+            dynamicLibraryMappings: [
+                DynamicLibMapping(
+                    path: "/lib/libfoo.so",
+                    architecture: "arm64",
+                    segmentSlide: 0x1000,
+                    segmentStartAddress: 0x2000,
+                    segmentEndAddress: 0x3000
+                )
+            ],
+            group: .singletonMultiThreadedEventLoopGroup,
+            logger: self.logger
+        )
+    }
+
+    override func tearDown() {
+        XCTAssertNoThrow(try self.underlyingSymbolizer!.shutdown())
+        self.underlyingSymbolizer = nil
+        self.symbolizer = nil
+        self.logger = nil
+    }
+
+    // MARK: - Helpers
+    private func render(_ renderer: FlamegraphSVGOutputRenderer, stacks: [(tid: Int, stack: [UInt])]) throws -> String {
+        var renderer = renderer
+        for (tid, stack) in stacks {
+            let actual = try renderer.consumeSingleSample(
+                Sample(
+                    sampleHeader: SampleHeader(pid: 1, tid: tid, name: "thread", timeSec: 4, timeNSec: 5),
+                    stack: stack.map { StackFrame(instructionPointer: $0, stackPointer: .max) }
+                ),
+                configuration: .default,
+                symbolizer: self.symbolizer
+            )
+            XCTAssertEqual(ByteBuffer(), actual)
+        }
+        let output = try renderer.finalise(
+            sampleConfiguration: SampleConfig(
+                currentTimeSeconds: 0,
+                currentTimeNanoseconds: 0,
+                microSecondsBetweenSamples: 10_000,
+                sampleCount: stacks.count
+            ),
+            configuration: .default,
+            symbolizer: self.symbolizer
+        )
+        return String(buffer: output)
+    }
+}
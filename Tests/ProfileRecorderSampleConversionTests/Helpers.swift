@@ -18,6 +18,12 @@ import NIO
 import ProfileRecorderPprofFormat
 
 final class FakeSymbolizer: Symbolizer {
+    private let functionName: String
+
+    init(functionName: String = "fake") {
+        self.functionName = functionName
+    }
+
     var description: String {
         return "FakeSymbolizer"
     }
@@ -34,7 +40,7 @@ final class FakeSymbolizer: Symbolizer {
             allFrames: [
                 SymbolisedStackFrame.SingleFrame(
                     address: fileVirtualAddressIP,
-                    functionName: "fake",
+                    functionName: self.functionName,
                     functionOffset: 5,
                     library: "libfoo",
                     vmap: library
@@ -0,0 +1,112 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import XCTest
+@testable import _ProfileRecorderSampleConversion
+
+final class InlineCallSiteIndexTests: XCTestCase {
+    private struct Range: InlineCallSiteRange, Equatable {
+        var lowPC: UInt64
+        var highPC: UInt64
+        var depth: Int
+    }
+
+    func testNestedChainsAreFoundOutermostFirst() {
+        let ranges = [
+            Range(lowPC: 0x1000, highPC: 0x1100, depth: 1),
+            Range(lowPC: 0x1010, highPC: 0x1020, depth: 2),
+            Range(lowPC: 0x1020, highPC: 0x1080, depth: 2),
+            Range(lowPC: 0x1020, highPC: 0x1080, depth: 3),
+            Range(lowPC: 0x1030, highPC: 0x1040, depth: 4),
+            Range(lowPC: 0x2000, highPC: 0x2010, depth: 1),
+        ]
+        let index = InlineCallSiteIndex(ranges.reversed())
+
+        XCTAssertEqual([], index.callSites(containing: 0xfff))
+        XCTAssertEqual([ranges[0], ranges[1]], index.callSites(containing: 0x1015))
+        XCTAssertEqual([ranges[0], ranges[2], ranges[3]], index.callSites(containing: 0x1020))
+        XCTAssertEqual([ranges[0], ranges[2], ranges[3], ranges[4]], index.callSites(containing: 0x1030))
+        // Past all the nested ranges, but still in the outer one.
+        XCTAssertEqual([ranges[0]], index.callSites(containing: 0x1090))
+        XCTAssertEqual([], index.callSites(containing: 0x1100))
+        XCTAssertEqual([ranges[5]], index.callSites(containing: 0x2000))
+        XCTAssertEqual([], index.callSites(containing: 0x2010))
+    }
+
+    func testLookupsMatchALinearScan() {
+        var generator = SystemRandomNumberGenerator()
+        for _ in 0..<20 {
+            // Properly nested ranges, plus some that overlap without nesting.
+            var ranges: [Range] = []
+            func addNested(_ lowPC: UInt64, _ highPC: UInt64, depth: Int) {
+                var start = lowPC
+                while start < highPC && ranges.count < 500 {
+                    let end = min(highPC, start + UInt64.random(in: 1...64, using: &generator))
+                    ranges.append(Range(lowPC: start, highPC: end, depth: depth))
+                    if depth < 6 && Bool.random(using: &generator) {
+                        addNested(start, end, depth: depth + 1)
+                    }
+                    start = end + UInt64.random(in: 0...8, using: &generator)
+                }
+            }
+            addNested(0x100, 0x1000, depth: 1)
+            for _ in 0..<10 {
+                let lowPC = UInt64.random(in: 0x100..<0x1000, using: &generator)
+                ranges.append(
+                    Range(lowPC: lowPC, highPC: lowPC + UInt64.random(in: 1...128, using: &generator), depth: 1)
+                )
+            }
+            ranges.shuffle(using: &generator)
+
+            let index = InlineCallSiteIndex(ranges)
+            for address in UInt64(0xf0)..<0x1100 {
+                let expected = index.callSites.filter { $0.lowPC <= address && $0.highPC > address }
+                XCTAssertEqual(expected, index.callSites(containing: address), "\(address)")
+            }
+        }
+    }
+
+    func testSymbolIndexMatchesTheInMemoryIndex() throws {
+        var builder = SymbolIndex.Builder()
+        let ranges = [
+            Range(lowPC: 0x1020, highPC: 0x1030, depth: 2),
+            Range(lowPC: 0x1010, highPC: 0x1040, depth: 1),
+            Range(lowPC: 0x1024, highPC: 0x1028, depth: 3),
+        ]
+        for range in ranges {
+            builder.addCallSite(
+                SymbolIndex.CallSite(
+                    depth: range.depth,
+                    name: "depth \(range.depth)",
+                    lowPC: range.lowPC,
+                    highPC: range.highPC,
+                    filename: "/src/a.swift",
+                    line: range.depth,
+                    column: 0
+                )
+            )
+        }
+        let inMemory = InlineCallSiteIndex(ranges)
+        try builder.serialise().withUnsafeBytes { buffer in
+            let index = try SymbolIndex(source: ImageSource(unowned: buffer, isMappedImage: false))
+            for address in UInt64(0x1000)..<0x1050 {
+                XCTAssertEqual(
+                    inMemory.callSites(containing: address).map { "depth \($0.depth)" as String? },
+                    index.inlineCallSites(at: address).map { $0.name },
+                    "\(address)"
+                )
+            }
+        }
+    }
+}
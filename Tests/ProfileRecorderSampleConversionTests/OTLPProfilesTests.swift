@@ -0,0 +1,280 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import Logging
+import XCTest
+import NIO
+
+@testable import _ProfileRecorderSampleConversion
+
+final class OTLPProfilesTests: XCTestCase {
+    private var symbolizer: CachedSymbolizer! = nil
+    private var underlyingSymbolizer: (any Symbolizer)! = nil
+    private var logger: Logger! = nil
+
+    func testProfilesDataReferencesTheDictionary() throws {
+        var renderer = OTLPProfilesOutputRenderer()
+        for (tid, stack) in [
+            (2, [0x2345, 0x2999]),
+            (2, [0x2345, 0x2999]),
+            (3, [0x3000]),  // not in any mapping
+        ] as [(Int, [UInt])] {
+            let actual = try renderer.consumeSingleSample(
+                Sample(
+                    sampleHeader: SampleHeader(pid: 1, tid: tid, name: "thread-\(tid)", timeSec: 4, timeNSec: 5),
+                    stack: stack.map { StackFrame(instructionPointer: $0, stackPointer: .max) }
+                ),
+                configuration: .default,
+                symbolizer: self.symbolizer
+            )
+            XCTAssertEqual(ByteBuffer(), actual)
+        }
+        let output = try renderer.finalise(
+            sampleConfiguration: SampleConfig(
+                currentTimeSeconds: 4,
+                currentTimeNanoseconds: 0,
+                microSecondsBetweenSamples: 10_000,
+                sampleCount: 3
+            ),
+            configuration: .default,
+            symbolizer: self.symbolizer
+        )
+
+        let profilesData = try ProtobufFields(Array(output.readableBytesView))
+        let dictionary = try XCTUnwrap(profilesData.messages(2).first)
+        let strings = dictionary.strings(5)
+        let mappingTable = try dictionary.messages(1)
+        let locationTable = try dictionary.messages(2)
+        let functionTable = try dictionary.messages(3)
+        let attributeTable = try dictionary.messages(6)
+        XCTAssertEqual("", strings.first)
+
+        let scopeProfiles = try XCTUnwrap(profilesData.messages(1).first?.messages(2).first)
+        XCTAssertEqual(["swift-profile-recorder"], try scopeProfiles.messages(1).first?.strings(1))
+        let profile = try XCTUnwrap(scopeProfiles.messages(2).first)
+        XCTAssertEqual(4_000_000_000, profile.varint(4))
+        XCTAssertEqual(30_000_000, profile.varint(5))
+        XCTAssertEqual(10_000_000, profile.varint(7))
+
+        let samples = try profile.messages(2)
+        XCTAssertEqual(2, samples.count)
+        let locationIndices = try profile.packed(3)
+
+        // Thread 2: both frames are in libfoo, which has a build ID.
+        XCTAssertEqual([2], try samples[0].packed(3))
+        XCTAssertEqual(
+            ["thread.id": "2", "thread.name": "thread-2"],
+            try self.attributes(samples[0].packed(4), attributeTable, strings)
+        )
+        let thread2Locations = locationIndices[Int(samples[0].varint(1))...].prefix(Int(samples[0].varint(2)))
+        XCTAssertEqual(2, thread2Locations.count)
+        for locationIndex in thread2Locations {
+            let location = locationTable[Int(locationIndex)]
+            XCTAssertEqual(1, location.varint(1))
+            XCTAssert((0x2000..<0x3000).contains(location.varint(2)), "\(location.varint(2))")
+            let functionIndex = try XCTUnwrap(location.messages(3).first?.varint(1))
+            XCTAssertEqual("fake", strings[Int(functionTable[Int(functionIndex)].varint(1))])
+        }
+        XCTAssertEqual(2, mappingTable.count)
+        XCTAssertEqual("/lib/libfoo.so", strings[Int(mappingTable[1].varint(4))])
+        XCTAssertEqual(0x2000, mappingTable[1].varint(1))
+        XCTAssertEqual(0x3000, mappingTable[1].varint(2))
+        XCTAssertEqual(
+            ["process.executable.build_id.gnu": "0123abcd"],
+            try self.attributes(mappingTable[1].packed(5), attributeTable, strings)
+        )
+
+        // Thread 3: the frame isn't in any mapping.
+        XCTAssertEqual([1], try samples[1].packed(3))
+        XCTAssertEqual(
+            ["thread.id": "3", "thread.name": "thread-3"],
+            try self.attributes(samples[1].packed(4), attributeTable, strings)
+        )
+        XCTAssertEqual(1, samples[1].varint(2))
+        let unmappedLocation = locationTable[Int(locationIndices[Int(samples[1].varint(1))])]
+        XCTAssertEqual(0, unmappedLocation.varint(1))
+        XCTAssertEqual(0x3000, unmappedLocation.varint(2))
+    }
+
+    func testBuildIDIsDecodedFromVMAPRecords() throws {
+        let withBuildID = try JSONDecoder().decode(
+            DynamicLibMapping.self,
+            from: Data(
+                #"""
+                {"path": "/lib/libfoo.so", "architecture": "arm64", "segmentSlide": "0x1000", \#
+                "segmentStartAddress": "0x2000", "segmentEndAddress": "0x3000", "buildID": "0123abcd"}
+                """#.utf8
+            )
+        )
+        XCTAssertEqual("0123abcd", withBuildID.buildID)
+
+        let withEmptyBuildID = try JSONDecoder().decode(
+            DynamicLibMapping.self,
+            from: Data(
+                #"""
+                {"path": "/lib/libfoo.so", "architecture": "arm64", "segmentSlide": "0x1000", \#
+                "segmentStartAddress": "0x2000", "segmentEndAddress": "0x3000", "buildID": ""}
+                """#.utf8
+            )
+        )
+        XCTAssertNil(withEmptyBuildID.buildID)
+
+        let withoutBuildID = try JSONDecoder().decode(
+            DynamicLibMapping.self,
+            from: Data(
+                #"""
+                {"path": "/lib/libfoo.so", "architecture": "arm64", "segmentSlide": "0x1000", \#
+                "segmentStartAddress": "0x2000", "segmentEndAddress": "0x3000"}
+                """#.utf8
+            )
+        )
+        XCTAssertNil(withoutBuildID.buildID)
+    }
+
+    // MARK: - Setup/teardown
+    override func setUpWithError() throws {
+        self.logger = Logger(label: "\(Self.self)")
+        self.logger.logLevel = .info
+
+        self.underlyingSymbolizer = FakeSymbolizer()
+        try self.underlyingSymbolizer!.start()
+        self.symbolizer = CachedSymbolizer(
+            configuration: .default,
+            symbolizer: self.underlyingSymbolizer!,
+            dynamicLibraryMappings: [
+                DynamicLibMapping(
+                    path: "/lib/libfoo.so",
+                    architecture: "arm64",
+                    segmentSlide: 0x1000,
+                    segmentStartAddress: 0x2000,
+                    segmentEndAddress: 0x3000,
+                    buildID: "0123abcd"
+                )
+            ],
+            group: .singletonMultiThreadedEventLoopGroup,
+            logger: self.logger
+        )
+    }
+
+    override func tearDown() {
+        XCTAssertNoThrow(try self.underlyingSymbolizer!.shutdown())
+        self.underlyingSymbolizer = nil
+        self.symbolizer = nil
+        self.logger = nil
+    }
+
+    // MARK: - Helpers
+
+    /// The `KeyValue`s at `indices` in the attribute table, with the values printed as strings.
+    private func attributes(
+        _ indices: [UInt64],
+        _ attributeTable: [ProtobufFields],
+        _ strings: [String]
+    ) throws -> [String: String] {
+        var attributes: [String: String] = [:]
+        for index in indices {
+            let keyValue = attributeTable[Int(index)]
+            let value = try XCTUnwrap(keyValue.messages(2).first)
+            attributes[keyValue.strings(1).first ?? ""] = value.strings(1).first ?? String(value.varint(3))
+        }
+        return attributes
+    }
+}
+
+/// Just enough of a protobuf decoder to look at the fields of a message without its generated code.
+private struct ProtobufFields {
+    struct Error: Swift.Error {
+        var message: String
+    }
+
+    private var varints: [Int: [UInt64]] = [:]
+    private var lengthDelimited: [Int: [[UInt8]]] = [:]
+
+    init(_ bytes: [UInt8]) throws {
+        var index = 0
+        func readVarint() throws -> UInt64 {
+            var value: UInt64 = 0
+            var shift: UInt64 = 0
+            while true {
+                guard index < bytes.count, shift < 64 else {
+                    throw Error(message: "truncated varint")
+                }
+                let byte = bytes[index]
+                index += 1
+                value |= UInt64(byte & 0x7f) << shift
+                shift += 7
+                if byte & 0x80 == 0 {
+                    return value
+                }
+            }
+        }
+
+        while index < bytes.count {
+            let tag = try readVarint()
+            let field = Int(tag >> 3)
+            switch tag & 0x7 {
+            case 0:
+                self.varints[field, default: []].append(try readVarint())
+            case 2:
+                let length = Int(try readVarint())
+                guard index + length <= bytes.count else {
+                    throw Error(message: "truncated field \(field)")
+                }
+                self.lengthDelimited[field, default: []].append(Array(bytes[index..<(index + length)]))
+                index += length
+            default:
+                throw Error(message: "unexpected wire type in tag \(tag)")
+            }
+        }
+    }
+
+    /// The last value of a varint field, 0 if absent.
+    func varint(_ field: Int) -> UInt64 {
+        return self.varints[field]?.last ?? 0
+    }
+
+    /// All values of a packed repeated varint field.
+    func packed(_ field: Int) throws -> [UInt64] {
+        var values: [UInt64] = []
+        for bytes in self.lengthDelimited[field] ?? [] {
+            var index = 0
+            while index < bytes.count {
+                var value: UInt64 = 0
+                var shift: UInt64 = 0
+                while true {
+                    let byte = bytes[index]
+                    index += 1
+                    value |= UInt64(byte & 0x7f) << shift
+                    shift += 7
+                    if byte & 0x80 == 0 {
+                        break
+                    }
+                    guard index < bytes.count else {
+                        throw Error(message: "truncated packed field \(field)")
+                    }
+                }
+                values.append(value)
+            }
+        }
+        return values
+    }
+
+    func strings(_ field: Int) -> [String] {
+        return (self.lengthDelimited[field] ?? []).map { String(decoding: $0, as: UTF8.self) }
+    }
+
+    func messages(_ field: Int) throws -> [ProtobufFields] {
+        return try (self.lengthDelimited[field] ?? []).map { try ProtobufFields($0) }
+    }
+}
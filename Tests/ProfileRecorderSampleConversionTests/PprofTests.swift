@@ -236,6 +236,84 @@ final class PprofTests: XCTestCase {
         XCTAssertEqual(emittedNames, Set(threadNames))
     }
 
+    func testProtobufWriterMatchesSwiftProtobuf() throws {
+        let sample = Perftools_Profiles_Sample.with {
+            $0.locationID = [1, 300, 0x1234_5678_9abc]
+            $0.value = [0, -1]
+            $0.label = [
+                .with {
+                    $0.key = 7
+                    $0.num = -5
+                },
+                .with {
+                    $0.key = 8
+                    $0.str = 0
+                },
+            ]
+        }
+
+        var labelScratch = ByteBuffer()
+        var written = ByteBuffer()
+        written.writeProtobufPackedUInt64(field: 1, [1, 300, 0x1234_5678_9abc])
+        written.writeProtobufPackedUInt64(field: 2, [0, UInt64(bitPattern: -1)])
+        written.writeProtobufMessage(field: 3, scratch: &labelScratch) { label in
+            label.writeProtobufInt64(field: 1, 7)
+            label.writeProtobufInt64(field: 3, -5)
+        }
+        written.writeProtobufMessage(field: 3, scratch: &labelScratch) { label in
+            label.writeProtobufInt64(field: 1, 8)
+            label.writeProtobufInt64(field: 2, 0)
+        }
+
+        let expected: [UInt8] = try sample.serializedBytes()
+        XCTAssertEqual(expected, Array(written.readableBytesView))
+        XCTAssertEqual(sample, try Perftools_Profiles_Sample(serializedBytes: Array(written.readableBytesView)))
+    }
+
+    func testPprofHasFileAndLineInformation() throws {
+        let symbolizer = CachedSymbolizer(
+            configuration: .default,
+            symbolizer: InliningSymbolizer(),
+            dynamicLibraryMappings: [
+                DynamicLibMapping(
+                    path: "/lib/libfoo.so",
+                    architecture: "arm64",
+                    segmentSlide: 0x1000,
+                    segmentStartAddress: 0x2000,
+                    segmentEndAddress: 0x3000
+                )
+            ],
+            group: .singletonMultiThreadedEventLoopGroup,
+            logger: self.logger
+        )
+        var renderer = PprofOutputRenderer()
+        let _ = try renderer.consumeSingleSample(
+            Sample(
+                sampleHeader: SampleHeader(pid: 1, tid: 2, name: "thread", timeSec: 4, timeNSec: 5),
+                stack: [StackFrame(instructionPointer: 0x2345, stackPointer: .max)]
+            ),
+            configuration: .default,
+            symbolizer: symbolizer
+        )
+        let output = try renderer.finalise(
+            sampleConfiguration: SampleConfig(
+                currentTimeSeconds: 0,
+                currentTimeNanoseconds: 0,
+                microSecondsBetweenSamples: 0,
+                sampleCount: 0
+            ),
+            configuration: .default,
+            symbolizer: symbolizer
+        )
+        let profile = try Perftools_Profiles_Profile(output)
+        XCTAssertEqual(1, profile.location.count)
+        let lines = profile.location.first?.line ?? []
+        XCTAssertEqual([3, 10, 0], lines.map { $0.line })
+        let functions = lines.map { line in profile.function.first { $0.id == line.functionID }! }
+        XCTAssertEqual(["inlined", "caller", "nofile"], functions.map { profile.stringTable[Int($0.name)] })
+        XCTAssertEqual(["a.swift", "b.swift", ""], functions.map { profile.stringTable[Int($0.filename)] })
+    }
+
     // MARK: - Setup/teardown
     override func setUpWithError() throws {
         self.logger = Logger(label: "\(Self.self)")
@@ -278,3 +356,39 @@ final class PprofTests: XCTestCase {
         #endif
     }
 }
+
+/// Returns an inlined frame and its caller with source locations, and an outer frame without.
+private final class InliningSymbolizer: Symbolizer {
+    var description: String {
+        return "InliningSymbolizer"
+    }
+
+    func start() throws {
+    }
+
+    func symbolise(
+        fileVirtualAddressIP: UInt,
+        library: DynamicLibMapping,
+        logger: Logger
+    ) throws -> SymbolisedStackFrame {
+        let frames: [(name: String, file: String?, line: Int?)] = [
+            ("inlined", "a.swift", 3), ("caller", "b.swift", 10), ("nofile", nil, nil),
+        ]
+        return SymbolisedStackFrame(
+            allFrames: frames.map {
+                SymbolisedStackFrame.SingleFrame(
+                    address: fileVirtualAddressIP,
+                    functionName: $0.name,
+                    functionOffset: 0,
+                    library: "libfoo",
+                    vmap: library,
+                    file: $0.file,
+                    line: $0.line
+                )
+            }
+        )
+    }
+
+    func shutdown() throws {
+    }
+}
@@ -0,0 +1,242 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import Logging
+import NIO
+import NIOConcurrencyHelpers
+import ProfileRecorderPprofFormat
+import XCTest
+
+@testable import _ProfileRecorderSampleConversion
+
+final class ProfileRecorderMergingConverterTests: XCTestCase {
+    private var logger: Logger! = nil
+    private var tempDirectory: String! = nil
+
+    func testInputsAreMergedIntoOneProfile() async throws {
+        let paths = try (0..<5).map { index in
+            try self.writeRawSamples(count: 4, slide: 0x1000 + index * 0x10_0000, name: "\(index)")
+        }
+        let symbolizer = CountingSymbolizer()
+        var converter = ProfileRecorderMergingConverter(config: .default, symbolizer: symbolizer)
+        converter.maximumConcurrency = 1
+
+        let output = try await self.convert(paths, converter: converter, format: .flamegraphCollapsedSymbolized)
+        // Same build everywhere, just loaded at different addresses. So it's all one stack (from all threads).
+        let lines = String(buffer: output).split(separator: "\n")
+        XCTAssertEqual(1, lines.count, "\(lines)")
+        XCTAssert(lines.first?.hasSuffix(" 20") ?? false, "\(lines)")
+        // Every stack has two frames, each symbolised once across all inputs.
+        XCTAssertEqual(2, symbolizer.symbolisedCount)
+    }
+
+    func testBatchesOnlyContainAddressesNotSymbolisedYet() async throws {
+        let paths = try (0..<3).map { index in
+            try self.writeRawSamples(count: 4, slide: 0x1000 + index * 0x10_0000, name: "\(index)")
+        }
+        let symbolizer = CountingSymbolizer()
+        var config = SymbolizerConfiguration.default
+        config.symbolisationBatchSize = 4096
+        var converter = ProfileRecorderMergingConverter(config: config, symbolizer: symbolizer)
+        converter.maximumConcurrency = 1
+
+        let output = try await self.convert(paths, converter: converter, format: .flamegraphCollapsedSymbolized)
+        let lines = String(buffer: output).split(separator: "\n")
+        XCTAssertEqual(1, lines.count, "\(lines)")
+        XCTAssert(lines.first?.hasSuffix(" 12") ?? false, "\(lines)")
+        // The first input's two addresses in one batch, the other inputs' addresses are all cached already.
+        XCTAssertEqual([2], symbolizer.batchSizes)
+        XCTAssertEqual(2, symbolizer.symbolisedCount)
+    }
+
+    func testFramesOfDifferentImagesAtTheSameAddressStayApart() async throws {
+        // Both libraries have a frame at file address 0x345, in both inputs.
+        let paths = try (0..<2).map { index in
+            let slide = 0x10_0000 * (index + 1)
+            func hex(_ address: Int) -> String {
+                return "0x\(String(address + slide, radix: 16))"
+            }
+            let raw = """
+                [SWIPR] VERS { "version": 1}
+                [SWIPR] VMAP { "path": "/lib/libfoo.so", "architecture": "arm64", "segmentSlide": "\(hex(0))", \
+                "segmentStartAddress": "\(hex(0))", "segmentEndAddress": "\(hex(0x1000))", "buildID": "f00d" }
+                [SWIPR] VMAP { "path": "/lib/libbar.so", "architecture": "arm64", "segmentSlide": "\(hex(0x1000))", \
+                "segmentStartAddress": "\(hex(0x1000))", "segmentEndAddress": "\(hex(0x2000))", "buildID": "ba12" }
+                [SWIPR] SMPL { "pid": 1, "tid": 1, "name": "thread", "timeSec": 4, "timeNSec": 0 }
+                [SWIPR] STCK { "ip": "0x0", "sp": "0x0" }
+                [SWIPR] STCK { "ip": "\(hex(0x346))", "sp": "0x0" }
+                [SWIPR] STCK { "ip": "\(hex(0x1346))", "sp": "0x0" }
+                [SWIPR] DONE
+
+                """
+            let path = self.tempDirectory + "/images-\(index).raw"
+            try raw.write(toFile: path, atomically: false, encoding: .utf8)
+            return path
+        }
+        let converter = ProfileRecorderMergingConverter(config: .default, symbolizer: FakeSymbolizer())
+
+        let pprof = try Perftools_Profiles_Profile(
+            try await self.convert(paths, converter: converter, format: .pprofSymbolized)
+        )
+        // One location per image, shared by both inputs.
+        XCTAssertEqual(2, pprof.location.count, "\(pprof.location)")
+        XCTAssertEqual(Set(pprof.location.map { $0.address }).count, 1, "\(pprof.location)")
+        XCTAssertEqual(1, pprof.sample.count)
+        XCTAssertEqual([2], pprof.sample.first?.value)
+        XCTAssertEqual(Set(pprof.location.map { $0.id }), Set(pprof.sample.first?.locationID ?? []))
+    }
+
+    func testSamplesCanBeLabelledWithTheirSource() async throws {
+        let paths = try (0..<3).map { try self.writeRawSamples(count: $0 + 1, slide: 0x1000, name: "\($0)") }
+        var converter = ProfileRecorderMergingConverter(config: .default, symbolizer: FakeSymbolizer())
+        converter.labelSamplesWithSource = true
+
+        let collapsed = try await self.convert(paths, converter: converter, format: .flamegraphCollapsedSymbolized)
+        XCTAssertEqual(
+            paths.enumerated().map { index, path in "\(path) \(index + 1)" },
+            String(buffer: collapsed).split(separator: "\n").map { line in
+                "\(line.prefix { $0 != ";" }) \(line.split(separator: " ").last!)"
+            }.sorted()
+        )
+
+        let pprof = try Perftools_Profiles_Profile(
+            try await self.convert(paths, converter: converter, format: .pprofSymbolized)
+        )
+        var samplesBySource: [String: Int64] = [:]
+        for sample in pprof.sample {
+            let source = sample.label.first { pprof.stringTable[Int($0.key)] == "source" }
+            samplesBySource[source.map { pprof.stringTable[Int($0.str)] } ?? "", default: 0] += sample.value[0]
+        }
+        XCTAssertEqual(
+            Dictionary(uniqueKeysWithValues: paths.enumerated().map { index, path in (path, Int64(index + 1)) }),
+            samplesBySource
+        )
+        // The locations are shared by all inputs.
+        XCTAssertEqual(2, pprof.location.count)
+    }
+
+    func testUnsupportedFormatsAreRejected() async throws {
+        let path = try self.writeRawSamples(count: 1, slide: 0x1000, name: "only")
+        let converter = ProfileRecorderMergingConverter(config: .default, symbolizer: FakeSymbolizer())
+        do {
+            _ = try await self.convert([path, path], converter: converter, format: .perfSymbolized)
+            XCTFail("no error thrown")
+        } catch is ProfileRecorderMergingConverter.Error {
+            // expected
+        }
+    }
+
+    // MARK: - Setup/teardown
+    override func setUpWithError() throws {
+        self.logger = Logger(label: "\(Self.self)")
+        self.logger.logLevel = .info
+        self.tempDirectory = NSTemporaryDirectory() + "/swipr-merging-tests-\(UUID())"
+        try FileManager.default.createDirectory(atPath: self.tempDirectory, withIntermediateDirectories: true)
+    }
+
+    override func tearDown() {
+        XCTAssertNoThrow(try FileManager.default.removeItem(atPath: self.tempDirectory))
+        self.tempDirectory = nil
+        self.logger = nil
+    }
+
+    // MARK: - Helpers
+    private func convert(
+        _ paths: [String],
+        converter: ProfileRecorderMergingConverter,
+        format: ProfileRecorderOutputFormat
+    ) async throws -> ByteBuffer {
+        let output = NIOLockedValueBox(ByteBuffer())
+        try await converter.convert(
+            inputRawProfileRecorderFormatPaths: paths,
+            format: format,
+            logger: self.logger
+        ) { chunk in
+            output.withLockedValue { $0.writeImmutableBuffer(chunk) }
+        }
+        return output.withLockedValue { $0 }
+    }
+
+    /// Writes `count` samples of the same stack in `libfoo.so` (always the same build), loaded at `slide`.
+    private func writeRawSamples(count: Int, slide: Int, name: String) throws -> String {
+        func hex(_ address: Int) -> String {
+            return "0x\(String(address + slide, radix: 16))"
+        }
+        var raw = """
+            [SWIPR] VERS { "version": 1}
+            [SWIPR] VMAP { "path": "/lib/libfoo.so", "architecture": "arm64", "segmentSlide": "\(hex(0))", \
+            "segmentStartAddress": "\(hex(0x1000))", "segmentEndAddress": "\(hex(0x2000))", "buildID": "f00d" }
+
+            """
+        for sample in 0..<count {
+            raw += """
+                [SWIPR] SMPL { "pid": 1, "tid": \(sample % 3), "name": "thread", "timeSec": 4, "timeNSec": \(sample) }
+                [SWIPR] STCK { "ip": "0x0", "sp": "0x0" }
+                [SWIPR] STCK { "ip": "\(hex(0x1345))", "sp": "0x0" }
+                [SWIPR] STCK { "ip": "\(hex(0x1400))", "sp": "0x0" }
+                [SWIPR] DONE
+
+                """
+        }
+        let path = self.tempDirectory + "/" + name + ".raw"
+        try raw.write(toFile: path, atomically: false, encoding: .utf8)
+        return path
+    }
+}
+
+/// Like ``FakeSymbolizer`` but counts how often it's asked to symbolise.
+private final class CountingSymbolizer: Symbolizer {
+    private let underlying = FakeSymbolizer()
+    private let count = NIOLockedValueBox(0)
+    private let batches = NIOLockedValueBox<[Int]>([])
+
+    var symbolisedCount: Int {
+        return self.count.withLockedValue { $0 }
+    }
+
+    /// The number of queries in every batch, in order.
+    var batchSizes: [Int] {
+        return self.batches.withLockedValue { $0 }
+    }
+
+    var description: String {
+        return "CountingSymbolizer"
+    }
+
+    func start() throws {
+    }
+
+    func symbolise(
+        fileVirtualAddressIP: UInt,
+        library: DynamicLibMapping,
+        logger: Logger
+    ) throws -> SymbolisedStackFrame {
+        self.count.withLockedValue { $0 += 1 }
+        return try self.underlying.symbolise(
+            fileVirtualAddressIP: fileVirtualAddressIP,
+            library: library,
+            logger: logger
+        )
+    }
+
+    func symbolise(_ queries: [SymbolisationQuery], logger: Logger) throws -> [SymbolisedStackFrame] {
+        self.batches.withLockedValue { $0.append(queries.count) }
+        return try queries.map { query in
+            try self.symbolise(fileVirtualAddressIP: query.fileVirtualAddressIP, library: query.library, logger: logger)
+        }
+    }
+
+    func shutdown() throws {
+    }
+}
@@ -0,0 +1,155 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import Logging
+import XCTest
+import NIO
+
+@testable import _ProfileRecorderSampleConversion
+
+final class ProfileRecorderSampleConverterTests: XCTestCase {
+    private var logger: Logger! = nil
+    private var tempDirectory: String! = nil
+
+    func testChunkedOutputMatchesFileOutput() throws {
+        let inputPath = try self.writeRawSamples(count: 100)
+        let outputPath = self.tempDirectory + "/samples.perf"
+
+        var converter = self.makeConverter(renderer: PerfScriptOutputRenderer())
+        try converter.convertSync(
+            inputRawProfileRecorderFormatPath: inputPath,
+            outputPath: outputPath,
+            format: .perfSymbolized,
+            logger: self.logger
+        )
+
+        var chunks: [ByteBuffer] = []
+        converter = self.makeConverter(renderer: PerfScriptOutputRenderer())
+        try converter.convertSync(
+            inputRawProfileRecorderFormatPath: inputPath,
+            format: .perfSymbolized,
+            logger: self.logger
+        ) { chunk in
+            chunks.append(chunk)
+        }
+
+        // Everything fits into one chunk.
+        XCTAssertEqual(1, chunks.count)
+        let fileOutput = try String(contentsOfFile: outputPath, encoding: .utf8)
+        XCTAssertEqual(fileOutput, chunks.map { String(buffer: $0) }.joined())
+        XCTAssertEqual(100, fileOutput.components(separatedBy: "swipr\n").count - 1)
+    }
+
+    func testGzipCompressedOutput() throws {
+        let inputPath = try self.writeRawSamples(count: 100)
+
+        var uncompressed = ByteBuffer()
+        var converter = self.makeConverter(renderer: PerfScriptOutputRenderer())
+        try converter.convertSync(
+            inputRawProfileRecorderFormatPath: inputPath,
+            format: .perfSymbolized,
+            logger: self.logger
+        ) { chunk in
+            uncompressed.writeImmutableBuffer(chunk)
+        }
+
+        var compressed = ByteBuffer()
+        converter = self.makeConverter(renderer: PerfScriptOutputRenderer())
+        converter.outputCompression = .gzip
+        try converter.convertSync(
+            inputRawProfileRecorderFormatPath: inputPath,
+            format: .perfSymbolized,
+            logger: self.logger
+        ) { chunk in
+            XCTAssertGreaterThan(chunk.readableBytes, 0)
+            compressed.writeImmutableBuffer(chunk)
+        }
+
+        XCTAssertLessThan(compressed.readableBytes, uncompressed.readableBytes / 4)
+        // gzip magic & deflate
+        XCTAssertEqual([0x1f, 0x8b, 0x08], compressed.getBytes(at: compressed.readerIndex, length: 3))
+        // The gzip trailer ends in the uncompressed length.
+        XCTAssertEqual(
+            UInt32(uncompressed.readableBytes),
+            compressed.getInteger(at: compressed.writerIndex - 4, endianness: .little, as: UInt32.self)
+        )
+    }
+
+    func testBufferedOutputWriterFlushesOnlyWhenFull() throws {
+        var writer = BufferedOutputWriter(flushThreshold: 10)
+        var chunks: [String] = []
+        let handler: (ByteBuffer) throws -> Void = { chunk in
+            chunks.append(String(buffer: chunk))
+        }
+
+        writer.buffer.writeString("12345")
+        try writer.flushIfFull(to: handler)
+        XCTAssertEqual([], chunks)
+        writer.buffer.writeString("67890A")
+        try writer.flushIfFull(to: handler)
+        XCTAssertEqual(["1234567890A"], chunks)
+        try writer.flush(to: handler)
+        XCTAssertEqual(["1234567890A"], chunks)
+        writer.buffer.writeString("B")
+        try writer.flush(to: handler)
+        XCTAssertEqual(["1234567890A", "B"], chunks)
+    }
+
+    // MARK: - Setup/teardown
+    override func setUpWithError() throws {
+        self.logger = Logger(label: "\(Self.self)")
+        self.logger.logLevel = .info
+        self.tempDirectory = NSTemporaryDirectory() + "/swipr-converter-tests-\(UUID())"
+        try FileManager.default.createDirectory(atPath: self.tempDirectory, withIntermediateDirectories: true)
+    }
+
+    override func tearDown() {
+        XCTAssertNoThrow(try FileManager.default.removeItem(atPath: self.tempDirectory))
+        self.tempDirectory = nil
+        self.logger = nil
+    }
+
+    // MARK: - Helpers
+    private func makeConverter(
+        renderer: any ProfileRecorderSampleConversionOutputRenderer
+    ) -> ProfileRecorderSampleConverter {
+        return ProfileRecorderSampleConverter(
+            config: .default,
+            renderer: renderer,
+            symbolizer: FakeSymbolizer()
+        )
+    }
+
+    private func writeRawSamples(count: Int) throws -> String {
+        var raw = """
+            [SWIPR] VERS { "version": 1}
+            [SWIPR] VMAP { "path": "/lib/libfoo.so", "architecture": "arm64", "segmentSlide": "0x1000", \
+            "segmentStartAddress": "0x2000", "segmentEndAddress": "0x3000" }
+
+            """
+        for sample in 0..<count {
+            raw += """
+                [SWIPR] SMPL { "pid": 1, "tid": \(sample % 3), "name": "thread", "timeSec": 4, "timeNSec": \(sample) }
+                [SWIPR] STCK { "ip": "0x0", "sp": "0x0" }
+                [SWIPR] STCK { "ip": "0x2345", "sp": "0x0" }
+                [SWIPR] STCK { "ip": "0x\(String(0x2400 + sample, radix: 16))", "sp": "0x0" }
+                [SWIPR] DONE
+
+                """
+        }
+        let path = self.tempDirectory + "/samples.raw"
+        try raw.write(toFile: path, atomically: false, encoding: .utf8)
+        return path
+    }
+}
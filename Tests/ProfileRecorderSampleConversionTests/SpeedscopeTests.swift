@@ -0,0 +1,165 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import Logging
+import XCTest
+import NIO
+
+@testable import _ProfileRecorderSampleConversion
+
+final class SpeedscopeTests: XCTestCase {
+    private var symbolizer: CachedSymbolizer! = nil
+    private var underlyingSymbolizer: (any Symbolizer)! = nil
+    private var logger: Logger! = nil
+
+    private struct SpeedscopeFile: Decodable {
+        struct Shared: Decodable {
+            var frames: [Frame]
+        }
+
+        struct Frame: Decodable, Equatable {
+            var name: String
+            var file: String?
+            var line: Int?
+        }
+
+        struct Profile: Decodable {
+            var type: String
+            var name: String
+            var unit: String
+            var startValue: Int
+            var endValue: Int
+            var samples: [[Int]]
+            var weights: [Int]
+        }
+
+        var shared: Shared
+        var profiles: [Profile]
+    }
+
+    func testFramesAreSharedAndStacksAggregatedPerThread() throws {
+        var renderer = SpeedscopeOutputRenderer()
+        for (tid, stack) in [
+            (2, [0x2345, 0x2999]),
+            (3, [0x2345, 0x2999]),
+            (2, [0x2345]),
+            (2, [0x2345, 0x2999]),
+            (2, [0x3000]),  // not in any mapping
+        ] as [(Int, [UInt])] {
+            let actual = try renderer.consumeSingleSample(
+                self.makeSample(tid: tid, stack: stack),
+                configuration: .default,
+                symbolizer: self.symbolizer
+            )
+            XCTAssertEqual(ByteBuffer(), actual)
+        }
+
+        let output = try renderer.finalise(
+            sampleConfiguration: SampleConfig(
+                currentTimeSeconds: 0,
+                currentTimeNanoseconds: 0,
+                microSecondsBetweenSamples: 10_000,
+                sampleCount: 5
+            ),
+            configuration: .default,
+            symbolizer: self.symbolizer
+        )
+        let file = try JSONDecoder().decode(SpeedscopeFile.self, from: Data(output.readableBytesView))
+
+        XCTAssertEqual(
+            [
+                SpeedscopeFile.Frame(name: "fake", file: "libfoo", line: nil),
+                SpeedscopeFile.Frame(name: "unknown @ 0x3000", file: "unknown-lib", line: nil),
+            ],
+            file.shared.frames
+        )
+        XCTAssertEqual(["thread-T2", "thread-T3"], file.profiles.map { $0.name })
+        XCTAssertEqual(["sampled", "sampled"], file.profiles.map { $0.type })
+        XCTAssertEqual(["nanoseconds", "nanoseconds"], file.profiles.map { $0.unit })
+
+        let thread2 = file.profiles[0]
+        XCTAssertEqual([[0], [0, 0], [1]], thread2.samples)
+        XCTAssertEqual([10_000_000, 20_000_000, 10_000_000], thread2.weights)
+        XCTAssertEqual(40_000_000, thread2.endValue)
+
+        let thread3 = file.profiles[1]
+        XCTAssertEqual([[0, 0]], thread3.samples)
+        XCTAssertEqual([10_000_000], thread3.weights)
+    }
+
+    func testNamesAreEscaped() throws {
+        var renderer = SpeedscopeOutputRenderer()
+        _ = try renderer.consumeSingleSample(
+            Sample(
+                sampleHeader: SampleHeader(pid: 1, tid: 1, name: "a \"quoted\"\\\tthread\u{1}", timeSec: 0, timeNSec: 0),
+                stack: [StackFrame(instructionPointer: 0x2345, stackPointer: .max)]
+            ),
+            configuration: .default,
+            symbolizer: self.symbolizer
+        )
+        let output = try renderer.finalise(
+            sampleConfiguration: SampleConfig(
+                currentTimeSeconds: 0,
+                currentTimeNanoseconds: 0,
+                microSecondsBetweenSamples: 0,
+                sampleCount: 1
+            ),
+            configuration: .default,
+            symbolizer: self.symbolizer
+        )
+        let file = try JSONDecoder().decode(SpeedscopeFile.self, from: Data(output.readableBytesView))
+        XCTAssertEqual(["a \"quoted\"\\\tthread\u{1}-T1"], file.profiles.map { $0.name })
+        XCTAssertEqual(["none"], file.profiles.map { $0.unit })
+        XCTAssertEqual([[1]], file.profiles.map { $0.weights })
+    }
+
+    // MARK: - Setup/teardown
+    override func setUpWithError() throws {
+        self.logger = Logger(label: "\(Self.self)")
+        self.logger.logLevel = .info
+
+        self.underlyingSymbolizer = FakeSymbolizer()
+        try self.underlyingSymbolizer!.start()
+        self.symbolizer = CachedSymbolizer(
+            configuration: .default,
+            symbolizer: self.underlyingSymbolizer!,
+            dynamicLibraryMappings: [
+                DynamicLibMapping(
+                    path: "/lib/libfoo.so",
+                    architecture: "arm64",
+                    segmentSlide: 0x1000,
+                    segmentStartAddress: 0x2000,
+                    segmentEndAddress: 0x3000
+                )
+            ],
+            group: .singletonMultiThreadedEventLoopGroup,
+            logger: self.logger
+        )
+    }
+
+    override func tearDown() {
+        XCTAssertNoThrow(try self.underlyingSymbolizer!.shutdown())
+        self.underlyingSymbolizer = nil
+        self.symbolizer = nil
+        self.logger = nil
+    }
+
+    // MARK: - Helpers
+    private func makeSample(tid: Int, stack: [UInt]) -> Sample {
+        return Sample(
+            sampleHeader: SampleHeader(pid: 1, tid: tid, name: "thread", timeSec: 4, timeNSec: 5),
+            stack: stack.map { StackFrame(instructionPointer: $0, stackPointer: .max) }
+        )
+    }
+}
@@ -0,0 +1,115 @@
+//===----------------------------------------------------------------------===//
+//
+// This source file is part of the Swift Profile Recorder open source project
+//
+// Copyright (c) 2024 Apple Inc. and the Swift Profile Recorder project authors
+// Licensed under Apache License v2.0
+//
+// See LICENSE.txt for license information
+// See CONTRIBUTORS.txt for the list of Swift Profile Recorder project authors
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+//===----------------------------------------------------------------------===//
+
+import XCTest
+@testable import _ProfileRecorderSampleConversion
+
+final class SymbolIndexTests: XCTestCase {
+    private func makeIndexBytes() throws -> [UInt8] {
+        var builder = SymbolIndex.Builder()
+        builder.addSymbol(address: 0x1000, name: "first")
+        builder.addSymbol(address: 0x2000, name: "small")
+        builder.addSymbol(address: 0x2000, name: "big")
+        builder.addSymbol(address: 0x3000, name: "last")
+        builder.addCallSite(
+            SymbolIndex.CallSite(
+                depth: 1,
+                name: "outer",
+                lowPC: 0x1010,
+                highPC: 0x1040,
+                filename: "/src/a.swift",
+                line: 12,
+                column: 3
+            )
+        )
+        builder.addCallSite(
+            SymbolIndex.CallSite(
+                depth: 2,
+                name: nil,
+                lowPC: 0x1020,
+                highPC: 0x1030,
+                filename: "/src/b.swift",
+                line: 7,
+                column: 0
+            )
+        )
+        return try builder.serialise()
+    }
+
+    func testSymbolLookups() throws {
+        let bytes = try self.makeIndexBytes()
+        try bytes.withUnsafeBytes { buffer in
+            let index = try SymbolIndex(source: ImageSource(unowned: buffer, isMappedImage: false))
+            XCTAssertEqual(4, index.symbolCount)
+            XCTAssertEqual(2, index.callSiteCount)
+
+            XCTAssertNil(index.lookupSymbol(address: 0xfff))
+            XCTAssertEqual("first", index.lookupSymbol(address: 0x1000)?.name)
+            XCTAssertEqual("first", index.lookupSymbol(address: 0x1fff)?.name)
+            XCTAssertEqual(0x1000, index.lookupSymbol(address: 0x1fff)?.value)
+            // Exactly at the start of two symbols: the first one wins, inside of them the last one.
+            XCTAssertEqual("small", index.lookupSymbol(address: 0x2000)?.name)
+            XCTAssertEqual("big", index.lookupSymbol(address: 0x2001)?.name)
+            XCTAssertEqual("last", index.lookupSymbol(address: 0xffff_ffff)?.name)
+        }
+    }
+
+    func testInlineCallSiteLookups() throws {
+        let bytes = try self.makeIndexBytes()
+        try bytes.withUnsafeBytes { buffer in
+            let index = try SymbolIndex(source: ImageSource(unowned: buffer, isMappedImage: false))
+
+            XCTAssertEqual([], index.inlineCallSites(at: 0x1000).map { $0.name })
+            XCTAssertEqual(["outer"], index.inlineCallSites(at: 0x1010).map { $0.name })
+            let both = index.inlineCallSites(at: 0x1025)
+            XCTAssertEqual(["outer", nil], both.map { $0.name })
+            XCTAssertEqual(["/src/a.swift", "/src/b.swift"], both.map { $0.filename })
+            XCTAssertEqual([12, 7], both.map { $0.line })
+            XCTAssertEqual([1, 2], both.map { $0.depth })
+            XCTAssertEqual([], index.inlineCallSites(at: 0x1040).map { $0.name })
+        }
+    }
+
+    func testRejectsCorruptIndexes() throws {
+        var bytes = try self.makeIndexBytes()
+        try bytes.withUnsafeBytes { buffer in
+            XCTAssertThrowsError(
+                try SymbolIndex(
+                    source: ImageSource(
+                        unowned: UnsafeRawBufferPointer(rebasing: buffer[..<(buffer.count - 1)]),
+                        isMappedImage: false
+                    )
+                )
+            )
+        }
+        bytes[8] = 0xff  // version
+        try bytes.withUnsafeBytes { buffer in
+            XCTAssertThrowsError(try SymbolIndex(source: ImageSource(unowned: buffer, isMappedImage: false)))
+        }
+    }
+
+    func testSaveAndMap() throws {
+        let directory = NSTemporaryDirectory() + "/swipr-symbol-index-\(UUID())"
+        defer {
+            try? FileManager.default.removeItem(atPath: directory)
+        }
+        let path = SymbolIndex.cachePath(cacheDirectory: directory, buildID: [0x0a, 0xbc, 0x01])
+        XCTAssert(path.hasSuffix("/0abc01.swipridx"), path)
+
+        try SymbolIndex.save(try self.makeIndexBytes(), to: path)
+        let index = try SymbolIndex(path: path)
+        XCTAssertEqual("last", index.lookupSymbol(address: 0x3000)?.name)
+        XCTAssertEqual(["outer", nil], index.inlineCallSites(at: 0x1025).map { $0.name })
+    }
+}
@@ -161,6 +161,36 @@ struct ProfileRecorderConfigurationTests {
         #expect(cfg.bindTarget == nil)
     }
 
+    @Test("Env: pre-warming CPU budget")
+    func envPrewarmCPUBudget() throws {
+        let cfg = try ProfileRecorderServerConfiguration._parseFromEnvironment([
+            "PROFILE_RECORDER_SERVER_URL": "unix:///tmp/direct.sock",
+            "PROFILE_RECORDER_SERVER_PREWARM_CPU_BUDGET": "5",
+        ])
+        #expect(unixPath(cfg.bindTarget) == "/tmp/direct.sock")
+        #expect(cfg.symbolizerPrewarmingCPUBudget == .seconds(5))
+
+        let cfgDefault = try ProfileRecorderServerConfiguration._parseFromEnvironment([:])
+        #expect(cfgDefault.symbolizerPrewarmingCPUBudget == nil)
+    }
+
+    @Test("Env: symbolizer memory budget")
+    func envSymbolizerMemoryBudget() throws {
+        let cfg = try ProfileRecorderServerConfiguration._parseFromEnvironment([
+            "PROFILE_RECORDER_SERVER_SYMBOLIZER_MEMORY_BUDGET": "268435456"
+        ])
+        #expect(cfg.symbolizerMemoryBudget == 256 * 1024 * 1024)
+
+        let cfgDefault = try ProfileRecorderServerConfiguration._parseFromEnvironment([:])
+        #expect(cfgDefault.symbolizerMemoryBudget == nil)
+
+        #expect(throws: Error.self) {
+            _ = try ProfileRecorderServerConfiguration._parseFromEnvironment([
+                "PROFILE_RECORDER_SERVER_SYMBOLIZER_MEMORY_BUDGET": "lots"
+            ])
+        }
+    }
+
     // MARK: ConfigReader
 
     #if compiler(>=6.2)
@@ -59,6 +59,78 @@ final class ProfileRecorderServerTests: XCTestCase {
         }
     }
 
+    func testSampleRouteCompressesIfAccepted() async throws {
+        let server = ProfileRecorderServer(
+            configuration: try ProfileRecorderServerConfiguration.makeTCPListener(host: "127.0.0.1", port: 0)
+        )
+        try await server.withProfileRecordingServer(logger: Logger(label: "")) { server in
+            guard case .successful(let serverAddress) = server.startResult else {
+                XCTFail("failed to start server")
+                return
+            }
+
+            for (acceptEncoding, expectCompression) in [("gzip, deflate", true), ("gzip;q=0", false), ("br", false)] {
+                var request = try HTTPClient.Request(
+                    url: "http://127.0.0.1:\(serverAddress.port!)/sample",
+                    method: .POST,
+                    body: .string(#"{"numberOfSamples":1,"timeInterval":"10 ms"}"#)
+                )
+                request.headers.add(name: "accept-encoding", value: acceptEncoding)
+                let response = try await HTTPClient.shared.execute(request: request).get()
+                XCTAssertEqual(.ok, response.status)
+                if expectCompression {
+                    XCTAssertEqual(["gzip"], response.headers["content-encoding"])
+                    XCTAssertEqual([0x1f, 0x8b], response.body?.getBytes(at: 0, length: 2))
+                } else {
+                    XCTAssertEqual([], response.headers["content-encoding"])
+                    let body = response.body.map { String(buffer: $0) }
+                    XCTAssert(body?.contains("NIO") ?? false, "\(body.debugDescription)")
+                }
+            }
+        }
+    }
+
+    func testFlamegraphSVGRouteWorks() async throws {
+        let server = ProfileRecorderServer(
+            configuration: try ProfileRecorderServerConfiguration.makeTCPListener(host: "127.0.0.1", port: 0)
+        )
+        try await server.withProfileRecordingServer(logger: Logger(label: "")) { server in
+            guard case .successful(let serverAddress) = server.startResult else {
+                XCTFail("failed to start server")
+                return
+            }
+
+            let response = try await HTTPClient.shared.get(
+                url: "http://127.0.0.1:\(serverAddress.port!)/debug/flamegraph.svg?seconds=1&rate=10"
+            ).get()
+            XCTAssertEqual(.ok, response.status)
+            XCTAssertEqual(["image/svg+xml"], response.headers["content-type"])
+            let body = response.body.map { String(buffer: $0) }
+            XCTAssert(body?.contains("<svg") ?? false, "\(body.debugDescription)")
+            XCTAssert(body?.hasSuffix("</svg>\n") ?? false, "\(body.debugDescription)")
+        }
+    }
+
+    func testSampleRouteWorksWithPrewarming() async throws {
+        var configuration = try ProfileRecorderServerConfiguration.makeTCPListener(host: "127.0.0.1", port: 0)
+        configuration.symbolizerPrewarmingCPUBudget = .seconds(1)
+        let server = ProfileRecorderServer(configuration: configuration)
+        try await server.withProfileRecordingServer(logger: Logger(label: "")) { server in
+            guard case .successful(let serverAddress) = server.startResult else {
+                XCTFail("failed to start server")
+                return
+            }
+
+            let response1 = try await HTTPClient.shared.post(
+                url: "http://127.0.0.1:\(serverAddress.port!)/sample",
+                body: .string(#"{"numberOfSamples":1,"timeInterval":"10 ms"}"#)
+            ).get()
+            XCTAssertEqual(.ok, response1.status)
+            let body = response1.body.map { String(buffer: $0) }
+            XCTAssert(body?.contains("NIO") ?? false, "\(body.debugDescription)")
+        }
+    }
+
     func testHealthEndpoint() async throws {
         let server = ProfileRecorderServer(
             configuration: try ProfileRecorderServerConfiguration.makeTCPListener(host: "127.0.0.1", port: 0)